@@ -62,9 +62,10 @@ class Blob {
  public:
   Blob()
 #ifdef DISTR_WEIGHT_UPDATE
-       : data_(), diff_(), count_(0), capacity_(0), owned_count_(0), owned_offset_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), storage_(FLOAT32),
+         owned_count_(0), owned_offset_(0) {}
 #else
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), storage_(FLOAT32) {}
 #endif
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
@@ -115,6 +116,20 @@ class Blob {
   inline int num_axes() const { return shape_.size(); }
   inline int count() const { return count_; }
 
+  /**
+   * @brief Returns the type the data is held in; the diff is always Dtype.
+   *
+   * A blob in one of the 16-bit storage types only exposes its data through
+   * cpu_data16() and mutable_cpu_data16(), and is converted to Dtype by the
+   * layers that accept it (see Layer::AllowReducedStorage).
+   */
+  inline StorageType storage() const { return storage_; }
+  /**
+   * @brief Changes the type the data is held in. The current data is
+   *        discarded if the type changes. INT8 is only a BlobProto type.
+   */
+  void set_storage(StorageType storage);
+
 #ifdef DISTR_WEIGHT_UPDATE
 
   inline void set_owned_count(int owned_count) {
@@ -277,8 +292,15 @@ class Blob {
     return diff_;
   }
 
+  /// @brief The SyncedMemory::version of the data; 0 if there is none.
+  inline uint64_t data_version() const {
+    return data_ ? data_->version() : 0;
+  }
+
   const Dtype* cpu_data() const;
   void set_cpu_data(Dtype* data);
+  /// @brief Points the data at memory kept valid by owner, see SyncedMemory.
+  void set_cpu_data(Dtype* data, const shared_ptr<void>& owner);
   void set_cpu_diff(Dtype* diff);
 
 #ifndef CPU_ONLY
@@ -291,6 +313,8 @@ class Blob {
   Dtype* mutable_gpu_data();
   Dtype* mutable_cpu_diff();
   Dtype* mutable_gpu_diff();
+  const uint16_t* cpu_data16() const;
+  uint16_t* mutable_cpu_data16();
 
   size_t prv_data_count() const {
       CHECK(data_); return data_->prv_descriptor_->prv_count();}
@@ -358,6 +382,7 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  StorageType storage_;
 
 #ifdef DISTR_WEIGHT_UPDATE
   /* for distributed weight update */
@@ -368,6 +393,17 @@ class Blob {
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
 
+/**
+ * @brief Moves the data of a BlobProto written by Blob::ToProto to
+ *        packed_data in the given 16-bit storage type, or INT8. Blob::FromProto
+ *        reads it back into any Dtype; diffs are left untouched.
+ *
+ * INT8 rounds every slice along the first axis (e.g. the filters of one
+ * output channel) to signed bytes scaled by its largest magnitude. Blobs with
+ * fewer than two axes, such as biases, are left unpacked.
+ */
+void PackBlobProto(StorageType storage, BlobProto* proto);
+
 }  // namespace caffe
 
 #endif  // CAFFE_BLOB_HPP_
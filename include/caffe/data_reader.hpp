@@ -38,6 +38,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef CAFFE_DATA_READER_HPP_
 #define CAFFE_DATA_READER_HPP_
 
+#include <algorithm>
 #include <map>
 #include <string>
 #include <utility>
@@ -56,17 +57,67 @@ namespace caffe {
  * are running in parallel, e.g. for multi-GPU training. This makes sure
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
- * way to keep parallel training deterministic.
+ * way to keep parallel training deterministic. With
+ * DataParameter.reader_threads > 1 that thread merges the records of several
+ * sharded readers instead of reading the source itself.
  */
 class DataReader {
  public:
+  /**
+   * @brief A serialized DB value handed to a data layer. By default the
+   * record owns a copy of the value. With DataParameter.zero_copy it only
+   * points into the read-only LMDB or packed DB mapping, which stays valid
+   * for as long as the reader is alive, so no bytes are copied per sample.
+   */
+  class Record {
+   public:
+    Record() : view_(NULL), view_size_(0), is_view_(false) {}
+
+    inline const char* data() const {
+      return is_view_ ? view_ : buffer_.data();
+    }
+    inline size_t size() const {
+      return is_view_ ? view_size_ : buffer_.size();
+    }
+    inline bool ParseTo(::google::protobuf::MessageLite* proto) const {
+      return proto->ParseFromArray(data(), static_cast<int>(size()));
+    }
+
+    // Copies value into the buffer owned by this record.
+    void set_value(const string& value) {
+      buffer_ = value;
+      is_view_ = false;
+    }
+    // Points this record at memory owned by the DB, without copying it.
+    void set_view(const void* data, size_t size) {
+      view_ = static_cast<const char*>(data);
+      view_size_ = size;
+      is_view_ = true;
+    }
+    // Exchanges contents with other in constant time.
+    void swap(Record* other) {
+      buffer_.swap(other->buffer_);
+      std::swap(view_, other->view_);
+      std::swap(view_size_, other->view_size_);
+      std::swap(is_view_, other->is_view_);
+    }
+
+   private:
+    string buffer_;
+    const char* view_;
+    size_t view_size_;
+    bool is_view_;
+
+  DISABLE_COPY_AND_ASSIGN(Record);
+  };
+
   explicit DataReader(const LayerParameter& param);
   ~DataReader();
 
-  inline BlockingQueue<std::string*>& free() const {
+  inline BlockingQueue<Record*>& free() const {
     return queue_pair_->free_;
   }
-  inline BlockingQueue<std::string*>& full() const {
+  inline BlockingQueue<Record*>& full() const {
     return queue_pair_->full_;
   }
 
@@ -77,33 +128,56 @@ class DataReader {
     explicit QueuePair(int size);
     ~QueuePair();
 
-    BlockingQueue<std::string*> free_;
-    BlockingQueue<std::string*> full_;
+    BlockingQueue<Record*> free_;
+    BlockingQueue<Record*> full_;
 
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
 
+  // A contiguous range of size records starting at key begin. An empty
+  // range stands for the whole DB.
+  struct KeyRange {
+    KeyRange() : size(0) {}
+    string begin;
+    size_t size;
+  };
+
   class DBWrapper  {
    public:
-    explicit DBWrapper(const LayerParameter& param);
+    // Opens the source unless an already opened db is given, and positions a
+    // new cursor at the start of range.
+    DBWrapper(const LayerParameter& param, shared_ptr<db::DB> db,
+              const KeyRange& range);
+    virtual ~DBWrapper() {}
+    // Fills record with the current value, as a copy or a zero-copy view.
+    virtual void Read(Record* record);
     virtual string value() = 0;
+    virtual std::pair<void*, size_t> valuePointer() = 0;
     virtual void Next() = 0;
    protected:
+    // For wrappers that do not read through a cursor of their own.
+    explicit DBWrapper(const LayerParameter& param);
+
     shared_ptr<db::DB> db;
     shared_ptr<db::Cursor> cursor;
+    const KeyRange range_;
+    const bool zero_copy_;
   };
 
   class DBShuffle: public DBWrapper {
    public:
-    explicit DBShuffle(const LayerParameter& param);
+    explicit DBShuffle(const LayerParameter& param,
+                       shared_ptr<db::DB> db = shared_ptr<db::DB>(),
+                       const KeyRange& range = KeyRange());
     virtual string value() {
       return string(static_cast<const char*>(current_image_->first),
                                                       current_image_->second);
     }
+    virtual std::pair<void*, size_t> valuePointer() { return *current_image_; }
     virtual void Next();
    protected:
-    vector<std::pair<void*, int> > image_pointers_;
-    vector<std::pair<void*, int> >::iterator current_image_;
+    vector<std::pair<void*, size_t> > image_pointers_;
+    vector<std::pair<void*, size_t> >::iterator current_image_;
     shared_ptr<Caffe::RNG> prefetch_rng_;
 
     void ShuffleImages();
@@ -111,9 +185,126 @@ class DataReader {
 
   class DBSequential: public DBWrapper {
    public:
-    explicit DBSequential(const LayerParameter& param): DBWrapper(param)  {}
+    explicit DBSequential(const LayerParameter& param,
+                          shared_ptr<db::DB> db = shared_ptr<db::DB>(),
+                          const KeyRange& range = KeyRange())
+      : DBWrapper(param, db, range), position_(0) {}
     virtual string value()  { return cursor->value(); }
+    virtual std::pair<void*, size_t> valuePointer() {
+      return cursor->valuePointer();
+    }
     virtual void Next();
+   protected:
+    size_t position_;
+  };
+
+  // Shuffles with memory bounded by the shuffle buffer and no startup pass,
+  // see DataParameter.shuffle_block_size.
+  class DBBlockShuffle: public DBWrapper {
+   public:
+    explicit DBBlockShuffle(const LayerParameter& param,
+                            shared_ptr<db::DB> db = shared_ptr<db::DB>(),
+                            const KeyRange& range = KeyRange());
+    virtual string value() {
+      return string(static_cast<const char*>(buffer_[current_].first),
+                    buffer_[current_].second);
+    }
+    virtual std::pair<void*, size_t> valuePointer() {
+      return buffer_[current_];
+    }
+    virtual void Next();
+   protected:
+    // Takes the record under the cursor and moves on in block order.
+    // Returns true if it was the last record of the epoch.
+    bool ReadNext(std::pair<void*, size_t>* value);
+    void StartEpoch();
+    int Rand(int n);
+
+    const size_t block_size_;
+    // First key of every block, complete after the first epoch.
+    vector<string> block_keys_;
+    vector<int> block_order_;
+    bool indexed_;
+    size_t num_records_;
+    size_t block_index_;
+    size_t position_;
+    vector<std::pair<void*, size_t> > buffer_;
+    int current_;
+    shared_ptr<Caffe::RNG> prefetch_rng_;
+  };
+
+  // Reads the blocks dealt to one of num_slots readers across all ranks,
+  // see DataParameter.partition. Each epoch deals the blocks anew.
+  class DBPartitioned: public DBWrapper {
+   public:
+    DBPartitioned(const LayerParameter& param, shared_ptr<db::DB> db,
+                  const vector<KeyRange>& blocks, int slot, int num_slots);
+    virtual string value() {
+      return shuffle_ ? string(static_cast<const char*>(
+          pointers_[position_].first), pointers_[position_].second) :
+          cursor->value();
+    }
+    virtual std::pair<void*, size_t> valuePointer() {
+      return shuffle_ ? pointers_[position_] : cursor->valuePointer();
+    }
+    virtual void Next();
+   protected:
+    void StartEpoch();
+    void StartBlock();
+
+    const vector<KeyRange> blocks_;
+    const int slot_;
+    const int num_slots_;
+    const bool shuffle_;
+    const unsigned int seed_;
+    int epoch_;
+    vector<int> slot_blocks_;
+    size_t block_index_;
+    size_t position_;
+    // With shuffle, the records of the current block in random order.
+    vector<std::pair<void*, size_t> > pointers_;
+    shared_ptr<Caffe::RNG> prefetch_rng_;
+  };
+
+  // Reads one key range of the source on its own thread into a private
+  // queue pair, from which DBSharded takes the records.
+  class ShardReader : public InternalThread {
+   public:
+    ShardReader(shared_ptr<DBWrapper> dbw, int queue_size);
+    virtual ~ShardReader();
+
+    QueuePair queue_pair_;
+
+   protected:
+    void InternalThreadEntry();
+
+    shared_ptr<DBWrapper> dbw_;
+
+  DISABLE_COPY_AND_ASSIGN(ShardReader);
+  };
+
+  // Reads each of the given parts of the source with a ShardReader, and
+  // merges their records either in a fixed round-robin order or in order of
+  // arrival.
+  class DBSharded: public DBWrapper {
+   public:
+    DBSharded(const LayerParameter& param,
+              const vector<shared_ptr<DBWrapper> >& parts);
+    virtual ~DBSharded();
+    virtual void Read(Record* record) { record->swap(current_); }
+    virtual string value() {
+      return string(current_->data(), current_->size());
+    }
+    virtual std::pair<void*, size_t> valuePointer() {
+      return std::make_pair(const_cast<char*>(current_->data()),
+                            current_->size());
+    }
+    virtual void Next();
+   protected:
+    vector<shared_ptr<ShardReader> > shards_;
+    const bool round_robin_;
+    int current_shard_;
+    Record* current_;
   };
 
   // A single body is created per source
@@ -135,6 +326,26 @@ class DataReader {
   DISABLE_COPY_AND_ASSIGN(Body);
   };
 
+  // Creates the reader for range of the source selected by data_param.
+  static DBWrapper* NewDBWrapper(const LayerParameter& param,
+                                 shared_ptr<db::DB> db, const KeyRange& range);
+  // Opens the source and creates one reader per reader thread, for the part
+  // of the source assigned to rank out of num_ranks, by default the rank of
+  // this process.
+  static vector<shared_ptr<DBWrapper> > NewPartReaders(
+      const LayerParameter& param);
+  static vector<shared_ptr<DBWrapper> > NewPartReaders(
+      const LayerParameter& param, int rank, int num_ranks);
+  // The partition mode of data_param, after build-specific defaults.
+  static DataParameter_Partition PartitionOf(const DataParameter& data_param);
+
+  // Splits the records of db into blocks_per_slot contiguous ranges of
+  // nearly equal size for each of num_slots readers, seeking by index where
+  // the backend can and otherwise in a single pass and bounded memory. Small
+  // sources get fewer blocks per reader.
+  static vector<KeyRange> SplitKeyRanges(db::DB* db, int num_slots,
+                                         int blocks_per_slot);
+
   // A source is uniquely identified by its layer name + path, in case
   // the same database is read from two different locations in the net.
   static inline string source_key(const LayerParameter& param) {
@@ -38,6 +38,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef CAFFE_DATA_TRANSFORMER_HPP
 #define CAFFE_DATA_TRANSFORMER_HPP
 
+#include <boost/thread/mutex.hpp>
 #include <queue>
 #include <vector>
 
@@ -80,12 +81,15 @@ class GenRandNumbers: public RandNumbers {
   }
   void Reset() { rng_.reset(); }
   virtual uint32_t GetNextNumber() {
+    // Several prefetch workers may draw from the same transformer.
+    boost::mutex::scoped_lock lock(mutex_);
     CHECK(rng_);
     caffe::rng_t* rng = static_cast<caffe::rng_t*>(rng_->generator());
     return (*rng)();
   }
  private:
   shared_ptr<Caffe::RNG> rng_;
+  boost::mutex mutex_;
 };
 
 
@@ -145,6 +149,18 @@ class DataTransformer {
                  Blob<Dtype>* transformed_blob,
                  RandNumbers& rand_num);
 
+  /**
+   * @brief Same as above for raw uint8 pixels that the datum does not own,
+   * e.g. a view into a memory-mapped DB record from ParseDatumView. Only
+   * the shape of datum is used.
+   */
+  void Transform(const Datum& datum, const char* data,
+                 Blob<Dtype>* transformed_blob) {
+    Transform(datum, data, transformed_blob, rand_num_);
+  }
+  void Transform(const Datum& datum, const char* data,
+                 Blob<Dtype>* transformed_blob, RandNumbers& rand_num);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a vector of Datum.
@@ -338,6 +354,11 @@ class DataTransformer {
                  NormalizedBBox* crop_bbox, RandNumbers& rand_num);
   void Transform(const Datum& datum, Dtype* transformed_data,
                 RandNumbers& rand_num);
+  void Transform(const Datum& datum, const char* data,
+                 Dtype* transformed_data, NormalizedBBox* crop_bbox,
+                 RandNumbers& rand_num);
+  void CheckTransformedShape(const Datum& datum,
+                             const Blob<Dtype>* transformed_blob);
 
   /**
    * @brief Applies the transformation defined in the data layer's
@@ -366,8 +387,9 @@ class DataTransformer {
 
   template<bool has_uint8,  bool do_mirror, bool has_mean_file,
           bool has_mean_values>
-  void Transform(const Datum& datum, Dtype* transformed_data,
-                 NormalizedBBox* crop_bbox, RandNumbers& rand_num);
+  void Transform(const Datum& datum, const char* data,
+                 Dtype* transformed_data, NormalizedBBox* crop_bbox,
+                 RandNumbers& rand_num);
 };
 
 }  // namespace caffe
@@ -49,7 +49,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace caffe {
 static const char* supportedEngines[] =
-    {"CAFFE", "CUDNN", "MKL2017", "MKLDNN"};
+    {"CAFFE", "CUDNN", "MKL2017", "MKLDNN", "DIRECT"};
 class EngineParser {
  public:
   explicit EngineParser(const std::string subEngineString) {
@@ -580,6 +580,33 @@ public:
     return true;
   }
 
+  /**
+   * @brief Return whether the layer accepts bottom and top blobs that hold
+   *        their data in a 16-bit storage type (see Blob::storage).
+   *
+   * Such layers convert the data to Dtype as they compute on the CPU. Net
+   * only applies NetParameter.activation_storage to blobs whose producer and
+   * consumers all return true.
+   */
+  virtual inline bool AllowReducedStorage() const { return false; }
+
+  /**
+   * @brief Return whether Backward always overwrites the diff of the bottom
+   *        blobs it propagates to, rather than adding to it.
+   *
+   * With NetParameter.share_diffs, a Split may then let this layer write its
+   * gradient straight into the Split's bottom diff.
+   */
+  virtual inline bool OverwritesBottomDiff() const { return false; }
+
+  /**
+   * @brief Return whether the layer runs the int8 inference path of
+   *        QuantizationParameter when its LayerParameter has one.
+   *
+   * Net::CalibrateQuantization only calibrates the inputs of such layers.
+   */
+  virtual inline bool AllowQuantization() const { return false; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
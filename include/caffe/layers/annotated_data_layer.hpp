@@ -73,6 +73,11 @@ class AnnotatedDataLayer : public BasePrefetchingDataLayer<Dtype> {
   AnnotatedDatum_AnnotationType anno_type_;
   vector<BatchSampler> batch_samplers_;
   string label_map_file_;
+  // Scratch datums of load_batch, reused from item to item.
+  AnnotatedDatum anno_datum_;
+  AnnotatedDatum distort_datum_;
+  AnnotatedDatum expand_datum_;
+  AnnotatedDatum sampled_datum_;
 };
 
 }  // namespace caffe
@@ -44,6 +44,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -55,7 +56,8 @@ template <typename Dtype>
 class BaseConvolutionLayer : public Layer<Dtype> {
  public:
   explicit BaseConvolutionLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), batch_images_(0), col_buffer_mt_(NULL),
+        batch_output_(NULL), int8_col_mt_(NULL), int32_output_mt_(NULL) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -80,6 +82,35 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   void clear_weight_mt(void);
   void sum_weight_mt(Dtype* weight_diff);
+  // Points the column buffers of the OpenMP threads into the SharedWorkspace
+  // of the calling thread; call before the CPU gemm helpers, outside of any
+  // parallel region.
+  void acquire_col_buffer_mt(void);
+  // Whether Forward_cpu goes through the column buffers. If not, Reshape
+  // only reserves them in the TRAIN phase; Backward_cpu still gets them.
+  virtual inline bool forward_uses_col_buffer() const { return true; }
+  // Whether the CPU passes of the layer can use the batched gemm helpers
+  // below; Reshape then sets batch_images_ per gemm_batching.
+  virtual inline bool supports_batched_gemm() const { return false; }
+
+  // Batched variants of the gemm helpers, for images consecutive images
+  // (at most batch_images_) at input and output. The columns of all images
+  // go side by side into one wide matrix, so that each group takes one
+  // large GEMM. Call from outside of any parallel region, after
+  // acquire_col_buffer_mt(): im2col and the copies run on the OpenMP
+  // threads, the GEMMs on those of the BLAS. backward_cpu_gemm_batched can
+  // skip gathering the output if weight_cpu_gemm_batched just did.
+  void forward_cpu_gemm_batched(const Dtype* input, const Dtype* weights,
+      Dtype* output, int images);
+  void backward_cpu_gemm_batched(const Dtype* output, const Dtype* weights,
+      Dtype* input, int images, bool skip_gather = false);
+  void weight_cpu_gemm_batched(const Dtype* input, const Dtype* output,
+      Dtype* weights, int images);
+
+  // Int8 variant of forward_cpu_gemm, used when int8_weights_ is set. Call
+  // quantize_weights_int8 first, outside of any parallel region.
+  void quantize_weights_int8(const Dtype* weights);
+  void forward_cpu_int8_gemm(const Dtype* input, Dtype* output);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -136,30 +167,53 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int num_of_threads_;              // Number of threads to be used for
                                     // batch based parallelization eg.
                                     // min(batch,omp_get_num_threads())
+  int batch_images_;                // Images per batched GEMM, 0 for one
+                                    // GEMM per image and thread
+
+  // Set in the TEST phase when the layer has a quantization_param and
+  // AllowQuantization(); the weights are quantized on first use.
+  shared_ptr<QuantizedWeights> int8_weights_;
+
  private:
+  // Bytes of SharedWorkspace taken, after the column buffers, by the
+  // quantized columns and int32 products of the int8 path.
+  size_t int8_workspace_size() const;
+  // Chooses batch_images_ from the gemm_batching of the layer and the
+  // shapes of the batch, the channels and the output.
+  int batched_gemm_images() const;
+  // Copy the output of images images between their blobs and the wide
+  // matrix batch_output_.
+  void gather_batch_output(const Dtype* output, int images);
+  void scatter_batch_output(Dtype* output, int images);
+
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
-  inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff) {
+  // col_stride is only supported by the 2D versions, see im2col_cpu.
+  inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff,
+      int col_stride = 0) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
       im2col_cpu(data, conv_in_channels_,
           conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
           kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
           pad_.cpu_data()[0], pad_.cpu_data()[1],
           stride_.cpu_data()[0], stride_.cpu_data()[1],
-          dilation_.cpu_data()[0], dilation_.cpu_data()[1], col_buff);
+          dilation_.cpu_data()[0], dilation_.cpu_data()[1], col_buff,
+          col_stride);
     } else {
       im2col_nd_cpu(data, num_spatial_axes_, conv_input_shape_.cpu_data(),
           col_buffer_shape_.data(), kernel_shape_.cpu_data(),
           pad_.cpu_data(), stride_.cpu_data(), dilation_.cpu_data(), col_buff);
     }
   }
-  inline void conv_col2im_cpu(const Dtype* col_buff, Dtype* data) {
+  inline void conv_col2im_cpu(const Dtype* col_buff, Dtype* data,
+      int col_stride = 0) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
       col2im_cpu(col_buff, conv_in_channels_,
           conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
           kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
           pad_.cpu_data()[0], pad_.cpu_data()[1],
           stride_.cpu_data()[0], stride_.cpu_data()[1],
-          dilation_.cpu_data()[0], dilation_.cpu_data()[1], data);
+          dilation_.cpu_data()[0], dilation_.cpu_data()[1], data,
+          col_stride);
     } else {
       col2im_nd_cpu(col_buff, num_spatial_axes_, conv_input_shape_.cpu_data(),
           col_buffer_shape_.data(), kernel_shape_.cpu_data(),
@@ -211,7 +265,10 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
 
-  std::vector<Dtype> col_buffer_mt_;   //  openmp
+  Dtype* col_buffer_mt_;               //  openmp, in SharedWorkspace
+  Dtype* batch_output_;                //  batched, in SharedWorkspace
+  uint8_t* int8_col_mt_;               //  openmp, in SharedWorkspace
+  int32_t* int32_output_mt_;           //  openmp, in SharedWorkspace
   std::vector<Dtype> weight_diff_mt_;  // openmp
 };
 
@@ -90,7 +90,41 @@ class BaseDataLayer : public Layer<Dtype> {
 template <typename Dtype>
 class Batch {
  public:
+  Batch() : sequence_(0), worker_(0) {}
   Blob<Dtype> data_, label_;
+  // Set by the prefetch worker loading the batch: its place in delivery
+  // order, and the worker, whose transform contexts load_batch uses.
+  uint64_t sequence_;
+  int worker_;
+};
+
+// Hands out places in delivery order to prefetch workers, and lets them
+// deliver their batches in that order.
+class PrefetchSequencer;
+
+/**
+ * @brief State of load_batch kept per prefetching thread and reused from item
+ *        to item and batch to batch, so that prefetching doesn't allocate once
+ *        shapes are steady.
+ */
+template <typename Dtype>
+class TransformContext {
+ public:
+  // Points view_ at item item_id of batch, shaped as a single item.
+  // batch_data is the batch's mutable_cpu_data(), fetched once per batch.
+  void SetItem(const Blob<Dtype>& batch, Dtype* batch_data, int item_id) {
+    item_shape_ = batch.shape();
+    item_shape_[0] = 1;
+    view_.Reshape(item_shape_);
+    view_.set_cpu_data(batch_data + batch.offset(item_id));
+  }
+
+  Blob<Dtype> view_;
+  // Keeps its buffers across ParseTo calls.
+  Datum datum_;
+
+ private:
+  vector<int> item_shape_;
 };
 
 template <typename Dtype>
@@ -109,20 +143,56 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
-
  protected:
+  // Runs the prefetch loop of the layer on one more thread.
+  class PrefetchWorker : public InternalThread {
+   public:
+    PrefetchWorker(BasePrefetchingDataLayer* layer, int worker)
+        : layer_(layer), worker_(worker) {}
+    virtual ~PrefetchWorker() { StopInternalThread(); }
+
+   protected:
+    virtual void InternalThreadEntry() { layer_->PrefetchLoop(worker_); }
+    BasePrefetchingDataLayer* layer_;
+    const int worker_;
+  };
+
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Whether load_batch may run on several prefetch workers at once, each
+  // filling its own batch.
+  virtual inline bool ConcurrentLoadBatch() const { return false; }
 
   virtual void GetBatch();
-
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
+  void PrefetchLoop(int worker);
+  // Pops the next loaded batch, keeping track of prefetch queue occupancy.
+  Batch<Dtype>* NextBatch();
+  // The context of the calling OpenMP thread of the worker loading batch,
+  // or the only one without OpenMP.
+  TransformContext<Dtype>& transform_context(const Batch<Dtype>& batch);
+  void ReserveTransformContexts(int worker);
+  // A load_batch running on several workers takes the records of batch
+  // between these, so that every batch holds the next run of records in
+  // delivery order, as with a single worker.
+  void BeginReading(const Batch<Dtype>& batch);
+  void EndReading();
+
+  // Depth set by DataParameter.prefetch.
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  // 0 when batches are loaded synchronously in Forward_cpu.
+  int prefetch_workers_;
+  shared_ptr<PrefetchSequencer> sequencer_;
+  // Batches delivered since the last occupancy report, the sum of the
+  // batches ready at each delivery, and how many found none ready.
+  int occupancy_batches_;
+  int occupancy_ready_;
+  int occupancy_empty_;
 
   Blob<Dtype> transformed_data_;
+  // Per prefetch worker, per OpenMP thread.
+  vector<vector<shared_ptr<TransformContext<Dtype> > > > transform_contexts_;
 };
 
 }  // namespace caffe
@@ -63,6 +63,10 @@ class ConcatLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Concat"; }
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  // A single bottom is passed through by sharing its data.
+  virtual inline bool AllowReducedStorage() const {
+    return this->layer_param_.bottom_size() > 1;
+  }
 
  protected:
   /**
@@ -113,6 +117,10 @@ class ConcatLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // Forward for blobs in 16-bit storage; Backward only moves diffs.
+  void Forward_reduced_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   int count_;
   int num_concats_;
   int concat_input_size_;
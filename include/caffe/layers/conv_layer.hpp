@@ -97,11 +97,31 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
    *    kernels + stream parallelism) engines.
+   *  - algorithm (\b optional, default IM2COL). WINOGRAD_2X2 or WINOGRAD_4X4
+   *  make the CAFFE engine compute 2D 3x3 convolutions with stride 1, no
+   *  dilation and pad <= 2 with Winograd F(2x2,3x3) or F(4x4,3x3), on the
+   *  CPU, forward and for the bottom diff; other shapes use im2col.
+   *  - gemm_batching (\b optional, default AUTO). Whether the im2col GEMMs
+   *  of the CPU run per image and thread, or batched over several images.
+   *  - relu / negative_slope, prelu (\b optional, default false). Apply a
+   *  ReLU, or a PReLU with a blob of slopes after the bias, to the output
+   *  while adding the bias. Inference only: the layer can then not be run
+   *  backward.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
-      : BaseConvolutionLayer<Dtype>(param) {}
+      : BaseConvolutionLayer<Dtype>(param), fused_relu_(false),
+        negative_slope_(0), winograd_tile_(0),
+        winograd_weights_version_(0), winograd_back_weights_version_(0),
+        winograd_buffer_count_(0), winograd_buffer_mt_(NULL) {}
+
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Convolution"; }
+  virtual inline bool AllowQuantization() const { return true; }
+  virtual inline bool OverwritesBottomDiff() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -114,6 +134,44 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+  virtual inline bool forward_uses_col_buffer() const {
+    return winograd_tile_ == 0;
+  }
+  virtual inline bool supports_batched_gemm() const {
+    return winograd_tile_ == 0;
+  }
+  // The PReLU slopes of the output channels, NULL for a ReLU.
+  inline const Dtype* relu_slopes() const {
+    return this->layer_param_.convolution_param().prelu() ?
+        this->blobs_.back()->cpu_data() : NULL;
+  }
+
+  // Whether the output goes through a ReLU or PReLU, see relu and prelu.
+  bool fused_relu_;
+  Dtype negative_slope_;
+
+ private:
+  // Adds the bias to the output of an image and applies the ReLU or PReLU
+  // in the same pass.
+  void forward_cpu_bias_relu(Dtype* output);
+  // Transforms the filters for the Winograd Forward (backward false) or
+  // bottom diff, unless they have not changed since the last time.
+  void transform_winograd_weights(bool backward);
+  // Points the Winograd buffers of the OpenMP threads into the
+  // SharedWorkspace; call outside of any parallel region.
+  void acquire_winograd_buffer_mt();
+  void forward_cpu_winograd(const Dtype* input, Dtype* output);
+  void backward_cpu_winograd(const Dtype* output, Dtype* input);
+
+  // The output tile m of Winograd F(m x m, 3x3), 0 when using im2col.
+  int winograd_tile_;
+  Blob<Dtype> winograd_weights_;
+  Blob<Dtype> winograd_back_weights_;
+  // The blobs_[0] data_version the transformed filters were made from.
+  uint64_t winograd_weights_version_;
+  uint64_t winograd_back_weights_version_;
+  size_t winograd_buffer_count_;  // per thread
+  Dtype* winograd_buffer_mt_;     // openmp, in SharedWorkspace
 };
 
 }  // namespace caffe
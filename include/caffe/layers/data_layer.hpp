@@ -67,6 +67,10 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
 
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  virtual inline bool ConcurrentLoadBatch() const { return true; }
+  // Parses the shape and label of record into datum, and its pixels too
+  // unless they can be skipped.
+  void ParseShape(const DataReader::Record& record, Datum* datum);
 
   DataReader reader_;
 };
@@ -0,0 +1,110 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CAFFE_DIRECT_CONV_LAYER_HPP_
+#define CAFFE_DIRECT_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Convolves 2D inputs directly, without im2col, on the CPU.
+ *
+ * The input of each image is copied, zero padded, into a channel blocked
+ * layout (C/B x H x W x B, B being the vector width of the processor) and
+ * the filters into O/B x I/B x kh x kw x B x B blocks. Each output row is
+ * then computed in tiles of a few pixels by B output channels, held in
+ * registers while the input channels and the filter taps are accumulated,
+ * which reads the input once per filter tap instead of writing and reading
+ * a column matrix kh x kw times its size. The images are done one after
+ * the other, OpenMP running over the channel blocks of one to block it and
+ * then over its output channel blocks and rows, so only one image is kept
+ * blocked; the filters are blocked again only when they change.
+ *
+ * Selected with engine DIRECT; the backward pass, and the forward one of
+ * inputs that are not 2D, are the im2col ones of ConvolutionLayer.
+ */
+template <typename Dtype>
+class DirectConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit DirectConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), direct_(false),
+        blocked_weights_version_(0) {}
+
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline bool AllowQuantization() const { return false; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual inline bool forward_uses_col_buffer() const {
+    return !direct_ && ConvolutionLayer<Dtype>::forward_uses_col_buffer();
+  }
+
+ private:
+  // Reorders the filters into blocked_weights_ if they have changed.
+  void block_weights();
+  // Copies the channels of block plane (group x in_blocks_) of the image,
+  // zero padded, into the blocked layout.
+  void block_input(const Dtype* image, int plane, Dtype* blocked);
+
+  bool direct_;        // false for inputs that are not 2D
+  int block_;          // channels per block
+  int in_blocks_;      // input channel blocks per group
+  int out_blocks_;     // output channel blocks per group
+  int padded_height_;
+  int padded_width_;
+  Blob<Dtype> blocked_weights_;
+  // The blobs_[0] data_version blocked_weights_ were made from.
+  uint64_t blocked_weights_version_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DIRECT_CONV_LAYER_HPP_
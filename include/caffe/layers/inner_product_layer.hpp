@@ -43,6 +43,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -65,6 +66,8 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "InnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool AllowQuantization() const { return true; }
+  virtual inline bool OverwritesBottomDiff() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -82,6 +85,12 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+
+  // Set in the TEST phase when the layer has a quantization_param; the
+  // weights are quantized on the first Forward_cpu.
+  shared_ptr<QuantizedWeights> int8_weights_;
+  std::vector<uint8_t> int8_bottom_;
+  std::vector<int32_t> int32_top_;
 };
 
 }  // namespace caffe
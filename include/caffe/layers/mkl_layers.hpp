@@ -62,6 +62,7 @@ class MKLConvolutionLayer : public ConvolutionLayer<Dtype> {
   virtual ~MKLConvolutionLayer();
 
   virtual inline const char* type() const { return "MklConvolution"; }
+  virtual inline bool AllowQuantization() const { return false; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
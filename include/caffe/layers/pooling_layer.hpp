@@ -51,6 +51,9 @@ namespace caffe {
 /**
  * @brief Pools the input image by taking the max, average, etc. within regions.
  *
+ * Pools images (num, channels, height, width) or, on the CPU, volumes
+ * (num, channels, depth, height, width) such as video clips.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
@@ -79,6 +82,11 @@ class PoolingLayer : public Layer<Dtype> {
     return (this->layer_param_.pooling_param().pool() ==
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
+  virtual inline bool OverwritesBottomDiff() const { return true; }
+  // The mask top holds indices, which 16 bits cannot represent exactly.
+  virtual inline bool AllowReducedStorage() const {
+    return this->layer_param_.top_size() == 1;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -90,12 +98,19 @@ class PoolingLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // Forward for blobs in 16-bit storage; Backward does not read the data.
+  void Forward_reduced_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
   int channels_;
   int height_, width_;
   int pooled_height_, pooled_width_;
+  // The depth dimension of 3D pooling; 1, 1, 0, 1 and 1 for 2D pooling.
+  int kernel_d_, stride_d_, pad_d_;
+  int depth_, pooled_depth_;
   bool global_pooling_;
   Blob<Dtype> rand_idx_;
   Blob<int> max_idx_;
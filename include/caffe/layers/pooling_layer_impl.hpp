@@ -41,12 +41,6 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdint.h>
 #include <vector>
 
-#if defined __x86_64__ || defined _M_X64
-# define XBYAK_NO_OP_NAMES
-# define XBYAK_USE_MMAP_ALLOCATOR
-# include "../xbyak/xbyak_util.h"
-#endif
-
 #include "caffe/proto/caffe.pb.h"
 
 namespace caffe {
@@ -58,12 +52,19 @@ class PoolingLayer;
 template <typename Dtype>
 class Blob;
 
+// Arguments of the code generated for a row of pooling windows, see
+// pooling_layer_impl.cpp.
+template <typename Dtype>
+struct PoolingRowArgs;
+
+// The generators run the pooling of a range of images and channels, in 2D
+// or 3D. Windows that lie within the width of the input are pooled a row at
+// a time by code generated for the kernel width, stride and input shape,
+// shared by all layers with these and cached for the life of the process;
+// the windows on the padding by plain C++ (Naive, which also does all of
+// them where no code is generated).
 template <typename Dtype>
-class PoolingCodeGeneratorForward
-#if defined __x86_64__ || defined _M_X64
-  : public ::Xbyak::CodeGenerator
-#endif
-{
+class PoolingCodeGeneratorForward {
  public:
   PoolingCodeGeneratorForward();
   ~PoolingCodeGeneratorForward();
@@ -80,6 +81,8 @@ class PoolingCodeGeneratorForward
     PoolingLayer<Dtype>* layer,
     bool use_top_mask);
 
+  typedef void (Row_t)(const PoolingRowArgs<Dtype>* args);
+
   Callback_t* Get_callback(
     PoolingLayer<Dtype>* layer,
     Blob<Dtype>* top,
@@ -99,18 +102,38 @@ class PoolingCodeGeneratorForward
     int64_t channel_end,
     PoolingLayer<Dtype>* layer,
     bool use_top_mask);
+  static void Generated(
+    const Dtype* bottom_data,
+    Dtype* top_data,
+    int top_count,
+    int batch_start,
+    int batch_end,
+    void* mask,
+    int64_t channel_start,
+    int64_t channel_end,
+    PoolingLayer<Dtype>* layer,
+    bool use_top_mask);
+  static void Pool(
+    const Dtype* bottom_data,
+    Dtype* top_data,
+    int batch_start,
+    int batch_end,
+    void* mask,
+    int64_t channel_start,
+    int64_t channel_end,
+    PoolingLayer<Dtype>* layer,
+    bool use_top_mask,
+    Row_t* row);
   Callback_t* Callback;
+  // The generated code for the rows of the current shape, NULL if none.
+  Row_t* Row;
   std::vector<int> Layer_output_shape_signature;
   bool Use_top_mask;
   PoolingParameter_PoolMethod Method;
 };
 
 template <typename Dtype>
-class PoolingCodeGeneratorBackward
-#if defined __x86_64__ || defined _M_X64
-  : public ::Xbyak::CodeGenerator
-#endif
-{
+class PoolingCodeGeneratorBackward {
  public:
   PoolingCodeGeneratorBackward();
   ~PoolingCodeGeneratorBackward();
@@ -126,6 +149,8 @@ class PoolingCodeGeneratorBackward
     const void* mask,
     PoolingLayer<Dtype>* layer);
 
+  typedef void (Row_t)(const PoolingRowArgs<Dtype>* args);
+
   Callback_t* Get_callback(PoolingLayer<Dtype>* layer, Blob<Dtype>* top);
 
  private:
@@ -141,8 +166,32 @@ class PoolingCodeGeneratorBackward
     bool use_top_mask,
     const void* mask,
     PoolingLayer<Dtype>* layer);
+  static void Generated(
+    const Dtype* top_diff,
+    Dtype* bottom_diff,
+    int batch_start,
+    int batch_end,
+    int64_t channel_start,
+    int64_t channel_end,
+    bool use_top_mask,
+    const void* mask,
+    PoolingLayer<Dtype>* layer);
+  static void Pool(
+    const Dtype* top_diff,
+    Dtype* bottom_diff,
+    int batch_start,
+    int batch_end,
+    int64_t channel_start,
+    int64_t channel_end,
+    bool use_top_mask,
+    const void* mask,
+    PoolingLayer<Dtype>* layer,
+    Row_t* row);
   Callback_t* Callback;
+  // The generated code for the rows of average pooling, NULL if none.
+  Row_t* Row;
   std::vector<int> layer_output_shape_signature;
+  PoolingParameter_PoolMethod Method;
 };
 }  // namespace caffe
 
@@ -65,6 +65,8 @@ class ReLULayer : public NeuronLayer<Dtype> {
       : NeuronLayer<Dtype>(param) {}
 
   virtual inline const char* type() const { return "ReLU"; }
+  virtual inline bool AllowReducedStorage() const { return true; }
+  virtual inline bool OverwritesBottomDiff() const { return true; }
 
 #ifdef USE_MLSL
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
@@ -120,6 +122,12 @@ class ReLULayer : public NeuronLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // Forward and Backward for blobs in 16-bit storage.
+  void Forward_reduced_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void Backward_reduced_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 };
 
 }  // namespace caffe
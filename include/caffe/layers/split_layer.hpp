@@ -56,7 +56,7 @@ template <typename Dtype>
 class SplitLayer : public Layer<Dtype> {
  public:
   explicit SplitLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), shared_diff_top_(-1) {}
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
@@ -69,6 +69,14 @@ class SplitLayer : public Layer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
 
+  /**
+   * @brief Let top blob top_id share its diff with the bottom, so that its
+   *        consumer writes straight into the bottom diff and Backward only
+   *        adds the remaining tops. The consumer must overwrite that diff on
+   *        every Backward; -1 (the default) keeps all diffs separate.
+   */
+  inline void set_shared_diff_top(int top_id) { shared_diff_top_ = top_id; }
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -80,6 +88,7 @@ class SplitLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
   int count_;
+  int shared_diff_top_;
 };
 
 }  // namespace caffe
@@ -48,6 +48,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/conversion_ledger.hpp"
 
 namespace caffe {
 
@@ -152,10 +153,21 @@ class Net {
   void CopyTrainedLayersFrom(const NetParameter& param);
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
-  void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Points the parameters at a copy-on-write mapping of the file
+   *        where possible instead of reading them, so that nets loading
+   *        the same weights share their pages until they write them. The
+   *        numbers of bytes mapped and read are stored in mapped_bytes and
+   *        read_bytes if given.
+   */
+  void CopyTrainedLayersFromHDF5(const string trained_filename,
+      size_t* mapped_bytes = NULL, size_t* read_bytes = NULL);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
-  /// @brief Writes the net to an HDF5 file.
+  /**
+   * @brief Writes the net to an HDF5 file, through a temporary file renamed
+   *        over filename so that nets mapping the old one keep their pages.
+   */
   void ToHDF5(const string& filename, bool write_diff = false) const;
 
   /// @brief returns the network name.
@@ -299,6 +311,14 @@ class Net {
   static void CompilationRuleThree(const NetParameter& param,
                              NetParameter* param_compiled);
 
+  /**
+  * @brief This is rule that, for TEST nets with fold_inference, drops the
+  *        BatchNorm, Scale and ReLU or PReLU layers following a Convolution
+  *        or InnerProduct layer, recording them in its folded_layer
+  */
+  static void CompilationRuleFour(const NetParameter& param,
+                                  NetParameter* param_compiled);
+
 
 
   static void GetBlobConsumers(std::vector<const LayerParameter*> &cnsmer_blobs,
@@ -306,6 +326,35 @@ class Net {
                                                 const NetParameter& param,
                                                 int layer_id);
 
+  /**
+   * @brief Moves layers to the MKL2017 or MKLDNN engine to remove the layout
+   *        conversions recorded by a ConversionLedger, e.g. a CAFFE layer
+   *        between two MKL2017 layers; returns the number of layers moved.
+   *
+   * A conversion is charged to the layer that did it if that layer runs
+   * outside the converting engine, and otherwise to its producers (forward)
+   * or consumers (backward) outside it. Connected runs of charged layers
+   * that can run in the engine are moved by setting the engine of their type
+   * parameter, but only where more of the layers around a run already use
+   * the engine than do not, so that boundaries disappear instead of moving.
+   * Layers whose type parameter already names an engine are kept, and
+   * entries of layers missing from param (e.g. inserted splits) ignored.
+   */
+  static int PlanEngines(const NetParameter& param,
+      const vector<ConversionLedger::Entry>& entries,
+      NetParameter* param_planned);
+
+  /**
+   * @brief Runs Forward iterations times and records the range of the inputs
+   *        of the layers that AllowQuantization(), then sets the
+   *        quantization_param of the layers of param with the same names;
+   *        returns the number of layers calibrated.
+   *
+   * The layers are run one at a time and their inputs read just before they
+   * run, so that in-place layers and shared activations do not interfere.
+   */
+  int CalibrateQuantization(int iterations, NetParameter* param);
+
   /// @brief return whether NetState state meets NetStateRule rule
   static bool StateMeetsRule(const NetState& state, const NetStateRule& rule,
       const string& layer_name);
@@ -323,6 +372,23 @@ class Net {
   /// @brief Append a new parameter blob to the net.
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
+  /**
+   * @brief Point activation data (or diffs) with disjoint lifetimes at shared
+   *        buffers (see NetParameter.share_activations and share_diffs).
+   */
+  void PlanActivationMemory(bool diff);
+  /**
+   * @brief Hold the activations passed only between layers that convert
+   *        16-bit data in the given storage type (see
+   *        NetParameter.activation_storage).
+   */
+  void AssignActivationStorage(StorageType storage);
+  /**
+   * @brief Folds the trained parameters of the layers that CompilationRuleFour
+   *        folded, by name, into the layers that took their place.
+   */
+  void FoldTrainedLayers(
+      const map<string, vector<shared_ptr<Blob<Dtype> > > >& folded_blobs);
 
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
@@ -339,6 +405,8 @@ class Net {
   vector<shared_ptr<Layer<Dtype> > > layers_;
   vector<string> layer_names_;
   map<string, int> layer_names_index_;
+  /// @brief The layer that each folded layer was folded into
+  map<string, int> folded_layer_owners_;
   vector<bool> layer_need_backward_;
   /// @brief the blobs storing intermediate results between the layer.
   vector<shared_ptr<Blob<Dtype> > > blobs_;
@@ -388,6 +456,12 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Whether PlanActivationMemory is still due after the next full Forward
+  /// (for data) or Backward (for diffs).
+  bool share_activations_;
+  bool share_diffs_;
+  /// Buffers backing the activations shared by PlanActivationMemory.
+  vector<shared_ptr<SyncedMemory> > activation_buffers_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
   DISABLE_COPY_AND_ASSIGN(Net);
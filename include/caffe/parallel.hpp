@@ -60,6 +60,7 @@ template<typename Dtype>
 class Params {
  public:
   explicit Params(shared_ptr<Solver<Dtype> > root_solver);
+  explicit Params(Solver<Dtype>* root_solver);
   virtual ~Params() {
   }
 
@@ -96,6 +97,27 @@ class GPUParams : public Params<Dtype> {
   using Params<Dtype>::diff_;
 };
 
+// Params stored in host memory. Once configured, the learnable parameters
+// and gradients of a net live directly in data() and diff(), so collectives
+// such as an MPI allreduce can work on them in place.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  explicit CPUParams(Solver<Dtype>* root_solver);
+  virtual ~CPUParams();
+
+  void configure(Solver<Dtype>* solver) const;
+  // Brings values held in a private (MKL) layout back into the buffers.
+  void sync(Solver<Dtype>* solver) const;
+
+ protected:
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+  bool data_use_cuda_;
+  bool diff_use_cuda_;
+};
+
 class DevicePair {
  public:
   DevicePair(int parent, int device)
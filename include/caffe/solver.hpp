@@ -71,6 +71,8 @@ namespace caffe {
  */
 typedef boost::function<SolverAction::Enum()> ActionCallback;
 
+template <typename Dtype> class CPUParams;
+
 /**
  * @brief An interface for classes that perform optimization on Net%s.
  *
@@ -155,12 +157,6 @@ class Solver {
   virtual void ApplyUpdate(int param_id) = 0;
 
   void TestAll();
-//MPI function start
-  void find_net_size( int & param_size);
-  void copy_diffs_to_net(Dtype* diffs);
-  void copy_params_to_net(Dtype* params);
-  void copy_params_from_net(Dtype* params);
-  void copy_diffs_from_net(Dtype* diffs);
 
 
 #ifdef CAFFE_PER_LAYER_TIMINGS
@@ -215,6 +211,12 @@ class Solver {
 
   ForwardBackwardFunc forward_backward_;
 
+#ifdef USE_SELF_MPI
+  // Contiguous host buffers the learnable params are bound to, reduced in
+  // place across ranks after each iteration.
+  shared_ptr<CPUParams<Dtype> > mpi_params_;
+#endif
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -51,6 +51,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "boost/thread/mutex.hpp"
 #include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
 
 namespace caffe {
 
@@ -67,19 +68,7 @@ inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
     return;
   }
 #endif
-
-#ifdef USE_MLSL
-  *ptr = MLSL::Alloc(size ? size : 1, 64);
-#else /* !USE_MLSL */
-
-#ifdef USE_MKL
-  *ptr = mkl_malloc(size ? size : 1, 64);
-#else
-  *ptr = malloc(size);
-#endif
-
-#endif /* USE_MLSL */
-
+  *ptr = HostAllocator::Get()->Allocate(size);
   *use_cuda = false;
   CHECK(*ptr) << "host allocation of size " << size << " failed";
 }
@@ -91,19 +80,7 @@ inline void CaffeFreeHost(void* ptr, bool use_cuda) {
     return;
   }
 #endif
-
-#ifdef USE_MLSL
-  MLSL::Free(ptr);
-#else /* !USE_MLSL */
-
-#ifdef USE_MKL
-  mkl_free(ptr);
-#else
-  free(ptr);
-#endif
-
-#endif /* USE_MLSL */
-
+  HostAllocator::Get()->Free(ptr);
 }
 
 // Base class
@@ -138,15 +115,21 @@ class SyncedMemory {
       : cpu_ptr_(NULL), gpu_ptr_(NULL),
         size_(0), head_(UNINITIALIZED), own_cpu_data_(false),
         cpu_malloc_use_cuda_(false), own_gpu_data_(false), own_prv_data_(false),
-        gpu_device_(-1) {}
+        gpu_device_(-1), version_(next_version()) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL),
         size_(size), head_(UNINITIALIZED), own_cpu_data_(false),
         cpu_malloc_use_cuda_(false), own_gpu_data_(false), own_prv_data_(false),
-        gpu_device_(-1) {}
+        gpu_device_(-1), version_(next_version()) {}
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
+  /**
+   * @brief Like set_cpu_data, for memory that stays valid as long as owner
+   *        is alive (e.g. a MappedFile); a reference to owner is kept until
+   *        the host memory is replaced or freed.
+   */
+  void set_cpu_data(void* data, const shared_ptr<void>& owner);
   const void* gpu_data();
   void set_gpu_data(void* data);
   void* mutable_cpu_data();
@@ -162,6 +145,29 @@ class SyncedMemory {
                     HEAD_AT_PRV, SYNCED_PRV};
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  /**
+   * @brief Changes whenever the data may have been written through any of
+   *        the mutable accessors or replaced by set_*_data, so that values
+   *        derived from it (e.g. transformed filters) can be cached. Versions
+   *        are unique across all SyncedMemory objects.
+   */
+  uint64_t version() const { return version_; }
+
+  /**
+   * @brief Where newly allocated host memory is placed on NUMA machines.
+   *
+   * Pages land on the node of the thread touching them first, which by
+   * default is the thread zeroing them in cpu_data(), often the main one.
+   * NUMA_FIRST_TOUCH zeroes in contiguous equal chunks, one per OpenMP
+   * thread, matching an omp parallel for with a static schedule over the
+   * outermost dimension (e.g. the images of a batch). NUMA_INTERLEAVE
+   * spreads the pages round-robin over the nodes with processors. Blocks
+   * reused by a caching HostAllocator keep their first placement. The
+   * default is read from CAFFE_NUMA_POLICY (first_touch or interleave).
+   */
+  enum NumaPolicy { NUMA_DEFAULT, NUMA_FIRST_TOUCH, NUMA_INTERLEAVE };
+  static NumaPolicy numa_policy();
+  static void set_numa_policy(NumaPolicy policy);
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -170,8 +176,11 @@ class SyncedMemory {
  private:
   void to_cpu();
   void to_gpu();
+  void place_cpu_data();
+  static uint64_t next_version();
   void* cpu_ptr_;
   void* gpu_ptr_;
+  shared_ptr<void> cpu_owner_;
   const size_t size_;
   SyncedHead head_;
   bool own_cpu_data_;
@@ -179,6 +188,7 @@ class SyncedMemory {
   bool own_gpu_data_;
   bool own_prv_data_;
   int gpu_device_;
+  uint64_t version_;
   boost::mutex mtx;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
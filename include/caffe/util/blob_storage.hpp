@@ -0,0 +1,149 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_UTIL_BLOB_STORAGE_HPP_
+#define CAFFE_UTIL_BLOB_STORAGE_HPP_
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Accessors for layers that accept blobs held in a 16-bit storage type, see
+// Layer::AllowReducedStorage. They fetch the data pointer on construction,
+// as the SyncedMemory accessors are not thread safe, and then convert ranges
+// of the data to and from Dtype, e.g. from inside a parallel loop. A blob
+// that holds Dtype is accessed in place, without copies.
+
+// Elements converted per step by loops over a whole blob.
+const int kStorageChunk = 1024;
+
+// Returns whether any of the blobs holds 16-bit data.
+template <typename Dtype>
+inline bool HasReducedStorage(const vector<Blob<Dtype>*>& blobs) {
+  for (int i = 0; i < blobs.size(); ++i) {
+    if (blobs[i]->storage() != FLOAT32) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Dtype>
+class BlobDataReader {
+ public:
+  explicit BlobDataReader(const Blob<Dtype>& blob)
+      : storage_(blob.storage()),
+        data_(storage_ == FLOAT32 ? blob.cpu_data() : NULL),
+        data16_(storage_ == FLOAT32 ? NULL : blob.cpu_data16()) {}
+
+  inline StorageType storage() const { return storage_; }
+
+  // Returns elements [offset, offset + n) as Dtype, unpacked into buffer if
+  // the blob holds 16-bit data.
+  inline const Dtype* Read(int offset, int n, Dtype* buffer) const {
+    if (data_) {
+      return data_ + offset;
+    }
+    caffe_cpu_unpack16(storage_, n, data16_ + offset, buffer);
+    return buffer;
+  }
+
+ private:
+  template <typename T> friend class BlobDataWriter;
+
+  const StorageType storage_;
+  const Dtype* data_;
+  const uint16_t* data16_;
+};
+
+template <typename Dtype>
+class BlobDataWriter {
+ public:
+  explicit BlobDataWriter(Blob<Dtype>* blob)
+      : storage_(blob->storage()),
+        data_(storage_ == FLOAT32 ? blob->mutable_cpu_data() : NULL),
+        data16_(storage_ == FLOAT32 ? NULL : blob->mutable_cpu_data16()) {}
+
+  inline StorageType storage() const { return storage_; }
+
+  // Returns where to compute the elements starting at offset: the blob
+  // itself, or buffer when it holds 16-bit data and Write has to pack them.
+  inline Dtype* Target(int offset, Dtype* buffer) const {
+    return data_ ? data_ + offset : buffer;
+  }
+
+  // Stores the n values computed into Target(offset, buffer), or any other n
+  // values to place at offset if they were not computed in place.
+  inline void Write(int offset, int n, const Dtype* values) const {
+    if (!data_) {
+      caffe_cpu_pack16(storage_, n, values, data16_ + offset);
+    } else if (values != data_ + offset) {
+      caffe_copy(n, values, data_ + offset);
+    }
+  }
+
+  // Copies n elements at src_offset of source to offset.
+  void Copy(int offset, const BlobDataReader<Dtype>& source, int src_offset,
+      int n) const {
+    if (source.storage_ == storage_ && data16_) {
+      memcpy(data16_ + offset, source.data16_ + src_offset,
+          n * sizeof(uint16_t));
+      return;
+    }
+    Dtype buffer[kStorageChunk];
+    for (int i = 0; i < n; i += kStorageChunk) {
+      const int chunk = std::min(kStorageChunk, n - i);
+      Write(offset + i, chunk, source.Read(src_offset + i, chunk,
+          Target(offset + i, buffer)));
+    }
+  }
+
+ private:
+  const StorageType storage_;
+  Dtype* data_;
+  uint16_t* data16_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BLOB_STORAGE_HPP_
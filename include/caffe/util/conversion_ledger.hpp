@@ -0,0 +1,161 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CAFFE_UTIL_CONVERSION_LEDGER_HPP_
+#define CAFFE_UTIL_CONVERSION_LEDGER_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "boost/thread/mutex.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Accounts for the layout conversions done by the private memory
+ *        descriptors of the MKL2017 and MKLDNN engines.
+ *
+ * Every convert_from_prv / convert_to_prv (and, for MKLDNN, every reorder
+ * between two private layouts) is charged to the layer that the Net is
+ * running on the same thread when it happens, together with its size and duration. In nets that
+ * mix engines this shows where the layout boundaries are and what they cost;
+ * Net::PlanEngines turns the entries into engine changes.
+ *
+ * The ledger is off unless CAFFE_CONVERSION_LEDGER is set to a non-zero value
+ * or set_enabled(true) is called, and then costs a single branch per
+ * conversion. Durations of MKLDNN reorders are those of their submission and
+ * may not include the work of a deferred stream.
+ */
+class ConversionLedger {
+ public:
+  enum Direction {
+    /// private layout to the plain one, e.g. a CAFFE layer reading MKL output
+    FROM_PRV,
+    /// plain layout to a private one
+    TO_PRV,
+    /// between two private layouts of the same engine
+    PRV_TO_PRV
+  };
+
+  /// @brief The conversions charged to one layer in one direction.
+  struct Entry {
+    Entry() : direction(FROM_PRV), backward(false),
+              engine(PrvMemDescr::PRV_DESCR_MKL2017), count(0), bytes(0),
+              seconds(0) {}
+    std::string layer;
+    Direction direction;
+    bool backward;
+    PrvMemDescr::PrvDescrType engine;
+    uint64_t count;
+    uint64_t bytes;
+    double seconds;
+  };
+
+  /**
+   * @brief Times a conversion from construction to destruction and records
+   *        it, if the ledger is enabled.
+   */
+  class Conversion {
+   public:
+    Conversion(Direction direction, PrvMemDescr::PrvDescrType engine,
+               size_t bytes);
+    ~Conversion();
+
+   private:
+    Direction direction_;
+    PrvMemDescr::PrvDescrType engine_;
+    size_t bytes_;
+    uint64_t start_;
+
+    DISABLE_COPY_AND_ASSIGN(Conversion);
+  };
+
+  static ConversionLedger* Get();
+  static bool enabled() { return enabled_; }
+  static void set_enabled(bool enabled) { enabled_ = enabled; }
+
+  /**
+   * @brief Charges the following conversions of the calling thread to layer
+   *        (NULL for none) in the given pass. The name must outlive the call.
+   */
+  static void set_layer(const std::string* layer, bool backward);
+
+  void Record(Direction direction, PrvMemDescr::PrvDescrType engine,
+              size_t bytes, double seconds);
+  /// @brief Marks the end of an iteration, for per-iteration averages.
+  void EndIteration();
+  void Clear();
+
+  int iterations() const;
+  /// @brief The entries, the most bytes first.
+  std::vector<Entry> entries() const;
+  uint64_t total_count() const;
+  uint64_t total_bytes() const;
+  /// @brief Logs the per-iteration cost of the costliest entries.
+  void Log(int max_entries = 20) const;
+
+  static const char* DirectionName(Direction direction);
+  static const char* EngineName(PrvMemDescr::PrvDescrType engine);
+
+ private:
+  ConversionLedger();
+
+  // The layer and pass running on a thread.
+  struct Current {
+    Current() : layer(NULL), backward(false) {}
+    const std::string* layer;
+    bool backward;
+  };
+  static Current* current();
+
+  static bool enabled_;
+
+  mutable boost::mutex mutex_;
+  std::vector<Entry> entries_;
+  int iterations_;
+
+  DISABLE_COPY_AND_ASSIGN(ConversionLedger);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CONVERSION_LEDGER_HPP_
@@ -0,0 +1,103 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_UTIL_CONVERT_WRITER_HPP_
+#define CAFFE_UTIL_CONVERT_WRITER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+
+#include "caffe/common.hpp"
+#include "caffe/util/db.hpp"
+
+namespace caffe {
+
+/// @brief An image of a converter tool's list, read and serialized.
+struct ConvertEntry {
+  bool status;
+  // Whether reading set the shape, even if it failed afterwards.
+  bool has_shape;
+  int channels;
+  int height;
+  int width;
+  int data_size;
+  // The DB key, or the list entry if reading failed.
+  string key;
+  // A serialized Datum, or AnnotatedDatum for annotated lists.
+  string value;
+};
+
+/**
+ * @brief Stores the entries read by convert_imageset and convert_annoset in
+ * list order, committing every commit_interval stored images.
+ *
+ * The tools read chunks of the list on several threads, and hand each chunk
+ * to one writer thread, so the DB is the same as when reading one image at
+ * a time.
+ */
+class ConvertWriter {
+ public:
+  ConvertWriter(db::DB* db, bool annotated, bool check_size,
+                int commit_interval);
+
+  void Write(const vector<ConvertEntry>* entries);
+  // Commits the last images.
+  void Finish();
+
+ private:
+  db::DB* db_;
+  boost::scoped_ptr<db::Transaction> txn_;
+  const bool annotated_;
+  const bool check_size_;
+  const int commit_interval_;
+  int count_;
+  int data_size_;
+  bool data_size_initialized_;
+  // The last shape set by reading an image.
+  bool has_shape_;
+  int channels_;
+  int height_;
+  int width_;
+
+  DISABLE_COPY_AND_ASSIGN(ConvertWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CONVERT_WRITER_HPP_
@@ -44,6 +44,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cstdlib>
 #include <cstring>
 #include <set>
+#include <string>
 #include <vector>
 
 
@@ -95,6 +96,10 @@ class CollectionInterface {
   virtual unsigned getTotalNumberOfCpuCores() = 0;
   virtual unsigned getNumberOfProcessors() = 0;
   virtual const Processor &getProcessor(unsigned processorId) = 0;
+  virtual unsigned getNumberOfNumaNodes() = 0;
+  virtual const std::vector<unsigned> &getNumaNodeProcessors(
+    unsigned nodeId) = 0;
+  virtual int getNumaNodeOfProcessor(unsigned processorId) = 0;
 };
 
 class Collection : public CollectionInterface {
@@ -107,12 +112,26 @@ class Collection : public CollectionInterface {
   virtual unsigned getNumberOfProcessors();
   virtual const Processor &getProcessor(unsigned processorId);
 
+  // NUMA nodes as listed in /sys/devices/system/node. Node ids may have
+  // gaps; absent and memory-only nodes have no processors. Without sysfs
+  // there are no nodes and getNumaNodeOfProcessor() returns -1.
+  virtual unsigned getNumberOfNumaNodes();
+  virtual const std::vector<unsigned> &getNumaNodeProcessors(unsigned nodeId);
+  virtual int getNumaNodeOfProcessor(unsigned processorId);
+
+  // Reads nodeN/cpulist files below nodeDirectory; the constructor does so
+  // for /sys/devices/system/node.
+  void loadNumaTopology(const char *nodeDirectory);
+  static void parseCpuList(const char *text, std::vector<unsigned> *cpus);
+
  private:
   CpuInfoInterface &cpuInfo;
   unsigned totalNumberOfSockets;
   unsigned totalNumberOfCpuCores;
   std::vector<Processor> processors;
   Processor *currentProcessor;
+  unsigned numberOfNumaNodes;
+  std::vector<std::vector<unsigned> > numaNodeProcessors;
 
   Collection(const Collection &collection);
   Collection &operator =(const Collection &collection);
@@ -130,6 +149,25 @@ class Collection : public CollectionInterface {
     unsigned numberOfUniquePhysicalId);
 };
 
+// Topology of the machine the process runs on.
+Collection &getCollection();
+
+// Vector instruction sets usable by hand-written kernels, widest last.
+enum Isa {
+  isaScalar,
+  isaAvx2,
+  isaAvx512
+};
+
+// Widest instruction set supported by the processor and the OS. Can be
+// lowered with the CAFFE_CPU_ISA environment variable (scalar, avx2 or
+// avx512), e.g. to compare kernels.
+Isa getSupportedIsa();
+const char *getIsaName(Isa isa);
+// Whether getSupportedIsa() is isaAvx512 and the processor also has the
+// AVX512_VNNI uint8 x int8 dot product instructions (Cascade Lake and later).
+bool hasAvx512Vnni();
+
 #ifdef _OPENMP
 
 class OpenMpManager {
@@ -53,11 +53,16 @@ class Cursor {
   Cursor() { }
   virtual ~Cursor() { }
   virtual void SeekToFirst() = 0;
+  // Positions the cursor at the first key that is not less than key.
+  virtual void Seek(const string& key) = 0;
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
   virtual std::pair<void*, size_t> valuePointer() = 0;
   virtual bool valid() = 0;
+  // Positions the cursor at the index-th record in key order and returns
+  // true, if the backend can do so without walking the records before it.
+  virtual bool SeekToIndex(size_t index) { return false; }
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
@@ -80,6 +85,9 @@ class DB {
   virtual void Close() = 0;
   virtual Cursor* NewCursor() = 0;
   virtual Transaction* NewTransaction() = 0;
+  // Sets count to the number of records and returns true, if the backend
+  // knows it without walking them.
+  virtual bool Count(size_t* count) { return false; }
 
   DISABLE_COPY_AND_ASSIGN(DB);
 };
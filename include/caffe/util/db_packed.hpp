@@ -0,0 +1,187 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_UTIL_DB_PACKED_HPP
+#define CAFFE_UTIL_DB_PACKED_HPP
+
+#include <stdint.h>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/db.hpp"
+
+namespace caffe { namespace db {
+
+/**
+ * @brief Layout of a packed DB file, which is read through a read-only
+ * memory mapping.
+ *
+ * The header is followed by the records, each starting on a kPackedAlignment
+ * boundary, then by the tables locating them, then by the keys. Values are
+ * stored as serialized protos, so every consumer of a DB reads them
+ * unchanged. Raw uint8 Datums are written with their label as a fixed-size
+ * varint, so that all Datums of one shape have the same size. When all
+ * records are such Datums the file is fixed-stride: record i is a pointer add
+ * away, and the labels are also kept in a table of their own, so they can be
+ * read without touching pixels. Otherwise, e.g. for encoded images or
+ * AnnotatedDatums, an index gives the offset and size of each record.
+ */
+struct PackedHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t count;
+  // With kPackedFixed, the size of every record and the distance between
+  // two of them.
+  uint64_t record_size;
+  uint64_t stride;
+  uint64_t records_offset;
+  // With kPackedFixed, count int32 labels, otherwise count (offset, size)
+  // pairs of uint64.
+  uint64_t labels_offset;
+  uint64_t index_offset;
+  // count + 1 uint64 offsets relative to the end of the table, then the keys.
+  uint64_t keys_offset;
+  // Shape of the records with kPackedFixed.
+  int32_t channels;
+  int32_t height;
+  int32_t width;
+  uint32_t reserved;
+};
+
+const uint32_t kPackedVersion = 1;
+const uint32_t kPackedFixed = 1;
+const size_t kPackedAlignment = 64;
+const size_t kPackedRecordsOffset = 4096;
+
+class PackedDB;
+
+class PackedCursor : public Cursor {
+ public:
+  explicit PackedCursor(const PackedDB* db) : db_(db), index_(0) { }
+  virtual void SeekToFirst() { index_ = 0; }
+  virtual void Seek(const string& key);
+  virtual void Next() { ++index_; }
+  virtual string key();
+  virtual string value();
+  virtual std::pair<void*, size_t> valuePointer();
+  virtual bool valid();
+  virtual bool SeekToIndex(size_t index) {
+    index_ = index;
+    return true;
+  }
+
+ private:
+  const PackedDB* db_;
+  size_t index_;
+};
+
+class PackedTransaction : public Transaction {
+ public:
+  explicit PackedTransaction(PackedDB* db) : db_(db) { }
+  virtual void Put(const string& key, const string& value) {
+    keys_.push_back(key);
+    values_.push_back(value);
+  }
+  virtual void Commit();
+
+ private:
+  PackedDB* db_;
+  vector<string> keys_, values_;
+
+  DISABLE_COPY_AND_ASSIGN(PackedTransaction);
+};
+
+/**
+ * @brief A packed, memory-mapped record file, see PackedHeader. The file is
+ * written once, with keys in increasing order, and read-only afterwards.
+ */
+class PackedDB : public DB {
+ public:
+  PackedDB() : map_(NULL), map_size_(0), header_(NULL), offset_(0),
+               fixed_(true) { }
+  virtual ~PackedDB() { Close(); }
+  virtual void Open(const string& source, Mode mode);
+  virtual void Close();
+  virtual PackedCursor* NewCursor();
+  virtual PackedTransaction* NewTransaction();
+  virtual bool Count(size_t* count) {
+    *count = this->count();
+    return true;
+  }
+
+  inline size_t count() const { return header_->count; }
+  inline bool fixed() const { return header_->flags & kPackedFixed; }
+  string key(size_t i) const;
+  std::pair<void*, size_t> record(size_t i) const;
+  // Only for fixed-stride files.
+  int label(size_t i) const;
+  // Index of the first key that is not less than key.
+  size_t LowerBound(const string& key) const;
+
+ protected:
+  void Append(const string& key, const string& value);
+  void Write(const void* data, size_t size);
+  void Align();
+  void Finish();
+  // Checks that the tables and all records lie within the mapping.
+  void CheckTables(const string& source) const;
+
+  // Reading
+  char* map_;
+  size_t map_size_;
+  const PackedHeader* header_;
+
+  // Writing
+  std::ofstream out_;
+  uint64_t offset_;
+  bool fixed_;
+  PackedHeader new_header_;
+  vector<string> keys_;
+  vector<uint64_t> offsets_, sizes_;
+  vector<int32_t> labels_;
+
+  friend class PackedTransaction;
+};
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_PACKED_HPP
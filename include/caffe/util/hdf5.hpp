@@ -44,6 +44,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "hdf5_hl.h"
 
 #include "caffe/blob.hpp"
+#include "caffe/util/mapped_file.hpp"
 
 namespace caffe {
 
@@ -57,6 +58,17 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob);
 
+/**
+ * @brief Like hdf5_load_nd_dataset, but points the blob data into file, the
+ *        mapping of the file of file_id, instead of reading it. Returns
+ *        false, leaving the data alone, if the dataset is not stored there
+ *        as contiguous native Dtype values.
+ */
+template <typename Dtype>
+bool hdf5_map_nd_dataset(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
+    const shared_ptr<MappedFile>& file, Blob<Dtype>* blob);
+
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
@@ -0,0 +1,146 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include <stdint.h>
+
+#include <cstddef>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/// @brief Counters kept by a HostAllocator; sizes are in bytes.
+struct HostAllocatorStats {
+  HostAllocatorStats()
+      : allocations(0), cache_hits(0), system_allocations(0),
+        bytes_in_use(0), peak_bytes_in_use(0), bytes_cached(0),
+        bytes_reserved(0) {}
+  uint64_t allocations;
+  /// Allocations served from a free list instead of the system.
+  uint64_t cache_hits;
+  uint64_t system_allocations;
+  uint64_t bytes_in_use;
+  uint64_t peak_bytes_in_use;
+  /// Freed blocks kept for reuse.
+  uint64_t bytes_cached;
+  /// Memory obtained from the system and not yet returned.
+  uint64_t bytes_reserved;
+};
+
+/**
+ * @brief Source of the host memory of SyncedMemory (see CaffeMallocHost).
+ *
+ * The process-wide allocator is chosen on the first host allocation, by
+ * HostAllocator::Set or else by the CAFFE_HOST_ALLOCATOR environment variable:
+ * "system" (the default) allocates and frees every block with MLSL, MKL or
+ * posix_memalign; "caching" uses a CachingHostAllocator and
+ * "caching_hugetlb" one that maps large blocks from hugetlbfs.
+ * CAFFE_HOST_CACHE_MB bounds the memory the caching allocator keeps in its
+ * shared pool.
+ */
+class HostAllocator {
+ public:
+  virtual ~HostAllocator() {}
+  /// @brief Returns at least size bytes aligned to 64 bytes, never NULL.
+  virtual void* Allocate(size_t size) = 0;
+  virtual void Free(void* ptr) = 0;
+  virtual HostAllocatorStats stats() const { return HostAllocatorStats(); }
+  virtual const char* type() const = 0;
+
+  static HostAllocator* Get();
+  /// @brief Installs allocator (which is never deleted) as the process-wide
+  ///        one; must come before the first host allocation.
+  static void Set(HostAllocator* allocator);
+};
+
+/// @brief Hands every request straight to MLSL::Alloc, mkl_malloc or
+///        posix_memalign.
+class SystemHostAllocator : public HostAllocator {
+ public:
+  virtual void* Allocate(size_t size);
+  virtual void Free(void* ptr);
+  virtual const char* type() const { return "system"; }
+};
+
+/**
+ * @brief Keeps freed blocks for reuse, so that reshaping blobs and variable
+ *        input sizes stop going through mmap/munmap and fresh page faults.
+ *
+ * Requests are rounded up to size classes: multiples of 64 bytes up to 4 KB,
+ * then four classes per power of two, so at most a quarter is wasted. Freed
+ * blocks go to a free list of the calling thread, which serves its next
+ * allocations without locking, and once that list is full (or for blocks of
+ * several MB) to a shared pool bounded by max_cached_bytes; anything beyond
+ * is returned to the system. Blocks of 2 MB and more are advised to use
+ * transparent huge pages, or with use_hugetlb are mapped from hugetlbfs when
+ * huge pages are reserved.
+ *
+ * Free lists of other threads are returned to the pool when those threads
+ * exit; destroy an allocator only after that.
+ */
+class CachingHostAllocator : public HostAllocator {
+ public:
+  explicit CachingHostAllocator(size_t max_cached_bytes = size_t(1) << 31,
+                                bool use_hugetlb = false);
+  virtual ~CachingHostAllocator();
+  virtual void* Allocate(size_t size);
+  virtual void Free(void* ptr);
+  virtual HostAllocatorStats stats() const;
+  virtual const char* type() const { return "caching"; }
+
+  /// @brief Returns the blocks cached by the shared pool and the calling
+  ///        thread to the system. Free lists of other threads are left
+  ///        alone, as only their threads touch them without locking; they
+  ///        reach the pool when those threads exit.
+  void Trim();
+
+  /// @brief The size class of a request: its index and the bytes it holds.
+  static int SizeClass(size_t size, size_t* class_size);
+
+ private:
+  class Impl;
+  shared_ptr<Impl> impl_;
+
+  DISABLE_COPY_AND_ASSIGN(CachingHostAllocator);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_ALLOCATOR_HPP_
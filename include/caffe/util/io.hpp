@@ -159,6 +159,15 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+/**
+ * @brief Parses a serialized Datum holding raw uint8 pixels without copying
+ * them: datum receives every other field, and data is set to point at the
+ * pixel bytes inside buffer. Returns false for encoded or float_data records,
+ * which must be parsed normally.
+ */
+bool ParseDatumView(const void* buffer, size_t size, Datum* datum,
+                    const char** data);
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
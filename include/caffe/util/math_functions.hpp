@@ -44,6 +44,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "glog/logging.h"
 
 #include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
 #include "caffe/util/device_alternate.hpp"
 #include "caffe/util/mkl_alternate.hpp"
 
@@ -182,6 +183,45 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]));
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Conversions between float and the 16-bit storage types, rounding to nearest
+// even. Values beyond the FLOAT16 range become infinity.
+uint16_t caffe_float_to_fp16(float x);
+float caffe_fp16_to_float(uint16_t x);
+uint16_t caffe_float_to_bf16(float x);
+float caffe_bf16_to_float(uint16_t x);
+
+// Converts n values to (pack) or from (unpack) the 16-bit storage type, which
+// must be FLOAT16 or BFLOAT16. The float versions use F16C or AVX-512 kernels
+// when cpu::getSupportedIsa() allows.
+template <typename Dtype>
+void caffe_cpu_pack16(const StorageType type, const int n, const Dtype* x,
+    uint16_t* y) {
+  CHECK_NE(type, FLOAT32);
+  for (int i = 0; i < n; ++i) {
+    const float value = static_cast<float>(x[i]);
+    y[i] = type == FLOAT16 ? caffe_float_to_fp16(value)
+                           : caffe_float_to_bf16(value);
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_unpack16(const StorageType type, const int n, const uint16_t* x,
+    Dtype* y) {
+  CHECK_NE(type, FLOAT32);
+  for (int i = 0; i < n; ++i) {
+    y[i] = static_cast<Dtype>(type == FLOAT16 ? caffe_fp16_to_float(x[i])
+                                              : caffe_bf16_to_float(x[i]));
+  }
+}
+
+template <>
+void caffe_cpu_pack16<float>(const StorageType type, const int n,
+    const float* x, uint16_t* y);
+
+template <>
+void caffe_cpu_unpack16<float>(const StorageType type, const int n,
+    const uint16_t* x, float* y);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
@@ -310,6 +310,10 @@ namespace performance {
       printf("%18lu : %s\n", (uint64_t)time, string);
     }
 
+    static void WriteCounter(const char* string, uint64_t value) {
+      printf("%18lu : %s\n", value, string);
+    }
+
     static void Write(const char* string, const PreciseTime& time) {
       printf("%18lu %10c %s\n", (uint64_t)time, ':', string);
     }
@@ -333,7 +337,12 @@ namespace performance {
   };
 
   class Monitor {
+   public:
+    typedef uint64_t (*CounterReader)();
+
+   private:
     typedef std::vector<std::string> NameVector;
+    typedef std::pair<std::string, CounterReader> Counter;
     typedef std::vector<Event> EventVector;
     typedef std::pair<std::string, unsigned> Pair;
     typedef std::map<std::string, unsigned> Map;
@@ -342,6 +351,7 @@ namespace performance {
 
     EventVector events_;
     Map event_name_id_map_;
+    std::vector<Counter> counters_;
 
     bool are_measurements_enabled_;
 
@@ -389,6 +399,17 @@ namespace performance {
       Log::WriteLine();
       DumpGeneralTimings();
 
+      if (counters_.size()) {
+        Log::WriteLine();
+        Log::WriteLine();
+        Log::WriteLine("Counters");
+        Log::WriteLine();
+        for (unsigned i = 0; i < counters_.size(); i++) {
+          Log::WriteCounter(counters_[i].first.c_str(),
+            counters_[i].second());
+        }
+      }
+
       Log::WriteLine();
     }
 
@@ -537,6 +558,11 @@ namespace performance {
       if (are_measurements_enabled_)
         events_[event_id].Update(measurement);
     }
+
+    // Adds a statistic kept elsewhere, read when the summary is dumped.
+    void RegisterCounter(const char *name, CounterReader reader) {
+      counters_.push_back(Counter(name, reader));
+    }
   };
 
   extern Monitor monitor;
@@ -0,0 +1,140 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_UTIL_QUANTIZE_HPP_
+#define CAFFE_UTIL_QUANTIZE_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Computes the int32 products C = A * B' of an M x K uint8 matrix A
+ *        and an N x K int8 matrix B, both row-major. C is M x N.
+ *
+ * B is packed into panels of 16 rows on each call, QuantizedWeights packs
+ * its weights once. The products are computed 4 rows of A by 16 rows of B at
+ * a time, with AVX512_VNNI or AVX2 kernels when cpu::getSupportedIsa() and
+ * cpu::hasAvx512Vnni() allow, or with MKL's cblas_gemm_s8u8s32 on VNNI
+ * processors in USE_MKL builds. The results are exact in every case.
+ */
+void caffe_cpu_gemm_u8s8s32(const int M, const int N, const int K,
+    const uint8_t* A, const int8_t* B, int32_t* C);
+
+/**
+ * @brief Weights of an InnerProduct or Convolution layer in int8, with the
+ *        quantization of the layer input, for the int8 inference path (see
+ *        QuantizationParameter).
+ *
+ * Each row holds the weights of one output channel with its own scale. An
+ * input x becomes round(x * input_scale) + input_zero_point in uint8; the
+ * zero point is folded out of the int32 products with the row sums.
+ */
+class QuantizedWeights {
+ public:
+  /// @brief Requires a calibrated QuantizationParameter::input_max.
+  explicit QuantizedWeights(const QuantizationParameter& param);
+
+  /**
+   * @brief Whether the quantization_param of param was calibrated, which
+   *        int8 inference needs. Warns if not.
+   */
+  static bool Calibrated(const LayerParameter& param);
+
+  /// @brief Whether Quantize() has been called.
+  bool empty() const { return data_.empty(); }
+  int rows() const { return rows_; }
+  int cols() const { return cols_; }
+  const int8_t* row(int r) const { return &data_[r * cols_]; }
+  /// @brief A weight is its int8 value times the scale of its row.
+  float scale(int r) const { return scale_[r]; }
+  float input_scale() const { return input_scale_; }
+  int input_zero_point() const { return input_zero_point_; }
+
+  /**
+   * @brief Quantizes a rows x cols weight matrix, stored as cols x rows if
+   *        transposed, whose rows fall into groups of equal size.
+   */
+  template <typename Dtype>
+  void Quantize(const int rows, const int cols, const Dtype* weights,
+      bool transposed, const int groups = 1);
+  /**
+   * @brief Quantizes a rows x cols input matrix into y, which is cols x rows
+   *        if transpose is set.
+   */
+  template <typename Dtype>
+  void QuantizeInput(const int rows, const int cols, const Dtype* x,
+      bool transpose, uint8_t* y) const;
+  /**
+   * @brief Multiplies the m x cols() uint8 inputs x with rows [first_row,
+   *        first_row + n) of the weights, all in one group, into the m x n
+   *        int32 products acc.
+   */
+  void Multiply(const int m, const int first_row, const int n,
+      const uint8_t* x, int32_t* acc) const;
+  /**
+   * @brief Converts products computed by Multiply() back to Dtype. y is
+   *        m x n, or n x m if transpose is set.
+   */
+  template <typename Dtype>
+  void Dequantize(const int m, const int first_row, const int n,
+      const int32_t* acc, bool transpose, Dtype* y) const;
+
+ private:
+  float input_scale_;
+  int input_zero_point_;
+  int groups_;
+  int rows_;
+  int cols_;
+  std::vector<int8_t> data_;
+  std::vector<float> scale_;
+  std::vector<int32_t> row_sum_;
+  // The rows of each group packed for caffe_cpu_gemm_u8s8s32's kernels,
+  // group_size_ bytes per group.
+  std::vector<int8_t> packed_;
+  size_t group_size_;
+
+  DISABLE_COPY_AND_ASSIGN(QuantizedWeights);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZE_HPP_
@@ -0,0 +1,90 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CAFFE_UTIL_SHARED_WORKSPACE_HPP_
+#define CAFFE_UTIL_SHARED_WORKSPACE_HPP_
+
+#include <cstddef>
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Host scratch memory shared by all the layers run by one thread.
+ *
+ * Layers such as BaseConvolutionLayer need large temporary buffers (the
+ * im2col columns of every OpenMP thread) only while they run. Since the
+ * layers of the nets of a thread never run concurrently, they can all use
+ * one buffer, sized to the largest request, instead of owning one each.
+ * Layers Reserve their size when reshaping and get the buffer with data()
+ * when they run, before entering any parallel region; its contents are
+ * undefined on entry and are overwritten by the next layer.
+ */
+class SharedWorkspace {
+ public:
+  /// @brief The workspace of the calling thread.
+  static SharedWorkspace& Get();
+
+  /// @brief Makes data() allocate at least size bytes from now on.
+  void Reserve(size_t size);
+  /**
+   * @brief Returns at least size bytes, valid until the next call of data()
+   *        that needs more memory.
+   */
+  void* data(size_t size);
+  /// @brief The bytes currently allocated.
+  size_t size() const { return memory_ ? memory_->size() : 0; }
+  /// @brief The largest size reserved or asked for so far.
+  size_t reserved() const { return reserved_; }
+  /// @brief Frees the memory, keeping the reserved size.
+  void Release() { memory_.reset(); }
+
+ private:
+  SharedWorkspace() : reserved_(0) {}
+
+  shared_ptr<SyncedMemory> memory_;
+  size_t reserved_;
+
+  DISABLE_COPY_AND_ASSIGN(SharedWorkspace);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SHARED_WORKSPACE_HPP_
@@ -0,0 +1,67 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_UTIL_TRANSFORM_ROW_HPP_
+#define CAFFE_UTIL_TRANSFORM_ROW_HPP_
+
+#include <stdint.h>
+
+namespace caffe {
+
+// Converts a row of width uint8 pixels to float as (src - mean) * scale and
+// writes it to dst, reversed if mirror is set. The mean is either per pixel,
+// aligned with src, or the constant mean_value when mean is NULL.
+typedef void (*TransformRowFunc)(const uint8_t* src, const float* mean,
+    float mean_value, float scale, int width, bool mirror, float* dst);
+
+void transform_row_scalar(const uint8_t* src, const float* mean,
+    float mean_value, float scale, int width, bool mirror, float* dst);
+#if defined __x86_64__ && defined __GNUC__
+#define CAFFE_TRANSFORM_ROW_X86
+void transform_row_avx2(const uint8_t* src, const float* mean,
+    float mean_value, float scale, int width, bool mirror, float* dst);
+void transform_row_avx512(const uint8_t* src, const float* mean,
+    float mean_value, float scale, int width, bool mirror, float* dst);
+#endif
+
+// The widest kernel supported by the running processor, see
+// cpu::getSupportedIsa().
+TransformRowFunc transform_row();
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TRANSFORM_ROW_HPP_
@@ -0,0 +1,91 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_UTIL_WINOGRAD_HPP_
+#define CAFFE_UTIL_WINOGRAD_HPP_
+
+#include <cstddef>
+
+namespace caffe {
+
+// Winograd minimal filtering F(m x m, 3x3) for 2D 3x3 convolutions with
+// stride 1 and no dilation (Lavin and Gray, "Fast Algorithms for
+// Convolutional Neural Networks"). The input is cut into overlapping
+// (m + 2) x (m + 2) tiles, each producing m x m outputs. Tiles and filters
+// are transformed so that the convolution becomes (m + 2)^2 independent
+// matrix products over the channels, whose results are transformed back.
+// m is 2 or 4.
+
+/// @brief The number of elements of the filters transformed for m.
+inline int winograd_filters_count(const int m, const int num_output,
+    const int channels, const int group) {
+  return (m + 2) * (m + 2) * num_output * (channels / group);
+}
+
+/**
+ * @brief Transforms num_output x (channels / group) x 3 x 3 filters for
+ *        winograd_conv_cpu.
+ *
+ * With backward set, the filters are flipped spatially and their input and
+ * output channels swapped, so that winograd_conv_cpu of the top diff with
+ * pad 2 - pad gives the bottom diff.
+ */
+template <typename Dtype>
+void winograd_transform_filters_cpu(const int m, const Dtype* weights,
+    const int num_output, const int channels, const int group,
+    const bool backward, Dtype* transformed);
+
+/// @brief The number of elements of workspace winograd_conv_cpu needs.
+size_t winograd_workspace_count(const int m, const int channels,
+    const int num_output, const int group, const int out_height,
+    const int out_width);
+
+/**
+ * @brief Convolves one channels x height x width image with 3x3 filters
+ *        transformed by winograd_transform_filters_cpu, writing
+ *        num_output x (height + 2 * pad_h - 2) x (width + 2 * pad_w - 2)
+ *        outputs. Runs on the calling thread.
+ */
+template <typename Dtype>
+void winograd_conv_cpu(const int m, const Dtype* data_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const Dtype* transformed, const int num_output, const int group,
+    Dtype* data_out, Dtype* workspace);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WINOGRAD_HPP_
@@ -35,6 +35,7 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
 #include <climits>
 #include <vector>
 
@@ -45,6 +46,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace caffe {
 
+// Bytes taken by one element of data held in the given storage type.
+template <typename Dtype>
+static size_t storage_size(StorageType storage) {
+  return storage == FLOAT32 ? sizeof(Dtype) : sizeof(uint16_t);
+}
+
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
     const int width) {
@@ -87,7 +94,7 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
   // requested count is bgger than current capacity
   if ( (actual_reshaping == true) || (count_ > capacity_) ) {
     capacity_ = count_;
-    data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    data_.reset(new SyncedMemory(capacity_ * storage_size<Dtype>(storage_)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
   }
 }
@@ -112,9 +119,9 @@ Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
 #ifdef DISTR_WEIGHT_UPDATE
-  : capacity_(0), owned_count_(0), owned_offset_(0) {
+  : capacity_(0), storage_(FLOAT32), owned_count_(0), owned_offset_(0) {
 #else
-  : capacity_(0) {
+  : capacity_(0), storage_(FLOAT32) {
 #endif
   Reshape(num, channels, height, width);
 }
@@ -123,9 +130,9 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
 #ifdef DISTR_WEIGHT_UPDATE
-  : capacity_(0), owned_count_(0), owned_offset_(0) {
+  : capacity_(0), storage_(FLOAT32), owned_count_(0), owned_offset_(0) {
 #else
-  : capacity_(0) {
+  : capacity_(0), storage_(FLOAT32) {
 #endif
 
   Reshape(shape);
@@ -139,18 +146,51 @@ const int* Blob<Dtype>::gpu_shape() const {
 }
 #endif
 
+template <typename Dtype>
+void Blob<Dtype>::set_storage(StorageType storage) {
+  if (storage == storage_) {
+    return;
+  }
+  CHECK_NE(storage, INT8) << "INT8 is only supported in BlobProto";
+  storage_ = storage;
+  if (data_) {
+    data_.reset(new SyncedMemory(capacity_ * storage_size<Dtype>(storage_)));
+  }
+}
+
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_data() const {
   CHECK(data_);
+  CHECK_EQ(storage_, FLOAT32) << "Data is held in 16 bits, see cpu_data16()";
   return (const Dtype*)data_->cpu_data();
 }
 
+template <typename Dtype>
+const uint16_t* Blob<Dtype>::cpu_data16() const {
+  CHECK(data_);
+  CHECK_NE(storage_, FLOAT32);
+  return static_cast<const uint16_t*>(data_->cpu_data());
+}
+
+template <typename Dtype>
+uint16_t* Blob<Dtype>::mutable_cpu_data16() {
+  CHECK(data_);
+  CHECK_NE(storage_, FLOAT32);
+  return static_cast<uint16_t*>(data_->mutable_cpu_data());
+}
+
 template <typename Dtype>
 void Blob<Dtype>::set_cpu_data(Dtype* data) {
   CHECK(data);
   data_->set_cpu_data(data);
 }
 
+template <typename Dtype>
+void Blob<Dtype>::set_cpu_data(Dtype* data, const shared_ptr<void>& owner) {
+  CHECK(data);
+  data_->set_cpu_data(data, owner);
+}
+
 template <typename Dtype>
 void Blob<Dtype>::set_cpu_diff(Dtype* diff) {
   CHECK(diff);
@@ -160,6 +200,7 @@ void Blob<Dtype>::set_cpu_diff(Dtype* diff) {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
+  CHECK_EQ(storage_, FLOAT32) << "16-bit storage is only supported on CPU";
   return (const Dtype*)data_->gpu_data();
 }
 
@@ -178,12 +219,14 @@ const Dtype* Blob<Dtype>::gpu_diff() const {
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_data() {
   CHECK(data_);
+  CHECK_EQ(storage_, FLOAT32) << "Data is held in 16 bits, see cpu_data16()";
   return static_cast<Dtype*>(data_->mutable_cpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_data() {
   CHECK(data_);
+  CHECK_EQ(storage_, FLOAT32) << "16-bit storage is only supported on CPU";
   return static_cast<Dtype*>(data_->mutable_gpu_data());
 }
 
@@ -253,6 +296,7 @@ shared_ptr<PrvMemDescr> Blob<Dtype>::get_prv_diff_descriptor() {
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  CHECK_EQ(storage_, other.storage());
   data_ = other.data();
 }
 
@@ -648,7 +692,22 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  if (proto.storage() == INT8) {
+    CHECK_EQ(count_, proto.packed_data().size());
+    CHECK_GT(proto.scale_size(), 0);
+    CHECK_EQ(count_ % proto.scale_size(), 0);
+    const int8_t* packed_vec =
+        reinterpret_cast<const int8_t*>(proto.packed_data().data());
+    const int slice_size = count_ / proto.scale_size();
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = packed_vec[i] * proto.scale(i / slice_size);
+    }
+  } else if (proto.storage() != FLOAT32) {
+    CHECK_EQ(count_ * sizeof(uint16_t), proto.packed_data().size());
+    caffe_cpu_unpack16(proto.storage(), count_,
+        reinterpret_cast<const uint16_t*>(proto.packed_data().data()),
+        data_vec);
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
@@ -714,6 +773,64 @@ void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
   }
 }
 
+template <typename Dtype>
+static void PackInt8(const int count, const int num_slices, const Dtype* data,
+    BlobProto* proto) {
+  string* packed = proto->mutable_packed_data();
+  packed->resize(count);
+  int8_t* packed_vec = reinterpret_cast<int8_t*>(&(*packed)[0]);
+  const int slice_size = count / num_slices;
+  for (int s = 0; s < num_slices; ++s) {
+    const Dtype* slice = data + s * slice_size;
+    Dtype max_abs = 0;
+    for (int i = 0; i < slice_size; ++i) {
+      max_abs = std::max(max_abs, static_cast<Dtype>(std::fabs(slice[i])));
+    }
+    const Dtype scale = max_abs > 0 ? max_abs / 127 : 1;
+    for (int i = 0; i < slice_size; ++i) {
+      packed_vec[s * slice_size + i] =
+          static_cast<int8_t>(std::floor(slice[i] / scale + Dtype(0.5)));
+    }
+    proto->add_scale(scale);
+  }
+}
+
+void PackBlobProto(StorageType storage, BlobProto* proto) {
+  CHECK_NE(storage, FLOAT32) << "Not a packed storage type";
+  CHECK_EQ(proto->storage(), FLOAT32) << "BlobProto is already packed";
+  const bool is_double = proto->double_data_size() > 0;
+  const int count = is_double ? proto->double_data_size() : proto->data_size();
+  if (storage == INT8) {
+    const bool legacy = !proto->has_shape();
+    const int num_axes = legacy ? 4 : proto->shape().dim_size();
+    const int num_slices = legacy ? proto->num() : proto->shape().dim(0);
+    if (num_axes < 2 || num_slices == 0) {
+      return;
+    }
+    proto->clear_scale();
+    if (is_double) {
+      PackInt8(count, num_slices, proto->double_data().data(), proto);
+    } else {
+      PackInt8(count, num_slices, proto->data().data(), proto);
+    }
+    proto->clear_data();
+    proto->clear_double_data();
+    proto->set_storage(storage);
+    return;
+  }
+  string* packed = proto->mutable_packed_data();
+  packed->resize(count * sizeof(uint16_t));
+  uint16_t* packed_vec = reinterpret_cast<uint16_t*>(&(*packed)[0]);
+  if (is_double) {
+    caffe_cpu_pack16(storage, count, proto->double_data().data(), packed_vec);
+  } else {
+    caffe_cpu_pack16(storage, count, proto->data().data(), packed_vec);
+  }
+  proto->clear_data();
+  proto->clear_double_data();
+  proto->set_storage(storage);
+}
+
 INSTANTIATE_CLASS(Blob);
 template class Blob<bool>;
 template class Blob<int>;
@@ -44,6 +44,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/data_reader.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#ifdef USE_SELF_MPI
+#include "caffe/util/mpi.hpp"
+#endif
 
 namespace caffe {
 
@@ -79,19 +82,19 @@ DataReader::~DataReader() {
 //
 
 DataReader::QueuePair::QueuePair(int size) {
-  // Initialize the free queue with requested number of datums
+  // Initialize the free queue with requested number of records
   for (int i = 0; i < size; ++i) {
-    free_.push(new string("empty buffer"));
+    free_.push(new Record());
   }
 }
 
 DataReader::QueuePair::~QueuePair() {
-  string* datum;
-  while (free_.try_pop(&datum)) {
-    delete datum;
+  Record* record;
+  while (free_.try_pop(&record)) {
+    delete record;
   }
-  while (full_.try_pop(&datum)) {
-    delete datum;
+  while (full_.try_pop(&record)) {
+    delete record;
   }
 }
 
@@ -100,6 +103,11 @@ DataReader::QueuePair::~QueuePair() {
 DataReader::Body::Body(const LayerParameter& param)
     : param_(param),
       new_queue_pairs_() {
+  CHECK(!param.data_param().zero_copy() ||
+        param.data_param().backend() == DataParameter_DB_LMDB ||
+        param.data_param().backend() == DataParameter_DB_PACKED)
+      << "Only LMDB and packed DBs support zero_copy";
+  CHECK_GE(param.data_param().reader_threads(), 1);
   StartInternalThread();
 }
 
@@ -111,12 +119,20 @@ void DataReader::Body::InternalThreadEntry() {
   const caffe::DataParameter *data_param = &param_.data_param();
   CHECK(data_param) << "Failed to obtain data_param";
 
-  shared_ptr<DBWrapper> dbw(data_param->shuffle() ?
-                        static_cast<DBWrapper*>(new DBShuffle(param_)):
-                        static_cast<DBWrapper*>(new DBSequential(param_)));
-
+  // With zero_copy the records in flight point into this DB's mapping, so
+  // it must outlive them. It does: it is only released when the body stops,
+  // which happens after the data layers owning the queues are gone.
+  shared_ptr<DBWrapper> dbw;
   vector<shared_ptr<QueuePair> > qps;
   try {
+    // Sharded readers block on their first record, so the body may be
+    // interrupted while this is still being set up.
+    vector<shared_ptr<DBWrapper> > parts = NewPartReaders(param_);
+    if (parts.size() > 1) {
+      dbw.reset(new DBSharded(param_, parts));
+    } else {
+      dbw = parts[0];
+    }
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
 
     // To ensure deterministic runs, only start running once all solvers
@@ -147,42 +163,192 @@ void DataReader::Body::read_one(DBWrapper* dbw, QueuePair* qp) {
   CHECK(dbw);
   CHECK(qp);
 
+  Record* record = qp->free_.pop();
+  dbw->Read(record);
+  qp->full_.push(record);
+
+  dbw->Next();
+}
+
+// Rank of this process among the ones reading the source, for partitioning.
+static void GetRank(int* rank, int* num_ranks) {
+#if defined(USE_MLSL)
+  *rank = MLSL::GetNodeId();
+  *num_ranks = MLSL::GetNumNodes();
+#elif defined(USE_SELF_MPI)
+  MPI_Comm_rank(MPI_COMM_WORLD, rank);
+  MPI_Comm_size(MPI_COMM_WORLD, num_ranks);
+#else
+  *rank = 0;
+  *num_ranks = 1;
+#endif
+}
+
+vector<shared_ptr<DataReader::DBWrapper> > DataReader::NewPartReaders(
+    const LayerParameter& param) {
+  int rank = 0;
+  int num_ranks = 1;
+  if (PartitionOf(param.data_param()) != DataParameter_Partition_NONE) {
+    GetRank(&rank, &num_ranks);
+  }
+  return NewPartReaders(param, rank, num_ranks);
+}
+
+DataParameter_Partition DataReader::PartitionOf(
+    const DataParameter& data_param) {
 #ifdef CAFFE_MLSL_SHUFFLE
-  string* data = qp->free_.pop();
-  static int mb=0;
-  if(!mb) { /* move each node’s file position to its node ID – this part can be move to the initialization */
-    for(int i=0;i<MLSL::GetNodeId();i++) {
-      dbw->Next();
+  // Single DB splitting used to have every node skip over the records of
+  // the others. Give each node its own key range instead.
+  if (!data_param.has_partition()) {
+    return DataParameter_Partition_CONTIGUOUS;
+  }
+#endif
+  return data_param.partition();
+}
+
+vector<shared_ptr<DataReader::DBWrapper> > DataReader::NewPartReaders(
+    const LayerParameter& param, int rank, int num_ranks) {
+  const DataParameter& data_param = param.data_param();
+  const DataParameter_Partition partition = PartitionOf(data_param);
+  const int num_threads = data_param.reader_threads();
+  const int num_slots = num_ranks * num_threads;
+  const int first_slot = rank * num_threads;
+
+  shared_ptr<db::DB> db(db::GetDB(data_param.backend()));
+  db->Open(data_param.source(), db::READ);
+  vector<shared_ptr<DBWrapper> > parts;
+  if (num_slots == 1) {
+    parts.push_back(shared_ptr<DBWrapper>(NewDBWrapper(param, db, KeyRange())));
+    return parts;
+  }
+  // Only keys are walked here, so other ranks' records are never read. All
+  // cursors are created on this thread, one read transaction each.
+  if (partition == DataParameter_Partition_HASHED) {
+    vector<KeyRange> blocks = SplitKeyRanges(db.get(), num_slots,
+                                             data_param.partition_blocks());
+    for (int i = 0; i < num_threads; ++i) {
+      parts.push_back(shared_ptr<DBWrapper>(
+          new DBPartitioned(param, db, blocks, first_slot + i, num_slots)));
+    }
+  } else {
+    vector<KeyRange> ranges = SplitKeyRanges(db.get(), num_slots, 1);
+    for (int i = 0; i < num_threads; ++i) {
+      parts.push_back(shared_ptr<DBWrapper>(
+          NewDBWrapper(param, db, ranges[first_slot + i])));
     }
-    mb = 1;
   }
-  *data = dbw->value();
-  qp->full_.push(data);
-  for(int i=0;i<MLSL::GetNumNodes();i++) {
-    dbw->Next();
+  if (partition != DataParameter_Partition_NONE) {
+    LOG(INFO) << "Rank " << rank << " of " << num_ranks << " reads its own "
+              << (partition == DataParameter_Partition_HASHED ?
+                  "blocks" : "key range") << " of " << data_param.source();
   }
-#else
-  string* data = qp->free_.pop();
-  // TODO deserialize in-place instead of copy?
-  *data = dbw->value();
-  qp->full_.push(data);
+  return parts;
+}
 
-  dbw->Next();
-#endif
+DataReader::DBWrapper* DataReader::NewDBWrapper(const LayerParameter& param,
+    shared_ptr<db::DB> db, const KeyRange& range) {
+  const DataParameter& data_param = param.data_param();
+  if (!data_param.shuffle()) {
+    return new DBSequential(param, db, range);
+  }
+  if (data_param.shuffle_block_size()) {
+    return new DBBlockShuffle(param, db, range);
+  }
+  return new DBShuffle(param, db, range);
 }
 
+vector<DataReader::KeyRange> DataReader::SplitKeyRanges(db::DB* db,
+    int num_slots, int blocks_per_slot) {
+  shared_ptr<db::Cursor> cursor(db->NewCursor());
+  // Backends that can seek by index give the keys at the range boundaries
+  // directly. Otherwise keep every stride-th key, doubling the stride and
+  // dropping every other sample whenever the sample fills up, so that
+  // sample[i] is always the key of record i * stride.
+  size_t count = 0;
+  const bool indexed = cursor->SeekToIndex(0) && db->Count(&count);
+  const size_t max_samples = 8192;
+  vector<string> samples;
+  size_t stride = 1;
+  if (!indexed) {
+    count = 0;
+    for (cursor->SeekToFirst(); cursor->valid(); cursor->Next(), ++count) {
+      if (count % stride == 0) {
+        samples.push_back(cursor->key());
+        if (samples.size() == max_samples) {
+          for (size_t i = 0; i < max_samples / 2; ++i) {
+            samples[i].swap(samples[2 * i]);
+          }
+          samples.resize(max_samples / 2);
+          stride *= 2;
+        }
+      }
+    }
+  }
+  // Every range must start at a distinct record.
+  const size_t num_starts = indexed ? count : samples.size();
+  CHECK_GE(num_starts, num_slots)
+      << "Too few records to split the source into " << num_slots << " parts";
+  if (num_starts < static_cast<size_t>(num_slots) * blocks_per_slot) {
+    const int fewer_blocks = num_starts / num_slots;
+    LOG(WARNING) << "Too few records to split the source into "
+                 << blocks_per_slot << " blocks for each of " << num_slots
+                 << " readers, using " << fewer_blocks << " blocks each";
+    blocks_per_slot = fewer_blocks;
+  }
+  const int num_ranges = num_slots * blocks_per_slot;
+
+  vector<KeyRange> ranges(num_ranges);
+  vector<size_t> offsets(num_ranges + 1, count);
+  for (int i = 0; i < num_ranges; ++i) {
+    if (indexed) {
+      offsets[i] = i * count / num_ranges;
+      CHECK(cursor->SeekToIndex(offsets[i]));
+      ranges[i].begin = cursor->key();
+    } else {
+      const size_t sample = i * samples.size() / num_ranges;
+      ranges[i].begin = samples[sample];
+      offsets[i] = sample * stride;
+    }
+  }
+  for (int i = 0; i < num_ranges; ++i) {
+    ranges[i].size = offsets[i + 1] - offsets[i];
+  }
+  return ranges;
+}
+
+DataReader::DBWrapper::DBWrapper(const LayerParameter& param,
+                                 shared_ptr<db::DB> db, const KeyRange& range)
+    : db(db), range_(range), zero_copy_(param.data_param().zero_copy()) {
+  if (!this->db) {
+    this->db.reset(db::GetDB(param.data_param().backend()));
+    this->db->Open(param.data_param().source(), db::READ);
+  }
+  cursor.reset(this->db->NewCursor());
+  if (range_.size) {
+    cursor->Seek(range_.begin);
+  }
+}
 
+DataReader::DBWrapper::DBWrapper(const LayerParameter& param)
+    : zero_copy_(param.data_param().zero_copy()) {
+}
 
-DataReader::DBWrapper::DBWrapper(const LayerParameter& param) {
-  db.reset(db::GetDB(param.data_param().backend()));
-  db->Open(param.data_param().source(), db::READ);
-  cursor.reset(db->NewCursor());
+void DataReader::DBWrapper::Read(Record* record) {
+  if (zero_copy_) {
+    std::pair<void*, size_t> value = valuePointer();
+    record->set_view(value.first, value.second);
+  } else {
+    record->set_value(value());
+  }
 }
 
-DataReader::DBShuffle::DBShuffle(const LayerParameter& param):DBWrapper(param) {
+DataReader::DBShuffle::DBShuffle(const LayerParameter& param,
+    shared_ptr<db::DB> db, const KeyRange& range)
+    : DBWrapper(param, db, range) {
   CHECK(param.data_param().backend() != DataParameter_DB_LEVELDB)
                                       << "LevelDB doesn't support shuffle";
-  while (cursor->valid()) {
+  while (cursor->valid() &&
+         (!range_.size || image_pointers_.size() < range_.size)) {
     image_pointers_.push_back(cursor->valuePointer());
     cursor->Next();
   }
@@ -212,12 +378,229 @@ void DataReader::DBShuffle::ShuffleImages() {
 
 void DataReader::DBSequential::Next() {
   cursor->Next();
-  if (!cursor->valid()) {
+  ++position_;
+  if (!cursor->valid() || position_ == range_.size) {
     DLOG(INFO) << "Restarting data prefetching from start.";
-    cursor->SeekToFirst();
+    if (range_.size) {
+      cursor->Seek(range_.begin);
+    } else {
+      cursor->SeekToFirst();
+    }
+    position_ = 0;
   }
 }
 
+DataReader::DBBlockShuffle::DBBlockShuffle(const LayerParameter& param,
+    shared_ptr<db::DB> db, const KeyRange& range)
+    : DBWrapper(param, db, range),
+      block_size_(param.data_param().shuffle_block_size()),
+      indexed_(false), num_records_(0), block_index_(0), position_(0),
+      current_(0) {
+  CHECK(param.data_param().backend() != DataParameter_DB_LEVELDB)
+                                      << "LevelDB doesn't support shuffle";
+  const size_t buffer_size = param.data_param().shuffle_buffer_size();
+  CHECK_GT(buffer_size, 0);
+  CHECK(cursor->valid());
+  const unsigned int prefetch_rng_seed = caffe_rng_rand();
+  prefetch_rng_.reset(new Caffe::RNG(prefetch_rng_seed));
 
+  block_keys_.push_back(cursor->key());
+  bool epoch_end = false;
+  while (buffer_.size() < buffer_size && !epoch_end) {
+    std::pair<void*, size_t> value;
+    epoch_end = ReadNext(&value);
+    buffer_.push_back(value);
+  }
+  current_ = Rand(buffer_.size());
+}
+
+void DataReader::DBBlockShuffle::Next() {
+  // Refill the slot just consumed and draw the next one.
+  ReadNext(&buffer_[current_]);
+  current_ = Rand(buffer_.size());
+}
+
+bool DataReader::DBBlockShuffle::ReadNext(std::pair<void*, size_t>* value) {
+  *value = cursor->valuePointer();
+  cursor->Next();
+  ++position_;
+  if (!indexed_) {
+    // The first epoch goes in key order, indexing the blocks on the way.
+    if (cursor->valid() && position_ != range_.size) {
+      if (position_ % block_size_ == 0) {
+        block_keys_.push_back(cursor->key());
+      }
+      return false;
+    }
+    indexed_ = true;
+    num_records_ = position_;
+    LOG(INFO) << "Indexed " << block_keys_.size() << " shuffle blocks of "
+              << block_size_ << " records";
+  } else {
+    const size_t block = block_order_[block_index_];
+    if (position_ < std::min(block_size_, num_records_ - block * block_size_)) {
+      return false;
+    }
+    if (++block_index_ < block_order_.size()) {
+      cursor->Seek(block_keys_[block_order_[block_index_]]);
+      position_ = 0;
+      return false;
+    }
+  }
+  StartEpoch();
+  return true;
+}
+
+void DataReader::DBBlockShuffle::StartEpoch() {
+  if (block_order_.empty()) {
+    for (int i = 0; i < block_keys_.size(); ++i) {
+      block_order_.push_back(i);
+    }
+  }
+  caffe::rng_t* prefetch_rng =
+      static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+  shuffle(block_order_.begin(), block_order_.end(), prefetch_rng);
+  block_index_ = 0;
+  position_ = 0;
+  cursor->Seek(block_keys_[block_order_[0]]);
+}
+
+int DataReader::DBBlockShuffle::Rand(int n) {
+  caffe::rng_t* prefetch_rng =
+      static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+  return (*prefetch_rng)() % n;
+}
+
+DataReader::DBPartitioned::DBPartitioned(const LayerParameter& param,
+    shared_ptr<db::DB> db, const vector<KeyRange>& blocks, int slot,
+    int num_slots)
+    : DBWrapper(param, db, KeyRange()), blocks_(blocks), slot_(slot),
+      num_slots_(num_slots), shuffle_(param.data_param().shuffle()),
+      seed_(param.data_param().partition_seed()), epoch_(0), block_index_(0),
+      position_(0) {
+  CHECK_EQ(blocks_.size() % num_slots_, 0);
+  CHECK(!shuffle_ || param.data_param().backend() != DataParameter_DB_LEVELDB)
+      << "LevelDB doesn't support shuffle";
+  // Only the order within blocks may differ between ranks, the way blocks
+  // are dealt must not.
+  const unsigned int prefetch_rng_seed = caffe_rng_rand();
+  prefetch_rng_.reset(new Caffe::RNG(prefetch_rng_seed));
+  StartEpoch();
+}
+
+void DataReader::DBPartitioned::StartEpoch() {
+  vector<int> order(blocks_.size());
+  for (int i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  Caffe::RNG epoch_rng(seed_ + epoch_);
+  shuffle(order.begin(), order.end(),
+          static_cast<caffe::rng_t*>(epoch_rng.generator()));
+  slot_blocks_.clear();
+  for (int i = slot_; i < order.size(); i += num_slots_) {
+    slot_blocks_.push_back(order[i]);
+  }
+  ++epoch_;
+  block_index_ = 0;
+  StartBlock();
+}
+
+void DataReader::DBPartitioned::StartBlock() {
+  const KeyRange& block = blocks_[slot_blocks_[block_index_]];
+  cursor->Seek(block.begin);
+  position_ = 0;
+  if (shuffle_) {
+    pointers_.clear();
+    for (size_t i = 0; i < block.size; ++i, cursor->Next()) {
+      pointers_.push_back(cursor->valuePointer());
+    }
+    caffe::rng_t* prefetch_rng =
+        static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+    shuffle(pointers_.begin(), pointers_.end(), prefetch_rng);
+  }
+}
+
+void DataReader::DBPartitioned::Next() {
+  ++position_;
+  if (position_ < blocks_[slot_blocks_[block_index_]].size) {
+    if (!shuffle_) {
+      cursor->Next();
+    }
+    return;
+  }
+  if (++block_index_ < slot_blocks_.size()) {
+    StartBlock();
+  } else {
+    StartEpoch();
+  }
+}
+
+DataReader::ShardReader::ShardReader(shared_ptr<DBWrapper> dbw,
+                                     int queue_size)
+    : queue_pair_(queue_size), dbw_(dbw) {
+  StartInternalThread();
+}
+
+DataReader::ShardReader::~ShardReader() {
+  StopInternalThread();
+}
+
+void DataReader::ShardReader::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      Record* record = queue_pair_.free_.pop();
+      dbw_->Read(record);
+      queue_pair_.full_.push(record);
+      dbw_->Next();
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+DataReader::DBSharded::DBSharded(const LayerParameter& param,
+    const vector<shared_ptr<DBWrapper> >& parts)
+    : DBWrapper(param),
+      round_robin_(param.data_param().reader_round_robin()),
+      current_shard_(0) {
+  const DataParameter& data_param = param.data_param();
+  const int num_shards = parts.size();
+  const int queue_size = std::max(1,
+      static_cast<int>(data_param.prefetch() * data_param.batch_size()) /
+      num_shards);
+  for (int i = 0; i < num_shards; ++i) {
+    shards_.push_back(shared_ptr<ShardReader>(
+        new ShardReader(parts[i], queue_size)));
+  }
+  LOG(INFO) << "Reading " << data_param.source() << " with " << num_shards
+            << " threads";
+  current_ = shards_[current_shard_]->queue_pair_.full_.pop();
+}
+
+DataReader::DBSharded::~DBSharded() {
+  // Stop the readers before their queues and cursors go away.
+  for (int i = 0; i < shards_.size(); ++i) {
+    shards_[i]->StopInternalThread();
+  }
+  shards_[current_shard_]->queue_pair_.free_.push(current_);
+}
+
+void DataReader::DBSharded::Next() {
+  const int num_shards = shards_.size();
+  shards_[current_shard_]->queue_pair_.free_.push(current_);
+  if (!round_robin_) {
+    // Take the first record ready after the current shard, so that a
+    // stalled shard does not hold the others back.
+    for (int i = 1; i <= num_shards; ++i) {
+      const int shard = (current_shard_ + i) % num_shards;
+      if (shards_[shard]->queue_pair_.full_.try_pop(&current_)) {
+        current_shard_ = shard;
+        return;
+      }
+    }
+  }
+  current_shard_ = (current_shard_ + 1) % num_shards;
+  current_ = shards_[current_shard_]->queue_pair_.full_.pop();
+}
 
 }  // namespace caffe
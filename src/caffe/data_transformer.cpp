@@ -47,10 +47,25 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/util/bbox_util.hpp"
 #include "caffe/util/im_transforms.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/transform_row.hpp"
 
 
 namespace caffe {
 
+template <typename Dtype>
+static void transform_uint8_row(const uint8_t* src, const Dtype* mean,
+    Dtype mean_value, Dtype scale, int width, bool mirror, Dtype* dst) {
+  for (int w = 0; w < width; ++w) {
+    const Dtype m = mean ? mean[w] : mean_value;
+    dst[mirror ? width - 1 - w : w] = (static_cast<Dtype>(src[w]) - m) * scale;
+  }
+}
+
+static void transform_uint8_row(const uint8_t* src, const float* mean,
+    float mean_value, float scale, int width, bool mirror, float* dst) {
+  transform_row()(src, mean, mean_value, scale, width, mirror, dst);
+}
+
 template<typename Dtype>
 DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
     Phase phase)
@@ -89,9 +104,17 @@ template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                          Dtype* transformed_data, 
                          NormalizedBBox* crop_bbox, RandNumbers& rand_num) {
-  const bool do_mirror = param_.mirror() && rand_num(2);
   const string& data = datum.data();
-  const bool has_uint8 = data.size() > 0;
+  Transform(datum, data.size() > 0 ? data.data() : NULL, transformed_data,
+            crop_bbox, rand_num);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const Datum& datum, const char* data,
+                         Dtype* transformed_data,
+                         NormalizedBBox* crop_bbox, RandNumbers& rand_num) {
+  const bool do_mirror = param_.mirror() && rand_num(2);
+  const bool has_uint8 = data != NULL;
   const bool has_mean_file = param_.has_mean_file();
   const bool has_mean_values = mean_values_.size() > 0;
 
@@ -101,41 +124,41 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 
   if (!has_uint8) {
     switch (transform_func_id) {
-        case 0: Transform<false, false, false, false>(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 1: Transform<false, false, false, true >(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 2: Transform<false, false, true , false>(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 3: Transform<false, false, true , true >(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 4: Transform<false, true , false, false>(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 5: Transform<false, true , false, true >(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 6: Transform<false, true , true , false>(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 7: Transform<false, true , true , true >(datum, transformed_data,
-          crop_bbox, rand_num); break;
+        case 0: Transform<false, false, false, false>(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 1: Transform<false, false, false, true >(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 2: Transform<false, false, true , false>(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 3: Transform<false, false, true , true >(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 4: Transform<false, true , false, false>(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 5: Transform<false, true , false, true >(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 6: Transform<false, true , true , false>(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 7: Transform<false, true , true , true >(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
     }
   } else {
     switch (transform_func_id) {
-        case 0: Transform<true, false, false, false>(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 1: Transform<true, false, false, true >(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 2: Transform<true, false, true , false>(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 3: Transform<true, false, true , true >(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 4: Transform<true, true , false, false>(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 5: Transform<true, true , false, true >(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 6: Transform<true, true , true , false>(datum, transformed_data,
-          crop_bbox, rand_num); break;
-        case 7: Transform<true, true , true , true >(datum, transformed_data,
-          crop_bbox, rand_num); break;
+        case 0: Transform<true, false, false, false>(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 1: Transform<true, false, false, true >(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 2: Transform<true, false, true , false>(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 3: Transform<true, false, true , true >(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 4: Transform<true, true , false, false>(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 5: Transform<true, true , false, true >(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 6: Transform<true, true , true , false>(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
+        case 7: Transform<true, true , true , true >(datum, data,
+          transformed_data, crop_bbox, rand_num); break;
     }
   }
 }
@@ -144,10 +167,10 @@ template<typename Dtype>
 template<bool has_uint8, bool do_mirror, bool has_mean_file,
   bool has_mean_values>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
+                                       const char* data,
                                        Dtype* transformed_data,
                                        NormalizedBBox* crop_bbox,
                                        RandNumbers& rand_num) {
-  const string& data = datum.data();
   const int datum_channels = datum.channels();
   const int datum_height = datum.height();
   const int datum_width = datum.width();
@@ -201,6 +224,23 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   crop_bbox->set_xmax(Dtype(w_off + width) / datum_width);
   crop_bbox->set_ymax(Dtype(h_off + height) / datum_height);
 
+  if (has_uint8) {
+    // Whole rows at a time, vectorized for float.
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(data);
+    for (int c = 0; c < datum_channels; ++c) {
+      const Dtype mean_value = has_mean_values ? mean_values_[c] : Dtype(0);
+      for (int h = 0; h < height; ++h) {
+        const int data_index =
+            (c * datum_height + h_off + h) * datum_width + w_off;
+        transform_uint8_row(pixels + data_index,
+                            has_mean_file ? mean + data_index : NULL,
+                            mean_value, scale, width, do_mirror,
+                            transformed_data + (c * height + h) * width);
+      }
+    }
+    return;
+  }
+
   Dtype datum_element;
   int top_index, data_index;
   for (int c = 0; c < datum_channels; ++c) {
@@ -212,12 +252,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
         } else {
           top_index = (c * height + h) * width + w;
         }
-        if (has_uint8) {
-          datum_element =
-            static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-        } else {
-          datum_element = datum.float_data(data_index);
-        }
+        datum_element = datum.float_data(data_index);
         if (has_mean_file) {
           transformed_data[top_index] =
             (datum_element - mean[data_index]) * scale;
@@ -277,6 +312,14 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
+  CheckTransformedShape(datum, transformed_blob);
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+  Transform(datum, transformed_data, crop_bbox, rand_num);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::CheckTransformedShape(const Datum& datum,
+                                       const Blob<Dtype>* transformed_blob) {
   const int crop_size = param_.crop_size();
   const int datum_channels = datum.channels();
   const int datum_height = datum.height();
@@ -300,9 +343,6 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     CHECK_EQ(datum_height, height);
     CHECK_EQ(datum_width, width);
   }
-
-  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  Transform(datum, transformed_data, crop_bbox, rand_num);
 }
 
 template<typename Dtype>
@@ -312,6 +352,18 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   Transform(datum, transformed_blob, &crop_bbox, rand_num);
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const Datum& datum, const char* data,
+                                       Blob<Dtype>* transformed_blob,
+                                       RandNumbers& rand_num) {
+  CHECK(!datum.encoded()) << "Pixel views can only hold raw uint8 data";
+  CHECK(data);
+  CheckTransformedShape(datum, transformed_blob);
+  NormalizedBBox crop_bbox;
+  Transform(datum, data, transformed_blob->mutable_cpu_data(), &crop_bbox,
+            rand_num);
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const vector<Datum> & datum_vector,
                                        Blob<Dtype>* transformed_blob) {
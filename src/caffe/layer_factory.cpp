@@ -48,6 +48,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/layers/batch_norm_layer.hpp"
 #include "caffe/layers/concat_layer.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/direct_conv_layer.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/layers/lrn_layer.hpp"
 #include "caffe/layers/pooling_layer.hpp"
@@ -118,18 +119,37 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
       engine = ConvolutionParameter_Engine_MKLDNN;
     }
 #endif
+    else if (ep.isEngine("DIRECT") && conv_param.kernel_size_size() <= 2 &&
+             conv_param.axis() == 1 && !conv_param.force_nd_im2col()) {
+      // Inputs that turn out not to be 2D once the bottom is known, e.g.
+      // with a single kernel_size, are convolved with im2col by the layer.
+      engine = ConvolutionParameter_Engine_DIRECT;
+    }
   }
 
   if (engine == ConvolutionParameter_Engine_DEFAULT) {
     engine = ConvolutionParameter_Engine_CAFFE;
 #ifdef USE_CUDNN
-    if (!use_dilation) {
+    // Only the CAFFE engine applies a fused ReLU.
+    if (!use_dilation && !conv_param.relu() && !conv_param.prelu()) {
       engine = ConvolutionParameter_Engine_CUDNN;
     }
 #endif
   }
+  // Only CAFFE and DIRECT apply a fused PReLU, and only they and MKLDNN a
+  // fused ReLU; the other engines would leave the output unactivated.
+  if (engine != ConvolutionParameter_Engine_CAFFE &&
+      engine != ConvolutionParameter_Engine_DIRECT &&
+      (conv_param.prelu() || (conv_param.relu() &&
+                              engine != ConvolutionParameter_Engine_MKLDNN))) {
+    LOG(INFO) << "Layer " << param.name() << " runs in the CAFFE engine to "
+              << "apply its fused " << (conv_param.prelu() ? "PReLU" : "ReLU");
+    engine = ConvolutionParameter_Engine_CAFFE;
+  }
   if (engine == ConvolutionParameter_Engine_CAFFE) {
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_DIRECT) {
+    return shared_ptr<Layer<Dtype> >(new DirectConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
     if (use_dilation) {
@@ -241,6 +261,14 @@ shared_ptr<Layer<Dtype> > GetPoolingLayer(const LayerParameter& param) {
     engine = PoolingParameter_Engine_CUDNN;
 #endif
   }
+  // Only Caffe's own pooling layer pools volumes. A 5-axis bottom pooled
+  // with the same kernel_size along each axis can only be told at setup,
+  // where the MKL layers reject it.
+  const PoolingParameter& pool_param = param.pooling_param();
+  if (pool_param.has_kernel_d() || pool_param.has_pad_d() ||
+      pool_param.has_stride_d()) {
+    engine = PoolingParameter_Engine_CAFFE;
+  }
   if (engine == PoolingParameter_Engine_CAFFE) {
     return shared_ptr<Layer<Dtype> >(new PoolingLayer<Dtype>(param));
 #ifdef USE_CUDNN
@@ -85,7 +85,7 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
 
   // Read a data point, and use it to initialize the top blob.
   AnnotatedDatum anno_datum;
-  anno_datum.ParseFromString(*(reader_.full().peek()));
+  reader_.full().peek()->ParseTo(&anno_datum);
 
   // Use data_transformer to infer the expected blob shape from anno_datum.
   vector<int> top_shape =
@@ -94,8 +94,8 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -139,8 +139,8 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
       label_shape[0] = batch_size;
     }
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
 }
@@ -163,11 +163,10 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       this->layer_param_.annotated_data_param();
   const TransformationParameter& transform_param =
     this->layer_param_.transform_param();
-  AnnotatedDatum anno_datum;
-  anno_datum.ParseFromString(*(reader_.full().peek()));
+  reader_.full().peek()->ParseTo(&anno_datum_);
   // Use data_transformer to infer the expected blob shape from anno_datum.
   vector<int> top_shape =
-      this->data_transformer_->InferBlobShape(anno_datum.datum());
+      this->data_transformer_->InferBlobShape(anno_datum_.datum());
   this->transformed_data_.Reshape(top_shape);
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
@@ -186,34 +185,34 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   for (int item_id = 0; item_id < batch_size; ++item_id) {
     timer.Start();
     // get a anno_datum
-    string* data = reader_.full().pop("Waiting for data");
-    AnnotatedDatum anno_datum;
-    anno_datum.ParseFromString(*data);
+    DataReader::Record* data = reader_.full().pop("Waiting for data");
+    // The datums are members, so that their buffers are reused.
+    data->ParseTo(&anno_datum_);
     reader_.free().push(data);
     read_time += timer.MicroSeconds();
     timer.Start();
-    AnnotatedDatum distort_datum;
     AnnotatedDatum* expand_datum = NULL;
     if (transform_param.has_distort_param()) {
-      distort_datum.CopyFrom(anno_datum);
-      this->data_transformer_->DistortImage(anno_datum.datum(),
-                                            distort_datum.mutable_datum());
+      distort_datum_.CopyFrom(anno_datum_);
+      this->data_transformer_->DistortImage(anno_datum_.datum(),
+                                            distort_datum_.mutable_datum());
       if (transform_param.has_expand_param()) {
-        expand_datum = new AnnotatedDatum();
-        this->data_transformer_->ExpandImage(distort_datum, expand_datum);
+        expand_datum_.Clear();
+        expand_datum = &expand_datum_;
+        this->data_transformer_->ExpandImage(distort_datum_, expand_datum);
       } else {
-        expand_datum = &distort_datum;
+        expand_datum = &distort_datum_;
       }
     } else {
       if (transform_param.has_expand_param()) {
-        expand_datum = new AnnotatedDatum();
-        this->data_transformer_->ExpandImage(anno_datum, expand_datum);
+        expand_datum_.Clear();
+        expand_datum = &expand_datum_;
+        this->data_transformer_->ExpandImage(anno_datum_, expand_datum);
       } else {
-        expand_datum = &anno_datum;
+        expand_datum = &anno_datum_;
       }
     }
     AnnotatedDatum* sampled_datum = NULL;
-    bool has_sampled = false;
     if (batch_samplers_.size() > 0) {
       // Generate sampled bboxes from expand_datum.
       vector<NormalizedBBox> sampled_bboxes;
@@ -221,11 +220,11 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       if (sampled_bboxes.size() > 0) {
         // Randomly pick a sampled bbox and crop the expand_datum.
         int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
-        sampled_datum = new AnnotatedDatum();
+        sampled_datum_.Clear();
+        sampled_datum = &sampled_datum_;
         this->data_transformer_->CropImage(*expand_datum,
                                            sampled_bboxes[rand_idx],
                                            sampled_datum);
-        has_sampled = true;
       } else {
         sampled_datum = expand_datum;
       }
@@ -290,13 +289,6 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       this->data_transformer_->Transform(sampled_datum->datum(),
                                          &(this->transformed_data_));
     }
-    // clear memory
-    if (has_sampled) {
-      delete sampled_datum;
-    }
-    if (transform_param.has_expand_param()) {
-      delete expand_datum;
-    }
     trans_time += timer.MicroSeconds();
   }
 
@@ -42,6 +42,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/shared_workspace.hpp"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -225,6 +226,12 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   weight_offset_ = conv_out_channels_ * kernel_dim_ / group_;
   // Propagate gradients to the parameters (as directed by backward pass).
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  if (this->phase_ == TEST && this->layer_param_.has_quantization_param() &&
+      this->AllowQuantization() &&
+      QuantizedWeights::Calibrated(this->layer_param_)) {
+    int8_weights_.reset(
+        new QuantizedWeights(this->layer_param_.quantization_param()));
+  }
 }
 
 template <typename Dtype>
@@ -309,10 +316,30 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 #endif
 
-  int col_buffer_mt_size = num_of_threads_ * col_buffer_.count();
-  int weight_diff_mt_size = num_of_threads_ * this->blobs_[0]->count();
-
-  col_buffer_mt_.resize(col_buffer_mt_size);
+  batch_images_ = batched_gemm_images();
+  // The batched GEMMs accumulate the weight diff directly.
+  int weight_diff_mt_size =
+      batch_images_ ? 0 : num_of_threads_ * this->blobs_[0]->count();
+
+  // The column buffers live in the workspace shared by all layers.
+  col_buffer_mt_ = NULL;
+  batch_output_ = NULL;
+  int8_col_mt_ = NULL;
+  int32_output_mt_ = NULL;
+  if (batch_images_) {
+    if (forward_uses_col_buffer() || this->phase_ == TRAIN) {
+      SharedWorkspace::Get().Reserve(sizeof(Dtype) * batch_images_ *
+          (col_buffer_.count() + conv_out_channels_ * conv_out_spatial_dim_));
+    }
+  } else {
+    const bool reserve_col_buffer = !is_1x1_ &&
+        (forward_uses_col_buffer() || this->phase_ == TRAIN);
+    if (reserve_col_buffer || int8_weights_) {
+      SharedWorkspace::Get().Reserve((reserve_col_buffer ?
+          sizeof(Dtype) * num_of_threads_ * col_buffer_.count() : 0)
+          + int8_workspace_size());
+    }
+  }
   weight_diff_mt_.resize(weight_diff_mt_size);
 
 #ifdef USE_MLSL
@@ -356,11 +383,11 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
   tid = tid % num_of_threads_;  //  just to be sure
 #endif
-  int col_data_buffer_size = col_buffer_mt_.size()/num_of_threads_;
 
   Dtype* col_buff = const_cast<Dtype*>(input);
   if (!is_1x1_) {
-    col_buff = & col_buffer_mt_[ tid* col_data_buffer_size];
+    CHECK(col_buffer_mt_) << "acquire_col_buffer_mt() not called";
+    col_buff = col_buffer_mt_ + tid * col_buffer_.count();
     if (!skip_im2col) {
       conv_im2col_cpu(input, col_buff);
     }
@@ -374,6 +401,51 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::quantize_weights_int8(const Dtype* weights) {
+  if (int8_weights_->empty()) {
+    int8_weights_->Quantize(conv_out_channels_, kernel_dim_, weights, false,
+        group_);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_int8_gemm(const Dtype* input,
+    Dtype* output) {
+  int tid = 0;
+#ifdef _OPENMP
+  tid = omp_get_thread_num();
+  if (tid >= num_of_threads_) {
+    LOG(FATAL) << "ConvLayer::forward_cpu_int8_gemm: omp_thread_num() ="
+               << tid << " > OMP_num_THREADS = " << num_of_threads_;
+  }
+  tid = tid % num_of_threads_;  //  just to be sure
+#endif
+
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    CHECK(col_buffer_mt_) << "acquire_col_buffer_mt() not called";
+    Dtype* thread_col_buff = col_buffer_mt_ + tid * col_buffer_.count();
+    conv_im2col_cpu(input, thread_col_buff);
+    col_buff = thread_col_buff;
+  }
+  // Padding is quantized with the columns, so it maps to the zero point.
+  // The columns are transposed on the way, so that the products of a group
+  // are computed as (output positions x kernel) * (channels x kernel)'.
+  const int group_out_channels = conv_out_channels_ / group_;
+  uint8_t* int8_col = int8_col_mt_ + tid * kernel_dim_ * conv_out_spatial_dim_;
+  int32_t* int32_output = int32_output_mt_ +
+      tid * group_out_channels * conv_out_spatial_dim_;
+  for (int g = 0; g < group_; ++g) {
+    int8_weights_->QuantizeInput(kernel_dim_, conv_out_spatial_dim_,
+        col_buff + col_offset_ * g, true, int8_col);
+    int8_weights_->Multiply(conv_out_spatial_dim_, group_out_channels * g,
+        group_out_channels, int8_col, int32_output);
+    int8_weights_->Dequantize(conv_out_spatial_dim_, group_out_channels * g,
+        group_out_channels, int32_output, true, output + output_offset_ * g);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -395,11 +467,10 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
   }
   tid = tid % num_of_threads_;  //  just to be sure
 #endif
-  int col_data_buffer_size = col_buffer_mt_.size()/num_of_threads_;
-  Dtype* col_buff = & col_buffer_mt_[ tid* col_data_buffer_size];
-
-  if (is_1x1_) {
-    col_buff = input;
+  Dtype* col_buff = input;
+  if (!is_1x1_) {
+    CHECK(col_buffer_mt_) << "acquire_col_buffer_mt() not called";
+    col_buff = col_buffer_mt_ + tid * col_buffer_.count();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
@@ -421,6 +492,49 @@ void BaseConvolutionLayer<Dtype>::clear_weight_mt(void) {
                &weight_diff_mt_[0]);
 }
 
+// Bytes of the quantized columns of all threads, rounded up so that the
+// int32 products after them start on a cache line.
+static size_t int8_col_size(int num_threads, int kernel_dim,
+    int spatial_dim) {
+  return (size_t(num_threads) * kernel_dim * spatial_dim + 63) / 64 * 64;
+}
+
+template <typename Dtype>
+size_t BaseConvolutionLayer<Dtype>::int8_workspace_size() const {
+  if (!int8_weights_) {
+    return 0;
+  }
+  return int8_col_size(num_of_threads_, kernel_dim_, conv_out_spatial_dim_) +
+      sizeof(int32_t) * num_of_threads_ * (conv_out_channels_ / group_) *
+      conv_out_spatial_dim_;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::acquire_col_buffer_mt(void) {
+  if (batch_images_) {
+    // One wide column matrix for all images, then their outputs.
+    col_buffer_mt_ = static_cast<Dtype*>(SharedWorkspace::Get().data(
+        sizeof(Dtype) * batch_images_ *
+        (col_buffer_.count() + conv_out_channels_ * conv_out_spatial_dim_)));
+    batch_output_ = col_buffer_mt_ + batch_images_ * col_buffer_.count();
+    return;
+  }
+  if (is_1x1_ && !int8_weights_) {
+    return;
+  }
+  const size_t col_size =
+      is_1x1_ ? 0 : sizeof(Dtype) * num_of_threads_ * col_buffer_.count();
+  char* workspace = static_cast<char*>(
+      SharedWorkspace::Get().data(col_size + int8_workspace_size()));
+  if (!is_1x1_) {
+    col_buffer_mt_ = reinterpret_cast<Dtype*>(workspace);
+  }
+  if (int8_weights_) {
+    int8_col_mt_ = reinterpret_cast<uint8_t*>(workspace + col_size);
+    int32_output_mt_ = reinterpret_cast<int32_t*>(workspace + col_size +
+        int8_col_size(num_of_threads_, kernel_dim_, conv_out_spatial_dim_));
+  }
+}
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::sum_weight_mt(Dtype* weight_diff) {
@@ -466,8 +580,8 @@ void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
   Dtype* col_buff = const_cast<Dtype*>(input);
 
   if (!is_1x1_) {
-    int col_data_buffer_size = col_buffer_mt_.size()/num_of_threads_;
-    col_buff = & col_buffer_mt_[ tid* col_data_buffer_size];
+    CHECK(col_buffer_mt_) << "acquire_col_buffer_mt() not called";
+    col_buff = col_buffer_mt_ + tid * col_buffer_.count();
     conv_im2col_cpu(input, col_buff);
   }
   for (int g = 0; g < group_; ++g) {
@@ -480,6 +594,141 @@ void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
 
 
 
+// AUTO batches the GEMMs of a layer when one image per thread leaves
+// threads idle, or when the product of an image and a group has fewer
+// outputs than this: such narrow GEMMs run far below the peak of the BLAS.
+static const int kMinPerImageGemmOutputs = 4096;
+
+template <typename Dtype>
+int BaseConvolutionLayer<Dtype>::batched_gemm_images() const {
+  const ConvolutionParameter_GemmBatching batching =
+      this->layer_param_.convolution_param().gemm_batching();
+  if (batching == ConvolutionParameter_GemmBatching_PER_IMAGE ||
+      !supports_batched_gemm() || int8_weights_ || force_nd_im2col_ ||
+      num_spatial_axes_ != 2) {
+    return 0;
+  }
+  int max_threads = 1;
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+#endif
+  const int gemm_outputs =
+      conv_out_channels_ / group_ * conv_out_spatial_dim_;
+  if (batching == ConvolutionParameter_GemmBatching_AUTO &&
+      num_ >= max_threads && gemm_outputs >= kMinPerImageGemmOutputs) {
+    return 0;
+  }
+  // As many images as the per-image path holds columns for, and enough
+  // for a wide GEMM.
+  const int wide_images =
+      (kMinPerImageGemmOutputs + gemm_outputs - 1) / gemm_outputs;
+  return std::min(num_, std::max(num_of_threads_, wide_images));
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::gather_batch_output(const Dtype* output,
+    int images) {
+  const int width = images * conv_out_spatial_dim_;
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(num_of_threads_)
+#endif
+  for (int n = 0; n < images; ++n) {
+    for (int c = 0; c < conv_out_channels_; ++c) {
+      caffe_copy(conv_out_spatial_dim_,
+          output + n * top_dim_ + c * conv_out_spatial_dim_,
+          batch_output_ + c * width + n * conv_out_spatial_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::scatter_batch_output(Dtype* output,
+    int images) {
+  const int width = images * conv_out_spatial_dim_;
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(num_of_threads_)
+#endif
+  for (int n = 0; n < images; ++n) {
+    for (int c = 0; c < conv_out_channels_; ++c) {
+      caffe_copy(conv_out_spatial_dim_,
+          batch_output_ + c * width + n * conv_out_spatial_dim_,
+          output + n * top_dim_ + c * conv_out_spatial_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_batched(
+    const Dtype* input, const Dtype* weights, Dtype* output, int images) {
+  CHECK(batch_output_) << "acquire_col_buffer_mt() not called";
+  CHECK_LE(images, batch_images_);
+  const int width = images * conv_out_spatial_dim_;
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(num_of_threads_)
+#endif
+  for (int n = 0; n < images; ++n) {
+    conv_im2col_cpu(input + n * bottom_dim_,
+        col_buffer_mt_ + n * conv_out_spatial_dim_, width);
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+        group_, width, kernel_dim_,
+        (Dtype)1., weights + weight_offset_ * g,
+        col_buffer_mt_ + col_offset_ * images * g,
+        (Dtype)0., batch_output_ + output_offset_ * images * g);
+  }
+  scatter_batch_output(output, images);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm_batched(
+    const Dtype* output, const Dtype* weights, Dtype* input, int images,
+    bool skip_gather) {
+  CHECK(batch_output_) << "acquire_col_buffer_mt() not called";
+  CHECK_LE(images, batch_images_);
+  const int width = images * conv_out_spatial_dim_;
+  if (!skip_gather) {
+    gather_batch_output(output, images);
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
+        width, conv_out_channels_ / group_,
+        (Dtype)1., weights + weight_offset_ * g,
+        batch_output_ + output_offset_ * images * g,
+        (Dtype)0., col_buffer_mt_ + col_offset_ * images * g);
+  }
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(num_of_threads_)
+#endif
+  for (int n = 0; n < images; ++n) {
+    conv_col2im_cpu(col_buffer_mt_ + n * conv_out_spatial_dim_,
+        input + n * bottom_dim_, width);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::weight_cpu_gemm_batched(
+    const Dtype* input, const Dtype* output, Dtype* weights, int images) {
+  CHECK(batch_output_) << "acquire_col_buffer_mt() not called";
+  CHECK_LE(images, batch_images_);
+  const int width = images * conv_out_spatial_dim_;
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(num_of_threads_)
+#endif
+  for (int n = 0; n < images; ++n) {
+    conv_im2col_cpu(input + n * bottom_dim_,
+        col_buffer_mt_ + n * conv_out_spatial_dim_, width);
+  }
+  gather_batch_output(output, images);
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ /
+        group_, kernel_dim_, width,
+        (Dtype)1., batch_output_ + output_offset_ * images * g,
+        col_buffer_mt_ + col_offset_ * images * g,
+        (Dtype)1., weights + weight_offset_ * g);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
     const Dtype* input) {
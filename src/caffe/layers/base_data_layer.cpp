@@ -36,8 +36,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "caffe/blob.hpp"
 #include "caffe/data_transformer.hpp"
 #include "caffe/internal_thread.hpp"
@@ -135,13 +140,63 @@ void BaseDataLayer<Dtype>::pack_buffer(FeatureMap *fm, Dtype *to, const Dtype *f
 
 #endif /* USE_MLSL */
 
+class PrefetchSequencer {
+ public:
+  PrefetchSequencer() : next_claim_(0), next_read_(0), next_delivery_(0) {}
+
+  uint64_t Claim() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return next_claim_++;
+  }
+  // Blocks until the batches claimed before sequence took their records.
+  void WaitForReadTurn(uint64_t sequence) {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (next_read_ != sequence) {
+      condition_.wait(lock);
+    }
+  }
+  void Read() {
+    boost::mutex::scoped_lock lock(mutex_);
+    ++next_read_;
+    condition_.notify_all();
+  }
+  // Blocks until the batches claimed before sequence were delivered.
+  void WaitForTurn(uint64_t sequence) {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (next_delivery_ != sequence) {
+      condition_.wait(lock);
+    }
+  }
+  void Delivered() {
+    boost::mutex::scoped_lock lock(mutex_);
+    ++next_delivery_;
+    condition_.notify_all();
+  }
+
+ private:
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  uint64_t next_claim_;
+  uint64_t next_read_;
+  uint64_t next_delivery_;
+};
+
+// Batches delivered between two reports of prefetch queue occupancy.
+static const int kOccupancyReportInterval = 1000;
+
 template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+      prefetch_free_(), prefetch_full_(),
+      prefetch_workers_(param.data_param().prefetch_workers()),
+      sequencer_(new PrefetchSequencer()),
+      occupancy_batches_(0), occupancy_ready_(0), occupancy_empty_(0) {
+  const int prefetch = param.data_param().prefetch();
+  CHECK_GT(prefetch, 0) << "prefetch must be positive";
+  for (int i = 0; i < prefetch; ++i) {
+    prefetch_.push_back(shared_ptr<Batch<Dtype> >(new Batch<Dtype>()));
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
@@ -153,18 +208,18 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
       }
     }
   }
@@ -173,15 +228,82 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   DLOG(INFO) << "Initializing prefetch";
   this->data_transformer_->InitRand();
 
-  // Only if GPU mode on then we use background threads
+  // In CPU mode batches are loaded in Forward unless workers were asked for,
+  // in GPU mode there is always at least one.
   if (Caffe::mode() == Caffe::GPU) {
+    prefetch_workers_ = std::max(prefetch_workers_, 1);
+  }
+  if (prefetch_workers_ > 1 && !ConcurrentLoadBatch()) {
+    LOG(WARNING) << this->type() << " layer " << this->layer_param_.name()
+                 << " loads batches on a single prefetch worker";
+    prefetch_workers_ = 1;
+  }
+  transform_contexts_.resize(std::max(prefetch_workers_, 1));
+  if (prefetch_workers_ > 0) {
     StartInternalThread();
   }
   DLOG(INFO) << "Prefetch initialized.";
 }
 
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::ReserveTransformContexts(int worker) {
+  // The thread limit is per thread, so this runs on the thread that is about
+  // to call load_batch.
+#ifdef _OPENMP
+  const int num_contexts = omp_get_max_threads();
+#else
+  const int num_contexts = 1;
+#endif
+  vector<shared_ptr<TransformContext<Dtype> > >& contexts =
+      transform_contexts_[worker];
+  while (contexts.size() < num_contexts) {
+    contexts.push_back(shared_ptr<TransformContext<Dtype> >(
+        new TransformContext<Dtype>()));
+  }
+}
+
+template <typename Dtype>
+TransformContext<Dtype>& BasePrefetchingDataLayer<Dtype>::transform_context(
+    const Batch<Dtype>& batch) {
+#ifdef _OPENMP
+  const int thread = omp_get_thread_num();
+#else
+  const int thread = 0;
+#endif
+  const vector<shared_ptr<TransformContext<Dtype> > >& contexts =
+      transform_contexts_[batch.worker_];
+  CHECK_LT(thread, contexts.size());
+  return *contexts[thread];
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::BeginReading(const Batch<Dtype>& batch) {
+  if (prefetch_workers_ > 1) {
+    sequencer_->WaitForReadTurn(batch.sequence_);
+  }
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::EndReading() {
+  if (prefetch_workers_ > 1) {
+    sequencer_->Read();
+  }
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
+  // This thread is worker 0 and owns the others, so that stopping it stops
+  // them all before the layer goes away.
+  vector<shared_ptr<PrefetchWorker> > workers;
+  for (int i = 1; i < prefetch_workers_; ++i) {
+    workers.push_back(shared_ptr<PrefetchWorker>(new PrefetchWorker(this, i)));
+    workers.back()->StartInternalThread();
+  }
+  PrefetchLoop(0);
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::PrefetchLoop(int worker) {
 #ifndef CPU_ONLY
   cudaStream_t stream;
   if (Caffe::mode() == Caffe::GPU) {
@@ -190,8 +312,13 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 
   try {
-    while (!must_stop()) {
+    while (!boost::this_thread::interruption_requested()) {
+      // A batch is taken before its place in delivery order, so that the
+      // worker whose turn it is never waits for a free batch.
       Batch<Dtype>* batch = prefetch_free_.pop();
+      batch->sequence_ = sequencer_->Claim();
+      batch->worker_ = worker;
+      ReserveTransformContexts(worker);
       load_batch(batch);
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
@@ -199,7 +326,9 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
 #endif
+      sequencer_->WaitForTurn(batch->sequence_);
       prefetch_full_.push(batch);
+      sequencer_->Delivered();
     }
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
@@ -216,6 +345,8 @@ template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::GetBatch() {
   try {
       Batch<Dtype>* batch = prefetch_free_.pop();
+      batch->worker_ = 0;
+      ReserveTransformContexts(0);
       load_batch(batch);
       prefetch_full_.push(batch);
   } catch (boost::thread_interrupted&) {
@@ -223,14 +354,36 @@ void BasePrefetchingDataLayer<Dtype>::GetBatch() {
   }
 }
 
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::NextBatch() {
+  if (prefetch_workers_ > 0) {
+    // A queue that is mostly full means the net is the bottleneck, one that
+    // is often empty means the loader is.
+    const int ready = prefetch_full_.size();
+    occupancy_ready_ += ready;
+    occupancy_empty_ += (ready == 0);
+    if (++occupancy_batches_ == kOccupancyReportInterval) {
+      LOG(INFO) << "Prefetch queue of " << this->layer_param_.name() << ": "
+                << static_cast<float>(occupancy_ready_) / occupancy_batches_
+                << " of " << prefetch_.size() << " batches ready on average, "
+                << "none ready for " << occupancy_empty_ << " of "
+                << occupancy_batches_ << " batches";
+      occupancy_batches_ = 0;
+      occupancy_ready_ = 0;
+      occupancy_empty_ = 0;
+    }
+  }
+  return prefetch_full_.pop("Data layer prefetch queue empty");
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  // Here for CPU we do transformation
-  if (Caffe::mode() == Caffe::CPU) {
+  // Without prefetch workers, the batch is loaded here.
+  if (prefetch_workers_ == 0) {
     this->GetBatch();
   }
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = NextBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
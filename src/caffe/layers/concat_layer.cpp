@@ -42,6 +42,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include "caffe/layers/concat_layer.hpp"
+#include "caffe/util/blob_storage.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -141,6 +142,10 @@ template <typename Dtype>
 void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   if (bottom.size() == 1) { return; }
+  if (HasReducedStorage(bottom) || HasReducedStorage(top)) {
+    Forward_reduced_cpu(bottom, top);
+    return;
+  }
   Dtype* top_data = top[0]->mutable_cpu_data();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
@@ -186,6 +191,28 @@ void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
 }
 
+template <typename Dtype>
+void ConcatLayer<Dtype>::Forward_reduced_cpu(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const BlobDataWriter<Dtype> top_data(top[0]);
+  int offset_concat_axis = 0;
+  const int top_concat_axis = top[0]->shape(concat_axis_);
+  for (int i = 0; i < bottom.size(); ++i) {
+    const BlobDataReader<Dtype> bottom_data(*bottom[i]);
+    const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
+    const int offset_value = offset_concat_axis;
+    offset_concat_axis += bottom_concat_axis;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+    for (int n = 0; n < num_concats_; ++n) {
+      top_data.Copy((n * top_concat_axis + offset_value) * concat_input_size_,
+          bottom_data, n * bottom_concat_axis * concat_input_size_,
+          bottom_concat_axis * concat_input_size_);
+    }
+  }
+}
+
 #ifdef CPU_ONLY
 STUB_GPU(ConcatLayer);
 #endif
@@ -35,6 +35,7 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
 #include <vector>
 #ifdef _OPENMP
 #include <omp.h>
@@ -42,9 +43,166 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/shared_workspace.hpp"
+#include "caffe/util/winograd.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  // The base layer sets up the weights and the bias only.
+  shared_ptr<Blob<Dtype> > slopes;
+  if (conv_param.prelu() &&
+      this->blobs_.size() == 2 + conv_param.bias_term()) {
+    slopes = this->blobs_.back();
+    this->blobs_.pop_back();
+  }
+  BaseConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  fused_relu_ = conv_param.relu() || conv_param.prelu();
+  negative_slope_ = conv_param.negative_slope();
+  if (conv_param.prelu()) {
+    const vector<int> slopes_shape(1, this->num_output_);
+    if (slopes) {
+      CHECK(slopes->shape() == slopes_shape)
+          << "Incorrect shape of the PReLU slopes of layer "
+          << this->layer_param_.name();
+    } else {
+      // The default of PReLUParameter.filler.
+      slopes.reset(new Blob<Dtype>(slopes_shape));
+      caffe_set(slopes->count(), Dtype(0.25), slopes->mutable_cpu_data());
+    }
+    this->blobs_.push_back(slopes);
+    this->param_propagate_down_.resize(this->blobs_.size(), true);
+  }
+  winograd_tile_ = 0;
+  const ConvolutionParameter_Algorithm algorithm =
+      this->layer_param_.convolution_param().algorithm();
+  if (algorithm == ConvolutionParameter_Algorithm_IM2COL) {
+    return;
+  }
+  bool supported = this->num_spatial_axes_ == 2 && !this->force_nd_im2col_ &&
+      !this->int8_weights_;
+  for (int i = 0; supported && i < this->num_spatial_axes_; ++i) {
+    supported = this->kernel_shape_.cpu_data()[i] == 3 &&
+        this->stride_.cpu_data()[i] == 1 &&
+        this->dilation_.cpu_data()[i] == 1 && this->pad_.cpu_data()[i] <= 2;
+  }
+  if (!supported) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " convolves with "
+              << "im2col: Winograd needs a 2D 3x3 kernel, stride 1, no "
+              << "dilation, pad <= 2 and no quantization";
+    return;
+  }
+  winograd_tile_ =
+      algorithm == ConvolutionParameter_Algorithm_WINOGRAD_2X2 ? 2 : 4;
+  vector<int> weights_shape(1, winograd_filters_count(winograd_tile_,
+      this->num_output_, this->channels_, this->group_));
+  winograd_weights_.Reshape(weights_shape);
+  winograd_back_weights_.Reshape(weights_shape);
+  winograd_weights_version_ = 0;
+  winograd_back_weights_version_ = 0;
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  BaseConvolutionLayer<Dtype>::Reshape(bottom, top);
+  winograd_buffer_mt_ = NULL;
+  if (!winograd_tile_) {
+    return;
+  }
+  const size_t forward_count = winograd_workspace_count(winograd_tile_,
+      this->channels_, this->num_output_, this->group_,
+      this->output_shape_[0], this->output_shape_[1]);
+  const size_t backward_count = winograd_workspace_count(winograd_tile_,
+      this->num_output_, this->channels_, this->group_,
+      this->input_shape(1), this->input_shape(2));
+  winograd_buffer_count_ = std::max(forward_count, backward_count);
+  SharedWorkspace::Get().Reserve(sizeof(Dtype) * this->num_of_threads_ *
+      (this->phase_ == TRAIN ? winograd_buffer_count_ : forward_count));
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::transform_winograd_weights(bool backward) {
+  uint64_t* version = backward ?
+      &winograd_back_weights_version_ : &winograd_weights_version_;
+  if (*version == this->blobs_[0]->data_version()) {
+    return;
+  }
+  Blob<Dtype>* transformed =
+      backward ? &winograd_back_weights_ : &winograd_weights_;
+  winograd_transform_filters_cpu(winograd_tile_, this->blobs_[0]->cpu_data(),
+      this->num_output_, this->channels_, this->group_, backward,
+      transformed->mutable_cpu_data());
+  *version = this->blobs_[0]->data_version();
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::acquire_winograd_buffer_mt() {
+  winograd_buffer_mt_ = static_cast<Dtype*>(SharedWorkspace::Get().data(
+      sizeof(Dtype) * this->num_of_threads_ * winograd_buffer_count_));
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_winograd(const Dtype* input,
+    Dtype* output) {
+  int tid = 0;
+#ifdef _OPENMP
+  tid = omp_get_thread_num();
+  if (tid >= this->num_of_threads_) {
+    LOG(FATAL) << "ConvLayer::Forward_cpu: omp_thread_num() =" << tid
+               << " > OMP_num_THREADS = " << this->num_of_threads_;
+  }
+#endif
+  CHECK(winograd_buffer_mt_) << "acquire_winograd_buffer_mt() not called";
+  winograd_conv_cpu(winograd_tile_, input, this->channels_,
+      this->input_shape(1), this->input_shape(2),
+      this->pad_.cpu_data()[0], this->pad_.cpu_data()[1],
+      winograd_weights_.cpu_data(), this->num_output_, this->group_, output,
+      winograd_buffer_mt_ + tid * winograd_buffer_count_);
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_cpu_winograd(const Dtype* output,
+    Dtype* input) {
+  int tid = 0;
+#ifdef _OPENMP
+  tid = omp_get_thread_num();
+  if (tid >= this->num_of_threads_) {
+    LOG(FATAL) << "ConvLayer::Backward_cpu: omp_thread_num() =" << tid
+               << " > OMP_num_THREADS = " << this->num_of_threads_;
+  }
+#endif
+  CHECK(winograd_buffer_mt_) << "acquire_winograd_buffer_mt() not called";
+  // The bottom diff is the full convolution of the top diff with the
+  // flipped filters: pad so that the output has the size of the input.
+  winograd_conv_cpu(winograd_tile_, output, this->num_output_,
+      this->output_shape_[0], this->output_shape_[1],
+      2 - this->pad_.cpu_data()[0], 2 - this->pad_.cpu_data()[1],
+      winograd_back_weights_.cpu_data(), this->channels_, this->group_,
+      input, winograd_buffer_mt_ + tid * winograd_buffer_count_);
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_bias_relu(Dtype* output) {
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const Dtype* slopes = relu_slopes();
+  const int spatial_dim = this->out_spatial_dim_;
+  for (int c = 0; c < this->num_output_; ++c) {
+    const Dtype b = bias ? bias[c] : Dtype(0);
+    const Dtype slope = slopes ? slopes[c] : negative_slope_;
+    Dtype* out = output + c * spatial_dim;
+    for (int j = 0; j < spatial_dim; ++j) {
+      const Dtype value = out[j] + b;
+      out[j] = value > 0 ? value : value * slope;
+    }
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::compute_output_shape() {
   const int* kernel_shape_data = this->kernel_shape_.cpu_data();
@@ -66,20 +224,60 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  if (winograd_tile_) {
+    transform_winograd_weights(false);
+    acquire_winograd_buffer_mt();
+  } else {
+    this->acquire_col_buffer_mt();
+  }
+  if (this->int8_weights_) {
+    this->quantize_weights_int8(weight);
+  }
   // If we have more threads available than batches to be prcessed then
   // we are wasting resources (lower batches than 36 on XeonE5)
   // So we instruct MKL
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
+    if (this->batch_images_) {
+      for (int n = 0; n < this->num_; n += this->batch_images_) {
+        this->forward_cpu_gemm_batched(bottom_data + n*this->bottom_dim_,
+            weight, top_data + n*this->top_dim_,
+            std::min(this->batch_images_, this->num_ - n));
+      }
+      if (fused_relu_ || this->bias_term_) {
+#ifdef _OPENMP
+        #pragma omp parallel for num_threads(this->num_of_threads_)
+#endif
+        for (int n = 0; n < this->num_; ++n) {
+          if (fused_relu_) {
+            forward_cpu_bias_relu(top_data + n * this->top_dim_);
+          } else {
+            this->forward_cpu_bias(top_data + n * this->top_dim_,
+                                   this->blobs_[1]->cpu_data());
+          }
+        }
+      }
+      continue;
+    }
 #ifdef _OPENMP
     #pragma omp parallel for num_threads(this->num_of_threads_)
 #endif
       for (int n = 0; n < this->num_; ++n) {
-        this->forward_cpu_gemm(bottom_data + n*this->bottom_dim_,
-                               weight,
+        if (this->int8_weights_) {
+          this->forward_cpu_int8_gemm(bottom_data + n*this->bottom_dim_,
+                                      top_data + n*this->top_dim_);
+        } else if (winograd_tile_) {
+          forward_cpu_winograd(bottom_data + n*this->bottom_dim_,
                                top_data + n*this->top_dim_);
-        if (this->bias_term_) {
+        } else {
+          this->forward_cpu_gemm(bottom_data + n*this->bottom_dim_,
+                                 weight,
+                                 top_data + n*this->top_dim_);
+        }
+        if (fused_relu_) {
+          forward_cpu_bias_relu(top_data + n * this->top_dim_);
+        } else if (this->bias_term_) {
           const Dtype* bias = this->blobs_[1]->cpu_data();
           this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
         }
@@ -90,8 +288,13 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!fused_relu_) << "Layer " << this->layer_param_.name()
+                      << " applies its ReLU for inference only";
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  if (winograd_tile_) {
+    transform_winograd_weights(true);
+  }
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
@@ -104,12 +307,38 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       }
     }
 
+    // The batched GEMMs accumulate the weight diff of several images at
+    // once; the top diff they gathered is reused for the bottom diff.
+    if (this->batch_images_) {
+      if (!this->param_propagate_down_[0] && !propagate_down[i]) {
+        continue;
+      }
+      this->acquire_col_buffer_mt();
+      for (int n = 0; n < this->num_; n += this->batch_images_) {
+        const int images = std::min(this->batch_images_, this->num_ - n);
+        if (this->param_propagate_down_[0]) {
+          this->weight_cpu_gemm_batched(bottom_data + n * this->bottom_dim_,
+              top_diff + n * this->top_dim_, weight_diff, images);
+        }
+        if (propagate_down[i]) {
+          this->backward_cpu_gemm_batched(top_diff + n * this->top_dim_,
+              weight, bottom_diff + n * this->bottom_dim_, images,
+              this->param_propagate_down_[0]);
+        }
+      }
+      continue;
+    }
+
     // OpenMP path is using bigger separate buffer to accumulate
     // weight diffs, which are lateron add to weight_diff
     // so bigger buffer (weight_diff_mt) hase to be cleared out
     // before GEMM ops and results has to be summed up after GEMM ops.
 
+    // The weight gradient always goes through the column buffers; the
+    // Winograd buffers share the workspace with them, so each loop gets
+    // its own.
     if (this->param_propagate_down_[0]) {
+      this->acquire_col_buffer_mt();
 #ifdef _OPENMP
       this->clear_weight_mt();
       #pragma omp parallel num_threads(this->num_of_threads_)
@@ -131,13 +360,23 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     }
 
     if (propagate_down[i]) {
+      if (winograd_tile_) {
+        acquire_winograd_buffer_mt();
+      } else {
+        this->acquire_col_buffer_mt();
+      }
 #ifdef _OPENMP
       #pragma omp parallel for num_threads(this->num_of_threads_)
 #endif
         for (int n = 0; n < this->num_; ++n) {
           // gradient w.r.t. bottom data, if necessary.
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
+          if (winograd_tile_) {
+            backward_cpu_winograd(top_diff + n * this->top_dim_,
+                bottom_diff + n * this->bottom_dim_);
+          } else {
+            this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+                bottom_diff + n * this->bottom_dim_);
+          }
         }
     }
   }
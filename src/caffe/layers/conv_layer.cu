@@ -4,6 +4,17 @@
 
 namespace caffe {
 
+template <typename Dtype>
+__global__ void ConvReLUForward(const int n, const int channels,
+    const int spatial_dim, const Dtype* slopes, const Dtype negative_slope,
+    Dtype* out) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int c = (index / spatial_dim) % channels;
+    const Dtype slope = slopes ? slopes[c] : negative_slope;
+    out[index] = out[index] > 0 ? out[index] : out[index] * slope;
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -19,12 +30,25 @@ void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
         this->forward_gpu_bias(top_data + n * this->top_dim_, bias);
       }
     }
+    if (fused_relu_) {
+      const Dtype* slopes = this->layer_param_.convolution_param().prelu() ?
+          this->blobs_.back()->gpu_data() : NULL;
+      const int count = top[i]->count();
+      // NOLINT_NEXT_LINE(whitespace/operators)
+      ConvReLUForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+          CAFFE_CUDA_NUM_THREADS>>>(
+          count, this->num_output_, this->out_spatial_dim_, slopes,
+          negative_slope_, top_data);
+      CUDA_POST_KERNEL_CHECK;
+    }
   }
 }
 
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!fused_relu_) << "Layer " << this->layer_param_.name()
+                      << " applies its ReLU for inference only";
   const Dtype* weight = this->blobs_[0]->gpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_gpu_diff();
   for (int i = 0; i < top.size(); ++i) {
@@ -45,6 +45,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
 //#include "caffe/solver.hpp"
 
 namespace caffe {
@@ -66,7 +67,7 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int batch_size = this->layer_param_.data_param().batch_size();
   // Read a data point, and use it to initialize the top blob.
   Datum datum;
-  datum.ParseFromString(*(reader_.full().peek()));
+  ParseShape(*reader_.full().peek(), &datum);
 
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
@@ -75,8 +76,8 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   top_shape[0] = batch_size;
 
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -85,12 +86,23 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
 }
 
+template <typename Dtype>
+void DataLayer<Dtype>::ParseShape(const DataReader::Record& record,
+                                  Datum* datum) {
+  // Only the shape is needed here, so skip copying raw pixels when possible.
+  const char* pixels;
+  if (!this->layer_param_.data_param().zero_copy() ||
+      !ParseDatumView(record.data(), record.size(), datum, &pixels)) {
+    record.ParseTo(datum);
+  }
+}
+
 // This function is called on prefetch thread
 template<typename Dtype>
 void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
@@ -102,20 +114,27 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CPUTimer trans_timer;
   CHECK(batch->data_.count());
 
-#ifndef _OPENMP
-  CHECK(this->transformed_data_.count());
-#endif
-
   // Reshape according to the first datum of each batch
   // on single input batches allows for inputs of varying dimension.
   const int batch_size = this->layer_param_.data_param().batch_size();
+  const bool zero_copy = this->layer_param_.data_param().zero_copy();
+  // Other prefetch workers may be popping records too, so the records of
+  // the batch and their random numbers are all taken in this batch's turn.
+  vector<DataReader::Record*> records(batch_size);
+  vector<PreclcRandomNumbers> rand_numbers(batch_size);
+  timer.Start();
+  this->BeginReading(*batch);
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    records[item_id] = reader_.full().pop("Waiting for data");
+    this->data_transformer_->GenerateRandNumbers(rand_numbers[item_id]);
+  }
+  this->EndReading();
+  timer.Stop();
+  read_time += timer.MicroSeconds();
   Datum datum;
-  datum.ParseFromString(*(reader_.full().peek()));
+  ParseShape(*records[0], &datum);
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-#ifndef _OPENMP
-  this->transformed_data_.Reshape(top_shape);
-#endif
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
@@ -133,45 +152,42 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   #pragma omp single nowait
 #endif
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
-    // get a datum
-    string* data = (reader_.full().pop("Waiting for data"));
-    timer.Stop();
-    read_time += timer.MicroSeconds();
+    DataReader::Record* data = records[item_id];
     // Apply data transformations (mirror, scale, crop...)
-    int offset = batch->data_.offset(item_id);
 
 #ifdef _OPENMP
-    PreclcRandomNumbers precalculated_rand_numbers;
-    this->data_transformer_->GenerateRandNumbers(precalculated_rand_numbers);
-    #pragma omp task firstprivate(offset, precalculated_rand_numbers, data, item_id)
+    #pragma omp task firstprivate(data, item_id)
 #endif
     {
-      Datum datum;
-      datum.ParseFromString(*data);
+      // The datum and the view into the batch are reused by this thread.
+      TransformContext<Dtype>& context = this->transform_context(*batch);
+      Datum& datum = context.datum_;
+      // With zero_copy the pixels stay in the DB mapping, not in the record,
+      // so the record can be recycled right away in either case.
+      const char* pixels = NULL;
+      if (!zero_copy ||
+          !ParseDatumView(data->data(), data->size(), &datum, &pixels)) {
+        data->ParseTo(&datum);
+      }
       (reader_.free()).push(data);  
       // Copy label. We need to copy it before we release datum
       if (this->output_labels_) {
         top_label[item_id] = datum.label();
       }
-#ifdef _OPENMP
-      Blob<Dtype> tmp_data;
-      tmp_data.Reshape(top_shape);
-      tmp_data.set_cpu_data(top_data + offset);
-      this->data_transformer_->Transform(datum, &tmp_data,
-                                              precalculated_rand_numbers);
-#else
-      this->transformed_data_.set_cpu_data(top_data + offset);
-      this->data_transformer_->Transform(datum, &(this->transformed_data_));
-#endif
+      context.SetItem(batch->data_, top_data, item_id);
+      if (pixels) {
+        this->data_transformer_->Transform(datum, pixels, &context.view_,
+                                           rand_numbers[item_id]);
+      } else {
+        this->data_transformer_->Transform(datum, &context.view_,
+                                           rand_numbers[item_id]);
+      }
     }
   }
   trans_timer.Stop();
   batch_timer.Stop();
-  // Due to multithreaded nature of transformation,
-  // time it takes to execute them we get from subtracting
-  // read batch of images time from total batch read&transform time
-  trans_time = trans_timer.MicroSeconds() - read_time;
+  // The records were all read before the transformations started.
+  trans_time = trans_timer.MicroSeconds();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
@@ -0,0 +1,421 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/util/cpu_info.hpp"
+#include "caffe/util/shared_workspace.hpp"
+
+#if defined __x86_64__ && defined __GNUC__
+#define CAFFE_DIRECT_CONV_X86
+#include <immintrin.h>
+#endif
+
+namespace caffe {
+
+namespace {
+
+// Output pixels of a row computed at once, each in one vector register per
+// block of output channels.
+const int kTileWidth = 8;
+
+// Where a tile kernel finds its operands. Strides are in elements.
+struct DirectConvArgs {
+  int in_blocks;     // input channel blocks
+  int block;         // channels per block
+  int kernel_h;
+  int kernel_w;
+  int plane_stride;  // between input channel blocks
+  int tap_h_stride;  // between filter rows, dilation included
+  int tap_w_stride;  // between filter columns, dilation included
+  int pixel_stride;  // between output pixels, stride included
+};
+
+// Computes count output pixels x block output channels into tile (pixel
+// major), from the blocked input at the first tap of the first pixel and
+// the blocked filters of the output channel block.
+template <typename Dtype>
+struct DirectTileFunc {
+  typedef void (*Type)(const Dtype* input, const Dtype* weights,
+      const DirectConvArgs& args, int count, Dtype* tile);
+};
+
+template <typename Dtype>
+void direct_tile_scalar(const Dtype* input, const Dtype* weights,
+    const DirectConvArgs& args, int count, Dtype* tile) {
+  const int block = args.block;
+  std::fill(tile, tile + count * block, Dtype(0));
+  for (int ib = 0; ib < args.in_blocks; ++ib) {
+    for (int kh = 0; kh < args.kernel_h; ++kh) {
+      for (int kw = 0; kw < args.kernel_w; ++kw) {
+        const Dtype* in = input + ib * args.plane_stride +
+            kh * args.tap_h_stride + kw * args.tap_w_stride;
+        const Dtype* w = weights +
+            ((ib * args.kernel_h + kh) * args.kernel_w + kw) * block * block;
+        for (int c = 0; c < block; ++c, w += block) {
+          for (int r = 0; r < count; ++r) {
+            const Dtype x = in[r * args.pixel_stride + c];
+            Dtype* out = tile + r * block;
+            for (int v = 0; v < block; ++v) {
+              out[v] += x * w[v];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+#ifdef CAFFE_DIRECT_CONV_X86
+// As for the other vector kernels, these are compiled for their own
+// instruction set and only selected once cpu::getSupportedIsa() has found
+// it; every AVX2 processor also implements FMA. The block is the vector
+// width; W pixels are accumulated in W registers.
+
+template <int W>
+__attribute__((target("avx2,fma")))
+void direct_tile_avx2(const float* input, const float* weights,
+    const DirectConvArgs& args, float* tile) {
+  __m256 acc[W];
+  for (int r = 0; r < W; ++r) {
+    acc[r] = _mm256_setzero_ps();
+  }
+  for (int ib = 0; ib < args.in_blocks; ++ib) {
+    for (int kh = 0; kh < args.kernel_h; ++kh) {
+      for (int kw = 0; kw < args.kernel_w; ++kw) {
+        const float* in = input + ib * args.plane_stride +
+            kh * args.tap_h_stride + kw * args.tap_w_stride;
+        const float* w =
+            weights + ((ib * args.kernel_h + kh) * args.kernel_w + kw) * 64;
+        for (int c = 0; c < 8; ++c) {
+          const __m256 wv = _mm256_loadu_ps(w + c * 8);
+          for (int r = 0; r < W; ++r) {
+            acc[r] = _mm256_fmadd_ps(
+                _mm256_broadcast_ss(in + r * args.pixel_stride + c), wv,
+                acc[r]);
+          }
+        }
+      }
+    }
+  }
+  for (int r = 0; r < W; ++r) {
+    _mm256_storeu_ps(tile + r * 8, acc[r]);
+  }
+}
+
+template <int W>
+__attribute__((target("avx512f")))
+void direct_tile_avx512(const float* input, const float* weights,
+    const DirectConvArgs& args, float* tile) {
+  __m512 acc[W];
+  for (int r = 0; r < W; ++r) {
+    acc[r] = _mm512_setzero_ps();
+  }
+  for (int ib = 0; ib < args.in_blocks; ++ib) {
+    for (int kh = 0; kh < args.kernel_h; ++kh) {
+      for (int kw = 0; kw < args.kernel_w; ++kw) {
+        const float* in = input + ib * args.plane_stride +
+            kh * args.tap_h_stride + kw * args.tap_w_stride;
+        const float* w =
+            weights + ((ib * args.kernel_h + kh) * args.kernel_w + kw) * 256;
+        for (int c = 0; c < 16; ++c) {
+          const __m512 wv = _mm512_loadu_ps(w + c * 16);
+          for (int r = 0; r < W; ++r) {
+            acc[r] = _mm512_fmadd_ps(
+                _mm512_set1_ps(in[r * args.pixel_stride + c]), wv, acc[r]);
+          }
+        }
+      }
+    }
+  }
+  for (int r = 0; r < W; ++r) {
+    _mm512_storeu_ps(tile + r * 16, acc[r]);
+  }
+}
+
+// Full tiles go through the kTileWidth kernel, leftover pixels one by one.
+void direct_tile_avx2(const float* input, const float* weights,
+    const DirectConvArgs& args, int count, float* tile) {
+  if (count == kTileWidth) {
+    direct_tile_avx2<kTileWidth>(input, weights, args, tile);
+    return;
+  }
+  for (int r = 0; r < count; ++r) {
+    direct_tile_avx2<1>(input + r * args.pixel_stride, weights, args,
+                        tile + r * 8);
+  }
+}
+
+void direct_tile_avx512(const float* input, const float* weights,
+    const DirectConvArgs& args, int count, float* tile) {
+  if (count == kTileWidth) {
+    direct_tile_avx512<kTileWidth>(input, weights, args, tile);
+    return;
+  }
+  for (int r = 0; r < count; ++r) {
+    direct_tile_avx512<1>(input + r * args.pixel_stride, weights, args,
+                          tile + r * 16);
+  }
+}
+#endif  // CAFFE_DIRECT_CONV_X86
+
+// The channel block and the tile kernel for Dtype on this processor.
+template <typename Dtype>
+void select_direct_tile(int* block, typename DirectTileFunc<Dtype>::Type* f) {
+  *block = 32 / sizeof(Dtype);
+  *f = direct_tile_scalar<Dtype>;
+}
+
+template <>
+void select_direct_tile<float>(int* block, DirectTileFunc<float>::Type* f) {
+  *block = 8;
+  *f = direct_tile_scalar<float>;
+#ifdef CAFFE_DIRECT_CONV_X86
+  switch (cpu::getSupportedIsa()) {
+    case cpu::isaAvx512:
+      *block = 16;
+      *f = direct_tile_avx512;
+      break;
+    case cpu::isaAvx2:
+      *f = direct_tile_avx2;
+      break;
+    default:
+      break;
+  }
+#endif
+}
+
+}  // namespace
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  // The kernel_size of the parameters can not tell, e.g. for a single one.
+  direct_ = this->num_spatial_axes_ == 2;
+  if (!direct_) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " convolves with "
+              << "im2col: the DIRECT engine needs a 2D input";
+    return;
+  }
+  typename DirectTileFunc<Dtype>::Type tile;
+  select_direct_tile<Dtype>(&block_, &tile);
+  blocked_weights_version_ = 0;
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  if (!direct_) {
+    return;
+  }
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int group_in = this->channels_ / this->group_;
+  const int group_out = this->num_output_ / this->group_;
+  in_blocks_ = (group_in + block_ - 1) / block_;
+  out_blocks_ = (group_out + block_ - 1) / block_;
+  padded_height_ = this->input_shape(1) + 2 * pad[0];
+  padded_width_ = this->input_shape(2) + 2 * pad[1];
+  vector<int> weights_shape(1, this->group_ * out_blocks_ * in_blocks_ *
+      kernel_shape[0] * kernel_shape[1] * block_ * block_);
+  blocked_weights_.Reshape(weights_shape);
+  SharedWorkspace::Get().Reserve(sizeof(Dtype) * this->group_ * in_blocks_ *
+      padded_height_ * padded_width_ * block_);
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::block_weights() {
+  if (blocked_weights_version_ == this->blobs_[0]->data_version()) {
+    return;
+  }
+  const Dtype* weights = this->blobs_[0]->cpu_data();
+  Dtype* blocked = blocked_weights_.mutable_cpu_data();
+  const int group_in = this->channels_ / this->group_;
+  const int group_out = this->num_output_ / this->group_;
+  const int taps = this->kernel_shape_.cpu_data()[0] *
+      this->kernel_shape_.cpu_data()[1];
+  for (int g = 0; g < this->group_; ++g) {
+    for (int ob = 0; ob < out_blocks_; ++ob) {
+      for (int ib = 0; ib < in_blocks_; ++ib) {
+        for (int t = 0; t < taps; ++t) {
+          for (int c = 0; c < block_; ++c) {
+            for (int v = 0; v < block_; ++v) {
+              const int o = ob * block_ + v, i = ib * block_ + c;
+              *blocked++ = o < group_out && i < group_in ? weights[
+                  ((g * group_out + o) * group_in + i) * taps + t] : Dtype(0);
+            }
+          }
+        }
+      }
+    }
+  }
+  blocked_weights_version_ = this->blobs_[0]->data_version();
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::block_input(const Dtype* image,
+    int plane, Dtype* blocked) {
+  const int height = this->input_shape(1), width = this->input_shape(2);
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int group_in = this->channels_ / this->group_;
+  const int plane_size = padded_height_ * padded_width_ * block_;
+  const int ib = plane % in_blocks_;
+  const int g = plane / in_blocks_;
+  const int first = ib * block_;
+  const int channels = std::min(block_, group_in - first);
+  const Dtype* src = image + (g * group_in + first) * height * width;
+  Dtype* dst = blocked + static_cast<size_t>(plane) * plane_size;
+  memset(dst, 0, sizeof(Dtype) * plane_size);
+  for (int h = 0; h < height; ++h) {
+    Dtype* row = dst + ((h + pad_h) * padded_width_ + pad_w) * block_;
+    for (int w = 0; w < width; ++w) {
+      for (int c = 0; c < channels; ++c) {
+        row[w * block_ + c] = src[(c * height + h) * width + w];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!direct_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  int block;
+  typename DirectTileFunc<Dtype>::Type tile_func;
+  select_direct_tile<Dtype>(&block, &tile_func);
+  CHECK_EQ(block, block_);
+  block_weights();
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  const int out_height = this->output_shape_[0];
+  const int out_width = this->output_shape_[1];
+  const int out_plane = out_height * out_width;
+  const int group_out = this->num_output_ / this->group_;
+  const int plane = padded_height_ * padded_width_ * block_;
+  const int weights_per_block =
+      in_blocks_ * kernel_shape[0] * kernel_shape[1] * block_ * block_;
+  DirectConvArgs args;
+  args.in_blocks = in_blocks_;
+  args.block = block_;
+  args.kernel_h = kernel_shape[0];
+  args.kernel_w = kernel_shape[1];
+  args.plane_stride = plane;
+  args.tap_h_stride = dilation[0] * padded_width_ * block_;
+  args.tap_w_stride = dilation[1] * block_;
+  args.pixel_stride = stride[1] * block_;
+  const Dtype* weights = blocked_weights_.cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const bool relu = this->fused_relu_;
+  const Dtype* slopes = this->relu_slopes();
+  const int planes = this->group_ * in_blocks_;
+  const int rows = this->group_ * out_blocks_ * out_height;
+
+  Dtype* blocked = static_cast<Dtype*>(SharedWorkspace::Get().data(
+      sizeof(Dtype) * planes * plane));
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    // The implicit barriers of the loops keep the threads from reading an
+    // image before it is blocked and from blocking the next one over it.
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    for (int n = 0; n < this->num_; ++n) {
+#ifdef _OPENMP
+      #pragma omp for
+#endif
+      for (int p = 0; p < planes; ++p) {
+        block_input(bottom_data + n * this->bottom_dim_, p, blocked);
+      }
+#ifdef _OPENMP
+      #pragma omp for
+#endif
+      for (int row = 0; row < rows; ++row) {
+        const int oh = row % out_height;
+        const int ob = row / out_height % out_blocks_;
+        const int g = row / out_height / out_blocks_;
+        const int first = g * group_out + ob * block_;
+        const int channels = std::min(block_, group_out - ob * block_);
+        const Dtype* in = blocked +
+            static_cast<size_t>(g * in_blocks_) * plane +
+            oh * stride[0] * padded_width_ * block_;
+        const Dtype* w = weights +
+            static_cast<size_t>(g * out_blocks_ + ob) * weights_per_block;
+        Dtype* out = top_data + n * this->top_dim_ + first * out_plane +
+            oh * out_width;
+        Dtype tile[kTileWidth * 16];
+        for (int ow = 0; ow < out_width; ow += kTileWidth) {
+          const int count = std::min(kTileWidth, out_width - ow);
+          tile_func(in + ow * args.pixel_stride, w, args, count, tile);
+          for (int v = 0; v < channels; ++v) {
+            const Dtype b = bias ? bias[first + v] : Dtype(0);
+            Dtype* out_v = out + v * out_plane + ow;
+            for (int r = 0; r < count; ++r) {
+              out_v[r] = tile[r * block_ + v] + b;
+            }
+            if (relu) {
+              const Dtype slope =
+                  slopes ? slopes[first + v] : this->negative_slope_;
+              for (int r = 0; r < count; ++r) {
+                out_v[r] = out_v[r] > 0 ? out_v[r] : out_v[r] * slope;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(DirectConvolutionLayer);
+
+}  // namespace caffe
@@ -39,6 +39,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 
 #include "caffe/layers/eltwise_layer.hpp"
+#include "caffe/util/blob_storage.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -108,6 +109,10 @@ void EltwiseLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (HasReducedStorage(bottom) || HasReducedStorage(top)) {
+    Forward_reduced_cpu(bottom, top);
+    return;
+  }
   int* mask = NULL;
   const Dtype* bottom_data_a = NULL;
   const Dtype* bottom_data_b = NULL;
@@ -163,13 +168,16 @@ void EltwiseLayer<Dtype>::Forward_cpu(
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (op_ == EltwiseParameter_EltwiseOp_PROD &&
+      (HasReducedStorage(bottom) || HasReducedStorage(top))) {
+    Backward_reduced_cpu(top, propagate_down, bottom);
+    return;
+  }
   const int* mask = NULL;
   const int count = top[0]->count();
-  const Dtype* top_data = top[0]->cpu_data();
   const Dtype* top_diff = top[0]->cpu_diff();
   for (int i = 0; i < bottom.size(); ++i) {
     if (propagate_down[i]) {
-      const Dtype* bottom_data = bottom[i]->cpu_data();
       Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
       switch (op_) {
       case EltwiseParameter_EltwiseOp_PROD:
@@ -186,7 +194,8 @@ void EltwiseLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
             }
           }
         } else {
-          caffe_div(count, top_data, bottom_data, bottom_diff);
+          caffe_div(count, top[0]->cpu_data(), bottom[i]->cpu_data(),
+                    bottom_diff);
         }
         caffe_mul(count, bottom_diff, top_diff, bottom_diff);
         break;
@@ -214,6 +223,120 @@ void EltwiseLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
 }
 
+template <typename Dtype>
+void EltwiseLayer<Dtype>::Forward_reduced_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  vector<BlobDataReader<Dtype> > bottom_data;
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_data.push_back(BlobDataReader<Dtype>(*bottom[i]));
+  }
+  const BlobDataWriter<Dtype> top_data(top[0]);
+  int* mask = op_ == EltwiseParameter_EltwiseOp_MAX ?
+      max_idx_.mutable_cpu_data() : NULL;
+  const int count = top[0]->count();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int offset = 0; offset < count; offset += kStorageChunk) {
+    Dtype bottom_buffer[kStorageChunk];
+    Dtype top_buffer[kStorageChunk];
+    const int n = std::min(kStorageChunk, count - offset);
+    Dtype* y = top_data.Target(offset, top_buffer);
+    const Dtype* x = bottom_data[0].Read(offset, n, bottom_buffer);
+    switch (op_) {
+    case EltwiseParameter_EltwiseOp_PROD:
+      caffe_copy(n, x, y);
+      for (int j = 1; j < bottom.size(); ++j) {
+        x = bottom_data[j].Read(offset, n, bottom_buffer);
+        for (int k = 0; k < n; ++k) {
+          y[k] *= x[k];
+        }
+      }
+      break;
+    case EltwiseParameter_EltwiseOp_SUM:
+      for (int k = 0; k < n; ++k) {
+        y[k] = coeffs_[0] * x[k];
+      }
+      for (int j = 1; j < bottom.size(); ++j) {
+        x = bottom_data[j].Read(offset, n, bottom_buffer);
+        for (int k = 0; k < n; ++k) {
+          y[k] += coeffs_[j] * x[k];
+        }
+      }
+      break;
+    case EltwiseParameter_EltwiseOp_MAX:
+      for (int k = 0; k < n; ++k) {
+        y[k] = x[k];
+        mask[offset + k] = 0;
+      }
+      for (int j = 1; j < bottom.size(); ++j) {
+        x = bottom_data[j].Read(offset, n, bottom_buffer);
+        for (int k = 0; k < n; ++k) {
+          // As in Forward_cpu, the second bottom wins ties with the first.
+          if (j == 1 ? !(y[k] > x[k]) : x[k] > y[k]) {
+            y[k] = x[k];
+            mask[offset + k] = j;
+          }
+        }
+      }
+      break;
+    default:
+      LOG(FATAL) << "Unknown elementwise operation.";
+    }
+    top_data.Write(offset, n, y);
+  }
+}
+
+// Only the product reads the data in Backward; the other operations go
+// through Backward_cpu.
+template <typename Dtype>
+void EltwiseLayer<Dtype>::Backward_reduced_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK_EQ(op_, EltwiseParameter_EltwiseOp_PROD);
+  vector<BlobDataReader<Dtype> > bottom_data;
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_data.push_back(BlobDataReader<Dtype>(*bottom[i]));
+  }
+  const BlobDataReader<Dtype> top_data(*top[0]);
+  const int count = top[0]->count();
+  const Dtype* top_diff = top[0]->cpu_diff();
+  for (int i = 0; i < bottom.size(); ++i) {
+    if (!propagate_down[i]) {
+      continue;
+    }
+    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int offset = 0; offset < count; offset += kStorageChunk) {
+      Dtype bottom_buffer[kStorageChunk];
+      Dtype top_buffer[kStorageChunk];
+      const int n = std::min(kStorageChunk, count - offset);
+      Dtype* diff = bottom_diff + offset;
+      if (stable_prod_grad_) {
+        bool initialized = false;
+        for (int j = 0; j < bottom.size(); ++j) {
+          if (i == j) { continue; }
+          const Dtype* x = bottom_data[j].Read(offset, n, bottom_buffer);
+          for (int k = 0; k < n; ++k) {
+            diff[k] = initialized ? diff[k] * x[k] : x[k];
+          }
+          initialized = true;
+        }
+      } else {
+        const Dtype* x = bottom_data[i].Read(offset, n, bottom_buffer);
+        const Dtype* y = top_data.Read(offset, n, top_buffer);
+        for (int k = 0; k < n; ++k) {
+          diff[k] = y[k] / x[k];
+        }
+      }
+      for (int k = 0; k < n; ++k) {
+        diff[k] *= top_diff[offset + k];
+      }
+    }
+  }
+}
+
 #ifdef CPU_ONLY
 STUB_GPU(EltwiseLayer);
 #endif
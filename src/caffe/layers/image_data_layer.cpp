@@ -114,8 +114,8 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int batch_size = this->layer_param_.image_data_param().batch_size();
   CHECK_GT(batch_size, 0) << "Positive batch size required";
   top_shape[0] = batch_size;
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   top[0]->Reshape(top_shape);
 
@@ -125,8 +125,8 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // label
   vector<int> label_shape(1, batch_size);
   top[1]->Reshape(label_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].label_.Reshape(label_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->label_.Reshape(label_shape);
   }
 }
 
@@ -195,22 +195,20 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     read_time = 0;
     trans_time = 0;
 
-    int offset = batch->data_.offset(item_id);
     std::string img_file_name = lines_[lines_id_].first;
     PreclcRandomNumbers precalculated_rand_numbers;
     this->data_transformer_->GenerateRandNumbers(precalculated_rand_numbers);
-    #pragma omp task firstprivate(offset, img_file_name, \
+    #pragma omp task firstprivate(item_id, img_file_name, \
                                                     precalculated_rand_numbers)
     {
         cv::Mat cv_img = ReadImageToCVMat(root_folder + img_file_name,
             new_height, new_width, is_color);
         CHECK(cv_img.data) << "Could not load " << img_file_name;
 
-        Blob<Dtype> tmp_data;
-        tmp_data.Reshape(top_shape);
-        tmp_data.set_cpu_data(prefetch_data + offset);
-        this->data_transformer_->Transform(cv_img, &tmp_data, 
-                                                  precalculated_rand_numbers);
+        TransformContext<Dtype>& context = this->transform_context(*batch);
+        context.SetItem(batch->data_, prefetch_data, item_id);
+        this->data_transformer_->Transform(cv_img, &context.view_,
+                                           precalculated_rand_numbers);
     }
 #endif
 
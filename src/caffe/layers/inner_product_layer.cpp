@@ -96,6 +96,12 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }  // parameter initialization
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  if (this->phase_ == TEST && this->layer_param_.has_quantization_param() &&
+      this->AllowQuantization() &&
+      QuantizedWeights::Calibrated(this->layer_param_)) {
+    int8_weights_.reset(
+        new QuantizedWeights(this->layer_param_.quantization_param()));
+  }
 
 #ifdef USE_MLSL
 
@@ -177,9 +183,20 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  if (int8_weights_) {
+    if (int8_weights_->empty()) {
+      int8_weights_->Quantize(N_, K_, weight, transpose_);
+    }
+    int8_bottom_.resize(M_ * K_);
+    int32_top_.resize(M_ * N_);
+    int8_weights_->QuantizeInput(M_, K_, bottom_data, false, &int8_bottom_[0]);
+    int8_weights_->Multiply(M_, 0, N_, &int8_bottom_[0], &int32_top_[0]);
+    int8_weights_->Dequantize(M_, 0, N_, &int32_top_[0], false, top_data);
+  } else {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
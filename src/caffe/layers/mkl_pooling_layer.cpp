@@ -242,6 +242,9 @@ void MKLPoolingLayer<Dtype>::Init(
 template <typename Dtype>
 void MKLPoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(4, bottom[0]->num_axes()) << "MKL2017 only pools 2D inputs, "
+      << "set engine CAFFE to pool the volumes of layer "
+      << this->layer_param_.name();
   Init(bottom, top);
 }
 
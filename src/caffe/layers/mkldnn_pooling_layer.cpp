@@ -56,6 +56,9 @@ void MKLDNNPoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom
     VLOG(1) << "MKLDNNPoolingLayer<Dtype>::LayerSetUp: " << this->layer_param_.name();
 
     Layer<Dtype>::LayerSetUp(bottom, top);
+    CHECK_EQ(4, bottom[0]->num_axes()) << "MKLDNN only pools 2D inputs, "
+        << "set engine CAFFE to pool the volumes of layer "
+        << this->layer_param_.name();
     PoolingParameter pool_param = this->layer_param_.pooling_param();
 
     if (pool_param.global_pooling()) {
@@ -40,6 +40,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/blob_storage.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -70,8 +71,8 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       << "Stride is stride OR stride_h and stride_w are required.";
   global_pooling_ = pool_param.global_pooling();
   if (global_pooling_) {
-    kernel_h_ = bottom[0]->height();
-    kernel_w_ = bottom[0]->width();
+    kernel_h_ = bottom[0]->shape(-2);
+    kernel_w_ = bottom[0]->shape(-1);
   } else {
     if (pool_param.has_kernel_size()) {
       kernel_h_ = kernel_w_ = pool_param.kernel_size();
@@ -107,6 +108,38 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_LT(pad_h_, kernel_h_);
     CHECK_LT(pad_w_, kernel_w_);
   }
+  kernel_d_ = stride_d_ = 1;
+  pad_d_ = 0;
+  if (bottom[0]->num_axes() == 5) {
+    if (global_pooling_) {
+      kernel_d_ = bottom[0]->shape(2);
+    } else {
+      CHECK(pool_param.has_kernel_d() || pool_param.has_kernel_size())
+        << "3D pooling needs kernel_d or kernel_size";
+      kernel_d_ = pool_param.has_kernel_d() ?
+          pool_param.kernel_d() : pool_param.kernel_size();
+    }
+    pad_d_ = pool_param.has_pad_d() ? pool_param.pad_d() : pool_param.pad();
+    stride_d_ = pool_param.has_stride_d() ?
+        pool_param.stride_d() : pool_param.stride();
+    CHECK_GT(kernel_d_, 0) << "Filter dimensions cannot be zero.";
+    if (global_pooling_) {
+      CHECK(pad_d_ == 0 && stride_d_ == 1)
+        << "With Global_pooling: true; only pad = 0 and stride = 1";
+    }
+    if (pad_d_ != 0) {
+      CHECK(this->layer_param_.pooling_param().pool()
+          == PoolingParameter_PoolMethod_AVE
+          || this->layer_param_.pooling_param().pool()
+          == PoolingParameter_PoolMethod_MAX)
+          << "Padding implemented only for average and max pooling.";
+      CHECK_LT(pad_d_, kernel_d_);
+    }
+  } else {
+    CHECK(!pool_param.has_kernel_d() && !pool_param.has_pad_d() &&
+          !pool_param.has_stride_d())
+      << "kernel_d, pad_d and stride_d apply to 3D pooling only";
+  }
 
 #ifdef USE_MLSL
 
@@ -157,19 +190,30 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
-      << "corresponding to (num, channels, height, width)";
-  channels_ = bottom[0]->channels();
-  height_ = bottom[0]->height();
-  width_ = bottom[0]->width();
+  const bool pool_3d = bottom[0]->num_axes() == 5;
+  CHECK(bottom[0]->num_axes() == 4 || pool_3d) << "Input must have 4 axes, "
+      << "corresponding to (num, channels, height, width), or 5, "
+      << "corresponding to (num, channels, depth, height, width)";
+  channels_ = bottom[0]->shape(1);
+  depth_ = pool_3d ? bottom[0]->shape(2) : 1;
+  height_ = bottom[0]->shape(-2);
+  width_ = bottom[0]->shape(-1);
   if (global_pooling_) {
-    kernel_h_ = bottom[0]->height();
-    kernel_w_ = bottom[0]->width();
+    kernel_h_ = height_;
+    kernel_w_ = width_;
+    if (pool_3d) {
+      kernel_d_ = depth_;
+    }
   }
+  pooled_depth_ = static_cast<int>(ceil(static_cast<float>(
+      depth_ + 2 * pad_d_ - kernel_d_) / stride_d_)) + 1;
   pooled_height_ = static_cast<int>(ceil(static_cast<float>(
       height_ + 2 * pad_h_ - kernel_h_) / stride_h_)) + 1;
   pooled_width_ = static_cast<int>(ceil(static_cast<float>(
       width_ + 2 * pad_w_ - kernel_w_) / stride_w_)) + 1;
+  if (pad_d_ && (pooled_depth_ - 1) * stride_d_ >= depth_ + pad_d_) {
+    --pooled_depth_;
+  }
   if (pad_h_ || pad_w_) {
     // If we have padding, ensure that the last pooling starts strictly
     // inside the image (instead of at the padding); otherwise clip the last.
@@ -182,22 +226,26 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     CHECK_LT((pooled_height_ - 1) * stride_h_, height_ + pad_h_);
     CHECK_LT((pooled_width_ - 1) * stride_w_, width_ + pad_w_);
   }
-  top[0]->Reshape(bottom[0]->num(), channels_, pooled_height_,
-      pooled_width_);
+  vector<int> top_shape(bottom[0]->shape().begin(),
+                        bottom[0]->shape().begin() + 2);
+  if (pool_3d) {
+    top_shape.push_back(pooled_depth_);
+  }
+  top_shape.push_back(pooled_height_);
+  top_shape.push_back(pooled_width_);
+  top[0]->Reshape(top_shape);
   if (top.size() > 1) {
     top[1]->ReshapeLike(*top[0]);
   }
   // If max pooling, we will initialize the vector index part.
   if (this->layer_param_.pooling_param().pool() ==
       PoolingParameter_PoolMethod_MAX && top.size() == 1) {
-    max_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
-        pooled_width_);
+    max_idx_.Reshape(top_shape);
   }
   // If stochastic pooling, we will initialize the random index part.
   if (this->layer_param_.pooling_param().pool() ==
       PoolingParameter_PoolMethod_STOCHASTIC) {
-    rand_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
-      pooled_width_);
+    rand_idx_.Reshape(top_shape);
   }
 }
 
@@ -206,6 +254,10 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (HasReducedStorage(bottom) || HasReducedStorage(top)) {
+    Forward_reduced_cpu(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int top_count = top[0]->count();
@@ -223,8 +275,8 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
                             static_cast<void*>(max_idx_.mutable_cpu_data());
   }
 
-  const int batch_size = bottom[0]->num();
-  const int num_channels = bottom[0]->channels();
+  const int batch_size = bottom[0]->shape(0);
+  const int num_channels = channels_;
 
 #ifdef _OPENMP
   #pragma omp parallel for collapse(2)
@@ -267,8 +319,8 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
                             static_cast<void*>(max_idx_.mutable_cpu_data());
   }
 
-  const int batch_size = bottom[0]->num();
-  const int num_channels = bottom[0]->channels();
+  const int batch_size = bottom[0]->shape(0);
+  const int num_channels = channels_;
 
 #ifdef _OPENMP
   #pragma omp parallel for collapse(2)
@@ -286,6 +338,54 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
                      this);
 }
 
+// Converts one feature map at a time and runs the generated code on it as a
+// batch of a single image with a single channel.
+template <typename Dtype>
+void PoolingLayer<Dtype>::Forward_reduced_cpu(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(top.size(), 1) << "The mask top cannot be held in 16 bits";
+  const BlobDataReader<Dtype> bottom_data(*bottom[0]);
+  const BlobDataWriter<Dtype> top_data(top[0]);
+  const int fm_size = depth_ * height_ * width_;
+  const int pooled_fm_size = pooled_depth_ * pooled_height_ * pooled_width_;
+
+  typename PoolingCodeGeneratorForward<Dtype>::Callback_t* generator_func =
+           Forward_code_generator.Get_callback(this, top[0], false);
+  int* mask = NULL;
+  if (this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX) {
+    mask = max_idx_.mutable_cpu_data();
+  }
+
+  const int num_fms = bottom[0]->shape(0) * channels_;
+
+#ifdef _OPENMP
+  #pragma omp parallel
+#endif
+  {
+    vector<Dtype> bottom_buffer(fm_size);
+    vector<Dtype> top_buffer(pooled_fm_size);
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+    for (int fm = 0; fm < num_fms; ++fm) {
+      const Dtype* bottom_fm =
+          bottom_data.Read(fm * fm_size, fm_size, &bottom_buffer[0]);
+      Dtype* top_fm = top_data.Target(fm * pooled_fm_size, &top_buffer[0]);
+      generator_func(bottom_fm,
+                     top_fm,
+                     pooled_fm_size,
+                     0,
+                     1,
+                     mask ? mask + fm * pooled_fm_size : NULL,
+                     0,
+                     1,
+                     this,
+                     false);
+      top_data.Write(fm * pooled_fm_size, pooled_fm_size, top_fm);
+    }
+  }
+}
 
 #ifdef CPU_ONLY
 STUB_GPU(PoolingLayer);
@@ -157,6 +157,11 @@ __global__ void StoPoolForwardTest(const int nthreads,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  // The kernels below pool 2D images only.
+  if (bottom[0]->num_axes() == 5) {
+    Forward_cpu(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
   int count = top[0]->count();
@@ -333,6 +338,10 @@ __global__ void StoPoolBackward(const int nthreads,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (bottom[0]->num_axes() == 5) {
+    Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
   if (!propagate_down[0]) {
     return;
   }
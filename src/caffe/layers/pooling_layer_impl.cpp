@@ -35,18 +35,450 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <stddef.h>
+
 #include <algorithm>
 #include <cfloat>
+#include <map>
+#include <vector>
 
+#include "boost/thread/mutex.hpp"
 #include "caffe/layers/pooling_layer.hpp"
 
+#if defined __x86_64__ || defined _M_X64
+# define XBYAK_NO_OP_NAMES
+# define XBYAK_USE_MMAP_ALLOCATOR
+# include "caffe/xbyak/xbyak_util.h"
+#endif
+
 namespace caffe {
 using std::min;
 using std::max;
 
+// The outputs [0, count) of a row whose windows lie within the width of the
+// input, all with the same planes and rows. Forward pools bottom into top
+// and, for MAX, writes the index of each maximum to mask (int, or Dtype for
+// a top mask). Backward adds the top diff times scale to the bottom diff of
+// the windows (AVE only).
+template <typename Dtype>
+struct PoolingRowArgs {
+  Dtype* bottom;  // The first valid plane and row of the window of output 0
+  Dtype* top;
+  void* mask;
+  int64_t count;
+  int64_t planes;  // The valid planes and rows of the windows
+  int64_t rows;
+  int64_t index;  // The index of bottom in its feature map
+  Dtype scale;  // 1 / pool size, for AVE
+};
+
+namespace {
+
+// The window of output p along a dimension: [start, end) of the input, and
+// its size on the padded input, which AVE divides by.
+struct PoolingWindow {
+  PoolingWindow(int p, int kernel, int stride, int pad, int extent) {
+    start = p * stride - pad;
+    end = min(start + kernel, extent + pad);
+    size = end - start;
+    start = max(start, 0);
+    end = min(end, extent);
+  }
+  bool empty() const { return end <= start; }
+  int start, end, size;
+};
+
+// The outputs of a row whose windows lie within the width of the input,
+// [begin, end); those before and after are on the padding.
+void Inner_columns(int pooled_width, int kernel_w, int stride_w, int pad_w,
+                   int width, int* begin, int* end) {
+  *begin = (pad_w + stride_w - 1) / stride_w;
+  *end = width + pad_w < kernel_w ?
+      0 : min((width + pad_w - kernel_w) / stride_w + 1, pooled_width);
+  *end = max(*end, *begin);
+}
+
+#if defined __x86_64__ || defined _M_X64
+// Lane offsets, for strides 1 and 2, and steps of the indices MAX tracks in
+// vector registers: int32 for float and double for double.
+const int32_t kFloatLaneIndices[2][8] = {
+  {0, 1, 2, 3, 4, 5, 6, 7}, {0, 2, 4, 6, 8, 10, 12, 14} };
+const int32_t kFloatIndexStep[8] = {1, 1, 1, 1, 1, 1, 1, 1};
+const double kDoubleLaneIndices[2][4] = { {0, 1, 2, 3}, {0, 2, 4, 6} };
+const double kDoubleIndexStep[4] = {1, 1, 1, 1};
+const double kDoubleNoIndex = -1;
+const float kFloatLowest = -FLT_MAX;
+const double kDoubleLowest = -FLT_MAX;
+
+// Code for PoolingRowArgs of one pooling method, kernel width, stride and
+// input shape: the kernel width is unrolled and, for strides 1 and 2, the
+// outputs are computed a vector register at a time. Needs AVX2.
+template <typename Dtype>
+class PoolingRowCode : public ::Xbyak::CodeGenerator {
+ public:
+  typedef void (Row_t)(const PoolingRowArgs<Dtype>* args);
+
+  PoolingRowCode(bool forward, bool max_pool, bool use_top_mask,
+                 int kernel_w, int stride_w, int width, int plane_size)
+      : ::Xbyak::CodeGenerator(4096 + kernel_w * 256) {
+    if (forward) {
+      Generate_forward(max_pool, use_top_mask, kernel_w, stride_w, width,
+                       plane_size);
+    } else {
+      Generate_backward(kernel_w, stride_w, width, plane_size);
+    }
+  }
+
+  Row_t* row() { return getCode<Row_t*>(); }
+
+ private:
+  typedef ::Xbyak::Xmm Xmm;
+  typedef ::Xbyak::Ymm Ymm;
+  typedef ::Xbyak::Operand Operand;
+  typedef ::Xbyak::Address Address;
+  static const bool kFloat = sizeof(Dtype) == 4;
+  static const int kLanes = 32 / sizeof(Dtype);
+
+  void Load_args(bool scale) {
+    push(rbx); push(r12); push(r13); push(r14); push(r15);
+    typedef PoolingRowArgs<Dtype> Args;
+    mov(r8, ptr[rdi + offsetof(Args, bottom)]);
+    mov(r9, ptr[rdi + offsetof(Args, top)]);
+    mov(r10, ptr[rdi + offsetof(Args, mask)]);
+    mov(r11, ptr[rdi + offsetof(Args, count)]);
+    mov(r12, ptr[rdi + offsetof(Args, planes)]);
+    mov(r13, ptr[rdi + offsetof(Args, rows)]);
+    mov(r14, ptr[rdi + offsetof(Args, index)]);
+    if (scale) {
+      vbroadcast(ymm15, ptr[rdi + offsetof(Args, scale)]);
+    }
+  }
+
+  void Return() {
+    vzeroupper();
+    pop(r15); pop(r14); pop(r13); pop(r12); pop(rbx);
+    ret();
+  }
+
+  // The instructions of Dtype.
+  void vbroadcast(const Ymm& y, const Operand& op) {
+    if (kFloat) { vbroadcastss(y, op); } else { vbroadcastsd(y, op); }
+  }
+  void vadd(const Xmm& x, const Xmm& a, const Operand& b) {
+    if (kFloat) { vaddps(x, a, b); } else { vaddpd(x, a, b); }
+  }
+  void vmul(const Xmm& x, const Xmm& a, const Operand& b) {
+    if (kFloat) { vmulps(x, a, b); } else { vmulpd(x, a, b); }
+  }
+  void vcmplt(const Xmm& x, const Xmm& a, const Operand& b) {
+    if (kFloat) { vcmpltps(x, a, b); } else { vcmpltpd(x, a, b); }
+  }
+  void vblend(const Xmm& x, const Xmm& a, const Operand& b, const Xmm& m) {
+    if (kFloat) { vblendvps(x, a, b, m); } else { vblendvpd(x, a, b, m); }
+  }
+  void sload(const Xmm& x, const Address& addr) {
+    if (kFloat) { vmovss(x, addr); } else { vmovsd(x, addr); }
+  }
+  void sstore(const Address& addr, const Xmm& x) {
+    if (kFloat) { vmovss(addr, x); } else { vmovsd(addr, x); }
+  }
+  void sadd(const Xmm& x, const Xmm& a, const Operand& b) {
+    if (kFloat) { vaddss(x, a, b); } else { vaddsd(x, a, b); }
+  }
+  void smul(const Xmm& x, const Xmm& a, const Operand& b) {
+    if (kFloat) { vmulss(x, a, b); } else { vmulsd(x, a, b); }
+  }
+  void smax(const Xmm& x, const Xmm& a, const Operand& b) {
+    if (kFloat) { vmaxss(x, a, b); } else { vmaxsd(x, a, b); }
+  }
+  void sucomi(const Xmm& a, const Operand& b) {
+    if (kFloat) { vucomiss(a, b); } else { vucomisd(a, b); }
+  }
+
+  // Loads the inputs at kw of the windows of kLanes outputs; stride 2
+  // reads one input past the last window.
+  void Load_lanes(const Ymm& y, const Ymm& tmp, int kw, int stride_w) {
+    vmovups(y, ptr[rsi + kw * sizeof(Dtype)]);
+    if (stride_w == 2) {
+      vmovups(tmp, ptr[rsi + kw * sizeof(Dtype) + 32]);
+      if (kFloat) {
+        vshufps(y, y, tmp, 0x88);
+      } else {
+        vunpcklpd(y, y, tmp);
+      }
+      vpermpd(y, y, 0xD8);
+    }
+  }
+
+  // Registers: r8 bottom, r9 top, r10 mask, r11 count, r12 planes, r13
+  // rows, r14 index; rax, rcx, rdx the plane, its index and the planes
+  // left, rsi, rbx, r15 the row, its index and the rows left. For MAX,
+  // ymm14 holds the lowest value, ymm13 the index step and ymm12 the lane
+  // indices; ymm15 holds the scale for AVE.
+  void Generate_forward(bool max_pool, bool use_top_mask, int kernel_w,
+                        int stride_w, int width, int plane_size) {
+    const int mask_size = use_top_mask ? sizeof(Dtype) : sizeof(int);
+    const int row_bytes = width * sizeof(Dtype);
+    const int plane_bytes = plane_size * sizeof(Dtype);
+    Load_args(!max_pool);
+    if (max_pool) {
+      if (kFloat) {
+        mov(rax, reinterpret_cast<size_t>(&kFloatLowest));
+        vbroadcastss(ymm14, ptr[rax]);
+        mov(rax, reinterpret_cast<size_t>(kFloatIndexStep));
+        vmovups(ymm13, ptr[rax]);
+        mov(rax, reinterpret_cast<size_t>(kFloatLaneIndices[stride_w == 2]));
+        vmovups(ymm12, ptr[rax]);
+      } else {
+        mov(rax, reinterpret_cast<size_t>(&kDoubleLowest));
+        vbroadcastsd(ymm14, ptr[rax]);
+        mov(rax, reinterpret_cast<size_t>(kDoubleIndexStep));
+        vmovups(ymm13, ptr[rax]);
+        mov(rax, reinterpret_cast<size_t>(kDoubleLaneIndices[stride_w == 2]));
+        vmovups(ymm12, ptr[rax]);
+        mov(rax, reinterpret_cast<size_t>(&kDoubleNoIndex));
+        vbroadcastsd(ymm11, ptr[rax]);
+      }
+    }
+
+    if (stride_w <= 2) {
+      L("vector_loop");
+      cmp(r11, stride_w == 1 ? kLanes : kLanes + 1);
+      jl("scalar_loop", T_NEAR);
+      if (max_pool) {
+        vmovaps(ymm0, ymm14);
+        if (kFloat) {
+          vpcmpeqd(ymm1, ymm1, ymm1);
+        } else {
+          vmovaps(ymm1, ymm11);
+        }
+      } else {
+        vxorps(ymm0, ymm0, ymm0);
+      }
+      mov(rax, r8);
+      mov(rcx, r14);
+      mov(rdx, r12);
+      L("vector_plane_loop");
+        mov(rsi, rax);
+        mov(rbx, rcx);
+        mov(r15, r13);
+        L("vector_row_loop");
+          if (max_pool) {
+            // The indices of the first inputs of the windows.
+            if (kFloat) {
+              vmovd(xmm2, ebx);
+              vpbroadcastd(ymm2, xmm2);
+              vpaddd(ymm2, ymm2, ymm12);
+            } else {
+              vcvtsi2sd(xmm2, xmm2, rbx);
+              vbroadcastsd(ymm2, xmm2);
+              vaddpd(ymm2, ymm2, ymm12);
+            }
+          }
+          for (int kw = 0; kw < kernel_w; ++kw) {
+            Load_lanes(ymm3, ymm4, kw, stride_w);
+            if (max_pool) {
+              vcmplt(ymm4, ymm0, ymm3);
+              vblend(ymm0, ymm0, ymm3, ymm4);
+              vblend(ymm1, ymm1, ymm2, ymm4);
+              if (kw + 1 < kernel_w) {
+                if (kFloat) {
+                  vpaddd(ymm2, ymm2, ymm13);
+                } else {
+                  vaddpd(ymm2, ymm2, ymm13);
+                }
+              }
+            } else {
+              vadd(ymm0, ymm0, ymm3);
+            }
+          }
+          add(rsi, row_bytes);
+          add(rbx, width);
+          dec(r15);
+          jnz("vector_row_loop", T_NEAR);
+        add(rax, plane_bytes);
+        add(rcx, plane_size);
+        dec(rdx);
+        jnz("vector_plane_loop", T_NEAR);
+
+      if (max_pool) {
+        vmovups(ptr[r9], ymm0);
+        if (kFloat && use_top_mask) {
+          vcvtdq2ps(ymm1, ymm1);
+          vmovups(ptr[r10], ymm1);
+        } else if (kFloat) {
+          vmovdqu(ptr[r10], ymm1);
+        } else if (use_top_mask) {
+          vmovupd(ptr[r10], ymm1);
+        } else {
+          vcvttpd2dq(xmm1, ymm1);
+          vmovdqu(ptr[r10], xmm1);
+        }
+        add(r10, kLanes * mask_size);
+      } else {
+        vmul(ymm0, ymm0, ymm15);
+        vmovups(ptr[r9], ymm0);
+      }
+      add(r8, kLanes * stride_w * sizeof(Dtype));
+      add(r9, kLanes * sizeof(Dtype));
+      add(r14, kLanes * stride_w);
+      sub(r11, kLanes);
+      jmp("vector_loop", T_NEAR);
+    }
+
+    // The remaining outputs, one at a time; rdi holds the index of the max.
+    L("scalar_loop");
+    test(r11, r11);
+    jz("done", T_NEAR);
+    if (max_pool) {
+      vmovaps(xmm0, xmm14);
+      mov(rdi, -1);
+    } else {
+      vxorps(xmm0, xmm0, xmm0);
+    }
+    mov(rax, r8);
+    mov(rcx, r14);
+    mov(rdx, r12);
+    L("scalar_plane_loop");
+      mov(rsi, rax);
+      mov(rbx, rcx);
+      mov(r15, r13);
+      L("scalar_row_loop");
+        for (int kw = 0; kw < kernel_w; ++kw) {
+          if (max_pool) {
+            sload(xmm3, ptr[rsi + kw * sizeof(Dtype)]);
+            sucomi(xmm3, xmm0);
+            cmova(rdi, rbx);
+            smax(xmm0, xmm3, xmm0);
+            if (kw + 1 < kernel_w) {
+              inc(rbx);
+            }
+          } else {
+            sadd(xmm0, xmm0, ptr[rsi + kw * sizeof(Dtype)]);
+          }
+        }
+        add(rsi, row_bytes);
+        add(rbx, width - (kernel_w - 1));
+        dec(r15);
+        jnz("scalar_row_loop", T_NEAR);
+      add(rax, plane_bytes);
+      add(rcx, plane_size);
+      dec(rdx);
+      jnz("scalar_plane_loop", T_NEAR);
+
+    if (max_pool) {
+      sstore(ptr[r9], xmm0);
+      if (use_top_mask) {
+        if (kFloat) {
+          vcvtsi2ss(xmm1, xmm1, rdi);
+        } else {
+          vcvtsi2sd(xmm1, xmm1, rdi);
+        }
+        sstore(ptr[r10], xmm1);
+      } else {
+        mov(dword[r10], edi);
+      }
+      add(r10, mask_size);
+    } else {
+      smul(xmm0, xmm0, xmm15);
+      sstore(ptr[r9], xmm0);
+    }
+    add(r8, stride_w * sizeof(Dtype));
+    add(r9, sizeof(Dtype));
+    add(r14, stride_w);
+    dec(r11);
+    jmp("scalar_loop", T_NEAR);
+
+    L("done");
+    Return();
+  }
+
+  // Registers as for Forward, the outputs going one at a time; ymm0 holds
+  // the top diff times the scale.
+  void Generate_backward(int kernel_w, int stride_w, int width,
+                         int plane_size) {
+    Load_args(true);
+    L("output_loop");
+    test(r11, r11);
+    jz("done", T_NEAR);
+    sload(xmm0, ptr[r9]);
+    smul(xmm0, xmm0, xmm15);
+    vbroadcast(ymm0, xmm0);
+    mov(rax, r8);
+    mov(rdx, r12);
+    L("plane_loop");
+      mov(rsi, rax);
+      mov(r15, r13);
+      L("row_loop");
+        int kw = 0;
+        for (; kw + kLanes <= kernel_w; kw += kLanes) {
+          vadd(ymm1, ymm0, ptr[rsi + kw * sizeof(Dtype)]);
+          vmovups(ptr[rsi + kw * sizeof(Dtype)], ymm1);
+        }
+        for (; kw < kernel_w; ++kw) {
+          sadd(xmm1, xmm0, ptr[rsi + kw * sizeof(Dtype)]);
+          sstore(ptr[rsi + kw * sizeof(Dtype)], xmm1);
+        }
+        add(rsi, width * sizeof(Dtype));
+        dec(r15);
+        jnz("row_loop", T_NEAR);
+      add(rax, plane_size * sizeof(Dtype));
+      dec(rdx);
+      jnz("plane_loop", T_NEAR);
+    add(r8, stride_w * sizeof(Dtype));
+    add(r9, sizeof(Dtype));
+    dec(r11);
+    jmp("output_loop", T_NEAR);
+
+    L("done");
+    Return();
+  }
+};
+#endif
+
+// The code for the rows of a layer, generated once per process for each
+// method, mask, kernel width, stride and input shape; NULL where there is
+// none, which leaves the layer to Naive.
+template <typename Dtype>
+typename PoolingCodeGeneratorForward<Dtype>::Row_t* Row_code(bool forward,
+    PoolingParameter_PoolMethod method, bool use_top_mask, int kernel_w,
+    int stride_w, int width, int height) {
+#if defined __x86_64__ || defined _M_X64
+  static const bool avx2 =
+      ::Xbyak::util::Cpu().has(::Xbyak::util::Cpu::tAVX2);
+  const bool max_pool = method == PoolingParameter_PoolMethod_MAX;
+  if (!avx2 || (!max_pool && method != PoolingParameter_PoolMethod_AVE) ||
+      (!forward && max_pool)) {
+    return NULL;
+  }
+  vector<int> key;
+  key.push_back(forward);
+  key.push_back(max_pool);
+  key.push_back(max_pool && use_top_mask);
+  key.push_back(kernel_w);
+  key.push_back(stride_w);
+  key.push_back(width);
+  key.push_back(height);
+  static boost::mutex mutex;
+  static std::map<vector<int>, shared_ptr<PoolingRowCode<Dtype> > > codes;
+  boost::mutex::scoped_lock lock(mutex);
+  shared_ptr<PoolingRowCode<Dtype> >& code = codes[key];
+  if (!code) {
+    code.reset(new PoolingRowCode<Dtype>(forward, max_pool, use_top_mask,
+        kernel_w, stride_w, width, width * height));
+  }
+  return code->row();
+#else
+  return NULL;
+#endif
+}
+
+}  // namespace
+
 template <typename Dtype>
 PoolingCodeGeneratorForward<Dtype>::PoolingCodeGeneratorForward() {
   Callback = NULL;
+  Row = NULL;
 }
 
 template <typename Dtype>
@@ -59,22 +491,31 @@ typename PoolingCodeGeneratorForward<Dtype>::Callback_t*
   Blob<Dtype>* top,
   bool use_top_mask) {
   // Wrapper for lazy initialization.
-  // Also check if top shape din't change.
-  // TODO: do we need to check all blobs' shapes?
-  // In future we may add cache for all already found options.
-  // Currently there is only one code for last used shape.
+  // Also check if the shape didn't change; the generated code itself is
+  // cached for all shapes.
+  vector<int> signature = top->shape();
+  signature.push_back(layer->height_);
+  signature.push_back(layer->width_);
   if (Callback == NULL ||
-      top->shape() != Layer_output_shape_signature ||
+      signature != Layer_output_shape_signature ||
       Use_top_mask != use_top_mask ||
       Method != layer->layer_param_.pooling_param().pool()) {
     Method = layer->layer_param_.pooling_param().pool();
     Use_top_mask = use_top_mask;
-    Layer_output_shape_signature = top->shape();
+    Layer_output_shape_signature = signature;
     Create_callback(layer);
   }
   return Callback;
 }
 
+template <typename Dtype>
+void PoolingCodeGeneratorForward<Dtype>::Create_callback(
+  PoolingLayer<Dtype>* layer) {
+  Row = Row_code<Dtype>(true, Method, Use_top_mask, layer->kernel_w_,
+                        layer->stride_w_, layer->width_, layer->height_);
+  Callback = Row ? Generated : Naive;
+}
+
 // Implementation of CodeGenerator classes for Pooling.
 template <typename Dtype>
 void PoolingCodeGeneratorForward<Dtype>::Naive(
@@ -88,620 +529,143 @@ void PoolingCodeGeneratorForward<Dtype>::Naive(
   int64_t channel_end,
   PoolingLayer<Dtype>* layer,
   bool use_top_mask) {
-  int* mask = NULL;  // suppress warnings about uninitalized variables
-  Dtype* top_mask = static_cast<Dtype*>(mask_ptr);
-
-  int pooled_fm_size = layer->pooled_height_ * layer->pooled_width_;
-  int fm_size = layer->height_ * layer->width_;
-
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more code.
-  switch (layer->layer_param_.pooling_param().pool()) {
-  case PoolingParameter_PoolMethod_MAX:
-    // Initialize
-    if (!use_top_mask) {
-      mask = static_cast<int*>(mask_ptr);
-    }
-
-    // Set starting point eg. memory offset corressponding to
-    // requested starting batch and requested starting channel
-    bottom_data += fm_size*(layer->channels_*batch_start + channel_start);
-    top_data += pooled_fm_size*(layer->channels_*batch_start + channel_start);
-    if (use_top_mask) {
-      top_mask += pooled_fm_size*(layer->channels_*batch_start + channel_start);
-    } else {
-      mask += pooled_fm_size*(layer->channels_*batch_start + channel_start);
-    }
-
-    // The main loop
-    for (int n = batch_start; n < batch_end; ++n) {
-      for (int c = channel_start; c < channel_end; ++c) {
-        for (int ph = 0; ph < layer->pooled_height_; ++ph) {
-          for (int pw = 0; pw < layer->pooled_width_; ++pw) {
-            int hstart = ph * layer->stride_h_ - layer->pad_h_;
-            int wstart = pw * layer->stride_w_ - layer->pad_w_;
-            int hend = min(hstart + layer->kernel_h_, layer->height_);
-            int wend = min(wstart + layer->kernel_w_, layer->width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * layer->pooled_width_ + pw;
-            Dtype acc = -FLT_MAX;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * layer->width_ + w;
-                if (bottom_data[index] > acc) {
-                  acc = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-            top_data[pool_index] = acc;
-          }
-        }
-        // compute offset
-        bottom_data += fm_size;
-        top_data += pooled_fm_size;
-        if (use_top_mask) {
-          top_mask += pooled_fm_size;
-        } else {
-          mask += pooled_fm_size;
-        }
-      }
-    }
-    break;
-  case PoolingParameter_PoolMethod_AVE:
-
-    bottom_data += fm_size*(layer->channels_*batch_start + channel_start);
-    top_data += pooled_fm_size*(layer->channels_*batch_start + channel_start);
-
-    // The main loop
-    for (int n = batch_start; n < batch_end; ++n) {
-      for (int c = channel_start; c < channel_end; ++c) {
-        for (int ph = 0; ph < layer->pooled_height_; ++ph) {
-          for (int pw = 0; pw < layer->pooled_width_; ++pw) {
-            int hstart = ph * layer->stride_h_ - layer->pad_h_;
-            int wstart = pw * layer->stride_w_ - layer->pad_w_;
-            int hend =
-              min(hstart + layer->kernel_h_, layer->height_ + layer->pad_h_);
-            int wend =
-              min(wstart + layer->kernel_w_, layer->width_ + layer->pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, layer->height_);
-            wend = min(wend, layer->width_);
-            Dtype acc = 0;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                acc += bottom_data[h * layer->width_ + w];
-              }
-            }
-            top_data[ph * layer->pooled_width_ + pw] = acc / pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += fm_size;
-        top_data += pooled_fm_size;
-      }
-    }
-    break;
-  case PoolingParameter_PoolMethod_STOCHASTIC:
-    NOT_IMPLEMENTED;
-    break;
-  default:
-    LOG(FATAL) << "Unknown pooling method.";
-  }
+  Pool(bottom_data, top_data, batch_start, batch_end, mask_ptr,
+       channel_start, channel_end, layer, use_top_mask, NULL);
 }
 
-// Generic datatypes - use naive versions.
 template <typename Dtype>
-void PoolingCodeGeneratorForward<Dtype>::Create_callback(
-  PoolingLayer<Dtype>* layer) {
-  Callback = Naive;
+void PoolingCodeGeneratorForward<Dtype>::Generated(
+  const Dtype* bottom_data,
+  Dtype* top_data,
+  int top_count,
+  int batch_start,
+  int batch_end,
+  void* mask_ptr,
+  int64_t channel_start,
+  int64_t channel_end,
+  PoolingLayer<Dtype>* layer,
+  bool use_top_mask) {
+  Pool(bottom_data, top_data, batch_start, batch_end, mask_ptr,
+       channel_start, channel_end, layer, use_top_mask,
+       layer->Forward_code_generator.Row);
 }
 
-#if defined __x86_64__ || defined _M_X64
-// Here we have specialized versions for supported formats in x64 architectures.
-template <>
-void PoolingCodeGeneratorForward<float>::Create_callback(
-  PoolingLayer<float>* layer) {
-  using Xbyak::util::Cpu;
-  using Xbyak::Reg64;
-  using Xbyak::Reg32;
-  using Xbyak::Address;
-  Cpu Current_cpu;
-  const LayerParameter& param = layer->layer_param();
-  if (Current_cpu.has(Cpu::tAVX2) &&
-      (param.pooling_param().pool() == PoolingParameter_PoolMethod_AVE ||
-       param.pooling_param().pool() == PoolingParameter_PoolMethod_MAX)) {
-    // AVX2 optimized version.
-    // Runtime constants.
-    const int pooled_fm_size = layer->pooled_height_ * layer->pooled_width_;
-    const int fm_size = layer->height_ * layer->width_;
-
-    const int pooled_batch_size = pooled_fm_size * layer->channels_;
-    const int batch_size = fm_size * layer->channels_;
-
-    const int height_kernel_h_ = layer->height_ - layer->kernel_h_;
-    const int width_kernel_w_ = layer->width_ - layer->kernel_w_;
-
-    const int height_kernel_h_pad_h_ = height_kernel_h_ + layer->pad_h_;
-    const int width_kernel_w_pad_w_ = width_kernel_w_ + layer->pad_w_;
-
-    int64_t internal_mask_ptr =
-      (Use_top_mask
-        || param.pooling_param().pool() == PoolingParameter_PoolMethod_AVE) ?
-          0 : reinterpret_cast<int64_t>(layer->max_idx_.cpu_data());
-
-    bool optimal_version = false;
-
-    if (layer->pad_h_ == 0 &&
-        layer->pad_w_ == 0 &&
-        (layer->pooled_height_-1) * layer->stride_h_ + layer->kernel_h_
-         == layer->height_ &&
-        (layer->pooled_width_-1) * layer->stride_w_ + layer->kernel_w_
-         == layer->width_)
-      optimal_version = true;
-
-    // Register names.
-    const Reg64& reg_input_ptr = rsi;
-    const Reg64& reg_index_acc = rcx;
-    const Reg32& reg_index_acc_l = ecx;
-    const Reg64& reg_index_cnt = rdi;
-
-    const Reg64& reg_scratch0 = r8;
-    const Reg64& reg_scratch1 = r9;
-    const Reg64& reg_scratch2 = r10;
-    const Reg64& reg_scratch3 = r11;
-    const Reg64& reg_scratch4 = r12;
-    const Reg64& reg_scratch5 = r13;
-    const Reg64& reg_scratch6 = r14;
-    const Reg64& reg_scratch7 = r15;
-    const Reg64& reg_scratch8 = rbx;
-
-    const Reg64& reg_arg0 = rdi;
-    const Reg64& reg_arg1 = rsi;
-    const Reg64& reg_arg2 = rdx;
-    const Reg64& reg_arg3 = rcx;
-    const Reg64& reg_arg4 = r8;
-    const Reg64& reg_arg5 = r9;
-    const Address& stackarg_channel_start = qword[rbp + 16];
-    const Address& stackarg_channel_end = qword[rbp + 24];
-
-    const Reg64& reg_mul_param = rax;
-    const Reg64& reg_mul_result_l = rax;
-
-    // Stack variable names residing inside red zone.
-    int stack_qwords = 0;
-    const Address& stack_bottom_data_ptr = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_top_data_ptr    = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_top_count       = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_batch_start     = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_batch_end       = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_top_mask_ptr    = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_batch_cnt       = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_channel_cnt     = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_out_w_cnt       = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_out_h_cnt       = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_pool_index      = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_top_mask_orig   = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_top_orig        = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_bottom_orig     = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_min_float       = dword[rbp - (++stack_qwords * 8)];
-    const Address& stack_wstart0         = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_index0          = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_true_height     = qword[rbp - (++stack_qwords * 8)];
-    const Address& stack_true_width      = qword[rbp - (++stack_qwords * 8)];
-
-    // ASSEMBLY STARTS HERE.
-    // It seems we are regenerating the code due to output reshape
-    if (Callback)
-      reset();
-
-    // Prologue.
-    push(rbp);
-    mov(rbp, rsp);
-    sub(rsp, stack_qwords * 8);
-
-    // Save r12-r15 and rbx registers.
-    push(r12); push(r13); push(r14); push(r15); push(rbx);
-
-    // Prepare default accumulator. (and bypass memory aliasing warning...)
-    float min_float = -FLT_MAX;
-    void* min_float_ptr = &min_float;
-    uint32_t min_float_cast = *reinterpret_cast<uint32_t*>(min_float_ptr);
-    mov(stack_min_float, min_float_cast);
-    vbroadcastss(xmm15, stack_min_float);
-
-    // Move register arguments to the stack,
-    // we gonna need the registers for other purposes.
-    mov(stack_bottom_orig,   reg_arg0);
-    mov(stack_top_orig,      reg_arg1);
-    mov(stack_top_count,     reg_arg2);
-    mov(stack_batch_start,   reg_arg3);
-    mov(stack_batch_end,     reg_arg4);
-
-    if (param.pooling_param().pool() == PoolingParameter_PoolMethod_MAX) {
-      if (Use_top_mask) {
-        mov(stack_top_mask_orig, reg_arg5);
-      } else {
-        mov(reg_scratch0, internal_mask_ptr);
-        mov(stack_top_mask_orig, reg_scratch0);
+template <typename Dtype>
+void PoolingCodeGeneratorForward<Dtype>::Pool(
+  const Dtype* bottom_data,
+  Dtype* top_data,
+  int batch_start,
+  int batch_end,
+  void* mask_ptr,
+  int64_t channel_start,
+  int64_t channel_end,
+  PoolingLayer<Dtype>* layer,
+  bool use_top_mask,
+  Row_t* row) {
+  const PoolingLayer<Dtype>& l = *layer;
+  const PoolingParameter_PoolMethod method =
+      l.layer_param_.pooling_param().pool();
+  if (method == PoolingParameter_PoolMethod_STOCHASTIC) {
+    NOT_IMPLEMENTED;
+  } else if (method != PoolingParameter_PoolMethod_MAX &&
+             method != PoolingParameter_PoolMethod_AVE) {
+    LOG(FATAL) << "Unknown pooling method.";
+  }
+  const bool max_pool = method == PoolingParameter_PoolMethod_MAX;
+  const int plane_size = l.height_ * l.width_;
+  const int fm_size = l.depth_ * plane_size;
+  const int pooled_fm_size =
+      l.pooled_depth_ * l.pooled_height_ * l.pooled_width_;
+  int inner_begin, inner_end;
+  Inner_columns(l.pooled_width_, l.kernel_w_, l.stride_w_, l.pad_w_,
+                l.width_, &inner_begin, &inner_end);
+
+  for (int n = batch_start; n < batch_end; ++n) {
+    for (int c = channel_start; c < channel_end; ++c) {
+      const int fm = n * l.channels_ + c;
+      const Dtype* bottom = bottom_data + fm * fm_size;
+      Dtype* top = top_data + fm * pooled_fm_size;
+      // The indices of the maxima, in top[1] or the layer.
+      Dtype* top_mask = NULL;
+      int* mask = NULL;
+      if (max_pool && use_top_mask) {
+        top_mask = static_cast<Dtype*>(mask_ptr) + fm * pooled_fm_size;
+      } else if (max_pool) {
+        mask = static_cast<int*>(mask_ptr) + fm * pooled_fm_size;
       }
-    }
-
-    // Further arguments on stack
-    // (layer_ptr and use_top_mask) are ingored in this implementation.
-
-    // Iterate through batches.
-    mov(reg_scratch0, stack_batch_start);
-    mov(stack_batch_cnt, reg_scratch0);
-    L("batch_loop_start");
-    mov(reg_scratch0, stack_batch_end);
-    cmp(stack_batch_cnt, reg_scratch0);
-    jae("batch_loop_end", T_NEAR);
-
-      // Iterate through channels.
-      mov(reg_scratch0, stackarg_channel_start);
-      mov(stack_channel_cnt, reg_scratch0);
-      L("channel_loop_start");
-      mov(reg_scratch0, stack_channel_cnt);
-      cmp(reg_scratch0, stackarg_channel_end);
-      jae("channel_loop_end", T_NEAR);
-
-        // Compute batch/channel offsets for buffers.
-        // input: (batch_size*batch+fm_size*fm)*4 + ptr
-        mov(reg_mul_param, batch_size);
-        mul(stack_batch_cnt);
-        mov(reg_scratch0, reg_mul_result_l);
-        mov(reg_mul_param, fm_size);
-        mul(stack_channel_cnt);
-        add(reg_scratch0, reg_mul_result_l);
-        shl(reg_scratch0, 2);
-        add(reg_scratch0, stack_bottom_orig);
-        mov(stack_bottom_data_ptr, reg_scratch0);
-
-        // output: (pooled_batch_size*batch+pooled_fm_size*fm)*4 + ptr
-        // mask same
-        mov(reg_mul_param, pooled_batch_size);
-        mul(stack_batch_cnt);
-        mov(reg_scratch0, reg_mul_result_l);
-        mov(reg_mul_param, pooled_fm_size);
-        mul(stack_channel_cnt);
-        add(reg_scratch0, reg_mul_result_l);
-        shl(reg_scratch0, 2);
-        mov(reg_scratch1, reg_scratch0);
-
-        add(reg_scratch0, stack_top_orig);
-        mov(stack_top_data_ptr, reg_scratch0);
-
-        if (param.pooling_param().pool() == PoolingParameter_PoolMethod_MAX) {
-          add(reg_scratch1, stack_top_mask_orig);
-          mov(stack_top_mask_ptr, reg_scratch1);
-        }
-
-        // Iterate through output height.
-        mov(stack_out_h_cnt, 0);
-        L("out_h_loop_start");
-        cmp(stack_out_h_cnt, layer->pooled_height_);
-        jae("out_h_loop_end", T_NEAR);
-
-          if (optimal_version) {
-            // index_in = ph * stride_h_ * width_; stored in reg_scratch7
-            mov(reg_mul_param, layer->stride_h_ * layer->width_);
-            imul(stack_out_h_cnt);
-            mov(reg_scratch7, reg_mul_result_l);
-
-            // effective_in = index_in*4 + input_ptr; stored in reg_scratch5
-            mov(reg_scratch0, stack_bottom_data_ptr);
-            lea(reg_scratch5, ptr[reg_scratch7*4 + reg_scratch0]);
-
-            // index_out = ph * pooled_width_; stored in reg_scratch6
-            mov(reg_mul_param, layer->pooled_width_);
-            imul(stack_out_h_cnt);
-            mov(reg_scratch6, reg_mul_result_l);
-
-            // effective_out = index_out*4 + output_ptr; stored in reg_scratch4
-            mov(reg_scratch0, stack_top_data_ptr);
-            lea(reg_scratch4, ptr[reg_scratch6*4 + reg_scratch0]);
-
-            if (param.pooling_param().pool()
-                == PoolingParameter_PoolMethod_MAX) {
-              // effective_mask = index_out*4 + mask_ptr; stored in reg_scratch3
-              mov(reg_scratch0, stack_top_mask_ptr);
-              lea(reg_scratch3, ptr[reg_scratch6*4 + reg_scratch0]);
+      for (int pd = 0; pd < l.pooled_depth_; ++pd) {
+        const PoolingWindow d(pd, l.kernel_d_, l.stride_d_, l.pad_d_,
+                              l.depth_);
+        for (int ph = 0; ph < l.pooled_height_; ++ph) {
+          const PoolingWindow h(ph, l.kernel_h_, l.stride_h_, l.pad_h_,
+                                l.height_);
+          const int top_row = (pd * l.pooled_height_ + ph) * l.pooled_width_;
+          int pw = 0;
+          while (pw < l.pooled_width_) {
+            if (row && pw == inner_begin && pw < inner_end &&
+                !d.empty() && !h.empty()) {
+              const int pool_index = top_row + pw;
+              PoolingRowArgs<Dtype> args;
+              args.index = d.start * plane_size + h.start * l.width_ +
+                           pw * l.stride_w_ - l.pad_w_;
+              args.bottom = const_cast<Dtype*>(bottom) + args.index;
+              args.top = top + pool_index;
+              args.mask = top_mask ? static_cast<void*>(top_mask + pool_index)
+                        : mask ? static_cast<void*>(mask + pool_index) : NULL;
+              args.count = inner_end - pw;
+              args.planes = d.end - d.start;
+              args.rows = h.end - h.start;
+              args.scale = Dtype(1) / (d.size * h.size * l.kernel_w_);
+              row(&args);
+              pw = inner_end;
+              continue;
             }
-
-            // Iterate through output width.
-            mov(reg_scratch8, 0);
-            L("out_w_loop_start");
-            cmp(reg_scratch8, layer->pooled_width_);
-            jae("out_w_loop_end", T_NEAR);
-
-              if (param.pooling_param().pool()
-                  == PoolingParameter_PoolMethod_MAX) {
-                mov(reg_index_cnt, reg_scratch7);
-                movaps(xmm0, xmm15);
-                for (int kernel_h = 0;
-                         kernel_h < layer->kernel_h_; ++kernel_h) {
-                  for (int kernel_w = 0;
-                           kernel_w < layer->kernel_w_; ++kernel_w) {
-                    ucomiss(xmm0,
-                        ptr[reg_scratch5
-                            + kernel_w*sizeof(float)
-                            + kernel_h*layer->width_*sizeof(float)]);
-                    maxss(xmm0,
-                        ptr[reg_scratch5
-                            + kernel_w*sizeof(float)
-                            + kernel_h*layer->width_*sizeof(float)]);
-                    cmovb(reg_index_acc, reg_index_cnt);
-
-                    if (kernel_w+1 < layer->kernel_w_)
-                      inc(reg_index_cnt);
+            const PoolingWindow w(pw, l.kernel_w_, l.stride_w_, l.pad_w_,
+                                  l.width_);
+            const int pool_index = top_row + pw;
+            if (max_pool) {
+              Dtype acc = -FLT_MAX;
+              int max_index = -1;
+              for (int z = d.start; z < d.end; ++z) {
+                for (int y = h.start; y < h.end; ++y) {
+                  for (int x = w.start; x < w.end; ++x) {
+                    const int index = (z * l.height_ + y) * l.width_ + x;
+                    if (bottom[index] > acc) {
+                      acc = bottom[index];
+                      max_index = index;
+                    }
                   }
-                  add(reg_index_cnt, layer->width_ - layer->kernel_w_ + 1);
                 }
-
-                if (Use_top_mask) {
-                  // Use float mask, convert value to float first.
-                  cvtsi2ss(xmm1, reg_index_acc);
-                  movss(ptr[reg_scratch3], xmm1);
-                } else {
-                  // Use 32bit integer mask.
-                  mov(dword[reg_scratch3], reg_index_acc_l);
-                }
-              } else if (param.pooling_param().pool()
-                         == PoolingParameter_PoolMethod_AVE) {
-                xorps(xmm0, xmm0);
-                for (int kernel_h = 0;
-                     kernel_h < layer->kernel_h_; ++kernel_h)
-                  for (int kernel_w = 0;
-                      kernel_w < layer->kernel_w_; ++kernel_w)
-                    addss(xmm0,
-                      ptr[reg_scratch5
-                        + kernel_w*sizeof(float)
-                        + kernel_h*layer->width_*sizeof(float)]);
-
-                mov(reg_scratch0, layer->kernel_h_*layer->kernel_w_);
-                cvtsi2ss(xmm1, reg_scratch0);
-                divss(xmm0, xmm1);
               }
-
-              movss(ptr[reg_scratch4], xmm0);
-
-              add(reg_scratch5, layer->stride_w_*sizeof(float));
-              add(reg_scratch4, sizeof(float));
-
-              if (param.pooling_param().pool()
-                  == PoolingParameter_PoolMethod_MAX) {
-                add(reg_scratch7, layer->stride_w_);
-                add(reg_scratch3, sizeof(float));
-              }
-
-              inc(reg_scratch8);
-              jmp("out_w_loop_start", T_NEAR);
-            L("out_w_loop_end");
-          } else {
-            // hstart = ph * stride_h_ - pad_h_; stored in reg_scratch3
-            mov(reg_mul_param, layer->stride_h_);
-            imul(stack_out_h_cnt);
-            sub(reg_mul_result_l, layer->pad_h_);
-            mov(reg_scratch3, reg_mul_result_l);
-
-            if (param.pooling_param().pool()
-                == PoolingParameter_PoolMethod_AVE) {
-              // true_height =
-              // min(hstart, height_ - kernel_h_ + pad_h_) + kernel_h_ - hstart;
-              // required to compute pooling size
-              mov(reg_scratch0, reg_scratch3);
-              mov(reg_scratch1, height_kernel_h_pad_h_);
-              cmp(reg_scratch0, reg_scratch1);
-              cmovg(reg_scratch0, reg_scratch1);
-              add(reg_scratch0, layer->kernel_h_);
-              sub(reg_scratch0, reg_scratch3);
-              mov(stack_true_height, reg_scratch0);
-            }
-
-            // int hend
-            // = min(hstart, height_ - kernel_h_) + kernel_h_;
-            // stored in reg_scratch6
-            mov(reg_scratch0, reg_scratch3);
-            mov(reg_scratch1, height_kernel_h_);
-            cmp(reg_scratch0, reg_scratch1);
-            cmovg(reg_scratch0, reg_scratch1);
-            add(reg_scratch0, layer->kernel_h_);
-            mov(reg_scratch6, reg_scratch0);
-
-            // hstart = max(hstart, 0); stored in reg_scratch3
-            mov(reg_scratch0, reg_scratch3);
-            mov(reg_scratch1, 0);
-            cmp(reg_scratch0, reg_scratch1);
-            cmovl(reg_scratch0, reg_scratch1);
-            mov(reg_scratch3, reg_scratch0);
-
-            // wstart0 = -pad_w_
-            mov(stack_wstart0, -layer->pad_w_);
-
-            // pool_index = (ph * pooled_width_)*4;
-            mov(reg_mul_param, layer->pooled_width_ * sizeof(float));
-            imul(stack_out_h_cnt);
-            mov(stack_pool_index, reg_mul_result_l);
-
-            // index0 = hstart * width_;
-            mov(reg_mul_param, layer->width_);
-            imul(reg_scratch3);
-            mov(stack_index0, reg_mul_result_l);
-
-            // Iterate through output width.
-            mov(stack_out_w_cnt, 0);
-            L("out_w_loop_start");
-            cmp(stack_out_w_cnt, layer->pooled_width_);
-            jae("out_w_loop_end", T_NEAR);
-
-              // wend = min(wstart0, width_ - kernel_w_) + kernel_w_;
-              // stored in reg_scratch7
-              mov(reg_scratch7, stack_wstart0);
-              mov(reg_scratch1, width_kernel_w_);
-              cmp(reg_scratch7, reg_scratch1);
-              cmovg(reg_scratch7, reg_scratch1);
-              add(reg_scratch7, layer->kernel_w_);
-
-              if (param.pooling_param().pool()
-                  == PoolingParameter_PoolMethod_AVE) {
-                // true_width =
-                //    min(wstart0, width_ - kernel_w_ + pad_h_)
-                //    + kernel_w_ - wstart0;
-                // required to compute pooling size
-                mov(reg_scratch0, stack_wstart0);
-                mov(reg_scratch1, width_kernel_w_pad_w_);
-                cmp(reg_scratch0, reg_scratch1);
-                cmovg(reg_scratch0, reg_scratch1);
-                add(reg_scratch0, layer->kernel_w_);
-                sub(reg_scratch0, stack_wstart0);
-                mov(stack_true_width, reg_scratch0);
-              }
-
-              // wstart = max(wstart0, 0); stored in reg_scratch8
-              mov(reg_scratch8, stack_wstart0);
-              mov(reg_scratch1, 0);
-              cmp(reg_scratch8, reg_scratch1);
-              cmovl(reg_scratch8, reg_scratch1);
-
-              // wstart0 += stride_w_
-              add(stack_wstart0, layer->stride_w_);
-
-              // num_elements_to_do = wend - wstart; stored in reg_scratch7
-              sub(reg_scratch7, reg_scratch8);
-
-              // const int index = index0 + wstart; stored in reg_scratch5
-              mov(reg_scratch5, stack_index0);
-              add(reg_scratch5, reg_scratch8);
-
-              // const int effective_ptr = (index)*4 + input_ptr;
-              // stored in reg_scratch4
-              lea(reg_scratch4, ptr[reg_scratch5*4]);
-              add(reg_scratch4, stack_bottom_data_ptr);
-
-              // Prepare accumulators.
-              if (param.pooling_param().pool()
-                  == PoolingParameter_PoolMethod_MAX) {
-                movaps(xmm0, xmm15);
-                mov(reg_index_acc, -1);
-              } else if (param.pooling_param().pool()
-                         == PoolingParameter_PoolMethod_AVE) {
-                xorps(xmm0, xmm0);
+              top[pool_index] = acc;
+              if (use_top_mask) {
+                top_mask[pool_index] = static_cast<Dtype>(max_index);
+              } else {
+                mask[pool_index] = max_index;
               }
-
-              // Iterate through kernel height.
-              // We are reusing mulparam reg here (rax)
-              // but we won't be MULing inside.
-              mov(reg_mul_param, reg_scratch3);
-              align(8);
-              L("kern_h_loop_start");
-              cmp(reg_mul_param, reg_scratch6);
-              jae("kern_h_loop_end", T_NEAR);
-
-                mov(reg_input_ptr, reg_scratch4);
-                mov(reg_index_cnt, reg_scratch5);
-                lea(reg_scratch2, ptr[reg_scratch5 + reg_scratch7]);
-
-                // Iterate through kernel width.
-                align(8);
-                L("kern_w_loop_start");
-                cmp(reg_index_cnt, reg_scratch2);
-                jae("kern_w_loop_end", T_NEAR);
-
-                  if (param.pooling_param().pool()
-                      == PoolingParameter_PoolMethod_MAX) {
-                    movss(xmm1, ptr[reg_input_ptr]);
-                    ucomiss(xmm1, xmm0);
-                    maxss(xmm0, xmm1);
-                    cmova(reg_index_acc, reg_index_cnt);
-                  } else if (param.pooling_param().pool()
-                           == PoolingParameter_PoolMethod_AVE) {
-                    addss(xmm0, ptr[reg_input_ptr]);
+            } else {
+              Dtype acc = 0;
+              for (int z = d.start; z < d.end; ++z) {
+                for (int y = h.start; y < h.end; ++y) {
+                  for (int x = w.start; x < w.end; ++x) {
+                    acc += bottom[(z * l.height_ + y) * l.width_ + x];
                   }
-
-                  add(reg_input_ptr, sizeof(float));
-
-                  inc(reg_index_cnt);
-                  jmp("kern_w_loop_start", T_NEAR);
-                L("kern_w_loop_end");
-
-                add(reg_scratch4, layer->width_ * sizeof(float));
-                add(reg_scratch5, layer->width_);
-
-                inc(reg_mul_param);
-                jmp("kern_h_loop_start", T_NEAR);
-              L("kern_h_loop_end");
-
-              // Save accumulators.
-              if (param.pooling_param().pool()
-                  == PoolingParameter_PoolMethod_AVE) {
-                mov(reg_mul_param, stack_true_height);
-                imul(stack_true_width);
-                cvtsi2ss(xmm1, reg_mul_result_l);
-                divss(xmm0, xmm1);
-              }
-
-              mov(reg_scratch0, stack_pool_index);
-              mov(reg_scratch1, stack_top_data_ptr);
-              movss(ptr[reg_scratch0 + reg_scratch1], xmm0);
-
-              if (param.pooling_param().pool()
-                  == PoolingParameter_PoolMethod_MAX) {
-                if (Use_top_mask) {
-                // Use float mask, convert value to float first.
-                  cvtsi2ss(xmm0, reg_index_acc);
-                  mov(reg_scratch1, stack_top_mask_ptr);
-                  movss(ptr[reg_scratch0 + reg_scratch1], xmm0);
-                } else {  // Use 32bit integer mask.
-                  mov(reg_scratch1, stack_top_mask_ptr);
-                  mov(dword[reg_scratch0 + reg_scratch1], reg_index_acc_l);
                 }
               }
-
-              // Update pool_index.
-              add(stack_pool_index, sizeof(float));
-
-              inc(stack_out_w_cnt);
-              jmp("out_w_loop_start", T_NEAR);
-            L("out_w_loop_end");
+              top[pool_index] = acc / (d.size * h.size * w.size);
+            }
+            ++pw;
           }
-
-          inc(stack_out_h_cnt);
-          jmp("out_h_loop_start", T_NEAR);
-        L("out_h_loop_end");
-
-        inc(stack_channel_cnt);
-        jmp("channel_loop_start", T_NEAR);
-      L("channel_loop_end");
-
-      inc(stack_batch_cnt);
-      jmp("batch_loop_start", T_NEAR);
-    L("batch_loop_end");
-
-    // Restore r12-r15 and rbx registers.
-    pop(rbx); pop(r15); pop(r14); pop(r13); pop(r12);
-
-    add(rsp, stack_qwords * 8);
-    pop(rbp);
-    ret();
-
-    Callback = getCode<Callback_t*>();
-  } else {  // Take naive path.
-    Callback = Naive;
+        }
+      }
+    }
   }
 }
-#endif
 
 template <typename Dtype>
 PoolingCodeGeneratorBackward<Dtype>::PoolingCodeGeneratorBackward() {
   Callback = NULL;
+  Row = NULL;
 }
 
 template <typename Dtype>
@@ -713,18 +677,31 @@ typename PoolingCodeGeneratorBackward<Dtype>::Callback_t*
   PoolingCodeGeneratorBackward<Dtype>::Get_callback(
     PoolingLayer<Dtype>* layer, Blob<Dtype>* top) {
   // Wrapper for lazy initialization.
-  // Also check if top shape din't change.
-  // TODO: do we need to check all blobs' shapes?
-  // In future we may add cache for all already found options.
-  // Currently there is only one code for last used shape.
-  if (Callback == NULL || top->shape() != layer_output_shape_signature) {
-    layer_output_shape_signature = top->shape();
+  // Also check if the shape didn't change; the generated code itself is
+  // cached for all shapes.
+  vector<int> signature = top->shape();
+  signature.push_back(layer->height_);
+  signature.push_back(layer->width_);
+  if (Callback == NULL || signature != layer_output_shape_signature ||
+      Method != layer->layer_param_.pooling_param().pool()) {
+    Method = layer->layer_param_.pooling_param().pool();
+    layer_output_shape_signature = signature;
     Create_callback(layer);
   }
 
   return Callback;
 }
 
+template <typename Dtype>
+void PoolingCodeGeneratorBackward<Dtype>::Create_callback(
+  PoolingLayer<Dtype>* layer) {
+  // MAX scatters the diffs through the mask, which gains nothing from
+  // generated code.
+  Row = Row_code<Dtype>(false, Method, false, layer->kernel_w_,
+                        layer->stride_w_, layer->width_, layer->height_);
+  Callback = Row ? Generated : Naive;
+}
+
 template <typename Dtype>
 void PoolingCodeGeneratorBackward<Dtype>::Naive(
   const Dtype* top_diff,
@@ -736,139 +713,128 @@ void PoolingCodeGeneratorBackward<Dtype>::Naive(
   bool use_top_mask,
   const void* mask_ptr,
   PoolingLayer<Dtype>* layer) {
-  const int* mask = NULL;  // suppress warnings about uninitialized variables
-  const Dtype* top_mask = static_cast<const Dtype*>(mask_ptr);
+  Pool(top_diff, bottom_diff, batch_start, batch_end, channel_start,
+       channel_end, use_top_mask, mask_ptr, layer, NULL);
+}
 
-  int pooled_fm_size = layer->pooled_height_ * layer->pooled_width_;
-  int fm_size = layer->height_ * layer->width_;
+template <typename Dtype>
+void PoolingCodeGeneratorBackward<Dtype>::Generated(
+  const Dtype* top_diff,
+  Dtype* bottom_diff,
+  int batch_start,
+  int batch_end,
+  int64_t channel_start,
+  int64_t channel_end,
+  bool use_top_mask,
+  const void* mask_ptr,
+  PoolingLayer<Dtype>* layer) {
+  Pool(top_diff, bottom_diff, batch_start, batch_end, channel_start,
+       channel_end, use_top_mask, mask_ptr, layer,
+       layer->Backward_code_generator.Row);
+}
 
-  switch (layer->layer_param_.pooling_param().pool()) {
-  case PoolingParameter_PoolMethod_MAX:
-    // The main loop
-    if (!use_top_mask) {
-      mask = static_cast<const int*>(mask_ptr);
-    }
-    bottom_diff += fm_size*(layer->channels_*batch_start + channel_start);
-    top_diff += pooled_fm_size*(layer->channels_*batch_start + channel_start);
-    if (use_top_mask) {
-      top_mask += pooled_fm_size*(layer->channels_*batch_start + channel_start);
-    } else {
-      mask += pooled_fm_size*(layer->channels_*batch_start + channel_start);
-    }
+template <typename Dtype>
+void PoolingCodeGeneratorBackward<Dtype>::Pool(
+  const Dtype* top_diff,
+  Dtype* bottom_diff,
+  int batch_start,
+  int batch_end,
+  int64_t channel_start,
+  int64_t channel_end,
+  bool use_top_mask,
+  const void* mask_ptr,
+  PoolingLayer<Dtype>* layer,
+  Row_t* row) {
+  const PoolingLayer<Dtype>& l = *layer;
+  const PoolingParameter_PoolMethod method =
+      l.layer_param_.pooling_param().pool();
+  if (method == PoolingParameter_PoolMethod_STOCHASTIC) {
+    NOT_IMPLEMENTED;
+  } else if (method != PoolingParameter_PoolMethod_MAX &&
+             method != PoolingParameter_PoolMethod_AVE) {
+    LOG(FATAL) << "Unknown pooling method.";
+  }
+  const int plane_size = l.height_ * l.width_;
+  const int fm_size = l.depth_ * plane_size;
+  const int pooled_fm_size =
+      l.pooled_depth_ * l.pooled_height_ * l.pooled_width_;
 
+  if (method == PoolingParameter_PoolMethod_MAX) {
     for (int n = batch_start; n < batch_end; ++n) {
-      if (use_top_mask) {
-        for (int c = channel_start; c < channel_end; ++c) {
-          int index0 = 0;
-          for (int ph = 0; ph < layer->pooled_height_; ++ph) {
-            int index = index0;
-            index0 += layer->pooled_width_;
-            for (int pw = 0; pw < layer->pooled_width_; ++pw) {
-              const int bottom_index = top_mask[index];
-              bottom_diff[bottom_index] += top_diff[index];
-              ++index;
-            }
-          }
-          bottom_diff += fm_size;
-          top_diff += pooled_fm_size;
-          top_mask += pooled_fm_size;
-        }
-      } else {
-        for (int c = channel_start; c < channel_end; ++c) {
-          int index0 = 0;
-          for (int ph = 0; ph < layer->pooled_height_; ++ph) {
-            int index = index0;
-            index0 += layer->pooled_width_;
-            for (int pw = 0; pw < layer->pooled_width_; ++pw) {
-              const int bottom_index = mask[index];
-              bottom_diff[bottom_index] += top_diff[index];
-              ++index;
-            }
+      for (int c = channel_start; c < channel_end; ++c) {
+        const int fm = n * l.channels_ + c;
+        const Dtype* top = top_diff + fm * pooled_fm_size;
+        Dtype* bottom = bottom_diff + fm * fm_size;
+        const Dtype* top_mask = use_top_mask ?
+            static_cast<const Dtype*>(mask_ptr) + fm * pooled_fm_size : NULL;
+        const int* mask = use_top_mask ?
+            NULL : static_cast<const int*>(mask_ptr) + fm * pooled_fm_size;
+        for (int i = 0; i < pooled_fm_size; ++i) {
+          const int bottom_index =
+              top_mask ? static_cast<int>(top_mask[i]) : mask[i];
+          // Windows with no maximum, all lowest, have no index.
+          if (bottom_index >= 0) {
+            bottom[bottom_index] += top[i];
           }
-          bottom_diff += fm_size;
-          top_diff += pooled_fm_size;
-          mask += pooled_fm_size;
         }
       }
     }
-    break;
-  case PoolingParameter_PoolMethod_AVE:
+    return;
+  }
 
-    bottom_diff += fm_size*(layer->channels_*batch_start + channel_start);
-    top_diff += pooled_fm_size*(layer->channels_*batch_start + channel_start);
-    // The main loop
-    for (int n = batch_start; n < batch_end; ++n) {
-      for (int c = channel_start; c < channel_end; ++c) {
-        for (int ph = 0; ph < layer->pooled_height_; ++ph) {
-          for (int pw = 0; pw < layer->pooled_width_; ++pw) {
-            int hstart = ph * layer->stride_h_ - layer->pad_h_;
-            int wstart = pw * layer->stride_w_ - layer->pad_w_;
-            int hend =
-              min(hstart + layer->kernel_h_, layer->height_ + layer->pad_h_);
-            int wend =
-              min(wstart + layer->kernel_w_, layer->width_ + layer->pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, layer->height_);
-            wend = min(wend, layer->width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                bottom_diff[h * layer->width_ + w] +=
-                  top_diff[ph * layer->pooled_width_ + pw] / pool_size;
+  int inner_begin, inner_end;
+  Inner_columns(l.pooled_width_, l.kernel_w_, l.stride_w_, l.pad_w_,
+                l.width_, &inner_begin, &inner_end);
+  for (int n = batch_start; n < batch_end; ++n) {
+    for (int c = channel_start; c < channel_end; ++c) {
+      const int fm = n * l.channels_ + c;
+      const Dtype* top = top_diff + fm * pooled_fm_size;
+      Dtype* bottom = bottom_diff + fm * fm_size;
+      for (int pd = 0; pd < l.pooled_depth_; ++pd) {
+        const PoolingWindow d(pd, l.kernel_d_, l.stride_d_, l.pad_d_,
+                              l.depth_);
+        for (int ph = 0; ph < l.pooled_height_; ++ph) {
+          const PoolingWindow h(ph, l.kernel_h_, l.stride_h_, l.pad_h_,
+                                l.height_);
+          const int top_row = (pd * l.pooled_height_ + ph) * l.pooled_width_;
+          int pw = 0;
+          while (pw < l.pooled_width_) {
+            if (row && pw == inner_begin && pw < inner_end &&
+                !d.empty() && !h.empty()) {
+              PoolingRowArgs<Dtype> args;
+              args.index = d.start * plane_size + h.start * l.width_ +
+                           pw * l.stride_w_ - l.pad_w_;
+              args.bottom = bottom + args.index;
+              args.top = const_cast<Dtype*>(top) + top_row + pw;
+              args.mask = NULL;
+              args.count = inner_end - pw;
+              args.planes = d.end - d.start;
+              args.rows = h.end - h.start;
+              args.scale = Dtype(1) / (d.size * h.size * l.kernel_w_);
+              row(&args);
+              pw = inner_end;
+              continue;
+            }
+            const PoolingWindow w(pw, l.kernel_w_, l.stride_w_, l.pad_w_,
+                                  l.width_);
+            const Dtype diff =
+                top[top_row + pw] / (d.size * h.size * w.size);
+            for (int z = d.start; z < d.end; ++z) {
+              for (int y = h.start; y < h.end; ++y) {
+                for (int x = w.start; x < w.end; ++x) {
+                  bottom[(z * l.height_ + y) * l.width_ + x] += diff;
+                }
               }
             }
+            ++pw;
           }
         }
-        // offset
-        bottom_diff += fm_size;
-        top_diff += pooled_fm_size;
       }
     }
-    break;
-  case PoolingParameter_PoolMethod_STOCHASTIC:
-    NOT_IMPLEMENTED;
-    break;
-  default:
-    LOG(FATAL) << "Unknown pooling method.";
   }
 }
 
-template <typename Dtype>
-void PoolingCodeGeneratorBackward<Dtype>::Create_callback(
-  PoolingLayer<Dtype>* layer) {
-  Callback = Naive;
-}
-
-#if defined __x86_64__ || defined _M_X64
-// Here we have specialized versions for supported formats in x64 architectures.
-/*
-template <>
-void PoolingCodeGeneratorBackward<float>::Create_callback(
-  PoolingLayer<float>* layer)
-{
-  using namespace ::Xbyak;
-  util::Cpu Current_cpu;
-  if (Current_cpu.has(util::Cpu::tAVX2))
-  { // AVX2 optimized version.
-    const LayerParameter& param = layer->layer_param();
-
-    // It seems we are regenerating the code due to output reshape.
-    if (Callback)
-      reset();
-
-    Callback = getCode<Callback_t*>();
-  }
-  else
-  { // Take naive path.
-    Callback = Naive;
-  }
-}*/
-
-#endif
-
 INSTANTIATE_CLASS(PoolingCodeGeneratorForward);
 INSTANTIATE_CLASS(PoolingCodeGeneratorBackward);
 
 }  // namespace caffe
-
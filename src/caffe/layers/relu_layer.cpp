@@ -39,6 +39,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 
 #include "caffe/layers/relu_layer.hpp"
+#include "caffe/util/blob_storage.hpp"
 
 namespace caffe {
 
@@ -73,6 +74,10 @@ void ReLULayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (HasReducedStorage(bottom) || HasReducedStorage(top)) {
+    Forward_reduced_cpu(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
@@ -90,6 +95,10 @@ template <typename Dtype>
 void ReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  if (HasReducedStorage(bottom)) {
+    Backward_reduced_cpu(top, propagate_down, bottom);
+    return;
+  }
   if (propagate_down[0]) {
     const Dtype* bottom_data = bottom[0]->cpu_data();
     const Dtype* top_diff = top[0]->cpu_diff();
@@ -106,6 +115,55 @@ void ReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
 }
 
+template <typename Dtype>
+void ReLULayer<Dtype>::Forward_reduced_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const BlobDataReader<Dtype> bottom_data(*bottom[0]);
+  const BlobDataWriter<Dtype> top_data(top[0]);
+  const int count = bottom[0]->count();
+  Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int offset = 0; offset < count; offset += kStorageChunk) {
+    Dtype bottom_buffer[kStorageChunk];
+    Dtype top_buffer[kStorageChunk];
+    const int n = std::min(kStorageChunk, count - offset);
+    const Dtype* x = bottom_data.Read(offset, n, bottom_buffer);
+    Dtype* y = top_data.Target(offset, top_buffer);
+    for (int i = 0; i < n; ++i) {
+      y[i] = std::max(x[i], Dtype(0))
+          + negative_slope * std::min(x[i], Dtype(0));
+    }
+    top_data.Write(offset, n, y);
+  }
+}
+
+template <typename Dtype>
+void ReLULayer<Dtype>::Backward_reduced_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) {
+    return;
+  }
+  const BlobDataReader<Dtype> bottom_data(*bottom[0]);
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  const int count = bottom[0]->count();
+  Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int offset = 0; offset < count; offset += kStorageChunk) {
+    Dtype buffer[kStorageChunk];
+    const int n = std::min(kStorageChunk, count - offset);
+    const Dtype* x = bottom_data.Read(offset, n, buffer);
+    for (int i = 0; i < n; ++i) {
+      bottom_diff[offset + i] = top_diff[offset + i] * ((x[i] > 0)
+          + negative_slope * (x[i] <= 0));
+    }
+  }
+}
 
 #ifdef CPU_ONLY
 STUB_GPU(ReLULayer);
@@ -85,14 +85,18 @@ void SplitLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < top.size(); ++i) {
     // Do not allow in-place computation in the SplitLayer.  Instead, share data
     // by reference in the forward pass, and keep separate diff allocations in
-    // the backward pass.  (Technically, it should be possible to share the diff
-    // blob of the first split output with the input, but this seems to cause
-    // some strange effects in practice...)
+    // the backward pass.  Only the top chosen by the Net (one whose consumer
+    // always overwrites its diff and which carries no loss weight) shares its
+    // diff with the input.
     CHECK_NE(top[i], bottom[0]) << this->type() << " Layer does not "
         "allow in-place computation.";
     top[i]->ReshapeLike(*bottom[0]);
     CHECK_EQ(count_, top[i]->count());
   }
+  if (shared_diff_top_ >= 0) {
+    CHECK_LT(shared_diff_top_, top.size());
+    top[shared_diff_top_]->ShareDiff(*bottom[0]);
+  }
 }
 
 template <typename Dtype>
@@ -107,6 +111,15 @@ template <typename Dtype>
 void SplitLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) { return; }
+  if (shared_diff_top_ >= 0) {
+    // The consumer of the shared top already wrote the bottom diff.
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    for (int i = 0; i < top.size(); ++i) {
+      if (i == shared_diff_top_) { continue; }
+      caffe_axpy(count_, Dtype(1.), top[i]->cpu_diff(), bottom_diff);
+    }
+    return;
+  }
   if (top.size() == 1) {
     caffe_copy(count_, top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
     return;
@@ -17,6 +17,14 @@ template <typename Dtype>
 void SplitLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) { return; }
+  if (shared_diff_top_ >= 0) {
+    Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
+    for (int i = 0; i < top.size(); ++i) {
+      if (i == shared_diff_top_) { continue; }
+      caffe_gpu_axpy(count_, Dtype(1.), top[i]->gpu_diff(), bottom_diff);
+    }
+    return;
+  }
   if (top.size() == 1) {
     caffe_copy(count_, top[0]->gpu_diff(), bottom[0]->mutable_gpu_diff());
     return;
@@ -36,6 +36,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #ifdef MKL2017_SUPPORTED
+#include "caffe/util/conversion_ledger.hpp"
 #include "caffe/util/performance.hpp"
 
 #include "caffe/mkl_memory.hpp"
@@ -195,6 +196,8 @@ void MKLMemoryDescriptorBase<Dtype>::convert_from_prv(void* cpu_ptr) {
   convert_resources[dnnResourceFrom] = this->prv_ptr();
   convert_resources[dnnResourceTo]   = cpu_ptr;
 
+  ConversionLedger::Conversion conversion(ConversionLedger::FROM_PRV,
+      PrvMemDescr::PRV_DESCR_MKL2017, this->prv_size());
   PERFORMANCE_MEASUREMENT_BEGIN();
   status = dnnExecute<Dtype>(this->convert_from_int, convert_resources);
   PERFORMANCE_MEASUREMENT_END_STATIC("mkl_conversion");
@@ -215,6 +218,8 @@ void MKLMemoryDescriptorBase<Dtype>::convert_to_prv(void* cpu_ptr) {
   convert_resources[dnnResourceFrom] = cpu_ptr;
   convert_resources[dnnResourceTo]   = this->prv_ptr();
 
+  ConversionLedger::Conversion conversion(ConversionLedger::TO_PRV,
+      PrvMemDescr::PRV_DESCR_MKL2017, this->prv_size());
   PERFORMANCE_MEASUREMENT_BEGIN();
   status = dnnExecute<Dtype>(this->convert_to_int, convert_resources);
   PERFORMANCE_MEASUREMENT_END_STATIC("mkl_conversion");
@@ -260,6 +265,8 @@ void MKLMemoryDescriptorBase<Dtype>::convert_from_other(
   convert_resources[dnnResourceFrom] = other_descr->prv_ptr();
   convert_resources[dnnResourceTo]   = this->prv_ptr();
 
+  ConversionLedger::Conversion conversion(ConversionLedger::PRV_TO_PRV,
+      PrvMemDescr::PRV_DESCR_MKL2017, this->prv_size());
   PERFORMANCE_MEASUREMENT_BEGIN();
   status = dnnExecute<Dtype>(convert, convert_resources);
   PERFORMANCE_MEASUREMENT_END_STATIC("mkl_conversion");
@@ -37,6 +37,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #ifdef MKLDNN_SUPPORTED
 #include "caffe/mkldnn_memory.hpp"
+#include "caffe/util/conversion_ledger.hpp"
 
 namespace caffe {
 
@@ -129,6 +130,8 @@ void MKLDNNMemoryDescriptor<Dtype, is_diff>::convert_to_prv(void* cpu_ptr)
     CHECK_EQ(this->_cpu_ptr, cpu_ptr);
     create_reorder_to_prv(cpu_ptr);
     VLOG(1) << "--- MKLDNNMemoryDescriptorBase<Dtype>::convert_to_prv --- " << this->name;
+    ConversionLedger::Conversion conversion(ConversionLedger::TO_PRV,
+        PrvMemDescr::PRV_DESCR_MKLDNN, this->prv_size());
     this->_reorder_usr2prv.submit();;
 }
 
@@ -159,6 +162,8 @@ void MKLDNNMemoryDescriptor<Dtype, is_diff>::convert_from_prv(void* cpu_ptr)
         return;
     create_reorder_from_prv(cpu_ptr);
     VLOG(1) << "--- MKLDNNMemoryDescriptorBase<Dtype>::convert_from_prv --- " << this->name;
+    ConversionLedger::Conversion conversion(ConversionLedger::FROM_PRV,
+        PrvMemDescr::PRV_DESCR_MKLDNN, this->prv_size());
     this->_reorder_prv2usr.submit();
 }
 
@@ -181,6 +186,8 @@ void MKLDNNMemoryDescriptor<Dtype, is_diff>::convert_from_extprv(shared_ptr<prim
         return;
     create_reorder_from_extprv(aprimitive);
     VLOG(1) << "--- MKLDNNMemoryDescriptorBase<Dtype>::convert_from_extprv --- " << this->name;
+    ConversionLedger::Conversion conversion(ConversionLedger::PRV_TO_PRV,
+        PrvMemDescr::PRV_DESCR_MKLDNN, this->prv_size());
     this->_reorder_extprv2prv.submit();
 }
 
@@ -36,6 +36,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <map>
 #include <set>
 #include <string>
@@ -46,12 +48,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/layers/split_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/conversion_ledger.hpp"
 #include "caffe/util/cpu_info.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
+#include "caffe/util/mapped_file.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/performance.hpp"
 #include "caffe/util/upgrade_proto.hpp"
@@ -410,9 +415,70 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   }
   for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
+    const LayerParameter& layer_param = layers_[layer_id]->layer_param();
+    for (int i = 0; i < layer_param.folded_layer_size(); ++i) {
+      folded_layer_owners_[layer_param.folded_layer(i).name()] = layer_id;
+    }
   }
   ShareWeights();
   debug_info_ = param.debug_info();
+  // Layers like Split alias their tops only once Forward runs, so the
+  // activations are planned after the first full pass.
+  share_activations_ = param.share_activations();
+  if (share_activations_ && phase_ != TEST) {
+    // Backward reads bottoms and tops after later layers overwrote them.
+    LOG(WARNING) << "share_activations is only supported in TEST phase";
+    share_activations_ = false;
+  }
+  // Split and Flatten hand their bottoms the top diff inside Backward, so
+  // diffs are likewise planned after the first full Backward.
+  share_diffs_ = param.share_diffs();
+  if (share_diffs_) {
+    // Let every Split hand its bottom diff to one consumer that overwrites
+    // it in Backward, so the Split only adds the remaining tops into it. The
+    // top must be read by that consumer alone, once, and not in place, as
+    // any layer adding to the diff would pick up what the Split wrote.
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      if (string(layers_[layer_id]->type()) != "Split") { continue; }
+      int shared_top = -1;
+      for (int top_id = 0;
+           top_id < top_id_vecs_[layer_id].size() && shared_top < 0;
+           ++top_id) {
+        if (layers_[layer_id]->loss(top_id)) { continue; }
+        const int blob_id = top_id_vecs_[layer_id][top_id];
+        int consumer_id = -1;
+        int num_reads = 0;
+        bool propagated = false;
+        for (int next_id = layer_id + 1; next_id < layers_.size(); ++next_id) {
+          for (int i = 0; i < bottom_id_vecs_[next_id].size(); ++i) {
+            if (bottom_id_vecs_[next_id][i] == blob_id) {
+              consumer_id = next_id;
+              ++num_reads;
+              propagated = bottom_need_backward_[next_id][i];
+            }
+          }
+        }
+        if (num_reads != 1 || !propagated ||
+            !layers_[consumer_id]->OverwritesBottomDiff()) {
+          continue;
+        }
+        const vector<int>& consumer_tops = top_id_vecs_[consumer_id];
+        if (std::find(consumer_tops.begin(), consumer_tops.end(), blob_id) ==
+            consumer_tops.end()) {
+          shared_top = top_id;
+        }
+      }
+      if (shared_top >= 0) {
+        static_cast<SplitLayer<Dtype>*>(layers_[layer_id].get())
+            ->set_shared_diff_top(shared_top);
+      }
+    }
+  }
+  if (param.activation_storage() != FLOAT32) {
+    CHECK_NE(param.activation_storage(), INT8)
+        << "activation_storage must be a 16-bit type";
+    AssignActivationStorage(param.activation_storage());
+  }
 
 #ifdef USE_MLSL
 
@@ -529,10 +595,15 @@ void Net<Dtype>::FilterNet(const NetParameter& param,
 template <typename Dtype>
 void Net<Dtype>::CompileNet(const NetParameter& param,
     NetParameter* param_compiled) {
+  NetParameter param_folded;  // temporary compiled param
+  param_folded.CopyFrom(param);
+  param_folded.clear_layer();  // Remove layers
+  CompilationRuleFour(param, &param_folded);
+
   NetParameter param_temp;  // temporary compiled param
-  param_temp.CopyFrom(param);
+  param_temp.CopyFrom(param_folded);
   param_temp.clear_layer();    // Remove layers
-  CompilationRuleOne(param, &param_temp);
+  CompilationRuleOne(param_folded, &param_temp);
 
   NetParameter param_temp2;  // temporary compiled param
   param_temp2.CopyFrom(param_temp);
@@ -771,6 +842,396 @@ void Net<Dtype>::GetBlobConsumers(
   }
 }
 
+namespace {
+
+// The engine named by the type parameter of a layer, "" if it leaves the
+// choice to LayerParameter::engine.
+string TypeEngine(const LayerParameter& layer_param) {
+#define TYPE_ENGINE(type_name, field, Param) \
+  if (layer_param.type() == type_name) { \
+    return layer_param.field().engine() == Param##_Engine_DEFAULT ? \
+        string() : Param##_Engine_Name(layer_param.field().engine()); \
+  }
+  TYPE_ENGINE("Convolution", convolution_param, ConvolutionParameter)
+  TYPE_ENGINE("InnerProduct", inner_product_param, InnerProductParameter)
+  TYPE_ENGINE("Pooling", pooling_param, PoolingParameter)
+  TYPE_ENGINE("LRN", lrn_param, LRNParameter)
+  TYPE_ENGINE("BatchNorm", batch_norm_param, BatchNormParameter)
+  TYPE_ENGINE("Split", split_param, SplitParameter)
+  TYPE_ENGINE("ReLU", relu_param, ReLUParameter)
+  TYPE_ENGINE("Concat", concat_param, ConcatParameter)
+  TYPE_ENGINE("Eltwise", eltwise_param, EltwiseParameter)
+#undef TYPE_ENGINE
+  return string();
+}
+
+void SetTypeEngine(const string& engine, LayerParameter* layer_param) {
+#define SET_TYPE_ENGINE(type_name, field, Param) \
+  if (layer_param->type() == type_name) { \
+    Param##_Engine value; \
+    CHECK(Param##_Engine_Parse(engine, &value)) \
+        << type_name << " has no engine " << engine; \
+    layer_param->mutable_##field()->set_engine(value); \
+    return; \
+  }
+  SET_TYPE_ENGINE("Convolution", convolution_param, ConvolutionParameter)
+  SET_TYPE_ENGINE("InnerProduct", inner_product_param, InnerProductParameter)
+  SET_TYPE_ENGINE("Pooling", pooling_param, PoolingParameter)
+  SET_TYPE_ENGINE("LRN", lrn_param, LRNParameter)
+  SET_TYPE_ENGINE("BatchNorm", batch_norm_param, BatchNormParameter)
+  SET_TYPE_ENGINE("Split", split_param, SplitParameter)
+  SET_TYPE_ENGINE("ReLU", relu_param, ReLUParameter)
+  SET_TYPE_ENGINE("Concat", concat_param, ConcatParameter)
+  SET_TYPE_ENGINE("Eltwise", eltwise_param, EltwiseParameter)
+#undef SET_TYPE_ENGINE
+  LOG(FATAL) << layer_param->type() << " has no engine " << engine;
+}
+
+// Whether the layer factory creates an engine's implementation of a layer
+// rather than falling back to CAFFE (see layer_factory.cpp).
+bool SupportsEngine(const LayerParameter& layer_param, const string& engine) {
+  if (engine == "DIRECT") {
+    const ConvolutionParameter& conv_param = layer_param.convolution_param();
+    return layer_param.type() == "Convolution" &&
+        conv_param.kernel_size_size() <= 2 && conv_param.axis() == 1 &&
+        !conv_param.force_nd_im2col();
+  }
+  if (layer_param.type() == "Convolution" && engine != "CAFFE") {
+    const ConvolutionParameter& conv_param = layer_param.convolution_param();
+    if (conv_param.prelu() || (conv_param.relu() && engine != "MKLDNN")) {
+      return false;
+    }
+  }
+  if (engine != "MKL2017" && engine != "MKLDNN") {
+    return true;
+  }
+  const bool mkl2017 = engine == "MKL2017";
+  const string& type = layer_param.type();
+  if (type == "Convolution") {
+    const ConvolutionParameter& conv_param = layer_param.convolution_param();
+    for (int i = 0; i < conv_param.dilation_size(); ++i) {
+      if (conv_param.dilation(i) > 1) { return false; }
+    }
+    return true;
+  }
+  if (type == "InnerProduct") {
+    return !mkl2017 && !layer_param.inner_product_param().transpose();
+  }
+  if (type == "Pooling") {
+    return mkl2017 || layer_param.pooling_param().pool() ==
+        PoolingParameter_PoolMethod_MAX;
+  }
+  if (type == "LRN") {
+    return layer_param.lrn_param().norm_region() ==
+        LRNParameter_NormRegion_ACROSS_CHANNELS;
+  }
+  if (type == "Concat") {
+    return !mkl2017 || layer_param.concat_param().axis() == 1;
+  }
+  if (type == "Split" || type == "Eltwise") {
+    return mkl2017;
+  }
+  return type == "BatchNorm" || type == "ReLU";
+}
+
+// The engine, without sub-engines, that a layer runs in.
+string RunningEngine(const LayerParameter& layer_param,
+                     const string& net_engine) {
+  string engine = TypeEngine(layer_param);
+  if (engine.empty()) {
+    engine = net_engine.empty() ? layer_param.engine() : net_engine;
+    engine = engine.substr(0, engine.find(':'));
+  }
+  if (engine.empty() || !SupportsEngine(layer_param, engine)) {
+    return "CAFFE";
+  }
+  return engine;
+}
+
+}  // namespace
+
+template <typename Dtype>
+void Net<Dtype>::CompilationRuleFour(const NetParameter& param,
+                                     NetParameter* param_compiled) {
+  const bool fold = param.fold_inference() && param.state().phase() == TEST;
+  std::set<std::string> layers_to_drop;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    if (layers_to_drop.erase(layer.name())) {
+      LOG_IF(INFO, Caffe::root_solver()) << "Dropped layer: "
+             << layer.name() << std::endl;
+      continue;
+    }
+    LayerParameter* layer_param = param_compiled->add_layer();
+    layer_param->CopyFrom(layer);
+
+    // Optimization rule 4:
+    // - If we are doing inference with fold_inference and a Convolution or
+    // InnerProduct layer is followed by (each optional, in this order) a
+    // BatchNorm using the global statistics, a Scale and, for a convolution
+    // running in the CAFFE or DIRECT engine, a ReLU or PReLU, each of them
+    // the only consumer of the blob before it, then we can drop them:
+    // BatchNorm and Scale are folded into the weights and bias when these
+    // are copied, the activation is applied by the convolution. The top
+    // blob is renamed after the top of the last dropped layer.
+    const bool conv = layer.type() == "Convolution";
+    if (!fold || layer.bottom_size() != 1 || layer.top_size() != 1) {
+      continue;
+    }
+    if (conv) {
+      const ConvolutionParameter& conv_param = layer.convolution_param();
+      if (conv_param.axis() != 1 || conv_param.relu() || conv_param.prelu()) {
+        continue;
+      }
+    } else if (layer.type() != "InnerProduct" ||
+               layer.inner_product_param().axis() != 1) {
+      continue;
+    }
+    const string engine = RunningEngine(layer, param.engine());
+    const bool fuse_relu = conv && (engine == "CAFFE" || engine == "DIRECT");
+    bool need_bias = false;
+    // 1 once a BatchNorm, 2 a Scale, 3 a ReLU or PReLU has been folded.
+    int stage = 0;
+    int last = i;
+    while (stage < 3 && last + 1 < param.layer_size()) {
+      std::vector<const LayerParameter*> consumer_layer_params;
+      GetBlobConsumers(consumer_layer_params, layer_param->top(0), param,
+                       last + 1);
+      if (consumer_layer_params.empty()) {
+        break;
+      }
+      const LayerParameter& consumer_layer_param = *consumer_layer_params[0];
+      if (consumer_layer_param.bottom_size() != 1 ||
+          consumer_layer_param.top_size() != 1) {
+        break;
+      }
+      // Later consumers of a layer computed in place read its output, which
+      // the folded layer still writes; others need the blob unfolded.
+      if (consumer_layer_param.top(0) != consumer_layer_param.bottom(0) &&
+          consumer_layer_params.size() != 1) {
+        break;
+      }
+      const string& type = consumer_layer_param.type();
+      if (type == "BatchNorm" && stage < 1) {
+        const BatchNormParameter& bn_param =
+            consumer_layer_param.batch_norm_param();
+        if (bn_param.has_use_global_stats() && !bn_param.use_global_stats()) {
+          break;
+        }
+        stage = 1;
+        need_bias = true;
+      } else if (type == "Scale" && stage < 2) {
+        const ScaleParameter& scale_param = consumer_layer_param.scale_param();
+        if (scale_param.axis() != 1 || scale_param.num_axes() != 1) {
+          break;
+        }
+        stage = 2;
+        need_bias = true;
+      } else if (type == "ReLU" && fuse_relu) {
+        layer_param->mutable_convolution_param()->set_relu(true);
+        layer_param->mutable_convolution_param()->set_negative_slope(
+            consumer_layer_param.relu_param().negative_slope());
+        stage = 3;
+      } else if (type == "PReLU" && fuse_relu) {
+        layer_param->mutable_convolution_param()->set_prelu(true);
+        stage = 3;
+        need_bias = true;
+      } else {
+        break;
+      }
+      LayerParameter* folded_layer = layer_param->add_folded_layer();
+      folded_layer->CopyFrom(consumer_layer_param);
+      folded_layer->clear_blobs();
+      layers_to_drop.insert(consumer_layer_param.name());
+      LOG_IF(INFO, Caffe::root_solver()) << "Folding layer "
+             << consumer_layer_param.name() << " into " << layer.name();
+      layer_param->set_top(0, consumer_layer_param.top(0));
+      while (&param.layer(last) != &consumer_layer_param) {
+        ++last;
+      }
+    }
+    // The folded parameters are applied through the bias, which the
+    // weights being folded may lack; it is zero then.
+    if (need_bias) {
+      if (conv) {
+        layer_param->mutable_convolution_param()->set_bias_term(true);
+      } else {
+        layer_param->mutable_inner_product_param()->set_bias_term(true);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+int Net<Dtype>::PlanEngines(const NetParameter& param,
+    const vector<ConversionLedger::Entry>& entries,
+    NetParameter* param_planned) {
+  param_planned->CopyFrom(param);
+  NetParameter filtered_param;
+  FilterNet(param, &filtered_param);
+  const int num_layers = filtered_param.layer_size();
+
+  // Connect every layer to the producers of its bottoms.
+  vector<vector<int> > producers(num_layers), consumers(num_layers);
+  vector<string> engines(num_layers);
+  map<string, int> layer_index, last_producer;
+  for (int i = 0; i < num_layers; ++i) {
+    const LayerParameter& layer_param = filtered_param.layer(i);
+    engines[i] = RunningEngine(layer_param, param.engine());
+    layer_index[layer_param.name()] = i;
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      map<string, int>::const_iterator it =
+          last_producer.find(layer_param.bottom(j));
+      if (it != last_producer.end()) {
+        producers[i].push_back(it->second);
+        consumers[it->second].push_back(i);
+      }
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      last_producer[layer_param.top(j)] = i;
+    }
+  }
+
+  // Charge each conversion to the layers outside the converting engine that
+  // caused it: the layer itself, or else the producers (forward) or
+  // consumers (backward) of a layer inside the engine.
+  vector<map<string, uint64_t> > charged(num_layers);
+  for (int e = 0; e < entries.size(); ++e) {
+    const ConversionLedger::Entry& entry = entries[e];
+    map<string, int>::const_iterator it = layer_index.find(entry.layer);
+    if (entry.direction == ConversionLedger::PRV_TO_PRV ||
+        it == layer_index.end()) {
+      continue;
+    }
+    const string engine = ConversionLedger::EngineName(entry.engine);
+    const int i = it->second;
+    if (engines[i] != engine) {
+      charged[i][engine] += entry.bytes;
+      continue;
+    }
+    const vector<int>& neighbors = entry.backward ? consumers[i] : producers[i];
+    for (int j = 0; j < neighbors.size(); ++j) {
+      if (engines[neighbors[j]] != engine) {
+        charged[neighbors[j]][engine] += entry.bytes;
+      }
+    }
+  }
+  vector<string> targets(num_layers);
+  for (int i = 0; i < num_layers; ++i) {
+    uint64_t most_bytes = 0;
+    for (map<string, uint64_t>::const_iterator it = charged[i].begin();
+         it != charged[i].end(); ++it) {
+      if (it->second > most_bytes) {
+        most_bytes = it->second;
+        targets[i] = it->first;
+      }
+    }
+    const LayerParameter& layer_param = filtered_param.layer(i);
+    if (!TypeEngine(layer_param).empty() ||
+        !SupportsEngine(layer_param, targets[i])) {
+      targets[i].clear();
+    }
+  }
+
+  // Move connected runs of charged layers with the same target to it when
+  // more of the layers around a run already use the target than do not.
+  int planned = 0;
+  vector<bool> visited(num_layers, false);
+  for (int i = 0; i < num_layers; ++i) {
+    if (targets[i].empty() || visited[i]) {
+      continue;
+    }
+    const string& target = targets[i];
+    vector<int> run(1, i);
+    visited[i] = true;
+    for (int r = 0; r < run.size(); ++r) {
+      for (int pass = 0; pass < 2; ++pass) {
+        const vector<int>& neighbors =
+            pass ? consumers[run[r]] : producers[run[r]];
+        for (int j = 0; j < neighbors.size(); ++j) {
+          const int k = neighbors[j];
+          if (!visited[k] && targets[k] == target) {
+            visited[k] = true;
+            run.push_back(k);
+          }
+        }
+      }
+    }
+    const set<int> members(run.begin(), run.end());
+    int inside = 0, outside = 0;
+    uint64_t bytes = 0;
+    for (int r = 0; r < run.size(); ++r) {
+      bytes += charged[run[r]][target];
+      for (int pass = 0; pass < 2; ++pass) {
+        const vector<int>& neighbors =
+            pass ? consumers[run[r]] : producers[run[r]];
+        for (int j = 0; j < neighbors.size(); ++j) {
+          if (members.count(neighbors[j]) == 0) {
+            ++(engines[neighbors[j]] == target ? inside : outside);
+          }
+        }
+      }
+    }
+    if (inside <= outside) {
+      continue;
+    }
+    for (int r = 0; r < run.size(); ++r) {
+      const string& name = filtered_param.layer(run[r]).name();
+      for (int j = 0; j < param_planned->layer_size(); ++j) {
+        if (param_planned->layer(j).name() == name) {
+          SetTypeEngine(target, param_planned->mutable_layer(j));
+        }
+      }
+      LOG(INFO) << "Moving layer " << name << " to engine " << target;
+    }
+    LOG(INFO) << "  which removes " << (bytes >> 10)
+              << " KB of recorded conversions";
+    planned += run.size();
+  }
+  return planned;
+}
+
+template <typename Dtype>
+int Net<Dtype>::CalibrateQuantization(int iterations, NetParameter* param) {
+  vector<Dtype> input_max(layers_.size(), Dtype(0));
+  vector<bool> input_signed(layers_.size(), false);
+  for (int iter = 0; iter < iterations; ++iter) {
+    for (int i = 0; i < layers_.size(); ++i) {
+      if (layers_[i]->AllowQuantization()) {
+        for (int j = 0; j < bottom_vecs_[i].size(); ++j) {
+          const Dtype* data = bottom_vecs_[i][j]->cpu_data();
+          for (int k = 0; k < bottom_vecs_[i][j]->count(); ++k) {
+            input_max[i] = std::max(input_max[i], std::fabs(data[k]));
+            if (data[k] < 0) {
+              input_signed[i] = true;
+            }
+          }
+        }
+      }
+      ForwardFromTo(i, i);
+    }
+  }
+  int calibrated = 0;
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    map<string, int>::const_iterator layer =
+        layer_names_index_.find(layer_param->name());
+    if (layer == layer_names_index_.end() ||
+        !layers_[layer->second]->AllowQuantization()) {
+      continue;
+    }
+    QuantizationParameter* quantization_param =
+        layer_param->mutable_quantization_param();
+    quantization_param->set_input_max(input_max[layer->second]);
+    quantization_param->set_input_signed(input_signed[layer->second]);
+    LOG_IF(INFO, Caffe::root_solver()) << "Calibrated " << layer_param->name()
+        << ": input_max " << input_max[layer->second]
+        << (input_signed[layer->second] ? ", signed" : ", unsigned");
+    ++calibrated;
+  }
+  return calibrated;
+}
+
 template <typename Dtype>
 bool Net<Dtype>::StateMeetsRule(const NetState& state,
     const NetStateRule& rule, const string& layer_name) {
@@ -999,6 +1460,191 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
 }
 
 
+template <typename Dtype>
+void Net<Dtype>::AssignActivationStorage(StorageType storage) {
+  if (Caffe::mode() != Caffe::CPU) {
+    LOG(WARNING) << "activation_storage is only supported in CPU mode";
+    return;
+  }
+  if (debug_info_) {
+    LOG(WARNING) << "activation_storage is ignored with debug_info";
+    return;
+  }
+  // Every layer producing or consuming a blob has to convert its data, and
+  // the blobs seen from outside the net stay in Dtype.
+  vector<bool> reduced(blobs_.size(), true);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (layers_[layer_id]->AllowReducedStorage()) { continue; }
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      reduced[bottom_id_vecs_[layer_id][i]] = false;
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      reduced[top_id_vecs_[layer_id][i]] = false;
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    reduced[net_input_blob_indices_[i]] = false;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    reduced[net_output_blob_indices_[i]] = false;
+  }
+  for (int blob_id = 0; blob_id < blob_loss_weights_.size(); ++blob_id) {
+    if (blob_loss_weights_[blob_id] != Dtype(0)) {
+      reduced[blob_id] = false;
+    }
+  }
+  int num_reduced = 0;
+  size_t bytes_saved = 0;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (!reduced[blob_id]) { continue; }
+    blobs_[blob_id]->set_storage(storage);
+    ++num_reduced;
+    bytes_saved += blobs_[blob_id]->count() * (sizeof(Dtype) - 2);
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Holding " << num_reduced << " activations in "
+      << StorageType_Name(storage) << ", saving " << bytes_saved << " bytes";
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanActivationMemory(bool diff) {
+  if (Caffe::mode() != Caffe::CPU) {
+    LOG(WARNING) << (diff ? "share_diffs" : "share_activations")
+                 << " is only supported in CPU mode";
+    return;
+  }
+  // Blobs aliased through ShareData/ShareDiff (Split, Flatten, Reshape...)
+  // hold the same SyncedMemory and are planned as one group spanning all
+  // their uses. A group is live from the first to the last layer using it;
+  // Forward walks that range upwards, Backward downwards.
+  struct Group {
+    int birth;
+    int death;
+    size_t size;
+    bool pinned;
+    SyncedMemory* mem;
+  };
+  vector<Group> groups;
+  map<SyncedMemory*, int> group_index;
+  vector<int> blob_group(blobs_.size(), -1);
+  // Diffs nobody writes in Backward keep whatever they were initialized to
+  // (zeros, or the loss weight), which their readers rely on.
+  vector<bool> diff_written(blobs_.size(), false);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      if (layer_need_backward_[layer_id] &&
+          bottom_need_backward_[layer_id][i]) {
+        diff_written[bottom_id_vecs_[layer_id][i]] = true;
+      }
+    }
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blobs_[blob_id]->count() == 0) { continue; }
+    SyncedMemory* mem = diff ? blobs_[blob_id]->diff().get()
+                             : blobs_[blob_id]->data().get();
+    map<SyncedMemory*, int>::iterator it = group_index.find(mem);
+    if (it == group_index.end()) {
+      Group group = { static_cast<int>(layers_.size()), -1, mem->size(),
+                      false, mem };
+      it = group_index.insert(std::make_pair(mem, groups.size())).first;
+      groups.push_back(group);
+    }
+    blob_group[blob_id] = it->second;
+    if (blob_loss_weights_[blob_id] != Dtype(0) ||
+        (diff && !diff_written[blob_id])) {
+      groups[it->second].pinned = true;
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    const int group_id = blob_group[net_input_blob_indices_[i]];
+    if (group_id >= 0) { groups[group_id].pinned = true; }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    const int group_id = blob_group[net_output_blob_indices_[i]];
+    if (group_id >= 0) { groups[group_id].pinned = true; }
+  }
+  // Tops sharing a parameter (Parameter layer) must keep pointing at it.
+  for (int i = 0; i < params_.size(); ++i) {
+    map<SyncedMemory*, int>::iterator it = group_index.find(
+        diff ? params_[i]->diff().get() : params_[i]->data().get());
+    if (it != group_index.end()) { groups[it->second].pinned = true; }
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int group_id = blob_group[bottom_id_vecs_[layer_id][i]];
+      if (group_id < 0) { continue; }
+      groups[group_id].birth = std::min(groups[group_id].birth, layer_id);
+      groups[group_id].death = std::max(groups[group_id].death, layer_id);
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int group_id = blob_group[top_id_vecs_[layer_id][i]];
+      if (group_id < 0) { continue; }
+      // Tops of source layers may be filled once in SetUp (e.g. constant
+      // DummyData) and are not necessarily rewritten on every Forward.
+      if (!diff && bottom_id_vecs_[layer_id].empty()) {
+        groups[group_id].pinned = true;
+      }
+      groups[group_id].birth = std::min(groups[group_id].birth, layer_id);
+      groups[group_id].death = std::max(groups[group_id].death, layer_id);
+    }
+  }
+  vector<int> order;
+  for (int group_id = 0; group_id < groups.size(); ++group_id) {
+    if (!groups[group_id].pinned && groups[group_id].size > 0) {
+      order.push_back(group_id);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(),
+      [&groups](int a, int b) { return groups[a].birth < groups[b].birth; });
+  // Greedy interval coloring: reuse the free buffer closest in size, where a
+  // buffer is free once its last occupant died before the current birth.
+  vector<size_t> buffer_size;
+  vector<int> buffer_free_after;
+  vector<int> assignment(groups.size(), -1);
+  size_t bytes_before = 0;
+  for (int i = 0; i < order.size(); ++i) {
+    const Group& group = groups[order[i]];
+    bytes_before += group.size;
+    int best = -1;
+    for (int b = 0; b < buffer_size.size(); ++b) {
+      if (buffer_free_after[b] >= group.birth) { continue; }
+      if (best < 0) { best = b; continue; }
+      // Prefer the smallest buffer that fits, else the largest one to grow.
+      const bool fits = buffer_size[b] >= group.size;
+      const bool best_fits = buffer_size[best] >= group.size;
+      if (fits && (!best_fits || buffer_size[b] < buffer_size[best])) {
+        best = b;
+      } else if (!fits && !best_fits && buffer_size[b] > buffer_size[best]) {
+        best = b;
+      }
+    }
+    if (best < 0) {
+      best = buffer_size.size();
+      buffer_size.push_back(0);
+      buffer_free_after.push_back(-1);
+    }
+    buffer_size[best] = std::max(buffer_size[best], group.size);
+    buffer_free_after[best] = group.death;
+    assignment[order[i]] = best;
+  }
+  size_t bytes_after = 0;
+  for (int b = 0; b < buffer_size.size(); ++b) {
+    activation_buffers_.push_back(
+        shared_ptr<SyncedMemory>(new SyncedMemory(buffer_size[b])));
+    bytes_after += buffer_size[b];
+  }
+  const int first_buffer = activation_buffers_.size() - buffer_size.size();
+  for (int i = 0; i < order.size(); ++i) {
+    groups[order[i]].mem->set_cpu_data(activation_buffers_[
+        first_buffer + assignment[order[i]]]->mutable_cpu_data());
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Shared " << order.size() << " activation "
+      << (diff ? "diff" : "data") << " buffers in "
+      << buffer_size.size() << ": " << bytes_after << " bytes instead of "
+      << bytes_before;
+}
+
 
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
@@ -1009,6 +1655,7 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
     PERFORMANCE_MEASUREMENT_BEGIN();
 
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
+    ConversionLedger::set_layer(&layer_names_[i], false);
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
 
     PERFORMANCE_MEASUREMENT_END((std::string("FW_") + layer_names_[i]).c_str());
@@ -1016,6 +1663,11 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
+  ConversionLedger::set_layer(NULL, false);
+  if (share_activations_ && start == 0 && end == layers_.size() - 1) {
+    PlanActivationMemory(false);
+    share_activations_ = false;
+  }
   return loss;
 }
 
@@ -1059,6 +1711,7 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
     if (layer_need_backward_[i]) {
       PERFORMANCE_MEASUREMENT_BEGIN();
 
+      ConversionLedger::set_layer(&layer_names_[i], true);
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
 
@@ -1067,6 +1720,11 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
       if (debug_info_) { BackwardDebugInfo(i); }
     }
   }
+  ConversionLedger::set_layer(NULL, false);
+  if (share_diffs_ && start == layers_.size() - 1 && end == 0) {
+    PlanActivationMemory(true);
+    share_diffs_ = false;
+  }
 }
 
 template <typename Dtype>
@@ -1216,12 +1874,110 @@ void Net<Dtype>::Reshape() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::FoldTrainedLayers(
+    const map<string, vector<shared_ptr<Blob<Dtype> > > >& folded_blobs) {
+  for (int i = 0; i < layers_.size(); ++i) {
+    const LayerParameter& layer_param = layers_[i]->layer_param();
+    vector<shared_ptr<Blob<Dtype> > >& blobs = layers_[i]->blobs();
+    // The weights have a row per output channel, or a column for an
+    // InnerProduct with transposed weights.
+    const bool transpose = layer_param.type() == "InnerProduct" &&
+        layer_param.inner_product_param().transpose();
+    for (int k = 0; k < layer_param.folded_layer_size(); ++k) {
+      const LayerParameter& folded = layer_param.folded_layer(k);
+      typename map<string, vector<shared_ptr<Blob<Dtype> > > >::const_iterator
+          it = folded_blobs.find(folded.name());
+      if (it == folded_blobs.end()) {
+        // Not in the source, so already folded into the weights (or
+        // nothing to fold, for a ReLU).
+        continue;
+      }
+      const vector<shared_ptr<Blob<Dtype> > >& source = it->second;
+      const string& type = folded.type();
+      if (type != "BatchNorm" && type != "Scale" && type != "PReLU") {
+        continue;
+      }
+      const int channels = blobs[1]->count();
+      if (type == "PReLU") {
+        CHECK_EQ(source.size(), 1) << "Incompatible number of blobs for "
+                                   << "layer " << folded.name();
+        const Dtype* source_slopes = source[0]->cpu_data();
+        const bool shared = source[0]->count() == 1;
+        CHECK(shared || source[0]->count() == channels)
+            << "Cannot fold the slopes of layer " << folded.name();
+        Dtype* slopes = blobs.back()->mutable_cpu_data();
+        for (int c = 0; c < channels; ++c) {
+          slopes[c] = source_slopes[shared ? 0 : c];
+        }
+        continue;
+      }
+      // Each of them maps channel c to scale[c] * x + shift[c].
+      vector<Dtype> scale(channels), shift(channels, Dtype(0));
+      if (type == "BatchNorm") {
+        CHECK_GE(source.size(), 3) << "Incompatible number of blobs for "
+                                   << "layer " << folded.name();
+        CHECK_EQ(source[0]->count(), channels)
+            << "Cannot fold the statistics of layer " << folded.name();
+        const Dtype scale_factor = source[2]->cpu_data()[0] == 0 ?
+            0 : 1 / source[2]->cpu_data()[0];
+        const Dtype* mean = source[0]->cpu_data();
+        const Dtype* variance = source[1]->cpu_data();
+        const Dtype eps = folded.batch_norm_param().eps();
+        for (int c = 0; c < channels; ++c) {
+          scale[c] = 1 / std::sqrt(variance[c] * scale_factor + eps);
+          shift[c] = -mean[c] * scale_factor * scale[c];
+        }
+        // The MKL2017 engine may keep the Scale in blobs 3 and 4.
+        if (source.size() > 3) {
+          const Dtype* gamma = source[3]->cpu_data();
+          const Dtype* beta = source.size() > 4 ? source[4]->cpu_data() : NULL;
+          for (int c = 0; c < channels; ++c) {
+            scale[c] *= gamma[c];
+            shift[c] = shift[c] * gamma[c] + (beta ? beta[c] : Dtype(0));
+          }
+        }
+      } else {
+        CHECK_EQ(source[0]->count(), channels)
+            << "Cannot fold the scale of layer " << folded.name();
+        const Dtype* gamma = source[0]->cpu_data();
+        const Dtype* beta = source.size() > 1 ? source[1]->cpu_data() : NULL;
+        for (int c = 0; c < channels; ++c) {
+          scale[c] = gamma[c];
+          shift[c] = beta ? beta[c] : Dtype(0);
+        }
+      }
+      Dtype* weights = blobs[0]->mutable_cpu_data();
+      Dtype* bias = blobs[1]->mutable_cpu_data();
+      const int dim = blobs[0]->count() / channels;
+      for (int c = 0; c < channels; ++c) {
+        for (int d = 0; d < dim; ++d) {
+          weights[transpose ? d * channels + c : c * dim + d] *= scale[c];
+        }
+        bias[c] = bias[c] * scale[c] + shift[c];
+      }
+      LOG(INFO) << "Folded layer " << folded.name() << " into "
+                << layer_param.name();
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_blobs;
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
     const LayerParameter& source_layer = param.layer(i);
     const string& source_layer_name = source_layer.name();
+    if (folded_layer_owners_.count(source_layer_name)) {
+      vector<shared_ptr<Blob<Dtype> > >& blobs =
+          folded_blobs[source_layer_name];
+      for (int j = 0; j < source_layer.blobs_size(); ++j) {
+        blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        blobs.back()->FromProto(source_layer.blobs(j));
+      }
+      continue;
+    }
     int target_layer_id = 0;
     while (target_layer_id != layer_names_.size() &&
         layer_names_[target_layer_id] != source_layer_name) {
@@ -1234,9 +1990,25 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
     DLOG(INFO) << "Copying source layer " << source_layer_name;
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
-        << "Incompatible number of blobs for layer " << source_layer_name;
+    // Layers that others were folded into may have gained a bias and the
+    // PReLU slopes.
+    if (layers_[target_layer_id]->layer_param().folded_layer_size()) {
+      CHECK_GE(source_layer.blobs_size(), 1)
+          << "Incompatible number of blobs for layer " << source_layer_name;
+      CHECK_LE(source_layer.blobs_size(), target_blobs.size())
+          << "Incompatible number of blobs for layer " << source_layer_name;
+    } else {
+      CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+          << "Incompatible number of blobs for layer " << source_layer_name;
+    }
     for (int j = 0; j < target_blobs.size(); ++j) {
+      if (j >= source_layer.blobs_size()) {
+        if (j == 1) {
+          caffe_set(target_blobs[j]->count(), Dtype(0),
+                    target_blobs[j]->mutable_cpu_data());
+        }
+        continue;
+      }
       if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
         Blob<Dtype> source_blob;
         const bool kReshape = true;
@@ -1252,6 +2024,7 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
       target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
     }
   }
+  FoldTrainedLayers(folded_blobs);
 }
 
 template <typename Dtype>
@@ -1273,15 +2046,37 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
 }
 
 template <typename Dtype>
-void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
+void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename,
+    size_t* mapped_bytes_out, size_t* read_bytes_out) {
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
   hid_t data_hid = H5Gopen2(file_hid, "data", H5P_DEFAULT);
   CHECK_GE(data_hid, 0) << "Error reading weights from " << trained_filename;
+  shared_ptr<MappedFile> mapped_file(new MappedFile(trained_filename));
+  size_t mapped_bytes = 0, loaded_bytes = 0;
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_blobs;
   int num_layers = hdf5_get_num_links(data_hid);
   for (int i = 0; i < num_layers; ++i) {
     string source_layer_name = hdf5_get_name_by_idx(data_hid, i);
+    if (folded_layer_owners_.count(source_layer_name)) {
+      hid_t layer_hid = H5Gopen2(data_hid, source_layer_name.c_str(),
+          H5P_DEFAULT);
+      CHECK_GE(layer_hid, 0)
+          << "Error reading weights from " << trained_filename;
+      vector<shared_ptr<Blob<Dtype> > >& blobs =
+          folded_blobs[source_layer_name];
+      int num_source_params = hdf5_get_num_links(layer_hid);
+      for (int j = 0; j < num_source_params; ++j) {
+        ostringstream oss;
+        oss << j;
+        blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        hdf5_load_nd_dataset(layer_hid, oss.str().c_str(), 0, kMaxBlobAxes,
+            blobs.back().get());
+      }
+      H5Gclose(layer_hid);
+      continue;
+    }
     if (!layer_names_index_.count(source_layer_name)) {
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
@@ -1308,18 +2103,42 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
         if (param_owners_[target_net_param_id] != -1) {
           // ...but it's weight-shared in target, so that's fine.
           continue;
+        } else if (j > 0 &&
+            layers_[target_layer_id]->layer_param().folded_layer_size()) {
+          // ...but it's the bias or slopes added for folding.
+          if (j == 1) {
+            caffe_set(target_blobs[j]->count(), Dtype(0),
+                      target_blobs[j]->mutable_cpu_data());
+          }
+          continue;
         } else {
           LOG(FATAL) << "Incompatible number of blobs for layer "
               << source_layer_name;
         }
       }
-      hdf5_load_nd_dataset(layer_hid, dataset_name.c_str(), 0, kMaxBlobAxes,
-          target_blobs[j].get());
+      Blob<Dtype>* target_blob = target_blobs[j].get();
+      if (mapped_file->data() && hdf5_map_nd_dataset(layer_hid,
+          dataset_name.c_str(), 0, kMaxBlobAxes, mapped_file, target_blob)) {
+        mapped_bytes += target_blob->count() * sizeof(Dtype);
+      } else {
+        hdf5_load_nd_dataset(layer_hid, dataset_name.c_str(), 0, kMaxBlobAxes,
+            target_blob);
+        loaded_bytes += target_blob->count() * sizeof(Dtype);
+      }
     }
     H5Gclose(layer_hid);
   }
   H5Gclose(data_hid);
   H5Fclose(file_hid);
+  FoldTrainedLayers(folded_blobs);
+  LOG(INFO) << "Mapped " << mapped_bytes << " and read " << loaded_bytes
+            << " bytes of weights from " << trained_filename;
+  if (mapped_bytes_out) {
+    *mapped_bytes_out = mapped_bytes;
+  }
+  if (read_bytes_out) {
+    *read_bytes_out = loaded_bytes;
+  }
 }
 
 template <typename Dtype>
@@ -1336,10 +2155,17 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
-  hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
-      H5P_DEFAULT);
+  // Truncating a file mapped by CopyTrainedLayersFromHDF5 would take the
+  // pages away from under its nets, so write a new file in its place.
+  const string temp_filename = filename + ".tmp";
+  // Align the larger datasets to cache lines for when they are mapped.
+  hid_t access_plist = H5Pcreate(H5P_FILE_ACCESS);
+  H5Pset_alignment(access_plist, 1024, 64);
+  hid_t file_hid = H5Fcreate(temp_filename.c_str(), H5F_ACC_TRUNC,
+      H5P_DEFAULT, access_plist);
+  H5Pclose(access_plist);
   CHECK_GE(file_hid, 0)
-      << "Couldn't open " << filename << " to save weights.";
+      << "Couldn't open " << temp_filename << " to save weights.";
   hid_t data_hid = H5Gcreate2(file_hid, "data", H5P_DEFAULT, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(data_hid, 0) << "Error saving weights to " << filename << ".";
@@ -1389,6 +2215,8 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
     H5Gclose(diff_hid);
   }
   H5Fclose(file_hid);
+  CHECK_EQ(rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Couldn't save weights to " << filename << ".";
 }
 
 template <typename Dtype>
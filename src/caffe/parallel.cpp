@@ -110,6 +110,58 @@ Params<Dtype>::Params(shared_ptr<Solver<Dtype> > root_solver)
       diff_() {
 }
 
+template<typename Dtype>
+Params<Dtype>::Params(Solver<Dtype>* root_solver)
+    : size_(total_size<Dtype>(root_solver->net()->learnable_params())),
+      data_(),
+      diff_() {
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(Solver<Dtype>* root_solver)
+    : Params<Dtype>(root_solver),
+      data_use_cuda_(false),
+      diff_use_cuda_(false) {
+  CaffeMallocHost(reinterpret_cast<void**>(&data_), size_ * sizeof(Dtype),
+                  &data_use_cuda_);
+
+  // Copy blob values
+  const vector<Blob<Dtype>*>& net =
+      root_solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, copy);
+
+  CaffeMallocHost(reinterpret_cast<void**>(&diff_), size_ * sizeof(Dtype),
+                  &diff_use_cuda_);
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::~CPUParams() {
+  CaffeFreeHost(data_, data_use_cuda_);
+  CaffeFreeHost(diff_, diff_use_cuda_);
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::configure(Solver<Dtype>* solver) const {
+  const vector<Blob<Dtype>*>& net =
+      solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, replace_cpu);
+  apply_buffers(net, diff_, size_, replace_cpu_diff);
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::sync(Solver<Dtype>* solver) const {
+  const vector<Blob<Dtype>*>& net =
+      solver->net()->learnable_params();
+  for (int i = 0; i < net.size(); ++i) {
+    // Converts from a private layout into the buffer if needed and leaves
+    // the CPU copy as the head, so the values written in place are the ones
+    // the layers pick up next.
+    net[i]->mutable_cpu_data();
+    net[i]->mutable_cpu_diff();
+  }
+}
+
 template<typename Dtype>
 GPUParams<Dtype>::GPUParams(shared_ptr<Solver<Dtype> > root_solver, int device)
     : Params<Dtype>(root_solver) {
@@ -474,6 +526,7 @@ void P2PSync<Dtype>::Run(const vector<int>& gpus) {
 }
 
 INSTANTIATE_CLASS(Params);
+INSTANTIATE_CLASS(CPUParams);
 INSTANTIATE_CLASS(GPUParams);
 INSTANTIATE_CLASS(P2PSync);
 
@@ -49,6 +49,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "boost/bind.hpp"
 #include "caffe/solver.hpp"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/conversion_ledger.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
@@ -60,76 +61,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <mpi.h>
 #endif /* USE_MLSL */
 #ifdef USE_SELF_MPI
+#include "caffe/parallel.hpp"
 #include "caffe/util/mpi.hpp"
 #endif
 
 
 namespace caffe {
-template<typename Dtype>
-void Solver<Dtype>::copy_params_from_net(Dtype* params)
-{
-    std::vector<shared_ptr<Blob<Dtype> > > net_params = net_->params();
-    int offset = 0;
-    for (int i = 0; i < net_params.size(); ++i)
-    {
-        Blob<Dtype>* net_param = net_params[i].get();
-        memcpy(params+offset, net_param->cpu_data(), sizeof(Dtype)*net_param->count());
-        offset += net_param->count();
-    }
-}
-
-template<typename Dtype>
-void Solver<Dtype>::copy_diffs_from_net(Dtype* diffs)
-{
-    std::vector<shared_ptr<Blob<Dtype> > > net_params = net_->params();
-    int offset = 0;
-    for (int i = 0; i < net_params.size(); ++i)
-    {
-        Blob<Dtype>* net_param = net_params[i].get();
-        memcpy(diffs+offset, net_param->cpu_diff(), sizeof(Dtype)*net_param->count());
-        offset += net_param->count();
-    }
-}
-
-template<typename Dtype>
-void Solver<Dtype>::copy_params_to_net(Dtype* params)
-{
-    std::vector<shared_ptr<Blob<Dtype> > > net_params = net_->params();
-    int offset = 0;
-    for (int i = 0; i < net_params.size(); ++i)
-    {
-        Blob<Dtype>* net_param = net_params[i].get();
-        net_param->set_cpu_data(params + offset);
-        offset += net_param->count();
-    }
-}
-
-template<typename Dtype>
-void Solver<Dtype>::copy_diffs_to_net(Dtype* diffs)
-{
-    std::vector<shared_ptr<Blob<Dtype> > > net_params = net_->params();
-    int offset = 0;
-    for (int i = 0; i < net_params.size(); ++i)
-    {
-        Blob<Dtype>* net_param = net_params[i].get();
-        //fjr
-        //net_param->set_cpu_diff(diffs + offset);
-        memcpy(diffs+offset, net_param->mutable_cpu_diff(), sizeof(Dtype)*net_param->count());
-        offset += net_param->count();
-    }
-}
-
-template<typename Dtype>
-void Solver<Dtype>::find_net_size(int & param_size)
-{
-      std::vector<shared_ptr<Blob<Dtype> > > net_params = net_->params();
-      param_size = 0;
-      for (int i = 0; i < net_params.size(); ++i)
-      {
-          const Blob<Dtype>* net_param = net_params[i].get();
-          param_size += net_param->count();
-      }
-}
 
 template<typename Dtype>
 void Solver<Dtype>::SetActionFunction(ActionCallback func) {
@@ -364,19 +301,16 @@ void Solver<Dtype>::Step(int iters) {
 
   printf("Hello world from processor %s, rank %d" " out of %d processors\n", processor_name, world_rank, world_size);
 
-	shared_ptr<Net<Dtype> > myNet;
-	myNet = net();
-	int param_size;
-	find_net_size(param_size);
-	printf("****** rank %d: number of layers is %d, paramter size is %d ******\n", world_rank, (int)(myNet->params().size()), param_size);
-
-	Dtype * local_param = (Dtype *)malloc(param_size*sizeof(Dtype));
-	Dtype * local_diff  = (Dtype *)malloc(param_size*sizeof(Dtype));
-	Dtype * global_diff = (Dtype *)malloc(param_size*sizeof(Dtype));
-
-	copy_params_from_net(local_param);
-	caffe_mpi_bcast<Dtype>(local_param, param_size, 0, MPI_COMM_WORLD);
-	copy_params_to_net(local_param);
+  // Rebind all learnable params and their gradients into one contiguous
+  // host buffer each, so that broadcast and allreduce work in place.
+  if (!mpi_params_) {
+    mpi_params_.reset(new CPUParams<Dtype>(this));
+    mpi_params_->configure(this);
+  }
+  const int param_size = mpi_params_->size();
+  LOG(INFO) << "rank " << world_rank << ": " << net_->learnable_params().size()
+            << " learnable params, " << param_size << " values";
+  caffe_mpi_bcast<Dtype>(mpi_params_->data(), param_size, 0, MPI_COMM_WORLD);
 
 #endif
   const int start_iter = iter_;
@@ -409,6 +343,9 @@ void Solver<Dtype>::Step(int iters) {
     Dtype loss = forward_backward_();
 
     iter_time += iter_timer.MilliSeconds();
+    if (ConversionLedger::enabled() && Caffe::root_solver()) {
+      ConversionLedger::Get()->EndIteration();
+    }
 
     // average the loss across iterations for smoothed reporting
     UpdateSmoothedLoss(loss, start_iter, average_loss);
@@ -439,6 +376,11 @@ void Solver<Dtype>::Step(int iters) {
               << result_vec[k] << loss_msg_stream.str();
         }
       }
+      if (ConversionLedger::enabled() && Caffe::root_solver()) {
+        // The ledger is shared by the solvers of all threads.
+        ConversionLedger::Get()->Log();
+        ConversionLedger::Get()->Clear();
+      }
 
 #ifdef CAFFE_PER_LAYER_TIMINGS
       PrintTimers(false);
@@ -485,16 +427,17 @@ void Solver<Dtype>::Step(int iters) {
       break;
     }
 #ifdef USE_SELF_MPI
-		copy_diffs_from_net(local_diff);
-		caffe_mpi_allreduce<Dtype>(local_diff, global_diff, param_size, MPI_SUM, MPI_COMM_WORLD);
+    mpi_params_->sync(this);
+    caffe_mpi_allreduce<Dtype>(MPI_IN_PLACE, mpi_params_->diff(), param_size,
+                               MPI_SUM, MPI_COMM_WORLD);
     LOG(INFO) << "USE_SELF_MPI allreduce ";
-		#pragma omp parallel for
-		#pragma simd
-		for(int j=0;j<param_size;j++)
-			local_param[j] -= global_diff[j];
-
-		copy_params_to_net(local_param);
-#elif
+    Dtype* param_data = mpi_params_->data();
+    const Dtype* param_diff = mpi_params_->diff();
+#pragma omp parallel for
+#pragma simd
+    for (int j = 0; j < param_size; j++)
+      param_data[j] -= param_diff[j];
+#else
     LOG(INFO) << "NOT USE_SELF_MPI allreduce ";
 #endif
     LOG(INFO) << "END USE_SELF_MPI allreduce ";
@@ -949,6 +892,14 @@ string Solver<Dtype>::SnapshotToBinaryProto() {
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
   NetParameter net_param;
   net_->ToProto(&net_param, param_.snapshot_diff());
+  if (param_.snapshot_storage() != FLOAT32) {
+    for (int i = 0; i < net_param.layer_size(); ++i) {
+      LayerParameter* layer_param = net_param.mutable_layer(i);
+      for (int j = 0; j < layer_param->blobs_size(); ++j) {
+        PackBlobProto(param_.snapshot_storage(), layer_param->mutable_blobs(j));
+      }
+    }
+  }
   WriteProtoToBinaryFile(net_param, model_filename);
   return model_filename;
 }
@@ -957,6 +908,8 @@ template <typename Dtype>
 string Solver<Dtype>::SnapshotToHDF5() {
   string model_filename = SnapshotFilename(".caffemodel.h5");
   LOG(INFO) << "Snapshotting to HDF5 file " << model_filename;
+  LOG_IF(WARNING, param_.snapshot_storage() != FLOAT32)
+      << "snapshot_storage only applies to BINARYPROTO snapshots";
   net_->ToHDF5(model_filename, param_.snapshot_diff());
   return model_filename;
 }
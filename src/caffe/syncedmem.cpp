@@ -35,12 +35,119 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/cpu_info.hpp"
 #include "caffe/util/math_functions.hpp"
 
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
 namespace caffe {
 
+namespace {
+
+SyncedMemory::NumaPolicy ReadNumaPolicy() {
+  const char* policy = getenv("CAFFE_NUMA_POLICY");
+  if (policy == NULL) {
+    return SyncedMemory::NUMA_DEFAULT;
+  }
+  if (strcmp(policy, "first_touch") == 0) {
+    return SyncedMemory::NUMA_FIRST_TOUCH;
+  }
+  if (strcmp(policy, "interleave") == 0) {
+    return SyncedMemory::NUMA_INTERLEAVE;
+  }
+  LOG(WARNING) << "Unknown CAFFE_NUMA_POLICY " << policy;
+  return SyncedMemory::NUMA_DEFAULT;
+}
+
+SyncedMemory::NumaPolicy current_numa_policy = ReadNumaPolicy();
+
+std::atomic<uint64_t> last_version(0);
+
+// Both placement policies work in whole pages.
+size_t PageSize() {
+  static const size_t page = sysconf(_SC_PAGESIZE);
+  return page;
+}
+
+// Asks the kernel to interleave the untouched pages of [ptr, ptr + size)
+// over the nodes that have processors. Returns false if it could not.
+bool InterleavePages(void* ptr, size_t size) {
+  cpu::Collection& collection = cpu::getCollection();
+  const int kMaskWords = 16;
+  const int kWordBits = 8 * sizeof(unsigned long);  // NOLINT(runtime/int)
+  unsigned long mask[kMaskWords] = {0};  // NOLINT(runtime/int)
+  int nodes = 0;
+  for (unsigned node = 0; node < kMaskWords * kWordBits; ++node) {
+    if (!collection.getNumaNodeProcessors(node).empty()) {
+      mask[node / kWordBits] |= 1UL << (node % kWordBits);
+      ++nodes;
+    }
+  }
+  if (nodes < 2) { return false; }
+  const uintptr_t page = PageSize();
+  const uintptr_t begin =
+      (reinterpret_cast<uintptr_t>(ptr) + page - 1) & ~(page - 1);
+  const uintptr_t end = (reinterpret_cast<uintptr_t>(ptr) + size) & ~(page - 1);
+  if (end <= begin) { return false; }
+  // The kernel takes one bit less than maxnode.
+  return syscall(SYS_mbind, begin, end - begin, MPOL_INTERLEAVE, mask,
+                 kMaskWords * kWordBits + 1, 0) == 0;
+}
+
+}  // namespace
+
+SyncedMemory::NumaPolicy SyncedMemory::numa_policy() {
+  return current_numa_policy;
+}
+
+uint64_t SyncedMemory::next_version() {
+  return ++last_version;
+}
+
+void SyncedMemory::set_numa_policy(NumaPolicy policy) {
+  current_numa_policy = policy;
+}
+
+// Zeroes freshly allocated host memory, which places its pages.
+void SyncedMemory::place_cpu_data() {
+  if (current_numa_policy == NUMA_INTERLEAVE &&
+      !InterleavePages(cpu_ptr_, size_)) {
+    LOG_FIRST_N(INFO, 1) << "NUMA interleaving not available";
+  }
+#ifdef _OPENMP
+  const int threads = omp_get_max_threads();
+  const size_t page = PageSize();
+  if (current_numa_policy == NUMA_FIRST_TOUCH && threads > 1 &&
+      size_ >= threads * page && !omp_in_parallel()) {
+    const size_t chunk = (size_ / threads + page - 1) & ~(page - 1);
+    char* data = static_cast<char*>(cpu_ptr_);
+    #pragma omp parallel num_threads(threads)
+    {
+      const size_t begin = std::min(size_, chunk * omp_get_thread_num());
+      const size_t end = std::min(size_, begin + chunk);
+      caffe_memset(end - begin, 0, data + begin);
+    }
+    return;
+  }
+#endif
+  caffe_memset(size_, 0, cpu_ptr_);
+}
+
 SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
@@ -63,7 +170,7 @@ inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
     CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
-    caffe_memset(size_, 0, cpu_ptr_);
+    place_cpu_data();
     head_ = HEAD_AT_CPU;
     own_cpu_data_ = true;
     break;
@@ -82,6 +189,9 @@ inline void SyncedMemory::to_cpu() {
   case HEAD_AT_PRV:
     if (cpu_ptr_ == NULL) {
       CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+      if (current_numa_policy != NUMA_DEFAULT) {
+        place_cpu_data();
+      }
       own_cpu_data_ = true;
     }
     CHECK(prv_descriptor_.get());
@@ -138,14 +248,20 @@ const void* SyncedMemory::cpu_data() {
 }
 
 void SyncedMemory::set_cpu_data(void* data) {
+  set_cpu_data(data, shared_ptr<void>());
+}
+
+void SyncedMemory::set_cpu_data(void* data, const shared_ptr<void>& owner) {
   boost::mutex::scoped_lock lock(mtx);
   CHECK(data);
   if (own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
   }
   cpu_ptr_ = data;
+  cpu_owner_ = owner;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  version_ = next_version();
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -175,6 +291,7 @@ void SyncedMemory::set_gpu_data(void* data) {
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  version_ = next_version();
 #else
   NO_GPU;
 #endif
@@ -184,6 +301,7 @@ void* SyncedMemory::mutable_cpu_data() {
   boost::mutex::scoped_lock lock(mtx);
   to_cpu();
   head_ = HEAD_AT_CPU;
+  version_ = next_version();
   return cpu_ptr_;
 }
 
@@ -192,6 +310,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  version_ = next_version();
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -229,6 +348,7 @@ void SyncedMemory::set_prv_descriptor(shared_ptr<PrvMemDescr> descriptor,
   }
 
   prv_descriptor_ = descriptor;
+  version_ = next_version();
 }
 
 const void* SyncedMemory::prv_data() {
@@ -247,6 +367,7 @@ void* SyncedMemory::mutable_prv_data() {
     prv_descriptor_->convert_to_prv(cpu_ptr_);
   }
   head_ = HEAD_AT_PRV;
+  version_ = next_version();
   return prv_descriptor_->prv_ptr();
 }
 
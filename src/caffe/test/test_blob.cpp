@@ -35,6 +35,7 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -149,6 +150,71 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestReducedStorage) {
+  EXPECT_EQ(FLOAT32, this->blob_preshaped_->storage());
+  EXPECT_EQ(120 * sizeof(TypeParam), this->blob_preshaped_->data()->size());
+  this->blob_preshaped_->set_storage(FLOAT16);
+  EXPECT_EQ(FLOAT16, this->blob_preshaped_->storage());
+  EXPECT_EQ(120 * sizeof(uint16_t), this->blob_preshaped_->data()->size());
+  EXPECT_EQ(120 * sizeof(TypeParam), this->blob_preshaped_->diff()->size());
+  EXPECT_TRUE(this->blob_preshaped_->cpu_data16() != NULL);
+  // Growing keeps the storage type.
+  this->blob_preshaped_->Reshape(3, 3, 4, 5);
+  EXPECT_EQ(180 * sizeof(uint16_t), this->blob_preshaped_->data()->size());
+}
+
+TYPED_TEST(BlobSimpleTest, TestPackedBlobProto) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  const StorageType types[] = { FLOAT16, BFLOAT16 };
+  for (int t = 0; t < 2; ++t) {
+    BlobProto blob_proto;
+    this->blob_preshaped_->ToProto(&blob_proto);
+    PackBlobProto(types[t], &blob_proto);
+    EXPECT_EQ(0, blob_proto.data_size());
+    EXPECT_EQ(0, blob_proto.double_data_size());
+    EXPECT_EQ(120 * sizeof(uint16_t), blob_proto.packed_data().size());
+    this->blob_->FromProto(blob_proto);
+    EXPECT_EQ(this->blob_preshaped_->shape(), this->blob_->shape());
+    const TypeParam* expected = this->blob_preshaped_->cpu_data();
+    const TypeParam* data = this->blob_->cpu_data();
+    for (int i = 0; i < 120; ++i) {
+      EXPECT_NEAR(expected[i], data[i], std::fabs(expected[i]) / 256 + 1e-7);
+    }
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestInt8BlobProto) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  BlobProto blob_proto;
+  this->blob_preshaped_->ToProto(&blob_proto);
+  PackBlobProto(INT8, &blob_proto);
+  EXPECT_EQ(INT8, blob_proto.storage());
+  EXPECT_EQ(0, blob_proto.data_size());
+  EXPECT_EQ(0, blob_proto.double_data_size());
+  EXPECT_EQ(120, blob_proto.packed_data().size());
+  // One scale per slice along the first axis.
+  ASSERT_EQ(2, blob_proto.scale_size());
+  this->blob_->FromProto(blob_proto);
+  EXPECT_EQ(this->blob_preshaped_->shape(), this->blob_->shape());
+  const TypeParam* expected = this->blob_preshaped_->cpu_data();
+  const TypeParam* data = this->blob_->cpu_data();
+  for (int i = 0; i < 120; ++i) {
+    EXPECT_NEAR(expected[i], data[i], blob_proto.scale(i / 60) / 2 + 1e-6);
+  }
+  // Vectors such as biases are left as they are.
+  vector<int> bias_shape(1, 5);
+  this->blob_->Reshape(bias_shape);
+  BlobProto bias_proto;
+  this->blob_->ToProto(&bias_proto);
+  PackBlobProto(INT8, &bias_proto);
+  EXPECT_EQ(FLOAT32, bias_proto.storage());
+  EXPECT_EQ(5, bias_proto.data_size() + bias_proto.double_data_size());
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -0,0 +1,162 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <string>
+#include <vector>
+
+#include "boost/thread.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/conversion_ledger.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Charges one conversion of the given size to layer on the calling thread.
+static void ConvertIn(const string* layer, size_t bytes) {
+  ConversionLedger::set_layer(layer, false);
+  ConversionLedger::Conversion conversion(ConversionLedger::FROM_PRV,
+      PrvMemDescr::PRV_DESCR_MKLDNN, bytes);
+}
+
+class ConversionLedgerTest : public ::testing::Test {
+ protected:
+  ConversionLedgerTest()
+      : ledger_(ConversionLedger::Get()),
+        was_enabled_(ConversionLedger::enabled()) {}
+
+  virtual void SetUp() {
+    ConversionLedger::set_enabled(true);
+    ledger_->Clear();
+  }
+
+  virtual void TearDown() {
+    ConversionLedger::set_layer(NULL, false);
+    ledger_->Clear();
+    ConversionLedger::set_enabled(was_enabled_);
+  }
+
+  ConversionLedger* ledger_;
+  bool was_enabled_;
+};
+
+TEST_F(ConversionLedgerTest, TestRecord) {
+  const string relu("relu1"), conv("conv2");
+  ConversionLedger::set_layer(&relu, false);
+  for (int i = 0; i < 3; ++i) {
+    ConversionLedger::Conversion conversion(ConversionLedger::FROM_PRV,
+        PrvMemDescr::PRV_DESCR_MKL2017, 100);
+  }
+  ConversionLedger::set_layer(&conv, false);
+  {
+    ConversionLedger::Conversion conversion(ConversionLedger::TO_PRV,
+        PrvMemDescr::PRV_DESCR_MKL2017, 1000);
+  }
+  ConversionLedger::set_layer(&conv, true);
+  {
+    ConversionLedger::Conversion conversion(ConversionLedger::TO_PRV,
+        PrvMemDescr::PRV_DESCR_MKL2017, 10);
+  }
+  ledger_->EndIteration();
+
+  const vector<ConversionLedger::Entry> entries = ledger_->entries();
+  ASSERT_EQ(entries.size(), 3);
+  // Sorted by bytes.
+  EXPECT_EQ(entries[0].layer, conv);
+  EXPECT_EQ(entries[0].direction, ConversionLedger::TO_PRV);
+  EXPECT_FALSE(entries[0].backward);
+  EXPECT_EQ(entries[0].count, 1);
+  EXPECT_EQ(entries[0].bytes, 1000);
+  EXPECT_EQ(entries[1].layer, relu);
+  EXPECT_EQ(entries[1].direction, ConversionLedger::FROM_PRV);
+  EXPECT_EQ(entries[1].engine, PrvMemDescr::PRV_DESCR_MKL2017);
+  EXPECT_EQ(entries[1].count, 3);
+  EXPECT_EQ(entries[1].bytes, 300);
+  EXPECT_GE(entries[1].seconds, 0);
+  EXPECT_EQ(entries[2].layer, conv);
+  EXPECT_TRUE(entries[2].backward);
+  EXPECT_EQ(ledger_->total_count(), 5);
+  EXPECT_EQ(ledger_->total_bytes(), 1310);
+  EXPECT_EQ(ledger_->iterations(), 1);
+
+  ledger_->Clear();
+  EXPECT_EQ(ledger_->entries().size(), 0);
+  EXPECT_EQ(ledger_->iterations(), 0);
+}
+
+TEST_F(ConversionLedgerTest, TestDisabled) {
+  ConversionLedger::set_enabled(false);
+  {
+    ConversionLedger::Conversion conversion(ConversionLedger::TO_PRV,
+        PrvMemDescr::PRV_DESCR_MKLDNN, 100);
+  }
+  EXPECT_EQ(ledger_->total_count(), 0);
+}
+
+TEST_F(ConversionLedgerTest, TestOutsideLayers) {
+  {
+    ConversionLedger::Conversion conversion(ConversionLedger::PRV_TO_PRV,
+        PrvMemDescr::PRV_DESCR_MKLDNN, 100);
+  }
+  const vector<ConversionLedger::Entry> entries = ledger_->entries();
+  ASSERT_EQ(entries.size(), 1);
+  EXPECT_EQ(entries[0].layer, "");
+  EXPECT_EQ(entries[0].engine, PrvMemDescr::PRV_DESCR_MKLDNN);
+}
+
+TEST_F(ConversionLedgerTest, TestLayerPerThread) {
+  const string train("train_conv"), test("test_conv");
+  ConversionLedger::set_layer(&train, false);
+  // A net running on another thread does not change this thread's layer.
+  boost::thread other(ConvertIn, &test, 100);
+  other.join();
+  {
+    ConversionLedger::Conversion conversion(ConversionLedger::FROM_PRV,
+        PrvMemDescr::PRV_DESCR_MKLDNN, 1000);
+  }
+  const vector<ConversionLedger::Entry> entries = ledger_->entries();
+  ASSERT_EQ(entries.size(), 2);
+  EXPECT_EQ(entries[0].layer, train);
+  EXPECT_EQ(entries[0].bytes, 1000);
+  EXPECT_EQ(entries[1].layer, test);
+  EXPECT_EQ(entries[1].bytes, 100);
+}
+
+}  // namespace caffe
@@ -35,6 +35,13 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 #include "caffe/util/cpu_info.hpp"
@@ -266,6 +273,61 @@ TEST(CpuInfo, testCollectionForSpeedRecognitionMhz) {
   EXPECT_EQ(collection.getProcessorSpeedMHz(), 2400);
 }
 
+TEST(CpuInfo, testParseCpuList) {
+  std::vector<unsigned> cpus;
+  Collection::parseCpuList("0-2,8,10-11\n", &cpus);
+  const unsigned expected[] = {0, 1, 2, 8, 10, 11};
+  ASSERT_EQ(cpus.size(), 6);
+  for (int i = 0; i < 6; i++) {
+    EXPECT_EQ(cpus[i], expected[i]);
+  }
+
+  cpus.clear();
+  Collection::parseCpuList("\n", &cpus);
+  EXPECT_EQ(cpus.size(), 0);
+}
+
+TEST(CpuInfo, testCollectionNumaTopology) {
+  CpuInfoContent cpuInfoContent("xxx", 2, 2, 1);
+  CpuInfo cpuInfo(cpuInfoContent.getContent());
+  Collection collection(&cpuInfo);
+
+  // node0 and node2 with processors, memory-only node3.
+  char directory[] = "/tmp/caffe_numa_XXXXXX";
+  ASSERT_TRUE(mkdtemp(directory) != NULL);
+  const char *nodes[] = {"node0", "node2", "node3"};
+  const char *cpuLists[] = {"0-1\n", "2,3\n", "\n"};
+  std::string paths[3];
+  for (int i = 0; i < 3; i++) {
+    paths[i] = std::string(directory) + "/" + nodes[i];
+    ASSERT_EQ(mkdir(paths[i].c_str(), 0700), 0);
+    FILE *file = fopen((paths[i] + "/cpulist").c_str(), "w");
+    ASSERT_TRUE(file != NULL);
+    fputs(cpuLists[i], file);
+    fclose(file);
+  }
+
+  collection.loadNumaTopology(directory);
+  EXPECT_EQ(collection.getNumberOfNumaNodes(), 3);
+  EXPECT_EQ(collection.getNumaNodeProcessors(0).size(), 2);
+  EXPECT_EQ(collection.getNumaNodeProcessors(1).size(), 0);
+  EXPECT_EQ(collection.getNumaNodeProcessors(3).size(), 0);
+  EXPECT_EQ(collection.getNumaNodeProcessors(7).size(), 0);
+  EXPECT_EQ(collection.getNumaNodeOfProcessor(1), 0);
+  EXPECT_EQ(collection.getNumaNodeOfProcessor(3), 2);
+  EXPECT_EQ(collection.getNumaNodeOfProcessor(4), -1);
+
+  for (int i = 0; i < 3; i++) {
+    remove((paths[i] + "/cpulist").c_str());
+    rmdir(paths[i].c_str());
+  }
+  rmdir(directory);
+
+  collection.loadNumaTopology("/nonexistent");
+  EXPECT_EQ(collection.getNumberOfNumaNodes(), 0);
+  EXPECT_EQ(collection.getNumaNodeOfProcessor(0), -1);
+}
+
 }  // namespace cpu
 }  // namespace caffe
 
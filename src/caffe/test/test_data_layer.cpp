@@ -44,6 +44,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
+#include "caffe/data_reader.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
@@ -56,6 +57,15 @@ namespace caffe {
 
 using boost::scoped_ptr;
 
+// Exposes how DataReader splits a source across ranks.
+class PartitionedReader : public DataReader {
+ public:
+  using DataReader::KeyRange;
+  using DataReader::DBWrapper;
+  using DataReader::NewPartReaders;
+  using DataReader::SplitKeyRanges;
+};
+
 template <typename TypeParam>
 class DataLayerTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -104,7 +114,9 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     db->Close();
   }
 
-  void TestRead() {
+  // extra_param is merged into the layer's DataParameter, e.g. to test
+  // alternative reader modes against the same expectations.
+  void TestRead(const DataParameter& extra_param = DataParameter()) {
     const Dtype scale = 3;
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -112,6 +124,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->MergeFrom(extra_param);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -142,6 +155,157 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // Reads with several reader threads, which changes the order of records
+  // but must still deliver each of them intact. Returns the label sequence.
+  vector<int> TestReadSharded(const bool round_robin,
+      const DataParameter& extra_param = DataParameter()) {
+    const Dtype scale = 3;
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_reader_threads(2);
+    data_param->set_reader_round_robin(round_robin);
+    data_param->MergeFrom(extra_param);
+
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_scale(scale);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(blob_top_data_->num(), 5);
+    EXPECT_EQ(blob_top_label_->num(), 5);
+
+    vector<int> labels;
+    vector<int> label_count(5, 0);
+    for (int iter = 0; iter < 20; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        EXPECT_GE(label, 0);
+        EXPECT_LT(label, 5);
+        labels.push_back(label);
+        ++label_count[label];
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(scale * label, blob_top_data_->cpu_data()[i * 24 + j])
+              << "debug: iter " << iter << " i " << i << " j " << j;
+        }
+      }
+    }
+    for (int label = 0; label < 5; ++label) {
+      EXPECT_GT(label_count[label], 0) << "label " << label << " never read";
+    }
+    return labels;
+  }
+
+  // Reads 20 epochs with block shuffling. Every record must come through
+  // intact and the order must not be the plain key order.
+  // Splits the 5 records of the source across several ranks, with more
+  // blocks per reader than the source can fill.
+  void TestPartitionSmallSource() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(1);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_partition(DataParameter_Partition_HASHED);
+    data_param->set_partition_blocks(16);
+    for (int num_ranks = 2; num_ranks <= 5; ++num_ranks) {
+      {
+        scoped_ptr<db::DB> db(db::GetDB(backend_));
+        db->Open(*filename_, db::READ);
+        const vector<PartitionedReader::KeyRange> blocks =
+            PartitionedReader::SplitKeyRanges(db.get(), num_ranks,
+                                              data_param->partition_blocks());
+        const int num_blocks = blocks.size();
+        EXPECT_EQ(num_ranks * (5 / num_ranks), num_blocks);
+        // The blocks cover every record once, in key order.
+        scoped_ptr<db::Cursor> cursor(db->NewCursor());
+        int record = 0;
+        for (int i = 0; i < num_blocks; ++i) {
+          EXPECT_GT(blocks[i].size, 0);
+          cursor->Seek(blocks[i].begin);
+          for (size_t j = 0; j < blocks[i].size; ++j, cursor->Next()) {
+            ASSERT_TRUE(cursor->valid());
+            stringstream ss;
+            ss << record++;
+            EXPECT_EQ(ss.str(), cursor->key());
+          }
+        }
+        EXPECT_EQ(5, record);
+      }
+      // Every rank gets a reader for its own blocks.
+      for (int rank = 0; rank < num_ranks; ++rank) {
+        vector<shared_ptr<PartitionedReader::DBWrapper> > parts =
+            PartitionedReader::NewPartReaders(param, rank, num_ranks);
+        ASSERT_EQ(1, parts.size());
+        for (int i = 0; i < 5; ++i, parts[0]->Next()) {
+          EXPECT_FALSE(parts[0]->value().empty());
+        }
+      }
+    }
+  }
+
+  vector<int> ReadBlockShuffle() {
+    const Dtype scale = 3;
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    Caffe::set_random_seed(1701);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(true);
+    data_param->set_shuffle_block_size(2);
+    data_param->set_shuffle_buffer_size(3);
+
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_scale(scale);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+
+    vector<int> labels;
+    for (int iter = 0; iter < 20; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        EXPECT_GE(label, 0);
+        EXPECT_LT(label, 5);
+        labels.push_back(label);
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(scale * label, blob_top_data_->cpu_data()[i * 24 + j])
+              << "debug: iter " << iter << " i " << i << " j " << j;
+        }
+      }
+    }
+    return labels;
+  }
+
+  void TestReadBlockShuffle() {
+    const vector<int> labels = ReadBlockShuffle();
+    const int num_records = labels.size();
+    vector<int> label_count(5, 0);
+    int num_in_order = 0;
+    for (int i = 0; i < num_records; ++i) {
+      ++label_count[labels[i]];
+      // Without shuffle, record i of the stream has label i % 5.
+      num_in_order += (labels[i] == i % 5);
+    }
+    for (int label = 0; label < 5; ++label) {
+      EXPECT_GT(label_count[label], 0) << "label " << label << " never read";
+    }
+    // Most records leave their unshuffled position.
+    EXPECT_LE(num_in_order, num_records / 2);
+    // The same seed reproduces the same order.
+    EXPECT_TRUE(labels == ReadBlockShuffle());
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -207,7 +371,8 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
-  void TestReadCrop(Phase phase) {
+  void TestReadCrop(Phase phase,
+                    const DataParameter& extra_param = DataParameter()) {
     const Dtype scale = 3;
     LayerParameter param;
     param.set_phase(phase);
@@ -217,6 +382,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->MergeFrom(extra_param);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -465,6 +631,103 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
   this->TestReadCrop(TEST);
 }
 
+TYPED_TEST(DataLayerTest, TestReadShardedLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  const bool round_robin = true;
+  vector<int> labels = this->TestReadSharded(round_robin);
+  // Round-robin merging keeps the order deterministic across runs.
+  EXPECT_TRUE(labels == this->TestReadSharded(round_robin));
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardedUnorderedLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  const bool round_robin = false;
+  this->TestReadSharded(round_robin);
+}
+
+TYPED_TEST(DataLayerTest, TestReadPartitionedLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  const bool round_robin = true;
+  DataParameter extra_param;
+  extra_param.set_partition(DataParameter_Partition_CONTIGUOUS);
+  // A single rank reads the same records as without partitioning.
+  EXPECT_TRUE(this->TestReadSharded(round_robin) ==
+              this->TestReadSharded(round_robin, extra_param));
+}
+
+TYPED_TEST(DataLayerTest, TestReadPartitionedHashedLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  const bool round_robin = true;
+  DataParameter extra_param;
+  extra_param.set_partition(DataParameter_Partition_HASHED);
+  extra_param.set_partition_blocks(1);
+  vector<int> labels = this->TestReadSharded(round_robin, extra_param);
+  // Blocks are dealt by the partition seed alone.
+  EXPECT_TRUE(labels == this->TestReadSharded(round_robin, extra_param));
+  extra_param.set_shuffle(true);
+  this->TestReadSharded(round_robin, extra_param);
+}
+
+TYPED_TEST(DataLayerTest, TestPartitionSmallSourceLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestPartitionSmallSource();
+}
+
+TYPED_TEST(DataLayerTest, TestReadBlockShuffleLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadBlockShuffle();
+}
+
+TYPED_TEST(DataLayerTest, TestReadZeroCopyLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  DataParameter extra_param;
+  extra_param.set_zero_copy(true);
+  this->TestRead(extra_param);
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTestZeroCopyLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  DataParameter extra_param;
+  extra_param.set_zero_copy(true);
+  this->TestReadCrop(TEST, extra_param);
+}
+
+TYPED_TEST(DataLayerTest, TestReadPrefetchWorkersLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  DataParameter extra_param;
+  extra_param.set_prefetch(5);
+  extra_param.set_prefetch_workers(1);
+  this->TestRead(extra_param);
+  // Concurrent workers still fill each batch with the next records in DB
+  // order, so the labels come out as with one worker.
+  extra_param.set_prefetch_workers(3);
+  this->TestRead(extra_param);
+  // The same holds for the deterministic order of several readers.
+  const bool round_robin = true;
+  extra_param.set_prefetch_workers(1);
+  const vector<int> one_worker = this->TestReadSharded(round_robin,
+                                                       extra_param);
+  extra_param.set_prefetch_workers(3);
+  EXPECT_TRUE(one_worker ==
+              this->TestReadSharded(round_robin, extra_param));
+}
+
 #endif  // USE_LMDB
+
+TYPED_TEST(DataLayerTest, TestPartitionSmallSourcePacked) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_PACKED);
+  this->TestPartitionSmallSource();
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
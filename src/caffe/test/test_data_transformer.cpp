@@ -35,7 +35,6 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-#ifdef USE_OPENCV
 #include <string>
 #include <vector>
 
@@ -46,12 +45,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/data_transformer.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/cpu_info.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/transform_row.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
 namespace caffe {
 
+#ifdef USE_OPENCV
 void FillDatum(const int label, const int channels, const int height,
   const int width, const bool unique_pixels, Datum * datum) {
   datum->set_label(label);
@@ -376,6 +378,50 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
     EXPECT_EQ(blob.cpu_data()[j], 0);
   }
 }
+#endif  // USE_OPENCV
+
+TEST(TransformRowTest, TestKernelsMatchScalar) {
+  vector<TransformRowFunc> kernels;
+#ifdef CAFFE_TRANSFORM_ROW_X86
+  if (cpu::getSupportedIsa() >= cpu::isaAvx2) {
+    kernels.push_back(transform_row_avx2);
+  }
+  if (cpu::getSupportedIsa() >= cpu::isaAvx512) {
+    kernels.push_back(transform_row_avx512);
+  }
+#endif
+  kernels.push_back(transform_row());
+  // Long enough for full vectors plus a tail of every length.
+  const int max_width = 53;
+  vector<uint8_t> src(max_width);
+  vector<float> mean(max_width);
+  for (int i = 0; i < max_width; ++i) {
+    src[i] = static_cast<uint8_t>(i * 37 + 200);
+    mean[i] = i * 0.5f;
+  }
+  vector<float> expected(max_width);
+  vector<float> actual(max_width);
+  for (int k = 0; k < kernels.size(); ++k) {
+    for (int width = 1; width <= max_width; ++width) {
+      for (int mirror = 0; mirror < 2; ++mirror) {
+        for (int has_mean = 0; has_mean < 2; ++has_mean) {
+          const float* m = has_mean ? &mean[0] : NULL;
+          transform_row_scalar(&src[0], m, 3.f, 0.25f, width, mirror,
+                               &expected[0]);
+          actual.assign(max_width, -1.f);
+          kernels[k](&src[0], m, 3.f, 0.25f, width, mirror, &actual[0]);
+          for (int i = 0; i < width; ++i) {
+            EXPECT_EQ(expected[i], actual[i]) << "kernel " << k << " width "
+                << width << " mirror " << mirror << " mean " << has_mean;
+          }
+          // Nothing is written past the row.
+          for (int i = width; i < max_width; ++i) {
+            EXPECT_EQ(-1.f, actual[i]);
+          }
+        }
+      }
+    }
+  }
+}
 
 }  // namespace caffe
-#endif  // USE_OPENCV
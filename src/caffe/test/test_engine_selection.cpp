@@ -51,6 +51,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/layers/batch_norm_layer.hpp"
 #include "caffe/layers/concat_layer.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/direct_conv_layer.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/layers/lrn_layer.hpp"
 #include "caffe/layers/pooling_layer.hpp"
@@ -189,6 +190,10 @@ TYPED_TEST(TestEngineSelection, TestEngineParser) {
   EXPECT_FALSE(ep1.isEngine("MKL2017"));
   EXPECT_FALSE(ep1.isEngine("CUDNN"));
 
+  EngineParser ep6("DIRECT");
+  EXPECT_FALSE(ep6.isEngine("CAFFE"));
+  EXPECT_TRUE(ep6.isEngine("DIRECT"));
+
 #ifdef MKL2017_SUPPORTED
   EngineParser ep2("MKL2017");
   EXPECT_FALSE(ep2.isEngine("CAFFE"));
@@ -323,7 +328,97 @@ TYPED_TEST(TestEngineSelection, TestEngineParserNetCAFFE) {
   }
 }
 
+TYPED_TEST(TestEngineSelection, TestEngineParserNetDIRECT) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  void* null_ptr = NULL;
+  this->InitNet("DIRECT");
+  Net<Dtype>* net = this->net_.get();
+
+  // conv1 verification
+  Layer<Dtype>* conv1_layer = net->layer_by_name("conv1").get();
+  DirectConvolutionLayer<Dtype>* conv1_direct =
+          dynamic_cast<DirectConvolutionLayer<Dtype>* >(conv1_layer);
+  EXPECT_NE(null_ptr, conv1_direct);
+
+  // The other layers fall back to CAFFE.
+  Layer<Dtype>* pool1_layer = net->layer_by_name("pool1").get();
+  PoolingLayer<Dtype>* pool1_caffe =
+          dynamic_cast<PoolingLayer<Dtype>* >(pool1_layer);
+  EXPECT_NE(null_ptr, pool1_caffe);
+
+  Layer<Dtype>* ip1_layer = net->layer_by_name("ip1").get();
+  InnerProductLayer<Dtype>* ip1_caffe =
+          dynamic_cast<InnerProductLayer<Dtype>* >(ip1_layer);
+  EXPECT_NE(null_ptr, ip1_caffe);
+
+  Layer<Dtype>* relu1_layer = net->layer_by_name("relu1").get();
+  ReLULayer<Dtype>* relu1_caffe =
+          dynamic_cast<ReLULayer<Dtype>* >(relu1_layer);
+  EXPECT_NE(null_ptr, relu1_caffe);
+}
+
+TYPED_TEST(TestEngineSelection, TestEngineParserNetDIRECT3D) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  // A single kernel_size on a 5-axis input: conv1 can only tell that it is
+  // not 2D once it sees its bottom, and convolves it with im2col.
+  this->InitNetFromProtoString(
+      "engine: 'DIRECT' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "  shape: { dim: 1 dim: 3 dim: 4 dim: 5 dim: 6 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 2 "
+      "    kernel_size: 3 "
+      "  } "
+      "} ");
+  Net<Dtype>* net = this->net_.get();
+  net->Forward();
+  const Blob<Dtype>* conv1 = net->blob_by_name("conv1").get();
+  ASSERT_EQ(5, conv1->num_axes());
+  EXPECT_EQ(2, conv1->shape(1));
+  EXPECT_EQ(2, conv1->shape(2));
+  EXPECT_EQ(3, conv1->shape(3));
+  EXPECT_EQ(4, conv1->shape(4));
+}
+
 #ifdef MKL2017_SUPPORTED
+TYPED_TEST(TestEngineSelection, TestFusedActivationMKL2017) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  // MKL2017 applies neither a fused ReLU nor a fused PReLU.
+  void* null_ptr = NULL;
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  layer_param.set_engine("MKL2017");
+  ConvolutionParameter* conv_param = layer_param.mutable_convolution_param();
+  conv_param->add_kernel_size(3);
+  conv_param->set_num_output(4);
+  shared_ptr<Layer<Dtype> > layer =
+      LayerRegistry<Dtype>::CreateLayer(layer_param);
+  EXPECT_NE(null_ptr, dynamic_cast<MKLConvolutionLayer<Dtype>* >(layer.get()));
+  conv_param->set_relu(true);
+  layer = LayerRegistry<Dtype>::CreateLayer(layer_param);
+  EXPECT_EQ(null_ptr, dynamic_cast<MKLConvolutionLayer<Dtype>* >(layer.get()));
+  EXPECT_NE(null_ptr, dynamic_cast<ConvolutionLayer<Dtype>* >(layer.get()));
+  conv_param->set_relu(false);
+  conv_param->set_prelu(true);
+  layer = LayerRegistry<Dtype>::CreateLayer(layer_param);
+  EXPECT_EQ(null_ptr, dynamic_cast<MKLConvolutionLayer<Dtype>* >(layer.get()));
+  EXPECT_NE(null_ptr, dynamic_cast<ConvolutionLayer<Dtype>* >(layer.get()));
+}
+
 TYPED_TEST(TestEngineSelection, TestEngineParserNetMKL2017) {
   typedef typename TypeParam::Dtype Dtype;
 
@@ -405,6 +500,30 @@ TYPED_TEST(TestEngineSelection, TestEngineParserNetMKL2017) {
 #endif
 
 #ifdef MKLDNN_SUPPORTED
+TYPED_TEST(TestEngineSelection, TestFusedActivationMKLDNN) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  // MKLDNN applies a fused ReLU but not a fused PReLU.
+  void* null_ptr = NULL;
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  layer_param.set_engine("MKLDNN");
+  ConvolutionParameter* conv_param = layer_param.mutable_convolution_param();
+  conv_param->add_kernel_size(3);
+  conv_param->set_num_output(4);
+  conv_param->set_relu(true);
+  shared_ptr<Layer<Dtype> > layer =
+      LayerRegistry<Dtype>::CreateLayer(layer_param);
+  EXPECT_NE(null_ptr,
+            dynamic_cast<MKLDNNConvolutionLayer<Dtype>* >(layer.get()));
+  conv_param->set_relu(false);
+  conv_param->set_prelu(true);
+  layer = LayerRegistry<Dtype>::CreateLayer(layer_param);
+  EXPECT_EQ(null_ptr,
+            dynamic_cast<MKLDNNConvolutionLayer<Dtype>* >(layer.get()));
+  EXPECT_NE(null_ptr, dynamic_cast<ConvolutionLayer<Dtype>* >(layer.get()));
+}
+
 TYPED_TEST(TestEngineSelection, TestEngineParserNetMKLDNN) {
   typedef typename TypeParam::Dtype Dtype;
 
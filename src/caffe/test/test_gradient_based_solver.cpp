@@ -731,6 +731,50 @@ TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestCPUParamsRebind) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 1;
+  this->share_ = true;
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+      kNumIters);
+  const vector<Blob<Dtype>*>& params =
+      this->solver_->net()->learnable_params();
+  vector<shared_ptr<Blob<Dtype> > > param_copies(params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    param_copies[i].reset(new Blob<Dtype>());
+    param_copies[i]->CopyFrom(*params[i], false, true);
+  }
+
+  CPUParams<Dtype> cpu_params(this->solver_.get());
+  cpu_params.configure(this->solver_.get());
+  // Params are laid out back to back and keep their values.
+  size_t offset = 0;
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(cpu_params.data() + offset, params[i]->cpu_data());
+    EXPECT_EQ(cpu_params.diff() + offset, params[i]->cpu_diff());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(param_copies[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+      EXPECT_EQ(0, params[i]->cpu_diff()[j]);
+    }
+    offset += params[i]->count();
+  }
+  EXPECT_EQ(offset, cpu_params.size());
+
+  // Writes into the buffers are seen through the blobs and vice versa.
+  caffe_set(cpu_params.size(), Dtype(2), cpu_params.diff());
+  params[0]->Update();
+  cpu_params.sync(this->solver_.get());
+  for (int j = 0; j < params[0]->count(); ++j) {
+    EXPECT_EQ(param_copies[0]->cpu_data()[j] - 2, cpu_params.data()[j]);
+  }
+}
+
 
 template <typename TypeParam>
 class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
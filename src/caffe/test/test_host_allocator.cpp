@@ -0,0 +1,155 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+
+#include <cstring>
+
+#include "boost/thread.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+TEST(SystemHostAllocatorTest, TestAlignment) {
+  SystemHostAllocator allocator;
+  const size_t sizes[] = {0, 1, 24, 1000, size_t(3) << 20};
+  for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    void* ptr = allocator.Allocate(sizes[i]);
+    ASSERT_TRUE(ptr != NULL) << "size " << sizes[i];
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % 64, 0) << "size " << sizes[i];
+    allocator.Free(ptr);
+  }
+}
+
+class CachingHostAllocatorTest : public ::testing::Test {
+ protected:
+  CachingHostAllocatorTest() : allocator_(size_t(64) << 20) {}
+
+  CachingHostAllocator allocator_;
+};
+
+TEST_F(CachingHostAllocatorTest, TestSizeClasses) {
+  size_t previous_size = 0;
+  int previous_index = -1;
+  for (size_t size = 1; size < (size_t(1) << 24); size += size / 7 + 1) {
+    size_t class_size;
+    const int index = CachingHostAllocator::SizeClass(size, &class_size);
+    EXPECT_GE(class_size, size);
+    EXPECT_EQ(class_size % 64, 0);
+    EXPECT_LE(class_size, size + size / 4 + 64);
+    // Classes grow with the size, and one index always means one size.
+    EXPECT_GE(index, previous_index);
+    if (index == previous_index) {
+      EXPECT_EQ(class_size, previous_size);
+    } else {
+      EXPECT_GT(class_size, previous_size);
+    }
+    previous_size = class_size;
+    previous_index = index;
+  }
+}
+
+TEST_F(CachingHostAllocatorTest, TestReuse) {
+  void* first = allocator_.Allocate(1000);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(first) % 64, 0);
+  memset(first, 1, 1000);
+  allocator_.Free(first);
+  // Same size class, served from the free list.
+  void* second = allocator_.Allocate(1020);
+  EXPECT_EQ(first, second);
+  HostAllocatorStats stats = allocator_.stats();
+  EXPECT_EQ(stats.allocations, 2);
+  EXPECT_EQ(stats.cache_hits, 1);
+  EXPECT_EQ(stats.system_allocations, 1);
+  EXPECT_EQ(stats.bytes_in_use, 1024);
+  EXPECT_EQ(stats.bytes_cached, 0);
+  allocator_.Free(second);
+  stats = allocator_.stats();
+  EXPECT_EQ(stats.bytes_in_use, 0);
+  EXPECT_EQ(stats.bytes_cached, 1024);
+  EXPECT_EQ(stats.peak_bytes_in_use, 1024);
+  allocator_.Trim();
+  stats = allocator_.stats();
+  EXPECT_EQ(stats.bytes_cached, 0);
+  EXPECT_EQ(stats.bytes_reserved, 0);
+}
+
+TEST_F(CachingHostAllocatorTest, TestLargeBlocks) {
+  // Larger than the per-thread lists take, so kept in the shared pool.
+  const size_t size = size_t(6) << 20;
+  char* block = static_cast<char*>(allocator_.Allocate(size));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(block) % 64, 0);
+  block[0] = 1;
+  block[size - 1] = 2;
+  allocator_.Free(block);
+  EXPECT_EQ(allocator_.Allocate(size), block);
+  allocator_.Free(block);
+  // Beyond the pool limit, blocks go back to the system.
+  void* huge = allocator_.Allocate(size_t(80) << 20);
+  allocator_.Free(huge);
+  HostAllocatorStats stats = allocator_.stats();
+  EXPECT_EQ(stats.system_allocations, 2);
+  EXPECT_EQ(stats.bytes_in_use, 0);
+  EXPECT_LE(stats.bytes_cached, size_t(64) << 20);
+}
+
+void AllocateAndFree(CachingHostAllocator* allocator) {
+  for (int i = 0; i < 100; ++i) {
+    allocator->Free(allocator->Allocate(128 * (i % 10 + 1)));
+  }
+}
+
+TEST_F(CachingHostAllocatorTest, TestThreadExit) {
+  boost::thread thread(AllocateAndFree, &allocator_);
+  thread.join();
+  // The exiting thread handed its free lists to the shared pool.
+  HostAllocatorStats stats = allocator_.stats();
+  EXPECT_EQ(stats.allocations, 100);
+  EXPECT_EQ(stats.system_allocations, 10);
+  EXPECT_EQ(stats.bytes_in_use, 0);
+  EXPECT_EQ(stats.bytes_cached, stats.bytes_reserved - 10 * 64);
+  void* ptr = allocator_.Allocate(128);
+  EXPECT_EQ(allocator_.stats().cache_hits, 91);
+  allocator_.Free(ptr);
+}
+
+}  // namespace caffe
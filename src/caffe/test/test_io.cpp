@@ -457,5 +457,47 @@ TEST_F(IOTest, TestDecodeDatumToCVMatContentNative) {
   }
 }
 
+TEST_F(IOTest, TestParseDatumView) {
+  Datum datum_ref;
+  datum_ref.set_channels(2);
+  datum_ref.set_height(3);
+  datum_ref.set_width(4);
+  datum_ref.set_label(-7);
+  for (int i = 0; i < 24; ++i) {
+    datum_ref.mutable_data()->push_back(static_cast<char>(i * 10));
+  }
+  string serialized;
+  datum_ref.SerializeToString(&serialized);
+  Datum datum;
+  const char* data = NULL;
+  EXPECT_TRUE(ParseDatumView(serialized.data(), serialized.size(), &datum,
+                             &data));
+  EXPECT_EQ(datum.channels(), 2);
+  EXPECT_EQ(datum.height(), 3);
+  EXPECT_EQ(datum.width(), 4);
+  EXPECT_EQ(datum.label(), -7);
+  EXPECT_EQ(datum.data().size(), 0);
+  // The pixels are not copied, data points into the serialized buffer.
+  EXPECT_GE(data, serialized.data());
+  EXPECT_LT(data, serialized.data() + serialized.size());
+  for (int i = 0; i < 24; ++i) {
+    EXPECT_EQ(data[i], datum_ref.data()[i]);
+  }
+}
+
+TEST_F(IOTest, TestParseDatumViewRejectsFloatData) {
+  Datum datum_ref;
+  datum_ref.set_channels(1);
+  datum_ref.set_height(1);
+  datum_ref.set_width(1);
+  datum_ref.add_float_data(1.f);
+  string serialized;
+  datum_ref.SerializeToString(&serialized);
+  Datum datum;
+  const char* data = NULL;
+  EXPECT_FALSE(ParseDatumView(serialized.data(), serialized.size(), &datum,
+                              &data));
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
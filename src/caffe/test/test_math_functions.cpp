@@ -38,6 +38,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
 #include <cmath>  // for std::fabs
+#include <limits>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -156,6 +158,47 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestPack16) {
+  // The odd count also covers the tails left by the vector kernels.
+  const int n = this->blob_bottom_->count();
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  TypeParam* y = this->blob_top_->mutable_cpu_data();
+  vector<uint16_t> packed(n);
+  const StorageType types[] = { FLOAT16, BFLOAT16 };
+  const float epsilon[] = { 1. / 2048, 1. / 256 };
+  for (int t = 0; t < 2; ++t) {
+    caffe_cpu_pack16(types[t], n, x, &packed[0]);
+    caffe_cpu_unpack16(types[t], n, &packed[0], y);
+    for (int i = 0; i < n; ++i) {
+      const float value = static_cast<float>(x[i]);
+      EXPECT_EQ(types[t] == FLOAT16 ? caffe_float_to_fp16(value)
+                                    : caffe_float_to_bf16(value), packed[i]);
+      // Half denormals are spaced 2^-24 apart.
+      EXPECT_NEAR(x[i], y[i], std::fabs(x[i]) * epsilon[t] + 1e-7);
+    }
+  }
+}
+
+TEST(MathFunctionsConvert16Test, TestSpecialValues) {
+  EXPECT_EQ(0x3c00, caffe_float_to_fp16(1.f));
+  EXPECT_EQ(0xc000, caffe_float_to_fp16(-2.f));
+  EXPECT_EQ(0x7bff, caffe_float_to_fp16(65504.f));
+  // Rounds up past the largest half.
+  EXPECT_EQ(0x7c00, caffe_float_to_fp16(65520.f));
+  // Smallest denormal half.
+  EXPECT_EQ(0x0001, caffe_float_to_fp16(std::ldexp(1.f, -24)));
+  EXPECT_EQ(std::ldexp(1.f, -24), caffe_fp16_to_float(0x0001));
+  EXPECT_EQ(65504.f, caffe_fp16_to_float(0x7bff));
+  EXPECT_TRUE(std::isinf(caffe_fp16_to_float(0xfc00)));
+  EXPECT_EQ(0x3f80, caffe_float_to_bf16(1.f));
+  // Ties round to even.
+  EXPECT_EQ(0x3f80, caffe_float_to_bf16(1.00390625f));
+  EXPECT_EQ(0x3f82, caffe_float_to_bf16(1.01171875f));
+  EXPECT_EQ(-3.f, caffe_bf16_to_float(0xc040));
+  EXPECT_TRUE(std::isnan(caffe_bf16_to_float(
+      caffe_float_to_bf16(std::numeric_limits<float>::quiet_NaN()))));
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
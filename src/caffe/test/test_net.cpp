@@ -540,7 +540,10 @@ class ParentTest : public ParentType {
     InitNetFromProtoString(proto);
   }
 
-  virtual void InitDiffDataSharedWeightsNet() {
+  // The shared weights are dim x dim.
+  virtual void InitDiffDataSharedWeightsNet(const int dim = 10) {
+    ostringstream dim_str;
+    dim_str << dim;
     const string& proto =
         "name: 'DiffDataSharedWeightsNetwork' "
         "layer { "
@@ -548,11 +551,11 @@ class ParentTest : public ParentType {
         "  type: 'DummyData' "
         "  dummy_data_param { "
         "    num: 10 "
-        "    channels: 10 "
+        "    channels: " + dim_str.str() + " "
         "    height: 1 "
         "    width: 1 "
         "    num: 10 "
-        "    channels: 10 "
+        "    channels: " + dim_str.str() + " "
         "    height: 1 "
         "    width: 1 "
         "    data_filler { "
@@ -567,7 +570,7 @@ class ParentTest : public ParentType {
         "  name: 'innerproduct1' "
         "  type: 'InnerProduct' "
         "  inner_product_param { "
-        "    num_output: 10 "
+        "    num_output: " + dim_str.str() + " "
         "    bias_term: false "
         "    weight_filler { "
         "      type: 'constant' "
@@ -582,7 +585,7 @@ class ParentTest : public ParentType {
         "  name: 'innerproduct2' "
         "  type: 'InnerProduct' "
         "  inner_product_param { "
-        "    num_output: 10 "
+        "    num_output: " + dim_str.str() + " "
         "    bias_term: false "
         "    weight_filler { "
         "      type: 'constant' "
@@ -1390,6 +1393,53 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestSharedWeightsResumeHDF5) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  // Weights of 1KB or more are aligned in the file, so they are mapped.
+  const int dim = 32;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet(dim);
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  Blob<Dtype> shared_params;
+  shared_params.CopyFrom(*this->net_->layers()[1]->blobs()[0], false, true);
+  const int count = shared_params.count();
+  ASSERT_GE(count * sizeof(Dtype), 1024);
+
+  // Snapshot to HDF5 twice, the second time over a file in use.
+  string filename;
+  MakeTempFilename(&filename);
+  filename += ".h5";
+  this->net_->ToHDF5(filename);
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet(dim);
+  size_t mapped_bytes, read_bytes;
+  this->net_->CopyTrainedLayersFromHDF5(filename, &mapped_bytes, &read_bytes);
+  EXPECT_EQ(count * sizeof(Dtype), mapped_bytes);
+  EXPECT_EQ(0, read_bytes);
+  shared_ptr<Net<Dtype> > mapped_net = this->net_;
+  mapped_net->ToHDF5(filename);
+
+  // The weights read back are shared by both layers, and writing them does
+  // not change the file.
+  Blob<Dtype>* ip1_weights = mapped_net->layers()[1]->blobs()[0].get();
+  Blob<Dtype>* ip2_weights = mapped_net->layers()[2]->blobs()[0].get();
+  EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+  caffe_set(count, Dtype(0), ip1_weights->mutable_cpu_data());
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet(dim);
+  this->net_->CopyTrainedLayersFromHDF5(filename, &mapped_bytes, &read_bytes);
+  EXPECT_EQ(count * sizeof(Dtype), mapped_bytes);
+  ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -2494,6 +2544,591 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTestCPU, TestShareActivations) {
+  typedef TypeParam Dtype;
+  // The same TEST net with and without shared activations must produce the
+  // same outputs, also after the input grows past the planned sizes.
+  const string& proto =
+      "name: 'SharedActivationsNetwork' "
+      "state { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "  shape: { dim: 2 dim: 3 dim: 12 dim: 10 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 5 "
+      "    kernel_size: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'pool1' "
+      "  type: 'Pooling' "
+      "  bottom: 'conv1' "
+      "  top: 'pool1' "
+      "  pooling_param { "
+      "    pool: MAX "
+      "    kernel_size: 2 "
+      "    stride: 2 "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'pool1' "
+      "  top: 'ip1' "
+      "  inner_product_param { "
+      "    num_output: 4 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'pool1' "
+      "  top: 'ip2' "
+      "  inner_product_param { "
+      "    num_output: 4 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'sum' "
+      "  type: 'Eltwise' "
+      "  bottom: 'ip1' "
+      "  bottom: 'ip2' "
+      "  top: 'sum' "
+      "} "
+      "layer { "
+      "  name: 'softmax' "
+      "  type: 'Softmax' "
+      "  bottom: 'sum' "
+      "  top: 'softmax' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> plain_net(param);
+  param.set_share_activations(true);
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> shared_net(param);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> blob1(2, 3, 12, 10);
+  Blob<Dtype> blob2(4, 3, 14, 12);
+  filler.Fill(&blob1);
+  filler.Fill(&blob2);
+  // Buffers are shared from the second Forward on.
+  Blob<Dtype>* inputs[] = { &blob1, &blob1, &blob2, &blob1 };
+  for (int n = 0; n < 4; ++n) {
+    Net<Dtype>* nets[] = { &plain_net, &shared_net };
+    for (int k = 0; k < 2; ++k) {
+      Blob<Dtype>* input_blob = nets[k]->input_blobs()[0];
+      input_blob->ReshapeLike(*inputs[n]);
+      caffe_copy(inputs[n]->count(), inputs[n]->cpu_data(),
+          input_blob->mutable_cpu_data());
+      nets[k]->Forward();
+    }
+    const Blob<Dtype>* expected = plain_net.output_blobs()[0];
+    const Blob<Dtype>* actual = shared_net.output_blobs()[0];
+    ASSERT_EQ(expected->count(), actual->count());
+    for (int i = 0; i < expected->count(); ++i) {
+      EXPECT_EQ(expected->cpu_data()[i], actual->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTestCPU, TestShareDiffs) {
+  typedef TypeParam Dtype;
+  // Sharing activation diffs (and letting Split write one consumer's
+  // gradient straight into its bottom) must not change the param gradients.
+  // 'sum' and 'label' are also read by an Accuracy layer that never writes
+  // their diffs.
+  const string& proto =
+      "name: 'SharedDiffsNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  top: 'label' "
+      "  input_param { "
+      "  shape: { dim: 4 dim: 3 dim: 6 dim: 5 } "
+      "  shape: { dim: 4 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 5 "
+      "    kernel_size: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'ip1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv1' "
+      "  top: 'ip1' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv1' "
+      "  top: 'ip2' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'sum' "
+      "  type: 'Eltwise' "
+      "  bottom: 'ip1' "
+      "  bottom: 'ip2' "
+      "  top: 'sum' "
+      "} "
+      "layer { "
+      "  name: 'accuracy' "
+      "  type: 'Accuracy' "
+      "  bottom: 'sum' "
+      "  bottom: 'label' "
+      "  top: 'accuracy' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'SoftmaxWithLoss' "
+      "  bottom: 'sum' "
+      "  bottom: 'label' "
+      "  top: 'loss' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> plain_net(param);
+  param.set_share_diffs(true);
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> shared_net(param);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(4, 3, 6, 5);
+  Blob<Dtype> label(vector<int>(1, 4));
+  // Diffs are shared from the second Backward on.
+  for (int n = 0; n < 3; ++n) {
+    filler.Fill(&data);
+    for (int i = 0; i < label.count(); ++i) {
+      label.mutable_cpu_data()[i] = (n + i) % 3;
+    }
+    Net<Dtype>* nets[] = { &plain_net, &shared_net };
+    for (int k = 0; k < 2; ++k) {
+      caffe_copy(data.count(), data.cpu_data(),
+          nets[k]->input_blobs()[0]->mutable_cpu_data());
+      caffe_copy(label.count(), label.cpu_data(),
+          nets[k]->input_blobs()[1]->mutable_cpu_data());
+      nets[k]->ClearParamDiffs();
+      nets[k]->ForwardBackward();
+    }
+    const vector<Blob<Dtype>*>& expected = plain_net.learnable_params();
+    const vector<Blob<Dtype>*>& actual = shared_net.learnable_params();
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int j = 0; j < expected.size(); ++j) {
+      for (int i = 0; i < expected[j]->count(); ++i) {
+        EXPECT_NEAR(expected[j]->cpu_diff()[i], actual[j]->cpu_diff()[i],
+            1e-6);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTestCPU, TestActivationStorage) {
+  typedef TypeParam Dtype;
+  // Holding the activations between ReLU, Pooling, Eltwise and Concat layers
+  // in 16 bits must give about the same loss and param gradients; the blobs
+  // read by Convolution and InnerProduct stay in Dtype.
+  const string& proto =
+      "name: 'ReducedStorageNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  top: 'label' "
+      "  input_param { "
+      "  shape: { dim: 4 dim: 3 dim: 10 dim: 9 } "
+      "  shape: { dim: 4 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 3 "
+      "    kernel_size: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'relu1' "
+      "} "
+      "layer { "
+      "  name: 'pool1' "
+      "  type: 'Pooling' "
+      "  bottom: 'relu1' "
+      "  top: 'pool1' "
+      "  pooling_param { "
+      "    pool: MAX "
+      "    kernel_size: 2 "
+      "    stride: 2 "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv2' "
+      "  convolution_param { "
+      "    num_output: 3 "
+      "    kernel_size: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu2' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv2' "
+      "  top: 'relu2' "
+      "} "
+      "layer { "
+      "  name: 'pool2' "
+      "  type: 'Pooling' "
+      "  bottom: 'relu2' "
+      "  top: 'pool2' "
+      "  pooling_param { "
+      "    pool: AVE "
+      "    kernel_size: 2 "
+      "    stride: 2 "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv3' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv3' "
+      "  convolution_param { "
+      "    num_output: 3 "
+      "    kernel_size: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu3' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv3' "
+      "  top: 'relu3' "
+      "} "
+      "layer { "
+      "  name: 'pool3' "
+      "  type: 'Pooling' "
+      "  bottom: 'relu3' "
+      "  top: 'pool3' "
+      "  pooling_param { "
+      "    pool: MAX "
+      "    kernel_size: 2 "
+      "    stride: 2 "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'prod' "
+      "  type: 'Eltwise' "
+      "  bottom: 'pool2' "
+      "  bottom: 'pool3' "
+      "  top: 'prod' "
+      "  eltwise_param { "
+      "    operation: PROD "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu4' "
+      "  type: 'ReLU' "
+      "  bottom: 'prod' "
+      "  top: 'prod' "
+      "} "
+      "layer { "
+      "  name: 'concat' "
+      "  type: 'Concat' "
+      "  bottom: 'pool1' "
+      "  bottom: 'prod' "
+      "  top: 'concat' "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'concat' "
+      "  top: 'ip' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'SoftmaxWithLoss' "
+      "  bottom: 'ip' "
+      "  bottom: 'label' "
+      "  top: 'loss' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> plain_net(param);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(4, 3, 10, 9);
+  Blob<Dtype> label(vector<int>(1, 4));
+  filler.Fill(&data);
+  for (int i = 0; i < label.count(); ++i) {
+    label.mutable_cpu_data()[i] = i % 3;
+  }
+  const StorageType types[] = { FLOAT16, BFLOAT16 };
+  const Dtype tolerance[] = { 2e-3, 2e-2 };
+  for (int t = 0; t < 2; ++t) {
+    param.set_activation_storage(types[t]);
+    Caffe::set_random_seed(this->seed_);
+    Net<Dtype> reduced_net(param);
+    EXPECT_EQ(types[t], reduced_net.blob_by_name("relu1")->storage());
+    EXPECT_EQ(types[t], reduced_net.blob_by_name("pool2")->storage());
+    EXPECT_EQ(types[t], reduced_net.blob_by_name("prod")->storage());
+    EXPECT_EQ(FLOAT32, reduced_net.blob_by_name("conv1")->storage());
+    EXPECT_EQ(FLOAT32, reduced_net.blob_by_name("concat")->storage());
+    Net<Dtype>* nets[] = { &plain_net, &reduced_net };
+    Dtype loss[2];
+    for (int k = 0; k < 2; ++k) {
+      caffe_copy(data.count(), data.cpu_data(),
+          nets[k]->input_blobs()[0]->mutable_cpu_data());
+      caffe_copy(label.count(), label.cpu_data(),
+          nets[k]->input_blobs()[1]->mutable_cpu_data());
+      nets[k]->ClearParamDiffs();
+      loss[k] = nets[k]->ForwardBackward();
+    }
+    EXPECT_NEAR(loss[0], loss[1], tolerance[t]);
+    const vector<Blob<Dtype>*>& expected = plain_net.learnable_params();
+    const vector<Blob<Dtype>*>& actual = reduced_net.learnable_params();
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int j = 0; j < expected.size(); ++j) {
+      for (int i = 0; i < expected[j]->count(); ++i) {
+        const Dtype diff = expected[j]->cpu_diff()[i];
+        EXPECT_NEAR(diff, actual[j]->cpu_diff()[i],
+            tolerance[t] * std::max(Dtype(1), std::fabs(diff)));
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTestCPU, TestShareDiffsAccumulatingConsumers) {
+  typedef TypeParam Dtype;
+  // 'conv1' branches into a Split, which adds into its bottom diff, and 'a'
+  // is read by an in-place ReLU and the layer after it. Only consumers that
+  // overwrite their bottom diff may take a Split's bottom diff, so sharing
+  // must not change any gradient, including the one of the input.
+  const string& proto =
+      "name: 'AccumulatingConsumersNetwork' "
+      "force_backward: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  top: 'label' "
+      "  input_param { "
+      "  shape: { dim: 4 dim: 3 dim: 6 dim: 5 } "
+      "  shape: { dim: 4 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 5 "
+      "    kernel_size: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'branch' "
+      "  type: 'Split' "
+      "  bottom: 'conv1' "
+      "  top: 'a' "
+      "  top: 'b' "
+      "} "
+      "layer { "
+      "  name: 'relu_a' "
+      "  type: 'ReLU' "
+      "  bottom: 'a' "
+      "  top: 'a' "
+      "} "
+      "layer { "
+      "  name: 'ip_a' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'a' "
+      "  top: 'ip_a' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip_b' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'b' "
+      "  top: 'ip_b' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip_conv1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv1' "
+      "  top: 'ip_conv1' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'sum' "
+      "  type: 'Eltwise' "
+      "  bottom: 'ip_a' "
+      "  bottom: 'ip_b' "
+      "  bottom: 'ip_conv1' "
+      "  top: 'sum' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'SoftmaxWithLoss' "
+      "  bottom: 'sum' "
+      "  bottom: 'label' "
+      "  top: 'loss' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> plain_net(param);
+  param.set_share_diffs(true);
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> shared_net(param);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(4, 3, 6, 5);
+  Blob<Dtype> label(vector<int>(1, 4));
+  // Diffs are shared from the second Backward on.
+  for (int n = 0; n < 3; ++n) {
+    filler.Fill(&data);
+    for (int i = 0; i < label.count(); ++i) {
+      label.mutable_cpu_data()[i] = (n + i) % 3;
+    }
+    Net<Dtype>* nets[] = { &plain_net, &shared_net };
+    for (int k = 0; k < 2; ++k) {
+      caffe_copy(data.count(), data.cpu_data(),
+          nets[k]->input_blobs()[0]->mutable_cpu_data());
+      caffe_copy(label.count(), label.cpu_data(),
+          nets[k]->input_blobs()[1]->mutable_cpu_data());
+      nets[k]->ClearParamDiffs();
+      nets[k]->ForwardBackward();
+    }
+    vector<Blob<Dtype>*> expected = plain_net.learnable_params();
+    vector<Blob<Dtype>*> actual = shared_net.learnable_params();
+    expected.push_back(plain_net.input_blobs()[0]);
+    actual.push_back(shared_net.input_blobs()[0]);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int j = 0; j < expected.size(); ++j) {
+      for (int i = 0; i < expected[j]->count(); ++i) {
+        EXPECT_NEAR(expected[j]->cpu_diff()[i], actual[j]->cpu_diff()[i],
+            1e-6) << "blob " << j << " index " << i;
+      }
+    }
+  }
+}
+
 // TODO: this test should work for Caffe Engine as well
 // but there were problems visible on Intel OpenMP
 // that need to be investigated
@@ -2620,6 +3255,161 @@ TYPED_TEST(NetTestCPU, TestForwardReshapeForward) {
 
 
 
+TYPED_TEST(NetTestCPU, TestFoldInference) {
+  typedef TypeParam Dtype;
+  // A TEST net with fold_inference must compute what the net does without,
+  // from the same weights, read from a proto or from HDF5.
+  const string& proto =
+      "name: 'FoldNetwork' "
+      "state { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "  shape: { dim: 2 dim: 3 dim: 6 dim: 5 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    bias_term: false "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.5 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'bn1' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'scale1' "
+      "  type: 'Scale' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "  scale_param { "
+      "    bias_term: true "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'relu1' "
+      "  relu_param { "
+      "    negative_slope: 0.1 "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  bottom: 'relu1' "
+      "  top: 'conv2' "
+      "  convolution_param { "
+      "    num_output: 3 "
+      "    kernel_size: 1 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.5 "
+      "    } "
+      "    bias_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.5 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'prelu2' "
+      "  type: 'PReLU' "
+      "  bottom: 'conv2' "
+      "  top: 'conv2' "
+      "} "
+      "layer { "
+      "  name: 'ip3' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv2' "
+      "  top: 'ip3' "
+      "  inner_product_param { "
+      "    num_output: 5 "
+      "    transpose: true "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.5 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'bn3' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'ip3' "
+      "  top: 'bn3' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> plain_net(param);
+  // Give the statistics, scales and slopes values that show.
+  FillerParameter filler_param;
+  filler_param.set_std(0.5);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler_param.set_min(0.5);
+  filler_param.set_max(1.5);
+  UniformFiller<Dtype> positive_filler(filler_param);
+  const char* bn_names[] = { "bn1", "bn3" };
+  for (int k = 0; k < 2; ++k) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs =
+        plain_net.layer_by_name(bn_names[k])->blobs();
+    filler.Fill(blobs[0].get());
+    positive_filler.Fill(blobs[1].get());
+    blobs[2]->mutable_cpu_data()[0] = 2;
+  }
+  filler.Fill(plain_net.layer_by_name("scale1")->blobs()[1].get());
+  positive_filler.Fill(plain_net.layer_by_name("scale1")->blobs()[0].get());
+  filler.Fill(plain_net.layer_by_name("prelu2")->blobs()[0].get());
+  NetParameter weights;
+  plain_net.ToProto(&weights);
+  string filename;
+  MakeTempFilename(&filename);
+  filename += ".h5";
+  plain_net.ToHDF5(filename);
+
+  param.set_fold_inference(true);
+  Net<Dtype> folded_net(param);
+  EXPECT_EQ(4, folded_net.layers().size());
+  EXPECT_TRUE(folded_net.has_blob("relu1"));
+  EXPECT_FALSE(folded_net.has_blob("conv1"));
+  Net<Dtype> hdf5_folded_net(param);
+  folded_net.CopyTrainedLayersFrom(weights);
+  hdf5_folded_net.CopyTrainedLayersFrom(filename);
+
+  Blob<Dtype> input(2, 3, 6, 5);
+  filler.Fill(&input);
+  Net<Dtype>* nets[] = { &plain_net, &folded_net, &hdf5_folded_net };
+  for (int k = 0; k < 3; ++k) {
+    caffe_copy(input.count(), input.cpu_data(),
+        nets[k]->input_blobs()[0]->mutable_cpu_data());
+    nets[k]->Forward();
+  }
+  const Blob<Dtype>* expected = plain_net.output_blobs()[0];
+  for (int k = 1; k < 3; ++k) {
+    const Blob<Dtype>* actual = nets[k]->output_blobs()[0];
+    ASSERT_EQ(expected->count(), actual->count());
+    for (int i = 0; i < expected->count(); ++i) {
+      EXPECT_NEAR(expected->cpu_data()[i], actual->cpu_data()[i], 1e-4);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
@@ -3243,4 +4033,131 @@ TEST_F(CompileNetTest, TestNoCompileNet) {
   this->RunCompilerNetTest(input_proto, input_proto);
 }
 
+TEST_F(CompileNetTest, TestCompileNetFoldInference) {
+  // conv1 takes bn1, sc1 and relu1; bn2 computes its own statistics, so
+  // ip2 keeps it.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "state { phase: TEST } "
+      "fold_inference: true "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'conv1' type: 'Convolution' bottom: 'data' "
+      "  top: 'conv1' convolution_param { bias_term: false } } "
+      "layer { name: 'bn1' type: 'BatchNorm' bottom: 'conv1' "
+      "  top: 'conv1' } "
+      "layer { name: 'sc1' type: 'Scale' bottom: 'conv1' top: 'conv1' } "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'relu1' } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'relu1' "
+      "  top: 'ip2' } "
+      "layer { name: 'bn2' type: 'BatchNorm' bottom: 'ip2' top: 'bn2' "
+      "  batch_norm_param { use_global_stats: false } } ";
+  const string& output_proto =
+      "name: 'TestNetwork' "
+      "state { phase: TEST } "
+      "fold_inference: true "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'conv1' type: 'Convolution' bottom: 'data' "
+      "  top: 'relu1' convolution_param { bias_term: true relu: true "
+      "  negative_slope: 0 } "
+      "  folded_layer { name: 'bn1' type: 'BatchNorm' bottom: 'conv1' "
+      "    top: 'conv1' } "
+      "  folded_layer { name: 'sc1' type: 'Scale' bottom: 'conv1' "
+      "    top: 'conv1' } "
+      "  folded_layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' "
+      "    top: 'relu1' } } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'relu1' "
+      "  top: 'ip2' } "
+      "layer { name: 'bn2' type: 'BatchNorm' bottom: 'ip2' top: 'bn2' "
+      "  batch_norm_param { use_global_stats: false } } ";
+  this->RunCompilerNetTest(input_proto, output_proto);
+}
+
+class PlanEnginesTest : public ::testing::Test {
+ protected:
+  void RunPlanEnginesTest(const string& input_param_string,
+      const vector<ConversionLedger::Entry>& entries,
+      const string& planned_param_string, int expected_moved) {
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_planned_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        planned_param_string, &expected_planned_param));
+    NetParameter actual_planned_param;
+    EXPECT_EQ(expected_moved, Net<float>::PlanEngines(input_param, entries,
+        &actual_planned_param));
+    EXPECT_EQ(expected_planned_param.DebugString(),
+        actual_planned_param.DebugString());
+  }
+
+  static ConversionLedger::Entry Charge(const string& layer,
+      ConversionLedger::Direction direction, uint64_t bytes) {
+    ConversionLedger::Entry entry;
+    entry.layer = layer;
+    entry.direction = direction;
+    entry.engine = PrvMemDescr::PRV_DESCR_MKL2017;
+    entry.count = 1;
+    entry.bytes = bytes;
+    return entry;
+  }
+
+  // data -> conv1 (MKL2017) -> relu1 -> pool1 -> conv2 (MKL2017) -> loss
+  static string ChainProto(const string& relu_param,
+                           const string& pool_engine) {
+    return
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'DummyData' top: 'data' top: 'label' } "
+      "layer { name: 'conv1' type: 'Convolution' bottom: 'data' "
+      "  top: 'conv1' engine: 'MKL2017' } "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' "
+      + relu_param + " } "
+      "layer { name: 'pool1' type: 'Pooling' bottom: 'conv1' top: 'pool1' "
+      "  pooling_param { pool: AVE " + pool_engine + " } } "
+      "layer { name: 'conv2' type: 'Convolution' bottom: 'pool1' "
+      "  top: 'conv2' engine: 'MKL2017' } "
+      "layer { name: 'loss' type: 'SoftmaxWithLoss' bottom: 'conv2' "
+      "  bottom: 'label' } ";
+  }
+};
+
+TEST_F(PlanEnginesTest, TestPlanEnginesRun) {
+  // relu1 reads the output of conv1 and conv2 converts the output of pool1:
+  // both layers move, together, between the two MKL2017 convolutions.
+  vector<ConversionLedger::Entry> entries;
+  entries.push_back(Charge("relu1", ConversionLedger::FROM_PRV, 4096));
+  entries.push_back(Charge("conv2", ConversionLedger::TO_PRV, 1024));
+  this->RunPlanEnginesTest(ChainProto("", ""), entries,
+      ChainProto("relu_param { engine: MKL2017 }", "engine: MKL2017"), 2);
+}
+
+TEST_F(PlanEnginesTest, TestPlanEnginesKeepsBoundary) {
+  // Moving relu1 alone would only move the boundary to pool1.
+  vector<ConversionLedger::Entry> entries;
+  entries.push_back(Charge("relu1", ConversionLedger::FROM_PRV, 4096));
+  this->RunPlanEnginesTest(ChainProto("", ""), entries,
+      ChainProto("", ""), 0);
+}
+
+TEST_F(PlanEnginesTest, TestPlanEnginesKeepsTypeEngine) {
+  vector<ConversionLedger::Entry> entries;
+  entries.push_back(Charge("relu1", ConversionLedger::FROM_PRV, 4096));
+  entries.push_back(Charge("conv2", ConversionLedger::TO_PRV, 1024));
+  const string input_proto = ChainProto("relu_param { engine: CAFFE }", "");
+  this->RunPlanEnginesTest(input_proto, entries, input_proto, 0);
+}
+
+TEST_F(PlanEnginesTest, TestPlanEnginesBackward) {
+  // conv1 converts the diff of relu1 in backward, which makes relu1 a
+  // candidate just as a forward conversion charged to it would.
+  vector<ConversionLedger::Entry> entries;
+  ConversionLedger::Entry entry =
+      Charge("conv1", ConversionLedger::TO_PRV, 4096);
+  entry.backward = true;
+  entries.push_back(entry);
+  entries.push_back(Charge("conv2", ConversionLedger::TO_PRV, 1024));
+  entries.push_back(Charge("unknown", ConversionLedger::TO_PRV, 1024));
+  this->RunPlanEnginesTest(ChainProto("", ""), entries,
+      ChainProto("relu_param { engine: MKL2017 }", "engine: MKL2017"), 2);
+}
+
 }  // namespace caffe
@@ -0,0 +1,145 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string>
+#include <utility>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db_packed.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+class PackedDBTest : public ::testing::Test {
+ protected:
+  // Writes three raw Datums, of the given heights.
+  void Fill(const int heights[3]) {
+    MakeTempFilename(&source_);
+    scoped_ptr<db::DB> db(db::GetDB("packed"));
+    db->Open(source_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < 3; ++i) {
+      Datum datum;
+      datum.set_channels(2);
+      datum.set_height(heights[i]);
+      datum.set_width(3);
+      datum.set_label(labels_[i]);
+      datum.set_data(string(2 * heights[i] * 3, static_cast<char>(i + 1)));
+      string out;
+      CHECK(datum.SerializeToString(&out));
+      txn->Put(keys_[i], out);
+    }
+    txn->Commit();
+  }
+
+  void TestRead(const bool fixed) {
+    db::PackedDB db;
+    db.Open(source_, db::READ);
+    EXPECT_EQ(fixed, db.fixed());
+    EXPECT_EQ(3, db.count());
+    scoped_ptr<db::Cursor> cursor(db.NewCursor());
+    for (int i = 0; i < 3; ++i) {
+      ASSERT_TRUE(cursor->valid());
+      EXPECT_EQ(keys_[i], cursor->key());
+      Datum datum;
+      ASSERT_TRUE(datum.ParseFromString(cursor->value()));
+      EXPECT_EQ(labels_[i], datum.label());
+      EXPECT_EQ(2, datum.channels());
+      EXPECT_EQ(3, datum.width());
+      EXPECT_EQ(string(2 * datum.height() * 3, static_cast<char>(i + 1)),
+                datum.data());
+      // Records in the mapping parse without copying pixels.
+      std::pair<void*, size_t> value = cursor->valuePointer();
+      const char* pixels;
+      ASSERT_TRUE(ParseDatumView(value.first, value.second, &datum, &pixels));
+      EXPECT_EQ(labels_[i], datum.label());
+      EXPECT_EQ(i + 1, pixels[0]);
+      if (fixed) {
+        EXPECT_EQ(labels_[i], db.label(i));
+        EXPECT_EQ(0, reinterpret_cast<size_t>(value.first) %
+                  db::kPackedAlignment);
+      }
+      cursor->Next();
+    }
+    EXPECT_FALSE(cursor->valid());
+    cursor->Seek("b");
+    ASSERT_TRUE(cursor->valid());
+    EXPECT_EQ(keys_[1], cursor->key());
+    cursor->Seek(keys_[2]);
+    EXPECT_EQ(keys_[2], cursor->key());
+    cursor->Seek("z");
+    EXPECT_FALSE(cursor->valid());
+    // Records are found by index without walking the ones before them.
+    size_t count;
+    ASSERT_TRUE(db.Count(&count));
+    EXPECT_EQ(3, count);
+    ASSERT_TRUE(cursor->SeekToIndex(1));
+    EXPECT_EQ(keys_[1], cursor->key());
+    ASSERT_TRUE(cursor->SeekToIndex(3));
+    EXPECT_FALSE(cursor->valid());
+  }
+
+  static const int labels_[3];
+  static const string keys_[3];
+  string source_;
+};
+
+// Labels of different varint sizes, which must not change the record size.
+const int PackedDBTest::labels_[3] = {1, 1000, -1};
+const string PackedDBTest::keys_[3] = {"a0", "b0", "c0"};
+
+TEST_F(PackedDBTest, TestReadFixed) {
+  const int heights[3] = {4, 4, 4};
+  Fill(heights);
+  TestRead(true);
+}
+
+TEST_F(PackedDBTest, TestReadVariable) {
+  const int heights[3] = {4, 5, 6};
+  Fill(heights);
+  TestRead(false);
+}
+
+}  // namespace caffe
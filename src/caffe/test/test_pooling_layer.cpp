@@ -35,6 +35,8 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -43,6 +45,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_pooling_layer.hpp"
@@ -406,6 +409,109 @@ class PoolingLayerTest : public MultiDeviceTest<TypeParam> {
       }
     }
   }
+  // Compares the layer with pooling computed here, for bottoms of 4 axes or
+  // of 5, wide enough for whole vectors of outputs in a row. MAX pooling is
+  // also compared backward, and keeps its mask in a top only if top_mask.
+  void TestForwardReference(const vector<int>& bottom_shape,
+      PoolingParameter_PoolMethod pool, int kernel, int stride, int pad,
+      bool top_mask = true) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(kernel);
+    pooling_param->set_stride(stride);
+    pooling_param->set_pad(pad);
+    pooling_param->set_pool(pool);
+    blob_bottom_->Reshape(bottom_shape);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_);
+    const bool max_pool = pool == PoolingParameter_PoolMethod_MAX;
+    top_mask = top_mask && max_pool;
+    if (top_mask) {
+      blob_top_vec_.push_back(blob_top_mask_);
+    }
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    if (max_pool) {
+      caffe_rng_gaussian(blob_top_->count(), Dtype(0), Dtype(1),
+          blob_top_->mutable_cpu_diff());
+      layer.Backward(blob_top_vec_, vector<bool>(1, true), blob_bottom_vec_);
+    }
+    if (top_mask) {
+      blob_top_vec_.pop_back();
+    }
+
+    const bool pool_3d = bottom_shape.size() == 5;
+    const int depth = pool_3d ? bottom_shape[2] : 1;
+    const int height = bottom_shape[bottom_shape.size() - 2];
+    const int width = bottom_shape.back();
+    const int kernel_d = pool_3d ? kernel : 1;
+    const int stride_d = pool_3d ? stride : 1;
+    const int pad_d = pool_3d ? pad : 0;
+    const int pooled_depth = pool_3d ? blob_top_->shape(2) : 1;
+    const int pooled_height = blob_top_->shape(-2);
+    const int pooled_width = blob_top_->shape(-1);
+    const int num_fms = bottom_shape[0] * bottom_shape[1];
+    const Dtype* bottom = blob_bottom_->cpu_data();
+    const Dtype* bottom_diff = blob_bottom_->cpu_diff();
+    const Dtype* top = blob_top_->cpu_data();
+    const Dtype* top_diff = blob_top_->cpu_diff();
+    const Dtype* mask = top_mask ? blob_top_mask_->cpu_data() : NULL;
+    vector<Dtype> ref_bottom_diff(depth * height * width);
+    for (int fm = 0; fm < num_fms; ++fm) {
+      std::fill(ref_bottom_diff.begin(), ref_bottom_diff.end(), Dtype(0));
+      for (int pd = 0; pd < pooled_depth; ++pd) {
+        for (int ph = 0; ph < pooled_height; ++ph) {
+          for (int pw = 0; pw < pooled_width; ++pw) {
+            const int dstart = pd * stride_d - pad_d;
+            const int hstart = ph * stride - pad;
+            const int wstart = pw * stride - pad;
+            const int pool_size =
+                (std::min(dstart + kernel_d, depth + pad_d) - dstart) *
+                (std::min(hstart + kernel, height + pad) - hstart) *
+                (std::min(wstart + kernel, width + pad) - wstart);
+            Dtype sum = 0;
+            Dtype maximum = -FLT_MAX;
+            int max_index = -1;
+            for (int d = std::max(dstart, 0);
+                 d < std::min(dstart + kernel_d, depth); ++d) {
+              for (int h = std::max(hstart, 0);
+                   h < std::min(hstart + kernel, height); ++h) {
+                for (int w = std::max(wstart, 0);
+                     w < std::min(wstart + kernel, width); ++w) {
+                  const int index = (d * height + h) * width + w;
+                  sum += bottom[index];
+                  if (bottom[index] > maximum) {
+                    maximum = bottom[index];
+                    max_index = index;
+                  }
+                }
+              }
+            }
+            if (max_pool) {
+              EXPECT_EQ(maximum, *top);
+              if (mask) {
+                EXPECT_EQ(static_cast<Dtype>(max_index), *mask++);
+              }
+              ref_bottom_diff[max_index] += *top_diff++;
+            } else {
+              EXPECT_NEAR(sum / pool_size, *top, 1e-5);
+            }
+            ++top;
+          }
+        }
+      }
+      if (max_pool) {
+        for (int j = 0; j < ref_bottom_diff.size(); ++j) {
+          EXPECT_NEAR(ref_bottom_diff[j], bottom_diff[j], 1e-5);
+        }
+      }
+      bottom += depth * height * width;
+      bottom_diff += depth * height * width;
+    }
+  }
 };
 
 TYPED_TEST_CASE(PoolingLayerTest, TestDtypesAndDevices);
@@ -440,6 +546,27 @@ TYPED_TEST(PoolingLayerTest, TestSetupPadded) {
   EXPECT_EQ(this->blob_top_->width(), 3);
 }
 
+TYPED_TEST(PoolingLayerTest, TestSetup3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  pooling_param->set_kernel_d(2);
+  pooling_param->set_stride_d(1);
+  vector<int> bottom_shape(this->blob_bottom_->shape());
+  bottom_shape.insert(bottom_shape.begin() + 2, 4);
+  this->blob_bottom_->Reshape(bottom_shape);
+  PoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(this->blob_top_->num_axes(), 5);
+  EXPECT_EQ(this->blob_top_->shape(0), 2);
+  EXPECT_EQ(this->blob_top_->shape(1), 3);
+  EXPECT_EQ(this->blob_top_->shape(2), 3);
+  EXPECT_EQ(this->blob_top_->shape(3), 3);
+  EXPECT_EQ(this->blob_top_->shape(4), 2);
+}
+
 TYPED_TEST(PoolingLayerTest, TestSetupGlobalPooling) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -646,6 +773,71 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestForwardReference) {
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 2;
+  bottom_shape[1] = 2;
+  bottom_shape[2] = 5;
+  bottom_shape[3] = 37;
+  for (int stride = 1; stride <= 3; ++stride) {
+    for (int pad = 0; pad <= 1; ++pad) {
+      this->TestForwardReference(bottom_shape,
+          PoolingParameter_PoolMethod_MAX, 3, stride, pad);
+      this->TestForwardReference(bottom_shape,
+          PoolingParameter_PoolMethod_MAX, 3, stride, pad, false);
+      this->TestForwardReference(bottom_shape,
+          PoolingParameter_PoolMethod_AVE, 3, stride, pad);
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestForwardReference3D) {
+  vector<int> bottom_shape(5);
+  bottom_shape[0] = 2;
+  bottom_shape[1] = 2;
+  bottom_shape[2] = 4;
+  bottom_shape[3] = 5;
+  bottom_shape[4] = 29;
+  for (int stride = 1; stride <= 2; ++stride) {
+    for (int pad = 0; pad <= 1; ++pad) {
+      this->TestForwardReference(bottom_shape,
+          PoolingParameter_PoolMethod_MAX, 2, stride, pad);
+      this->TestForwardReference(bottom_shape,
+          PoolingParameter_PoolMethod_MAX, 2, stride, pad, false);
+      this->TestForwardReference(bottom_shape,
+          PoolingParameter_PoolMethod_AVE, 3, stride, pad);
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestGradient3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape(5);
+  bottom_shape[0] = 2;
+  bottom_shape[1] = 2;
+  bottom_shape[2] = 3;
+  bottom_shape[3] = 4;
+  bottom_shape[4] = 5;
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  for (int method = 0; method <= 1; ++method) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pad(1);
+    pooling_param->set_pool(method ? PoolingParameter_PoolMethod_AVE :
+                                     PoolingParameter_PoolMethod_MAX);
+    PoolingLayer<Dtype> layer(layer_param);
+    // MAX takes small steps, to not move an input past a close maximum.
+    GradientChecker<Dtype> checker(method ? 1e-2 : 1e-4, 1e-2);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
@@ -0,0 +1,189 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class QuantizeTest : public ::testing::Test {};
+
+TEST_F(QuantizeTest, TestGemmU8S8S32) {
+  // Sizes around the vector widths of the kernels.
+  const int sizes[][3] = {
+    { 1, 1, 1 }, { 3, 5, 15 }, { 7, 65, 16 }, { 33, 9, 63 }, { 4, 70, 130 }
+  };
+  for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    const int M = sizes[s][0], N = sizes[s][1], K = sizes[s][2];
+    std::vector<uint8_t> A(M * K);
+    std::vector<int8_t> B(N * K);
+    std::vector<int32_t> C(M * N);
+    for (int i = 0; i < A.size(); ++i) {
+      // Include the extremes, where vpmaddubsw would saturate.
+      A[i] = i % 3 ? caffe_rng_rand() % 256 : 255;
+    }
+    for (int i = 0; i < B.size(); ++i) {
+      B[i] = i % 3 ? static_cast<int>(caffe_rng_rand() % 255) - 127 : -127;
+    }
+    caffe_cpu_gemm_u8s8s32(M, N, K, &A[0], &B[0], &C[0]);
+    for (int m = 0; m < M; ++m) {
+      for (int n = 0; n < N; ++n) {
+        int32_t expected = 0;
+        for (int k = 0; k < K; ++k) {
+          expected += A[m * K + k] * B[n * K + k];
+        }
+        EXPECT_EQ(expected, C[m * N + n]);
+      }
+    }
+  }
+}
+
+TEST_F(QuantizeTest, TestQuantizedWeights) {
+  const int M = 3, N = 4, K = 5;
+  // Values that are exact in 8 bits: weights scaled by 1/127 per row, inputs
+  // in steps of 1/127 around the zero point.
+  float weights[N * K], weights_t[K * N], x[M * K];
+  for (int n = 0; n < N; ++n) {
+    for (int k = 0; k < K; ++k) {
+      weights[n * K + k] = (n + 1) * (k == 0 ? 127 : k * 7 - 20) / 127.f;
+      weights_t[k * N + n] = weights[n * K + k];
+    }
+  }
+  for (int i = 0; i < M * K; ++i) {
+    x[i] = ((i * 37) % 255 - 127) / 127.f;
+  }
+  QuantizationParameter param;
+  param.set_input_max(1);
+  param.set_input_signed(true);
+  for (int transposed = 0; transposed < 2; ++transposed) {
+    QuantizedWeights quantized(param);
+    EXPECT_TRUE(quantized.empty());
+    quantized.Quantize(N, K, transposed ? weights_t : weights, transposed);
+    EXPECT_FALSE(quantized.empty());
+    EXPECT_EQ(128, quantized.input_zero_point());
+    for (int n = 0; n < N; ++n) {
+      EXPECT_FLOAT_EQ((n + 1) / 127.f, quantized.scale(n));
+      EXPECT_EQ(127, quantized.row(n)[0]);
+    }
+    uint8_t x_int8[M * K];
+    int32_t acc[M * N];
+    float y[M * N];
+    quantized.QuantizeInput(M, K, x, false, x_int8);
+    quantized.Multiply(M, 0, N, x_int8, acc);
+    quantized.Dequantize(M, 0, N, acc, false, y);
+    for (int m = 0; m < M; ++m) {
+      for (int n = 0; n < N; ++n) {
+        float expected = 0;
+        for (int k = 0; k < K; ++k) {
+          expected += x[m * K + k] * weights[n * K + k];
+        }
+        EXPECT_NEAR(expected, y[m * N + n], 1e-4);
+      }
+    }
+    // Transposed inputs and outputs, for the last two rows only.
+    uint8_t x_int8_t[K * M];
+    float y_t[2 * M];
+    quantized.QuantizeInput(M, K, x, true, x_int8_t);
+    for (int m = 0; m < M; ++m) {
+      for (int k = 0; k < K; ++k) {
+        EXPECT_EQ(x_int8[m * K + k], x_int8_t[k * M + m]);
+      }
+    }
+    quantized.Multiply(M, 2, 2, x_int8, acc);
+    quantized.Dequantize(M, 2, 2, acc, true, y_t);
+    for (int m = 0; m < M; ++m) {
+      for (int n = 0; n < 2; ++n) {
+        EXPECT_FLOAT_EQ(y[m * N + n + 2], y_t[n * M + m]);
+      }
+    }
+  }
+}
+
+TEST_F(QuantizeTest, TestQuantizedWeightsGroups) {
+  // Groups of 20 rows, each packed on its own over two panels.
+  const int groups = 3, rows = 60, cols = 37, M = 9;
+  std::vector<float> weights(rows * cols);
+  for (int i = 0; i < weights.size(); ++i) {
+    weights[i] = static_cast<int>(caffe_rng_rand() % 255) - 127;
+  }
+  std::vector<uint8_t> x(M * cols);
+  for (int i = 0; i < x.size(); ++i) {
+    x[i] = caffe_rng_rand() % 256;
+  }
+  QuantizationParameter param;
+  param.set_input_max(1);
+  QuantizedWeights quantized(param);
+  quantized.Quantize(rows, cols, &weights[0], false, groups);
+  const int group_rows = rows / groups;
+  // Whole groups, and rows within a group on either side of a panel.
+  const int ranges[][2] = { { 0, 20 }, { 20, 20 }, { 40, 20 }, { 22, 14 },
+                            { 45, 3 }, { 59, 1 } };
+  for (int i = 0; i < sizeof(ranges) / sizeof(ranges[0]); ++i) {
+    const int first_row = ranges[i][0], n = ranges[i][1];
+    ASSERT_LE(first_row + n, (first_row / group_rows + 1) * group_rows);
+    std::vector<int32_t> acc(M * n);
+    quantized.Multiply(M, first_row, n, &x[0], &acc[0]);
+    for (int m = 0; m < M; ++m) {
+      for (int j = 0; j < n; ++j) {
+        int32_t expected = 0;
+        for (int k = 0; k < cols; ++k) {
+          expected += x[m * cols + k] * quantized.row(first_row + j)[k];
+        }
+        EXPECT_EQ(expected, acc[m * n + j]);
+      }
+    }
+  }
+}
+
+TEST_F(QuantizeTest, TestCalibrated) {
+  LayerParameter param;
+  EXPECT_FALSE(QuantizedWeights::Calibrated(param));
+  param.mutable_quantization_param()->set_input_signed(true);
+  EXPECT_FALSE(QuantizedWeights::Calibrated(param));
+  param.mutable_quantization_param()->set_input_max(2);
+  EXPECT_TRUE(QuantizedWeights::Calibrated(param));
+}
+
+}  // namespace caffe
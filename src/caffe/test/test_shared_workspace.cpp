@@ -0,0 +1,87 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "boost/thread.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/shared_workspace.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SharedWorkspaceTest : public ::testing::Test {};
+
+TEST_F(SharedWorkspaceTest, TestGrowth) {
+  SharedWorkspace& workspace = SharedWorkspace::Get();
+  workspace.Release();
+  const size_t reserved = workspace.reserved();
+  workspace.Reserve(reserved + 1000);
+  EXPECT_EQ(workspace.size(), 0);
+  // The first request allocates everything reserved, later smaller ones
+  // get the same memory.
+  void* data = workspace.data(10);
+  EXPECT_TRUE(data);
+  EXPECT_EQ(workspace.size(), reserved + 1000);
+  EXPECT_EQ(workspace.data(reserved + 1000), data);
+  workspace.Reserve(10);
+  EXPECT_EQ(workspace.data(100), data);
+  // Larger ones grow it.
+  EXPECT_TRUE(workspace.data(reserved + 2000));
+  EXPECT_EQ(workspace.size(), reserved + 2000);
+  EXPECT_EQ(workspace.reserved(), reserved + 2000);
+  workspace.Release();
+  EXPECT_EQ(workspace.size(), 0);
+  EXPECT_EQ(workspace.reserved(), reserved + 2000);
+}
+
+void GetWorkspace(SharedWorkspace** workspace) {
+  *workspace = &SharedWorkspace::Get();
+}
+
+TEST_F(SharedWorkspaceTest, TestPerThread) {
+  SharedWorkspace* other = NULL;
+  boost::thread thread(GetWorkspace, &other);
+  thread.join();
+  EXPECT_TRUE(other);
+  EXPECT_NE(other, &SharedWorkspace::Get());
+  EXPECT_EQ(&SharedWorkspace::Get(), &SharedWorkspace::Get());
+}
+
+}  // namespace caffe
@@ -104,6 +104,24 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestNumaPolicies) {
+  // Whatever the placement, fresh memory reads as zeros.
+  const SyncedMemory::NumaPolicy default_policy = SyncedMemory::numa_policy();
+  const SyncedMemory::NumaPolicy policies[] = {
+    SyncedMemory::NUMA_FIRST_TOUCH, SyncedMemory::NUMA_INTERLEAVE
+  };
+  for (int p = 0; p < 2; ++p) {
+    SyncedMemory::set_numa_policy(policies[p]);
+    SyncedMemory mem(3 << 20);
+    const char* cpu_data = static_cast<const char*>(mem.cpu_data());
+    EXPECT_EQ(mem.head(), SyncedMemory::HEAD_AT_CPU);
+    for (int i = 0; i < mem.size(); ++i) {
+      EXPECT_EQ(cpu_data[i], 0);
+    }
+  }
+  SyncedMemory::set_numa_policy(default_policy);
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
@@ -0,0 +1,246 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "boost/thread/tss.hpp"
+
+#include "caffe/util/conversion_ledger.hpp"
+#include "caffe/util/performance.hpp"
+
+namespace caffe {
+
+namespace {
+
+uint64_t NowNanoseconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+bool ReadEnabled() {
+  const char* value = getenv("CAFFE_CONVERSION_LEDGER");
+  return value != NULL && atoi(value) != 0;
+}
+
+bool MoreBytes(const ConversionLedger::Entry& a,
+               const ConversionLedger::Entry& b) {
+  return a.bytes > b.bytes;
+}
+
+#ifdef PERFORMANCE_MONITORING
+uint64_t LayoutConversions() {
+  return ConversionLedger::Get()->total_count();
+}
+uint64_t LayoutConversionBytes() {
+  return ConversionLedger::Get()->total_bytes();
+}
+#endif
+
+}  // namespace
+
+bool ConversionLedger::enabled_ = ReadEnabled();
+
+ConversionLedger::Current* ConversionLedger::current() {
+  // Nets may run on several threads at once, e.g. test and train nets or the
+  // solvers of P2PSync, so each thread tracks its own layer.
+  static boost::thread_specific_ptr<Current> thread_current;
+  if (!thread_current.get()) {
+    thread_current.reset(new Current());
+  }
+  return thread_current.get();
+}
+
+void ConversionLedger::set_layer(const std::string* layer, bool backward) {
+  Current* current = ConversionLedger::current();
+  current->layer = layer;
+  current->backward = backward;
+}
+
+ConversionLedger::Conversion::Conversion(Direction direction,
+    PrvMemDescr::PrvDescrType engine, size_t bytes)
+    : direction_(direction), engine_(engine), bytes_(bytes),
+      start_(ConversionLedger::enabled() ? NowNanoseconds() : 0) {}
+
+ConversionLedger::Conversion::~Conversion() {
+  if (ConversionLedger::enabled() && start_ != 0) {
+    ConversionLedger::Get()->Record(direction_, engine_, bytes_,
+        (NowNanoseconds() - start_) * 1e-9);
+  }
+}
+
+ConversionLedger::ConversionLedger() : iterations_(0) {
+#ifdef PERFORMANCE_MONITORING
+  performance::monitor.RegisterCounter("Layout conversions",
+                                       LayoutConversions);
+  performance::monitor.RegisterCounter("Layout conversion bytes",
+                                       LayoutConversionBytes);
+#endif
+}
+
+ConversionLedger* ConversionLedger::Get() {
+  static ConversionLedger* const ledger = new ConversionLedger();
+  return ledger;
+}
+
+void ConversionLedger::Record(Direction direction,
+    PrvMemDescr::PrvDescrType engine, size_t bytes, double seconds) {
+  static const std::string kNoLayer;
+  const Current* current = ConversionLedger::current();
+  const std::string& layer = current->layer ? *current->layer : kNoLayer;
+  const bool backward = current->backward;
+  boost::mutex::scoped_lock lock(mutex_);
+  Entry* entry = NULL;
+  for (int i = 0; i < entries_.size(); ++i) {
+    Entry& e = entries_[i];
+    if (e.direction == direction && e.engine == engine &&
+        e.backward == backward && e.layer == layer) {
+      entry = &e;
+      break;
+    }
+  }
+  if (entry == NULL) {
+    entries_.push_back(Entry());
+    entry = &entries_.back();
+    entry->layer = layer;
+    entry->direction = direction;
+    entry->backward = backward;
+    entry->engine = engine;
+  }
+  ++entry->count;
+  entry->bytes += bytes;
+  entry->seconds += seconds;
+}
+
+void ConversionLedger::EndIteration() {
+  boost::mutex::scoped_lock lock(mutex_);
+  ++iterations_;
+}
+
+void ConversionLedger::Clear() {
+  boost::mutex::scoped_lock lock(mutex_);
+  entries_.clear();
+  iterations_ = 0;
+}
+
+int ConversionLedger::iterations() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return iterations_;
+}
+
+std::vector<ConversionLedger::Entry> ConversionLedger::entries() const {
+  std::vector<Entry> entries;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    entries = entries_;
+  }
+  std::stable_sort(entries.begin(), entries.end(), MoreBytes);
+  return entries;
+}
+
+uint64_t ConversionLedger::total_count() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  uint64_t count = 0;
+  for (int i = 0; i < entries_.size(); ++i) {
+    count += entries_[i].count;
+  }
+  return count;
+}
+
+uint64_t ConversionLedger::total_bytes() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  uint64_t bytes = 0;
+  for (int i = 0; i < entries_.size(); ++i) {
+    bytes += entries_[i].bytes;
+  }
+  return bytes;
+}
+
+void ConversionLedger::Log(int max_entries) const {
+  const std::vector<Entry> entries = this->entries();
+  const int iterations = std::max(this->iterations(), 1);
+  uint64_t count = 0, bytes = 0;
+  double seconds = 0;
+  for (int i = 0; i < entries.size(); ++i) {
+    count += entries[i].count;
+    bytes += entries[i].bytes;
+    seconds += entries[i].seconds;
+  }
+  LOG(INFO) << "Layout conversions per iteration: "
+            << static_cast<double>(count) / iterations << ", "
+            << (bytes / iterations >> 10) << " KB, "
+            << seconds * 1e3 / iterations << " ms";
+  for (int i = 0; i < entries.size() && i < max_entries; ++i) {
+    const Entry& e = entries[i];
+    LOG(INFO) << "    " << (e.layer.empty() ? "(outside layers)" : e.layer)
+              << (e.backward ? " backward " : " forward ")
+              << EngineName(e.engine) << " " << DirectionName(e.direction)
+              << ": " << static_cast<double>(e.count) / iterations << " x, "
+              << (e.bytes / iterations >> 10) << " KB, "
+              << e.seconds * 1e3 / iterations << " ms";
+  }
+}
+
+const char* ConversionLedger::DirectionName(Direction direction) {
+  switch (direction) {
+  case FROM_PRV:
+    return "prv->cpu";
+  case TO_PRV:
+    return "cpu->prv";
+  case PRV_TO_PRV:
+    return "prv->prv";
+  }
+  return "unknown";
+}
+
+const char* ConversionLedger::EngineName(PrvMemDescr::PrvDescrType engine) {
+  switch (engine) {
+  case PrvMemDescr::PRV_DESCR_MKL2017:
+    return "MKL2017";
+  case PrvMemDescr::PRV_DESCR_MKLDNN:
+    return "MKLDNN";
+  }
+  return "unknown";
+}
+
+}  // namespace caffe
@@ -0,0 +1,111 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string>
+#include <vector>
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/convert_writer.hpp"
+
+namespace caffe {
+
+ConvertWriter::ConvertWriter(db::DB* db, bool annotated, bool check_size,
+                             int commit_interval)
+    : db_(db), txn_(db->NewTransaction()), annotated_(annotated),
+      check_size_(check_size), commit_interval_(commit_interval), count_(0),
+      data_size_(0), data_size_initialized_(false), has_shape_(false),
+      channels_(0), height_(0), width_(0) {}
+
+void ConvertWriter::Write(const vector<ConvertEntry>* entries) {
+  for (int i = 0; i < entries->size(); ++i) {
+    const ConvertEntry& entry = (*entries)[i];
+    if (entry.has_shape) {
+      has_shape_ = true;
+      channels_ = entry.channels;
+      height_ = entry.height;
+      width_ = entry.width;
+    }
+    if (entry.status == false) {
+      LOG(WARNING) << "Failed to read " << entry.key;
+      continue;
+    }
+    // Images were read into one Datum reused from image to image, and
+    // encoded images that are resized or converted do not set a shape, so
+    // they keep the last one set. Keep doing so for the output not to
+    // change.
+    const string* value = &entry.value;
+    string stale_value;
+    if (!entry.has_shape && has_shape_) {
+      AnnotatedDatum anno_datum;
+      Datum* datum = anno_datum.mutable_datum();
+      CHECK(annotated_ ? anno_datum.ParseFromString(entry.value) :
+            datum->ParseFromString(entry.value));
+      datum->set_channels(channels_);
+      datum->set_height(height_);
+      datum->set_width(width_);
+      CHECK(annotated_ ? anno_datum.SerializeToString(&stale_value) :
+            datum->SerializeToString(&stale_value));
+      value = &stale_value;
+    }
+    if (check_size_) {
+      if (!data_size_initialized_) {
+        data_size_ = channels_ * height_ * width_;
+        data_size_initialized_ = true;
+      } else {
+        CHECK_EQ(entry.data_size, data_size_) << "Incorrect data field size "
+            << entry.data_size;
+      }
+    }
+    txn_->Put(entry.key, *value);
+    if (++count_ % commit_interval_ == 0) {
+      // Commit db
+      txn_->Commit();
+      txn_.reset(db_->NewTransaction());
+      LOG(INFO) << "Processed " << count_ << " files.";
+    }
+  }
+}
+
+void ConvertWriter::Finish() {
+  // write the last batch
+  if (count_ % commit_interval_ != 0) {
+    txn_->Commit();
+    LOG(INFO) << "Processed " << count_ << " files.";
+  }
+}
+
+}  // namespace caffe
@@ -35,6 +35,7 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <dirent.h>
 #include <glog/logging.h>
 
 #include <fstream>
@@ -127,6 +128,7 @@ Collection::Collection(CpuInfoInterface *cpuInfo) : cpuInfo(*cpuInfo) {
 
   parseCpuInfo();
   collectBasicCpuInformation();
+  loadNumaTopology("/sys/devices/system/node");
 }
 
 unsigned Collection::getProcessorSpeedMHz() {
@@ -149,6 +151,90 @@ const Processor &Collection::getProcessor(unsigned processorId) {
   return processors[processorId];
 }
 
+unsigned Collection::getNumberOfNumaNodes() {
+  return numberOfNumaNodes;
+}
+
+const std::vector<unsigned> &Collection::getNumaNodeProcessors(
+    unsigned nodeId) {
+  static const std::vector<unsigned> noProcessors;
+  return nodeId < numaNodeProcessors.size() ?
+    numaNodeProcessors[nodeId] : noProcessors;
+}
+
+int Collection::getNumaNodeOfProcessor(unsigned processorId) {
+  for (unsigned nodeId = 0; nodeId < numaNodeProcessors.size(); nodeId++) {
+    const std::vector<unsigned> &cpus = numaNodeProcessors[nodeId];
+    for (unsigned i = 0; i < cpus.size(); i++) {
+      if (cpus[i] == processorId) {
+        return nodeId;
+      }
+    }
+  }
+
+  return -1;
+}
+
+void Collection::loadNumaTopology(const char *nodeDirectory) {
+  numberOfNumaNodes = 0;
+  numaNodeProcessors.clear();
+
+  DIR *directory = opendir(nodeDirectory);
+  if (!directory) {
+    return;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(directory)) != NULL) {
+    unsigned nodeId;
+    char trailing;
+    if (sscanf(entry->d_name, "node%u%c", &nodeId, &trailing) != 1) {
+      continue;
+    }
+
+    std::string fileName =
+      std::string(nodeDirectory) + "/" + entry->d_name + "/cpulist";
+    std::ifstream file(fileName.c_str());
+    std::string content(
+      (std::istreambuf_iterator<char>(file)),
+      (std::istreambuf_iterator<char>()));
+
+    if (numaNodeProcessors.size() <= nodeId) {
+      numaNodeProcessors.resize(nodeId + 1);
+    }
+    parseCpuList(content.c_str(), &numaNodeProcessors[nodeId]);
+    numberOfNumaNodes++;
+  }
+  closedir(directory);
+}
+
+/* Function parses the kernel's list format, e.g. "0-17,36-53". */
+void Collection::parseCpuList(const char *text, std::vector<unsigned> *cpus) {
+  while (*text) {
+    char *end;
+    unsigned first = strtoul(text, &end, 10);
+    if (end == text) {
+      break;
+    }
+
+    unsigned last = first;
+    if (*end == '-') {
+      text = end + 1;
+      last = strtoul(text, &end, 10);
+    }
+
+    for (unsigned cpu = first; cpu <= last; cpu++) {
+      cpus->push_back(cpu);
+    }
+
+    text = end;
+    if (*text != ',') {
+      break;
+    }
+    text++;
+  }
+}
+
 void Collection::parseCpuInfo() {
   const char *cpuInfoLine = cpuInfo.getFirstLine();
   for (; cpuInfoLine; cpuInfoLine = cpuInfo.getNextLine()) {
@@ -260,6 +346,62 @@ void Collection::updateCpuInformation(const Processor &processor,
   totalNumberOfCpuCores += processor.cpuCores;
 }
 
+static Isa detectIsa() {
+  Isa isa = isaScalar;
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    isa = isaAvx512;
+  } else if (__builtin_cpu_supports("avx2")) {
+    isa = isaAvx2;
+  }
+#endif
+  const char *requested = getenv("CAFFE_CPU_ISA");
+  if (requested != NULL) {
+    for (int i = isaScalar; i < isa; i++) {
+      if (strcmp(requested, getIsaName(static_cast<Isa>(i))) == 0) {
+        isa = static_cast<Isa>(i);
+      }
+    }
+  }
+  return isa;
+}
+
+Collection &getCollection() {
+  static CpuInfo cpuInfo;
+  static Collection collection(&cpuInfo);
+  return collection;
+}
+
+Isa getSupportedIsa() {
+  static const Isa isa = detectIsa();
+  return isa;
+}
+
+static bool detectAvx512Vnni() {
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__ && \
+    (defined __clang__ || __GNUC__ >= 8)
+  if (getSupportedIsa() == isaAvx512) {
+    return __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vnni");
+  }
+#endif
+  return false;
+}
+
+bool hasAvx512Vnni() {
+  static const bool vnni = detectAvx512Vnni();
+  return vnni;
+}
+
+const char *getIsaName(Isa isa) {
+  switch (isa) {
+    case isaAvx2: return "avx2";
+    case isaAvx512: return "avx512";
+    default: return "scalar";
+  }
+}
+
 #ifdef _OPENMP
 
 /* The OpenMpManager class is responsible for determining a set of all of
@@ -297,9 +439,7 @@ OpenMpManager::OpenMpManager(Collection *collection) :
 }
 
 OpenMpManager &OpenMpManager::getInstance() {
-  static CpuInfo cpuInfo;
-  static Collection collection(&cpuInfo);
-  static OpenMpManager openMpManager(&collection);
+  static OpenMpManager openMpManager(&getCollection());
   return openMpManager;
 }
 
@@ -38,6 +38,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/util/db.hpp"
 #include "caffe/util/db_leveldb.hpp"
 #include "caffe/util/db_lmdb.hpp"
+#include "caffe/util/db_packed.hpp"
 
 #include <string>
 
@@ -53,6 +54,8 @@ DB* GetDB(DataParameter::DB backend) {
   case DataParameter_DB_LMDB:
     return new LMDB();
 #endif  // USE_LMDB
+  case DataParameter_DB_PACKED:
+    return new PackedDB();
   default:
     LOG(FATAL) << "Unknown database backend";
     return NULL;
@@ -70,6 +73,9 @@ DB* GetDB(const string& backend) {
     return new LMDB();
   }
 #endif  // USE_LMDB
+  if (backend == "packed") {
+    return new PackedDB();
+  }
   LOG(FATAL) << "Unknown database backend";
   return NULL;
 }
@@ -0,0 +1,359 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "caffe/util/db_packed.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+#include "caffe/util/io.hpp"
+
+namespace caffe { namespace db {
+
+static const char kPackedMagic[8] = {'C', 'A', 'F', 'F', 'E', 'P', 'K', 'D'};
+
+static void AppendVarint(uint64_t value, string* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+// Writes value in the 10 bytes any int32 takes when negative. Parsers accept
+// the redundant continuation bytes.
+static void AppendPaddedVarint(uint64_t value, string* out) {
+  for (int i = 0; i < 9; ++i) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value & 1));
+}
+
+// Serializes a raw Datum so that its size only depends on its shape.
+static void SerializeFixedDatum(const Datum& datum, string* out) {
+  out->clear();
+  AppendVarint((Datum::kChannelsFieldNumber << 3) | 0, out);
+  AppendVarint(datum.channels(), out);
+  AppendVarint((Datum::kHeightFieldNumber << 3) | 0, out);
+  AppendVarint(datum.height(), out);
+  AppendVarint((Datum::kWidthFieldNumber << 3) | 0, out);
+  AppendVarint(datum.width(), out);
+  AppendVarint((Datum::kLabelFieldNumber << 3) | 0, out);
+  AppendPaddedVarint(static_cast<uint64_t>(
+      static_cast<int64_t>(datum.label())), out);
+  AppendVarint((Datum::kDataFieldNumber << 3) | 2, out);
+  AppendVarint(datum.data().size(), out);
+  out->append(datum.data());
+}
+
+// Whether [offset, offset + size) lies within a mapping of map_size bytes.
+static bool InMapping(uint64_t offset, uint64_t size, uint64_t map_size) {
+  return offset <= map_size && size <= map_size - offset;
+}
+
+void PackedCursor::Seek(const string& key) {
+  index_ = db_->LowerBound(key);
+}
+
+string PackedCursor::key() {
+  return db_->key(index_);
+}
+
+string PackedCursor::value() {
+  std::pair<void*, size_t> record = db_->record(index_);
+  return string(static_cast<const char*>(record.first), record.second);
+}
+
+std::pair<void*, size_t> PackedCursor::valuePointer() {
+  return db_->record(index_);
+}
+
+bool PackedCursor::valid() {
+  return index_ < db_->count();
+}
+
+void PackedTransaction::Commit() {
+  for (int i = 0; i < keys_.size(); ++i) {
+    db_->Append(keys_[i], values_[i]);
+  }
+  keys_.clear();
+  values_.clear();
+}
+
+void PackedDB::Open(const string& source, Mode mode) {
+  CHECK(mode != WRITE) << "Packed DBs can only be created or read, not "
+                       << "appended to";
+  if (mode == NEW) {
+    out_.open(source.c_str(), std::ios::out | std::ios::binary |
+              std::ios::trunc);
+    CHECK(out_.is_open()) << "Failed to create packed DB " << source;
+    memset(&new_header_, 0, sizeof(new_header_));
+    // The header is written last, once the tables are known.
+    offset_ = 0;
+    const string blank(kPackedRecordsOffset, '\0');
+    Write(blank.data(), blank.size());
+    new_header_.records_offset = kPackedRecordsOffset;
+    fixed_ = true;
+    LOG(INFO) << "Created packed DB " << source;
+    return;
+  }
+  int fd = open(source.c_str(), O_RDONLY);
+  CHECK_GE(fd, 0) << "Failed to open packed DB " << source;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Failed to stat packed DB " << source;
+  map_size_ = st.st_size;
+  CHECK_GE(map_size_, sizeof(PackedHeader)) << source << " is not a packed DB";
+  void* map = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  CHECK(map != MAP_FAILED) << "Failed to map packed DB " << source;
+  map_ = static_cast<char*>(map);
+  header_ = reinterpret_cast<const PackedHeader*>(map_);
+  CHECK_EQ(memcmp(header_->magic, kPackedMagic, sizeof(kPackedMagic)), 0)
+      << source << " is not a packed DB";
+  CHECK_EQ(header_->version, kPackedVersion)
+      << "Unsupported packed DB version in " << source;
+  CheckTables(source);
+  LOG(INFO) << "Opened packed DB " << source << " with " << header_->count
+            << (fixed() ? " fixed-size" : "") << " records";
+}
+
+void PackedDB::Close() {
+  if (out_.is_open()) {
+    Finish();
+  }
+  if (map_ != NULL) {
+    munmap(map_, map_size_);
+    map_ = NULL;
+    header_ = NULL;
+  }
+}
+
+void PackedDB::CheckTables(const string& source) const {
+  const uint64_t count = header_->count;
+  // Every record has a key offset, which bounds count before the sizes of
+  // the tables are computed from it.
+  CHECK_LT(count, map_size_ / sizeof(uint64_t))
+      << source << " is truncated or corrupt";
+  CHECK(header_->keys_offset % sizeof(uint64_t) == 0 &&
+        InMapping(header_->keys_offset, (count + 1) * sizeof(uint64_t),
+                  map_size_)) << source << " is truncated or corrupt";
+  const uint64_t* key_offsets =
+      reinterpret_cast<const uint64_t*>(map_ + header_->keys_offset);
+  CHECK_EQ(key_offsets[0], 0) << source << " is truncated or corrupt";
+  for (uint64_t i = 0; i < count; ++i) {
+    CHECK_LE(key_offsets[i], key_offsets[i + 1])
+        << source << " is truncated or corrupt";
+  }
+  CHECK(InMapping(header_->keys_offset + (count + 1) * sizeof(uint64_t),
+                  key_offsets[count], map_size_))
+      << source << " is truncated or corrupt";
+  if (count == 0) {
+    return;
+  }
+  if (fixed()) {
+    CHECK(header_->stride > 0 && header_->stride >= header_->record_size &&
+          count - 1 <= map_size_ / header_->stride &&
+          InMapping(header_->records_offset,
+                    (count - 1) * header_->stride + header_->record_size,
+                    map_size_)) << source << " is truncated or corrupt";
+    CHECK(header_->labels_offset % sizeof(int32_t) == 0 &&
+          InMapping(header_->labels_offset, count * sizeof(int32_t),
+                    map_size_)) << source << " is truncated or corrupt";
+    return;
+  }
+  CHECK(header_->index_offset % sizeof(uint64_t) == 0 &&
+        InMapping(header_->index_offset, 2 * count * sizeof(uint64_t),
+                  map_size_)) << source << " is truncated or corrupt";
+  const uint64_t* index =
+      reinterpret_cast<const uint64_t*>(map_ + header_->index_offset);
+  for (uint64_t i = 0; i < count; ++i) {
+    CHECK(InMapping(index[2 * i], index[2 * i + 1], map_size_))
+        << source << " is truncated or corrupt: record " << i << " at "
+        << index[2 * i] << " of size " << index[2 * i + 1];
+  }
+}
+
+PackedCursor* PackedDB::NewCursor() {
+  CHECK(map_) << "Packed DB is not open for reading";
+  return new PackedCursor(this);
+}
+
+PackedTransaction* PackedDB::NewTransaction() {
+  CHECK(out_.is_open()) << "Packed DB is not open for writing";
+  return new PackedTransaction(this);
+}
+
+string PackedDB::key(size_t i) const {
+  const uint64_t* offsets =
+      reinterpret_cast<const uint64_t*>(map_ + header_->keys_offset);
+  const char* keys = reinterpret_cast<const char*>(offsets + count() + 1);
+  return string(keys + offsets[i], offsets[i + 1] - offsets[i]);
+}
+
+std::pair<void*, size_t> PackedDB::record(size_t i) const {
+  if (fixed()) {
+    return std::make_pair(static_cast<void*>(map_ + header_->records_offset +
+        i * header_->stride), static_cast<size_t>(header_->record_size));
+  }
+  const uint64_t* index =
+      reinterpret_cast<const uint64_t*>(map_ + header_->index_offset);
+  return std::make_pair(static_cast<void*>(map_ + index[2 * i]),
+                        static_cast<size_t>(index[2 * i + 1]));
+}
+
+int PackedDB::label(size_t i) const {
+  CHECK(fixed()) << "Labels are only kept apart in fixed-size packed DBs";
+  return reinterpret_cast<const int32_t*>(map_ + header_->labels_offset)[i];
+}
+
+size_t PackedDB::LowerBound(const string& key) const {
+  size_t begin = 0;
+  size_t end = count();
+  while (begin < end) {
+    const size_t middle = begin + (end - begin) / 2;
+    if (this->key(middle) < key) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return begin;
+}
+
+void PackedDB::Append(const string& key, const string& value) {
+  CHECK(keys_.empty() || keys_.back() < key)
+      << "Packed DBs are written in increasing key order, got " << key
+      << " after " << keys_.back();
+  // Raw uint8 Datums are rewritten to a size that only depends on their
+  // shape, anything else is stored as is.
+  Datum datum;
+  const char* pixels;
+  string fixed_value;
+  const string* record = &value;
+  if (ParseDatumView(value.data(), value.size(), &datum, &pixels) &&
+      datum.ParseFromString(value)) {
+    SerializeFixedDatum(datum, &fixed_value);
+    record = &fixed_value;
+    if (keys_.empty()) {
+      new_header_.record_size = fixed_value.size();
+      new_header_.channels = datum.channels();
+      new_header_.height = datum.height();
+      new_header_.width = datum.width();
+    }
+    fixed_ = fixed_ && fixed_value.size() == new_header_.record_size &&
+        datum.channels() == new_header_.channels &&
+        datum.height() == new_header_.height &&
+        datum.width() == new_header_.width;
+    labels_.push_back(datum.label());
+  } else {
+    fixed_ = false;
+  }
+  keys_.push_back(key);
+  offsets_.push_back(offset_);
+  sizes_.push_back(record->size());
+  Write(record->data(), record->size());
+  Align();
+}
+
+void PackedDB::Write(const void* data, size_t size) {
+  out_.write(static_cast<const char*>(data), size);
+  CHECK(out_.good()) << "Failed to write packed DB";
+  offset_ += size;
+}
+
+void PackedDB::Align() {
+  static const char zeros[kPackedAlignment] = {};
+  const size_t padding = (kPackedAlignment - offset_ % kPackedAlignment) %
+      kPackedAlignment;
+  Write(zeros, padding);
+}
+
+void PackedDB::Finish() {
+  PackedHeader& header = new_header_;
+  memcpy(header.magic, kPackedMagic, sizeof(kPackedMagic));
+  header.version = kPackedVersion;
+  header.count = keys_.size();
+  if (fixed_ && !keys_.empty()) {
+    header.flags |= kPackedFixed;
+    header.stride = (header.record_size + kPackedAlignment - 1) /
+        kPackedAlignment * kPackedAlignment;
+    header.labels_offset = offset_;
+    Write(&labels_[0], labels_.size() * sizeof(labels_[0]));
+    Align();
+  } else {
+    header.record_size = 0;
+    header.channels = header.height = header.width = 0;
+    header.index_offset = offset_;
+    for (int i = 0; i < keys_.size(); ++i) {
+      Write(&offsets_[i], sizeof(offsets_[i]));
+      Write(&sizes_[i], sizeof(sizes_[i]));
+    }
+    Align();
+  }
+  header.keys_offset = offset_;
+  uint64_t key_offset = 0;
+  for (int i = 0; i <= keys_.size(); ++i) {
+    Write(&key_offset, sizeof(key_offset));
+    if (i < keys_.size()) {
+      key_offset += keys_[i].size();
+    }
+  }
+  for (int i = 0; i < keys_.size(); ++i) {
+    Write(keys_[i].data(), keys_[i].size());
+  }
+  out_.seekp(0);
+  out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  CHECK(out_.good()) << "Failed to write packed DB header";
+  out_.close();
+  LOG(INFO) << "Wrote packed DB with " << header.count
+            << ((header.flags & kPackedFixed) ? " fixed-size" : "")
+            << " records";
+  keys_.clear();
+  offsets_.clear();
+  sizes_.clear();
+  labels_.clear();
+}
+
+}  // namespace db
+}  // namespace caffe
@@ -118,6 +118,66 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
 }
 
+// The offset in the file of the raw data of a dataset, or -1 if it is not
+// stored contiguously and unfiltered as values of type.
+static int64_t hdf5_get_contiguous_offset(
+    hid_t file_id, const char* dataset_name_, hid_t type) {
+  hid_t dataset = H5Dopen2(file_id, dataset_name_, H5P_DEFAULT);
+  CHECK_GE(dataset, 0) << "Failed to open dataset " << dataset_name_;
+  hid_t dataset_type = H5Dget_type(dataset);
+  hid_t create_plist = H5Dget_create_plist(dataset);
+  const bool contiguous = H5Tequal(dataset_type, type) > 0 &&
+      H5Pget_layout(create_plist) == H5D_CONTIGUOUS &&
+      H5Pget_nfilters(create_plist) == 0;
+  const haddr_t address = H5Dget_offset(dataset);
+  H5Pclose(create_plist);
+  H5Tclose(dataset_type);
+  H5Dclose(dataset);
+  if (!contiguous || address == HADDR_UNDEF) {
+    return -1;
+  }
+  // Addresses are relative to the end of the user block.
+  hid_t file = H5Iget_file_id(file_id);
+  hid_t file_plist = H5Fget_create_plist(file);
+  hsize_t user_block = 0;
+  H5Pget_userblock(file_plist, &user_block);
+  H5Pclose(file_plist);
+  H5Fclose(file);
+  return address + user_block;
+}
+
+template <typename Dtype>
+static bool hdf5_map_nd_dataset_helper(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
+    const shared_ptr<MappedFile>& file, hid_t type, Blob<Dtype>* blob) {
+  hdf5_load_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim, blob);
+  const int64_t offset =
+      hdf5_get_contiguous_offset(file_id, dataset_name_, type);
+  const size_t size = blob->count() * sizeof(Dtype);
+  if (offset < 0 || offset % sizeof(Dtype) != 0 || size == 0 ||
+      offset + size > file->size()) {
+    return false;
+  }
+  blob->set_cpu_data(reinterpret_cast<Dtype*>(file->data() + offset), file);
+  return true;
+}
+
+template <>
+bool hdf5_map_nd_dataset<float>(hid_t file_id, const char* dataset_name_,
+        int min_dim, int max_dim, const shared_ptr<MappedFile>& file,
+        Blob<float>* blob) {
+  return hdf5_map_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim,
+                                    file, H5T_NATIVE_FLOAT, blob);
+}
+
+template <>
+bool hdf5_map_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
+        int min_dim, int max_dim, const shared_ptr<MappedFile>& file,
+        Blob<double>* blob) {
+  return hdf5_map_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim,
+                                    file, H5T_NATIVE_DOUBLE, blob);
+}
+
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
@@ -0,0 +1,450 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <vector>
+
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/tss.hpp"
+
+#ifdef USE_MKL
+#include <mkl_service.h>
+#endif
+
+#ifdef USE_MLSL
+#include "mlsl.h"
+#endif /* USE_MLSL */
+
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/performance.hpp"
+
+namespace caffe {
+
+namespace {
+
+const size_t kAlignment = 64;
+const size_t kHugePageSize = size_t(2) << 20;
+const uint32_t kBlockMagic = 0xCAFFEB10;
+const uint32_t kBlockMapped = 1;
+// Blocks up to kMaxThreadBlock are kept in per-thread free lists of at most
+// kThreadCacheBytes; larger ones are rare enough to always go to the pool.
+const size_t kMaxThreadBlock = size_t(4) << 20;
+const size_t kThreadCacheBytes = size_t(64) << 20;
+
+// Precedes every block handed out; the caller's pointer starts kAlignment
+// bytes after it.
+struct BlockHeader {
+  size_t class_size;
+  size_t backing_size;
+  int32_t class_index;
+  uint32_t flags;
+  uint32_t magic;
+};
+
+void* AllocateBacking(size_t size) {
+  void* ptr = NULL;
+#ifdef USE_MLSL
+  ptr = MLSL::Alloc(size, kAlignment);
+#elif defined(USE_MKL)
+  ptr = mkl_malloc(size, kAlignment);
+#else
+  if (posix_memalign(&ptr, kAlignment, size) != 0) {
+    ptr = NULL;
+  }
+#endif
+  return ptr;
+}
+
+void FreeBacking(void* ptr) {
+#ifdef USE_MLSL
+  MLSL::Free(ptr);
+#elif defined(USE_MKL)
+  mkl_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+}  // namespace
+
+void* SystemHostAllocator::Allocate(size_t size) {
+  void* ptr = AllocateBacking(size ? size : 1);
+  CHECK(ptr) << "Failed to allocate " << size << " bytes of host memory";
+  return ptr;
+}
+
+void SystemHostAllocator::Free(void* ptr) {
+  FreeBacking(ptr);
+}
+
+class CachingHostAllocator::Impl {
+ public:
+  Impl(size_t max_cached_bytes, bool use_hugetlb)
+      : max_cached_bytes_(max_cached_bytes), use_hugetlb_(use_hugetlb),
+        thread_cache_(&Impl::ReleaseThreadCache), pool_bytes_(0),
+        allocations_(0), cache_hits_(0), system_allocations_(0),
+        bytes_in_use_(0), peak_bytes_in_use_(0), bytes_cached_(0),
+        bytes_reserved_(0) {
+    CHECK_LE(sizeof(BlockHeader), kAlignment);
+  }
+
+  ~Impl() {
+    // Hands the calling thread's blocks to the pool while members are alive.
+    thread_cache_.reset();
+    Trim();
+  }
+
+  void* Allocate(size_t size) {
+    size_t class_size;
+    const int index = CachingHostAllocator::SizeClass(size, &class_size);
+    ++allocations_;
+    BlockHeader* block = NULL;
+    ThreadCache* cache = thread_cache();
+    if (index < cache->lists.size() && !cache->lists[index].empty()) {
+      block = cache->lists[index].back();
+      cache->lists[index].pop_back();
+      cache->bytes -= class_size;
+    } else {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (index < pool_.size() && !pool_[index].empty()) {
+        block = pool_[index].back();
+        pool_[index].pop_back();
+        pool_bytes_ -= class_size;
+      }
+    }
+    if (block) {
+      ++cache_hits_;
+      bytes_cached_ -= class_size;
+    } else {
+      block = NewBlock(index, class_size);
+    }
+    const uint64_t in_use = bytes_in_use_ += class_size;
+    uint64_t peak = peak_bytes_in_use_;
+    while (in_use > peak &&
+           !peak_bytes_in_use_.compare_exchange_weak(peak, in_use)) {}
+    return reinterpret_cast<char*>(block) + kAlignment;
+  }
+
+  void Free(void* ptr) {
+    if (ptr == NULL) { return; }
+    BlockHeader* block = reinterpret_cast<BlockHeader*>(
+        static_cast<char*>(ptr) - kAlignment);
+    CHECK_EQ(block->magic, kBlockMagic)
+        << "Freeing memory not allocated by the caching host allocator";
+    bytes_in_use_ -= block->class_size;
+    ThreadCache* cache = thread_cache();
+    if (block->class_size <= kMaxThreadBlock &&
+        cache->bytes + block->class_size <= kThreadCacheBytes) {
+      if (cache->lists.size() <= block->class_index) {
+        cache->lists.resize(block->class_index + 1);
+      }
+      cache->lists[block->class_index].push_back(block);
+      cache->bytes += block->class_size;
+      bytes_cached_ += block->class_size;
+      return;
+    }
+    boost::mutex::scoped_lock lock(mutex_);
+    CacheLocked(block);
+  }
+
+  HostAllocatorStats stats() const {
+    HostAllocatorStats stats;
+    stats.allocations = allocations_;
+    stats.cache_hits = cache_hits_;
+    stats.system_allocations = system_allocations_;
+    stats.bytes_in_use = bytes_in_use_;
+    stats.peak_bytes_in_use = peak_bytes_in_use_;
+    stats.bytes_cached = bytes_cached_;
+    stats.bytes_reserved = bytes_reserved_;
+    return stats;
+  }
+
+  void Trim() {
+    ThreadCache* cache = thread_cache_.get();
+    if (cache) {
+      for (int i = 0; i < cache->lists.size(); ++i) {
+        for (int j = 0; j < cache->lists[i].size(); ++j) {
+          bytes_cached_ -= cache->lists[i][j]->class_size;
+          DeleteBlock(cache->lists[i][j]);
+        }
+        cache->lists[i].clear();
+      }
+      cache->bytes = 0;
+    }
+    boost::mutex::scoped_lock lock(mutex_);
+    for (int i = 0; i < pool_.size(); ++i) {
+      for (int j = 0; j < pool_[i].size(); ++j) {
+        bytes_cached_ -= pool_[i][j]->class_size;
+        DeleteBlock(pool_[i][j]);
+      }
+      pool_[i].clear();
+    }
+    pool_bytes_ = 0;
+  }
+
+ private:
+  struct ThreadCache {
+    Impl* owner;
+    size_t bytes;
+    vector<vector<BlockHeader*> > lists;
+  };
+
+  ThreadCache* thread_cache() {
+    ThreadCache* cache = thread_cache_.get();
+    if (cache == NULL) {
+      cache = new ThreadCache();
+      cache->owner = this;
+      cache->bytes = 0;
+      thread_cache_.reset(cache);
+    }
+    return cache;
+  }
+
+  // Runs when a thread exits: its free lists go to the shared pool.
+  static void ReleaseThreadCache(ThreadCache* cache) {
+    Impl* owner = cache->owner;
+    boost::mutex::scoped_lock lock(owner->mutex_);
+    for (int i = 0; i < cache->lists.size(); ++i) {
+      for (int j = 0; j < cache->lists[i].size(); ++j) {
+        owner->bytes_cached_ -= cache->lists[i][j]->class_size;
+        owner->CacheLocked(cache->lists[i][j]);
+      }
+    }
+    delete cache;
+  }
+
+  // Keeps a free block in the pool, or returns it to the system once the
+  // pool is full. Requires mutex_.
+  void CacheLocked(BlockHeader* block) {
+    if (pool_bytes_ + block->class_size > max_cached_bytes_) {
+      DeleteBlock(block);
+      return;
+    }
+    if (pool_.size() <= block->class_index) {
+      pool_.resize(block->class_index + 1);
+    }
+    pool_[block->class_index].push_back(block);
+    pool_bytes_ += block->class_size;
+    bytes_cached_ += block->class_size;
+  }
+
+  BlockHeader* NewBlock(int class_index, size_t class_size) {
+    const size_t size = class_size + kAlignment;
+    void* base = NULL;
+    uint32_t flags = 0;
+    size_t backing_size = size;
+#ifdef MAP_HUGETLB
+    if (use_hugetlb_ && size >= kHugePageSize) {
+      const size_t mapped_size =
+          (size + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+      base = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (base == MAP_FAILED) {
+        LOG_FIRST_N(WARNING, 1) << "Could not map " << mapped_size
+            << " bytes from hugetlbfs, using regular pages";
+        base = NULL;
+      } else {
+        flags |= kBlockMapped;
+        backing_size = mapped_size;
+      }
+    }
+#endif
+    if (base == NULL) {
+      base = AllocateBacking(size);
+      CHECK(base) << "host allocation of size " << size << " failed";
+#ifdef MADV_HUGEPAGE
+      // Transparent huge pages can only back the 2 MB aligned ranges.
+      const uintptr_t begin = (reinterpret_cast<uintptr_t>(base) +
+          kHugePageSize - 1) & ~(kHugePageSize - 1);
+      const uintptr_t end = (reinterpret_cast<uintptr_t>(base) + size) &
+          ~(kHugePageSize - 1);
+      if (end > begin) {
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE);
+      }
+#endif
+    }
+    ++system_allocations_;
+    bytes_reserved_ += backing_size;
+    BlockHeader* block = static_cast<BlockHeader*>(base);
+    block->class_size = class_size;
+    block->backing_size = backing_size;
+    block->class_index = class_index;
+    block->flags = flags;
+    block->magic = kBlockMagic;
+    return block;
+  }
+
+  void DeleteBlock(BlockHeader* block) {
+    bytes_reserved_ -= block->backing_size;
+    block->magic = 0;
+    if (block->flags & kBlockMapped) {
+      munmap(block, block->backing_size);
+    } else {
+      FreeBacking(block);
+    }
+  }
+
+  const size_t max_cached_bytes_;
+  const bool use_hugetlb_;
+  boost::thread_specific_ptr<ThreadCache> thread_cache_;
+  boost::mutex mutex_;
+  vector<vector<BlockHeader*> > pool_;
+  size_t pool_bytes_;
+  std::atomic<uint64_t> allocations_;
+  std::atomic<uint64_t> cache_hits_;
+  std::atomic<uint64_t> system_allocations_;
+  std::atomic<uint64_t> bytes_in_use_;
+  std::atomic<uint64_t> peak_bytes_in_use_;
+  std::atomic<uint64_t> bytes_cached_;
+  std::atomic<uint64_t> bytes_reserved_;
+};
+
+CachingHostAllocator::CachingHostAllocator(size_t max_cached_bytes,
+                                           bool use_hugetlb)
+    : impl_(new Impl(max_cached_bytes, use_hugetlb)) {}
+
+CachingHostAllocator::~CachingHostAllocator() {}
+
+void* CachingHostAllocator::Allocate(size_t size) {
+  return impl_->Allocate(size);
+}
+
+void CachingHostAllocator::Free(void* ptr) {
+  impl_->Free(ptr);
+}
+
+HostAllocatorStats CachingHostAllocator::stats() const {
+  return impl_->stats();
+}
+
+void CachingHostAllocator::Trim() {
+  impl_->Trim();
+}
+
+int CachingHostAllocator::SizeClass(size_t size, size_t* class_size) {
+  const size_t rounded = size ? (size + kAlignment - 1) & ~(kAlignment - 1)
+                              : kAlignment;
+  const size_t kLinearLimit = 4096;
+  if (rounded <= kLinearLimit) {
+    *class_size = rounded;
+    return rounded / kAlignment - 1;
+  }
+  // Four classes in (2^k, 2^(k+1)], spaced by 2^(k-2).
+  int k = 0;
+  while ((size_t(1) << (k + 1)) < rounded) { ++k; }
+  const size_t step = size_t(1) << (k - 2);
+  const size_t j = (rounded - (size_t(1) << k) + step - 1) / step;
+  *class_size = (size_t(1) << k) + j * step;
+  return kLinearLimit / kAlignment + (k - 12) * 4 + (j - 1);
+}
+
+namespace {
+
+HostAllocator* requested_allocator = NULL;
+bool allocator_in_use = false;
+
+#ifdef PERFORMANCE_MONITORING
+uint64_t HostAllocations() {
+  return HostAllocator::Get()->stats().allocations;
+}
+uint64_t HostCacheHits() {
+  return HostAllocator::Get()->stats().cache_hits;
+}
+uint64_t HostSystemAllocations() {
+  return HostAllocator::Get()->stats().system_allocations;
+}
+uint64_t HostPeakBytesInUse() {
+  return HostAllocator::Get()->stats().peak_bytes_in_use;
+}
+uint64_t HostBytesCached() {
+  return HostAllocator::Get()->stats().bytes_cached;
+}
+uint64_t HostBytesReserved() {
+  return HostAllocator::Get()->stats().bytes_reserved;
+}
+#endif
+
+HostAllocator* CreateHostAllocator() {
+  allocator_in_use = true;
+  if (requested_allocator) { return requested_allocator; }
+  const char* type = getenv("CAFFE_HOST_ALLOCATOR");
+  if (type == NULL || strcmp(type, "system") == 0) {
+    return new SystemHostAllocator();
+  }
+  const bool use_hugetlb = strcmp(type, "caching_hugetlb") == 0;
+  CHECK(use_hugetlb || strcmp(type, "caching") == 0)
+      << "Unknown CAFFE_HOST_ALLOCATOR " << type;
+  size_t max_cached_bytes = size_t(1) << 31;
+  const char* limit = getenv("CAFFE_HOST_CACHE_MB");
+  if (limit != NULL) {
+    max_cached_bytes = static_cast<size_t>(atoll(limit)) << 20;
+  }
+  LOG(INFO) << "Using " << type << " host allocator, caching up to "
+            << (max_cached_bytes >> 20) << " MB";
+#ifdef PERFORMANCE_MONITORING
+  performance::monitor.RegisterCounter("Host allocations", HostAllocations);
+  performance::monitor.RegisterCounter("Host cache hits", HostCacheHits);
+  performance::monitor.RegisterCounter("Host system allocations",
+                                       HostSystemAllocations);
+  performance::monitor.RegisterCounter("Host peak bytes in use",
+                                       HostPeakBytesInUse);
+  performance::monitor.RegisterCounter("Host bytes cached", HostBytesCached);
+  performance::monitor.RegisterCounter("Host bytes reserved",
+                                       HostBytesReserved);
+#endif
+  return new CachingHostAllocator(max_cached_bytes, use_hugetlb);
+}
+
+}  // namespace
+
+HostAllocator* HostAllocator::Get() {
+  static HostAllocator* const allocator = CreateHostAllocator();
+  return allocator;
+}
+
+void HostAllocator::Set(HostAllocator* allocator) {
+  CHECK(!allocator_in_use)
+      << "The host allocator must be set before the first host allocation";
+  requested_allocator = allocator;
+}
+
+}  // namespace caffe
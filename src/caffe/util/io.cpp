@@ -115,6 +115,58 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   CHECK(proto.SerializeToOstream(&output));
 }
 
+bool ParseDatumView(const void* buffer, size_t size, Datum* datum,
+                    const char** data) {
+  const uint8_t* begin = static_cast<const uint8_t*>(buffer);
+  CodedInputStream input(begin, static_cast<int>(size));
+  datum->Clear();
+  *data = NULL;
+  uint32_t tag, value;
+  while ((tag = input.ReadTag()) != 0) {
+    const int field = tag >> 3;
+    const int wire_type = tag & 7;
+    if (field == Datum::kDataFieldNumber) {
+      // Length-delimited raw pixels: point at them instead of copying.
+      const void* ptr;
+      int available;
+      if (wire_type != 2 || !input.ReadVarint32(&value) ||
+          !input.GetDirectBufferPointer(&ptr, &available) ||
+          available < static_cast<int>(value)) {
+        return false;
+      }
+      *data = static_cast<const char*>(ptr);
+      input.Skip(value);
+      continue;
+    }
+    if (wire_type != 0 || !input.ReadVarint32(&value)) {
+      return false;
+    }
+    switch (field) {
+    case Datum::kChannelsFieldNumber:
+      datum->set_channels(value);
+      break;
+    case Datum::kHeightFieldNumber:
+      datum->set_height(value);
+      break;
+    case Datum::kWidthFieldNumber:
+      datum->set_width(value);
+      break;
+    case Datum::kLabelFieldNumber:
+      datum->set_label(static_cast<int32_t>(value));
+      break;
+    case Datum::kEncodedFieldNumber:
+      if (value) {
+        return false;
+      }
+      break;
+    default:
+      // float_data or an unknown field, leave it to the full parser.
+      return false;
+    }
+  }
+  return *data != NULL && input.CurrentPosition() == static_cast<int>(size);
+}
+
 #ifdef USE_OPENCV
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color) {
@@ -48,6 +48,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <boost/random.hpp>
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 
 #include "caffe/common.hpp"
@@ -55,6 +56,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
 
+#if defined __x86_64__ && defined __GNUC__
+#define CAFFE_CONVERT16_X86
+#include <immintrin.h>
+#endif
+
 namespace caffe {
 
 template<>
@@ -566,4 +572,260 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+static inline uint32_t float_bits(float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+static inline float bits_float(uint32_t bits) {
+  float x;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+uint16_t caffe_float_to_fp16(float x) {
+  const uint32_t f32_infinity = 255u << 23;
+  const uint32_t f16_limit = (127u + 16) << 23;
+  const uint32_t denormal_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+  uint32_t bits = float_bits(x);
+  const uint32_t sign = bits & 0x80000000u;
+  bits ^= sign;
+  uint32_t half;
+  if (bits >= f16_limit) {
+    // Infinity, NaN or too large to represent.
+    half = bits > f32_infinity ? 0x7e00 : 0x7c00;
+  } else if (bits < (113u << 23)) {
+    // Denormal or zero; the addition rounds the mantissa into place.
+    half = float_bits(bits_float(bits) + bits_float(denormal_magic))
+        - denormal_magic;
+  } else {
+    const uint32_t mantissa_odd = (bits >> 13) & 1;
+    bits += ((15u - 127) << 23) + 0xfff + mantissa_odd;
+    half = bits >> 13;
+  }
+  return static_cast<uint16_t>(half | (sign >> 16));
+}
+
+float caffe_fp16_to_float(uint16_t x) {
+  const uint32_t shifted_exponent = 0x7c00u << 13;
+  uint32_t bits = (x & 0x7fffu) << 13;
+  const uint32_t exponent = bits & shifted_exponent;
+  bits += (127u - 15) << 23;
+  if (exponent == shifted_exponent) {
+    bits += (128u - 16) << 23;  // Infinity or NaN.
+  } else if (exponent == 0) {
+    bits += 1u << 23;  // Denormal, renormalized by the subtraction.
+    bits = float_bits(bits_float(bits) - bits_float(113u << 23));
+  }
+  return bits_float(bits | (static_cast<uint32_t>(x & 0x8000u) << 16));
+}
+
+uint16_t caffe_float_to_bf16(float x) {
+  const uint32_t bits = float_bits(x);
+  if ((bits & 0x7fffffffu) > 0x7f800000u) {
+    return static_cast<uint16_t>((bits >> 16) | 0x40);  // Keep NaN quiet.
+  }
+  return static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+float caffe_bf16_to_float(uint16_t x) {
+  return bits_float(static_cast<uint32_t>(x) << 16);
+}
+
+typedef void (*PackFunc)(const int n, const float* x, uint16_t* y);
+typedef void (*UnpackFunc)(const int n, const uint16_t* x, float* y);
+
+static void pack_fp16_scalar(const int n, const float* x, uint16_t* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = caffe_float_to_fp16(x[i]);
+  }
+}
+
+static void unpack_fp16_scalar(const int n, const uint16_t* x, float* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = caffe_fp16_to_float(x[i]);
+  }
+}
+
+static void pack_bf16_scalar(const int n, const float* x, uint16_t* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = caffe_float_to_bf16(x[i]);
+  }
+}
+
+static void unpack_bf16_scalar(const int n, const uint16_t* x, float* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = caffe_bf16_to_float(x[i]);
+  }
+}
+
+#ifdef CAFFE_CONVERT16_X86
+// As with the data transformation kernels, these are compiled for their own
+// instruction set and only selected once cpu::getSupportedIsa() has found it.
+// Every AVX2 processor also implements F16C. The tail of each array goes
+// through the scalar kernel.
+
+__attribute__((target("avx2,f16c")))
+static void pack_fp16_avx2(const int n, const float* x, uint16_t* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i),
+        _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+  pack_fp16_scalar(n - i, x + i, y + i);
+}
+
+__attribute__((target("avx2,f16c")))
+static void unpack_fp16_avx2(const int n, const uint16_t* x, float* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(y + i, _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))));
+  }
+  unpack_fp16_scalar(n - i, x + i, y + i);
+}
+
+__attribute__((target("avx2")))
+static void pack_bf16_avx2(const int n, const float* x, uint16_t* y) {
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i bias = _mm256_set1_epi32(0x7fff);
+  const __m256i abs_mask = _mm256_set1_epi32(0x7fffffff);
+  const __m256i infinity = _mm256_set1_epi32(0x7f800000);
+  const __m256i quiet = _mm256_set1_epi32(0x40);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i bits = _mm256_castps_si256(_mm256_loadu_ps(x + i));
+    const __m256i odd = _mm256_and_si256(_mm256_srli_epi32(bits, 16), one);
+    __m256i rounded = _mm256_srli_epi32(
+        _mm256_add_epi32(bits, _mm256_add_epi32(bias, odd)), 16);
+    const __m256i nan = _mm256_cmpgt_epi32(
+        _mm256_and_si256(bits, abs_mask), infinity);
+    rounded = _mm256_blendv_epi8(rounded,
+        _mm256_or_si256(_mm256_srli_epi32(bits, 16), quiet), nan);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i),
+        _mm_packus_epi32(_mm256_castsi256_si128(rounded),
+                         _mm256_extracti128_si256(rounded, 1)));
+  }
+  pack_bf16_scalar(n - i, x + i, y + i);
+}
+
+__attribute__((target("avx2")))
+static void unpack_bf16_avx2(const int n, const uint16_t* x, float* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i wide = _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+    _mm256_storeu_ps(y + i,
+        _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16)));
+  }
+  unpack_bf16_scalar(n - i, x + i, y + i);
+}
+
+__attribute__((target("avx512f")))
+static void pack_fp16_avx512(const int n, const float* x, uint16_t* y) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i),
+        _mm512_cvtps_ph(_mm512_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+  pack_fp16_avx2(n - i, x + i, y + i);
+}
+
+__attribute__((target("avx512f")))
+static void unpack_fp16_avx512(const int n, const uint16_t* x, float* y) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(y + i, _mm512_cvtph_ps(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i))));
+  }
+  unpack_fp16_avx2(n - i, x + i, y + i);
+}
+
+__attribute__((target("avx512f")))
+static void pack_bf16_avx512(const int n, const float* x, uint16_t* y) {
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i bias = _mm512_set1_epi32(0x7fff);
+  const __m512i abs_mask = _mm512_set1_epi32(0x7fffffff);
+  const __m512i infinity = _mm512_set1_epi32(0x7f800000);
+  const __m512i quiet = _mm512_set1_epi32(0x40);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512i bits = _mm512_castps_si512(_mm512_loadu_ps(x + i));
+    const __m512i odd = _mm512_and_si512(_mm512_srli_epi32(bits, 16), one);
+    __m512i rounded = _mm512_srli_epi32(
+        _mm512_add_epi32(bits, _mm512_add_epi32(bias, odd)), 16);
+    const __mmask16 nan = _mm512_cmpgt_epi32_mask(
+        _mm512_and_si512(bits, abs_mask), infinity);
+    rounded = _mm512_mask_blend_epi32(nan, rounded,
+        _mm512_or_si512(_mm512_srli_epi32(bits, 16), quiet));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i),
+        _mm512_cvtepi32_epi16(rounded));
+  }
+  pack_bf16_avx2(n - i, x + i, y + i);
+}
+
+__attribute__((target("avx512f")))
+static void unpack_bf16_avx512(const int n, const uint16_t* x, float* y) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512i wide = _mm512_cvtepu16_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i)));
+    _mm512_storeu_ps(y + i,
+        _mm512_castsi512_ps(_mm512_slli_epi32(wide, 16)));
+  }
+  unpack_bf16_avx2(n - i, x + i, y + i);
+}
+#endif  // CAFFE_CONVERT16_X86
+
+struct Convert16Kernels {
+  PackFunc pack[3];
+  UnpackFunc unpack[3];
+};
+
+static Convert16Kernels select_convert16_kernels() {
+  Convert16Kernels kernels = {
+    { NULL, pack_fp16_scalar, pack_bf16_scalar },
+    { NULL, unpack_fp16_scalar, unpack_bf16_scalar }
+  };
+#ifdef CAFFE_CONVERT16_X86
+  switch (cpu::getSupportedIsa()) {
+    case cpu::isaAvx512:
+      kernels.pack[FLOAT16] = pack_fp16_avx512;
+      kernels.pack[BFLOAT16] = pack_bf16_avx512;
+      kernels.unpack[FLOAT16] = unpack_fp16_avx512;
+      kernels.unpack[BFLOAT16] = unpack_bf16_avx512;
+      break;
+    case cpu::isaAvx2:
+      kernels.pack[FLOAT16] = pack_fp16_avx2;
+      kernels.pack[BFLOAT16] = pack_bf16_avx2;
+      kernels.unpack[FLOAT16] = unpack_fp16_avx2;
+      kernels.unpack[BFLOAT16] = unpack_bf16_avx2;
+      break;
+    default:
+      break;
+  }
+#endif
+  return kernels;
+}
+
+static const Convert16Kernels& convert16_kernels() {
+  static const Convert16Kernels kernels = select_convert16_kernels();
+  return kernels;
+}
+
+template <>
+void caffe_cpu_pack16<float>(const StorageType type, const int n,
+    const float* x, uint16_t* y) {
+  CHECK(type == FLOAT16 || type == BFLOAT16) << "Not a 16-bit storage type";
+  convert16_kernels().pack[type](n, x, y);
+}
+
+template <>
+void caffe_cpu_unpack16<float>(const StorageType type, const int n,
+    const uint16_t* x, float* y) {
+  CHECK(type == FLOAT16 || type == BFLOAT16) << "Not a 16-bit storage type";
+  convert16_kernels().unpack[type](n, x, y);
+}
+
 }  // namespace caffe
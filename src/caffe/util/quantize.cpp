@@ -0,0 +1,469 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "caffe/util/cpu_info.hpp"
+#include "caffe/util/quantize.hpp"
+
+#ifdef USE_MKL
+#include <mkl_cblas.h>
+#include <mkl_version.h>
+// Integer GEMM appeared in MKL 2018 Update 1.
+#if INTEL_MKL_VERSION >= 20180001
+#define CAFFE_INT8_MKL
+#endif
+#endif
+
+#if defined __x86_64__ && defined __GNUC__
+#define CAFFE_INT8_X86
+#include <immintrin.h>
+#if defined __clang__ || __GNUC__ >= 8
+#define CAFFE_INT8_VNNI
+#endif
+#endif
+
+namespace caffe {
+
+// B is packed into panels of kPanelRows rows. A panel holds, for each group
+// of 4 columns, the 4 int8 values of each of its rows: one 64-byte vector per
+// 4 columns, which is what vpdpbusd multiplies with 4 broadcast uint8 values
+// of A. Rows and columns past the end of B are zero.
+static const int kPanelRows = 16;
+// Rows of A in a tile. A tile keeps kTileRows x kPanelRows int32 sums in
+// registers over all of K and stores them once.
+static const int kTileRows = 4;
+
+static inline size_t panel_size(const int K) {
+  return size_t((K + 3) / 4) * 4 * kPanelRows;
+}
+
+static inline int num_panels(const int N) {
+  return (N + kPanelRows - 1) / kPanelRows;
+}
+
+static void pack_panels(const int N, const int K, const int8_t* B,
+    int8_t* panels) {
+  const size_t size = panel_size(K);
+  for (int p = 0; p < num_panels(N); ++p) {
+    int8_t* panel = panels + p * size;
+    for (int k = 0; k < (K + 3) / 4 * 4; ++k) {
+      for (int j = 0; j < kPanelRows; ++j) {
+        const int n = p * kPanelRows + j;
+        panel[(k / 4) * 4 * kPanelRows + j * 4 + k % 4] =
+            n < N && k < K ? B[n * K + k] : 0;
+      }
+    }
+  }
+}
+
+// The first n <= 4 values of a row of A at a, zero after them.
+static inline int32_t load_a4(const uint8_t* a, const int n = 4) {
+  int32_t a4 = 0;
+  if (n == 4) {
+    memcpy(&a4, a, 4);
+  } else {
+    for (int i = 0; i < n; ++i) {
+      a4 |= static_cast<int32_t>(a[i]) << (8 * i);
+    }
+  }
+  return a4;
+}
+
+// Computes the products of mr <= kTileRows rows of A, K apart, with one
+// panel into tile, kPanelRows int32 per row.
+typedef void (*TileFunc)(const int mr, const int K, const uint8_t* a,
+    const int8_t* panel, int32_t* tile);
+
+static void tile_u8s8_scalar(const int mr, const int K, const uint8_t* a,
+    const int8_t* panel, int32_t* tile) {
+  for (int r = 0; r < mr; ++r) {
+    for (int j = 0; j < kPanelRows; ++j) {
+      int32_t sum = 0;
+      for (int k = 0; k < K; ++k) {
+        sum += static_cast<int32_t>(a[r * K + k]) *
+            panel[(k / 4) * 4 * kPanelRows + j * 4 + k % 4];
+      }
+      tile[r * kPanelRows + j] = sum;
+    }
+  }
+}
+
+#ifdef CAFFE_INT8_X86
+// As the 16-bit conversions in math_functions.cpp, these are compiled for
+// their own instruction set and only selected once the processor is known to
+// implement it. The AVX2 kernel widens both operands to 16 bits: the pairwise
+// sums of vpmaddwd are exact, those of vpmaddubsw could saturate. Each int32
+// of its sums holds half of the 4 products of a row, the halves are added
+// when the tile is stored.
+
+// 4 values of a row of A, widened to 16 bits and repeated over 4 lanes.
+__attribute__((target("avx2")))
+static inline __m256i broadcast_a4_avx2(const int32_t a4) {
+  return _mm256_broadcastq_epi64(_mm_cvtepu8_epi16(_mm_cvtsi32_si128(a4)));
+}
+
+// Adds the products of 4 values of a row of A with those of two quarters of
+// a panel, b_lo and b_hi widened to 16 bits.
+__attribute__((target("avx2")))
+static inline void madd_a4_avx2(const int32_t a4, const __m256i b_lo,
+    const __m256i b_hi, __m256i* sum_lo, __m256i* sum_hi) {
+  const __m256i a = broadcast_a4_avx2(a4);
+  *sum_lo = _mm256_add_epi32(*sum_lo, _mm256_madd_epi16(b_lo, a));
+  *sum_hi = _mm256_add_epi32(*sum_hi, _mm256_madd_epi16(b_hi, a));
+}
+
+// Rows 0, 1, 4, 5 | 2, 3, 6, 7 of the pairwise sums, then in order.
+__attribute__((target("avx2")))
+static inline void store_sums_avx2(const __m256i sum_lo, const __m256i sum_hi,
+    int32_t* tile) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile),
+      _mm256_permute4x64_epi64(_mm256_hadd_epi32(sum_lo, sum_hi), 0xD8));
+}
+
+__attribute__((target("avx2")))
+static void tile_u8s8_avx2(const int mr, const int K, const uint8_t* a,
+    const int8_t* panel, int32_t* tile) {
+  // Missing rows repeat the first one, and are not stored.
+  const uint8_t* a0 = a;
+  const uint8_t* a1 = mr > 1 ? a + K : a;
+  const uint8_t* a2 = mr > 2 ? a + 2 * K : a;
+  const uint8_t* a3 = mr > 3 ? a + 3 * K : a;
+  // One half of the panel at a time, each as rows 0-3 and 4-7.
+  for (int half = 0; half < 2; ++half) {
+    __m256i sum0_lo = _mm256_setzero_si256(), sum0_hi = sum0_lo;
+    __m256i sum1_lo = sum0_lo, sum1_hi = sum0_lo;
+    __m256i sum2_lo = sum0_lo, sum2_hi = sum0_lo;
+    __m256i sum3_lo = sum0_lo, sum3_hi = sum0_lo;
+    for (int k = 0; k < K; k += 4) {
+      const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+          panel + k * kPanelRows + half * 32));
+      const __m256i b_lo = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(b));
+      const __m256i b_hi = _mm256_cvtepi8_epi16(
+          _mm256_extracti128_si256(b, 1));
+      const int n = std::min(4, K - k);
+      madd_a4_avx2(load_a4(a0 + k, n), b_lo, b_hi, &sum0_lo, &sum0_hi);
+      madd_a4_avx2(load_a4(a1 + k, n), b_lo, b_hi, &sum1_lo, &sum1_hi);
+      madd_a4_avx2(load_a4(a2 + k, n), b_lo, b_hi, &sum2_lo, &sum2_hi);
+      madd_a4_avx2(load_a4(a3 + k, n), b_lo, b_hi, &sum3_lo, &sum3_hi);
+    }
+    int32_t* t = tile + half * 8;
+    store_sums_avx2(sum0_lo, sum0_hi, t);
+    store_sums_avx2(sum1_lo, sum1_hi, t + kPanelRows);
+    store_sums_avx2(sum2_lo, sum2_hi, t + 2 * kPanelRows);
+    store_sums_avx2(sum3_lo, sum3_hi, t + 3 * kPanelRows);
+  }
+}
+
+#ifdef CAFFE_INT8_VNNI
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void tile_u8s8_vnni(const int mr, const int K, const uint8_t* a,
+    const int8_t* panel, int32_t* tile) {
+  // Missing rows repeat the first one, and are not stored.
+  const uint8_t* a0 = a;
+  const uint8_t* a1 = mr > 1 ? a + K : a;
+  const uint8_t* a2 = mr > 2 ? a + 2 * K : a;
+  const uint8_t* a3 = mr > 3 ? a + 3 * K : a;
+  __m512i sum0 = _mm512_setzero_si512();
+  __m512i sum1 = _mm512_setzero_si512();
+  __m512i sum2 = _mm512_setzero_si512();
+  __m512i sum3 = _mm512_setzero_si512();
+  int k = 0;
+  for (; k + 4 <= K; k += 4) {
+    const __m512i b = _mm512_loadu_si512(panel + k * kPanelRows);
+    sum0 = _mm512_dpbusd_epi32(sum0, _mm512_set1_epi32(load_a4(a0 + k)), b);
+    sum1 = _mm512_dpbusd_epi32(sum1, _mm512_set1_epi32(load_a4(a1 + k)), b);
+    sum2 = _mm512_dpbusd_epi32(sum2, _mm512_set1_epi32(load_a4(a2 + k)), b);
+    sum3 = _mm512_dpbusd_epi32(sum3, _mm512_set1_epi32(load_a4(a3 + k)), b);
+  }
+  if (k < K) {
+    const __m512i b = _mm512_loadu_si512(panel + k * kPanelRows);
+    const int n = K - k;
+    sum0 = _mm512_dpbusd_epi32(sum0, _mm512_set1_epi32(load_a4(a0 + k, n)), b);
+    sum1 = _mm512_dpbusd_epi32(sum1, _mm512_set1_epi32(load_a4(a1 + k, n)), b);
+    sum2 = _mm512_dpbusd_epi32(sum2, _mm512_set1_epi32(load_a4(a2 + k, n)), b);
+    sum3 = _mm512_dpbusd_epi32(sum3, _mm512_set1_epi32(load_a4(a3 + k, n)), b);
+  }
+  _mm512_storeu_si512(tile, sum0);
+  _mm512_storeu_si512(tile + kPanelRows, sum1);
+  _mm512_storeu_si512(tile + 2 * kPanelRows, sum2);
+  _mm512_storeu_si512(tile + 3 * kPanelRows, sum3);
+}
+#endif  // CAFFE_INT8_VNNI
+#endif  // CAFFE_INT8_X86
+
+static TileFunc select_tile_kernel() {
+#ifdef CAFFE_INT8_X86
+#ifdef CAFFE_INT8_VNNI
+  if (cpu::hasAvx512Vnni()) {
+    return tile_u8s8_vnni;
+  }
+#endif
+  if (cpu::getSupportedIsa() != cpu::isaScalar) {
+    return tile_u8s8_avx2;
+  }
+#endif
+  return tile_u8s8_scalar;
+}
+
+// Computes the M x N products C = A * B' with rows [row_begin, row_begin + N)
+// of B, packed by pack_panels.
+static void gemm_u8s8s32_packed(const int M, const int N, const int K,
+    const uint8_t* A, const int8_t* packed, const int row_begin,
+    int32_t* C) {
+  static const TileFunc tile_func = select_tile_kernel();
+  if (M <= 0 || N <= 0) {
+    return;
+  }
+  // Blocks of about 32 KB of A, each passed over by every panel, so that
+  // both stay in cache. The blocks are spread over the OpenMP threads unless
+  // the caller already runs in a parallel region.
+  const size_t size = panel_size(K);
+  const int first_panel = row_begin / kPanelRows;
+  const int panels = (row_begin + N - 1) / kPanelRows - first_panel + 1;
+  const int block_m = kTileRows * std::min((M + kTileRows - 1) / kTileRows,
+      std::max(1, 32768 / std::max(K, 1) / kTileRows));
+  const int blocks_m = (M + block_m - 1) / block_m;
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static) \
+      if (!omp_in_parallel() && blocks_m * panels > 1)
+#endif
+  for (int t = 0; t < blocks_m * panels; ++t) {
+    const int m_begin = (t / panels) * block_m;
+    const int m_end = std::min(M, m_begin + block_m);
+    const int p = first_panel + t % panels;
+    // The rows of the panel that are in C, and the column of its first row.
+    const int j_begin = std::max(row_begin - p * kPanelRows, 0);
+    const int j_end = std::min(row_begin + N - p * kPanelRows, kPanelRows);
+    const int n_first = p * kPanelRows - row_begin;
+    int32_t tile[kTileRows * kPanelRows];
+    for (int m = m_begin; m < m_end; m += kTileRows) {
+      const int mr = std::min(kTileRows, m_end - m);
+      tile_func(mr, K, A + m * K, packed + p * size, tile);
+      for (int r = 0; r < mr; ++r) {
+        for (int j = j_begin; j < j_end; ++j) {
+          C[(m + r) * N + n_first + j] = tile[r * kPanelRows + j];
+        }
+      }
+    }
+  }
+}
+
+#ifdef CAFFE_INT8_MKL
+// Without VNNI, MKL may saturate the pairwise sums of vpmaddubsw, so its
+// integer GEMM only replaces the kernels above where it is exact.
+static bool use_mkl_gemm_u8s8s32() {
+  static const bool use_mkl = cpu::hasAvx512Vnni();
+  return use_mkl;
+}
+
+// MKL takes the int8 matrix first, so this computes the column-major N x M
+// matrix C' = B * A', which is C in row-major order.
+static void mkl_gemm_u8s8s32(const int M, const int N, const int K,
+    const uint8_t* A, const int8_t* B, int32_t* C) {
+  const MKL_INT32 offset = 0;
+  cblas_gemm_s8u8s32(CblasColMajor, CblasTrans, CblasNoTrans, CblasFixOffset,
+      N, M, K, 1.f, B, K, 0, A, K, 0, 0.f, C, N, &offset);
+}
+#endif  // CAFFE_INT8_MKL
+
+void caffe_cpu_gemm_u8s8s32(const int M, const int N, const int K,
+    const uint8_t* A, const int8_t* B, int32_t* C) {
+#ifdef CAFFE_INT8_MKL
+  if (use_mkl_gemm_u8s8s32()) {
+    mkl_gemm_u8s8s32(M, N, K, A, B, C);
+    return;
+  }
+#endif
+  if (M <= 0 || N <= 0) {
+    return;
+  }
+  CHECK_GT(K, 0);
+  std::vector<int8_t> packed(num_panels(N) * panel_size(K));
+  pack_panels(N, K, B, &packed[0]);
+  gemm_u8s8s32_packed(M, N, K, A, &packed[0], 0, C);
+}
+
+bool QuantizedWeights::Calibrated(const LayerParameter& param) {
+  if (param.quantization_param().input_max() > 0) {
+    return true;
+  }
+  LOG(WARNING) << "Layer " << param.name() << " stays in floating point: "
+               << "its quantization_param has no input_max, see "
+               << "caffe test -calibration_iterations";
+  return false;
+}
+
+QuantizedWeights::QuantizedWeights(const QuantizationParameter& param)
+    : input_scale_(0), input_zero_point_(param.input_signed() ? 128 : 0),
+      groups_(1), rows_(0), cols_(0), group_size_(0) {
+  const float input_max = param.input_max();
+  CHECK_GT(input_max, 0) << "Int8 inputs need the calibrated input_max, "
+                         << "see caffe test -calibration_iterations";
+  input_scale_ = (param.input_signed() ? 127 : 255) / input_max;
+}
+
+template <typename Dtype>
+void QuantizedWeights::Quantize(const int rows, const int cols,
+    const Dtype* weights, bool transposed, const int groups) {
+  CHECK_EQ(rows % groups, 0);
+  groups_ = groups;
+  rows_ = rows;
+  cols_ = cols;
+  data_.resize(rows * cols);
+  scale_.resize(rows);
+  row_sum_.resize(rows);
+  const int row_stride = transposed ? 1 : cols;
+  const int col_stride = transposed ? rows : 1;
+  for (int r = 0; r < rows; ++r) {
+    const Dtype* w = weights + r * row_stride;
+    Dtype max_abs = 0;
+    for (int c = 0; c < cols; ++c) {
+      max_abs = std::max(max_abs,
+          static_cast<Dtype>(std::fabs(w[c * col_stride])));
+    }
+    // The same rounding as PackBlobProto, so that INT8 snapshots come back
+    // unchanged.
+    const Dtype scale = max_abs > 0 ? max_abs / 127 : 1;
+    int32_t sum = 0;
+    for (int c = 0; c < cols; ++c) {
+      const int q = static_cast<int>(
+          std::floor(w[c * col_stride] / scale + Dtype(0.5)));
+      data_[r * cols + c] =
+          static_cast<int8_t>(std::max(-127, std::min(127, q)));
+      sum += data_[r * cols + c];
+    }
+    scale_[r] = scale;
+    row_sum_[r] = sum;
+  }
+#ifdef CAFFE_INT8_MKL
+  if (use_mkl_gemm_u8s8s32()) {
+    return;
+  }
+#endif
+  // Each group is packed on its own, so that its first row starts a panel.
+  const int group_rows = rows / groups;
+  group_size_ = num_panels(group_rows) * panel_size(cols);
+  packed_.resize(groups * group_size_);
+  for (int g = 0; g < groups; ++g) {
+    pack_panels(group_rows, cols, row(g * group_rows),
+        &packed_[g * group_size_]);
+  }
+}
+
+template <typename Dtype>
+void QuantizedWeights::QuantizeInput(const int rows, const int cols,
+    const Dtype* x, bool transpose, uint8_t* y) const {
+  const int row_stride = transpose ? 1 : cols;
+  const int col_stride = transpose ? rows : 1;
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      const int q = static_cast<int>(
+          std::floor(x[r * cols + c] * input_scale_ + Dtype(0.5)))
+          + input_zero_point_;
+      y[r * row_stride + c * col_stride] =
+          static_cast<uint8_t>(std::max(0, std::min(255, q)));
+    }
+  }
+}
+
+void QuantizedWeights::Multiply(const int m, const int first_row,
+    const int n, const uint8_t* x, int32_t* acc) const {
+  CHECK(!empty()) << "Weights not quantized";
+  CHECK_LE(first_row + n, rows_);
+#ifdef CAFFE_INT8_MKL
+  if (use_mkl_gemm_u8s8s32()) {
+    mkl_gemm_u8s8s32(m, n, cols_, x, row(first_row), acc);
+    return;
+  }
+#endif
+  const int group_rows = rows_ / groups_;
+  const int group = first_row / group_rows;
+  CHECK_LE(first_row + n, (group + 1) * group_rows)
+      << "The rows must be in one group";
+  gemm_u8s8s32_packed(m, n, cols_, x, &packed_[group * group_size_],
+      first_row - group * group_rows, acc);
+}
+
+template <typename Dtype>
+void QuantizedWeights::Dequantize(const int m, const int first_row,
+    const int n, const int32_t* acc, bool transpose, Dtype* y) const {
+  if (transpose) {
+    for (int j = 0; j < n; ++j) {
+      const int r = first_row + j;
+      const Dtype factor = scale_[r] / input_scale_;
+      const int32_t offset = input_zero_point_ * row_sum_[r];
+      for (int i = 0; i < m; ++i) {
+        y[j * m + i] = (acc[i * n + j] - offset) * factor;
+      }
+    }
+  } else {
+    for (int i = 0; i < m; ++i) {
+      for (int j = 0; j < n; ++j) {
+        const int r = first_row + j;
+        y[i * n + j] = (acc[i * n + j] - input_zero_point_ * row_sum_[r])
+            * (scale_[r] / input_scale_);
+      }
+    }
+  }
+}
+
+template void QuantizedWeights::Quantize<float>(const int rows,
+    const int cols, const float* weights, bool transposed, const int groups);
+template void QuantizedWeights::Quantize<double>(const int rows,
+    const int cols, const double* weights, bool transposed,
+    const int groups);
+template void QuantizedWeights::QuantizeInput<float>(const int rows,
+    const int cols, const float* x, bool transpose, uint8_t* y) const;
+template void QuantizedWeights::QuantizeInput<double>(const int rows,
+    const int cols, const double* x, bool transpose, uint8_t* y) const;
+template void QuantizedWeights::Dequantize<float>(const int m,
+    const int first_row, const int n, const int32_t* acc, bool transpose,
+    float* y) const;
+template void QuantizedWeights::Dequantize<double>(const int m,
+    const int first_row, const int n, const int32_t* acc, bool transpose,
+    double* y) const;
+
+}  // namespace caffe
@@ -0,0 +1,71 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <algorithm>
+
+#include "boost/thread/tss.hpp"
+
+#include "caffe/util/shared_workspace.hpp"
+
+namespace caffe {
+
+static boost::thread_specific_ptr<SharedWorkspace> thread_workspace_;
+
+SharedWorkspace& SharedWorkspace::Get() {
+  if (!thread_workspace_.get()) {
+    thread_workspace_.reset(new SharedWorkspace());
+  }
+  return *thread_workspace_.get();
+}
+
+void SharedWorkspace::Reserve(size_t size) {
+  reserved_ = std::max(reserved_, size);
+}
+
+void* SharedWorkspace::data(size_t size) {
+  Reserve(size);
+  if (!memory_ || memory_->size() < reserved_) {
+    // Drop the old buffer first so that both never coexist.
+    memory_.reset();
+    memory_.reset(new SyncedMemory(reserved_));
+    DLOG(INFO) << "Shared workspace grown to " << reserved_ << " bytes";
+  }
+  return memory_->mutable_cpu_data();
+}
+
+}  // namespace caffe
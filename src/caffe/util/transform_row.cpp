@@ -0,0 +1,137 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <glog/logging.h>
+
+#include "caffe/util/cpu_info.hpp"
+#include "caffe/util/transform_row.hpp"
+
+#ifdef CAFFE_TRANSFORM_ROW_X86
+#include <immintrin.h>
+#endif
+
+namespace caffe {
+
+void transform_row_scalar(const uint8_t* src, const float* mean,
+    float mean_value, float scale, int width, bool mirror, float* dst) {
+  const int step = mirror ? -1 : 1;
+  float* out = mirror ? dst + width - 1 : dst;
+  for (int w = 0; w < width; ++w, out += step) {
+    const float m = mean ? mean[w] : mean_value;
+    *out = (static_cast<float>(src[w]) - m) * scale;
+  }
+}
+
+#ifdef CAFFE_TRANSFORM_ROW_X86
+// The vector kernels are compiled for their own instruction set only, and
+// are only called once cpu::getSupportedIsa() has found it. Leftover pixels
+// at the end of the row go through the scalar kernel.
+
+__attribute__((target("avx2")))
+void transform_row_avx2(const uint8_t* src, const float* mean,
+    float mean_value, float scale, int width, bool mirror, float* dst) {
+  const __m256 vscale = _mm256_set1_ps(scale);
+  const __m256 vmean_value = _mm256_set1_ps(mean_value);
+  const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  int w = 0;
+  for (; w + 8 <= width; w += 8) {
+    const __m128i bytes =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + w));
+    __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+    v = _mm256_sub_ps(v, mean ? _mm256_loadu_ps(mean + w) : vmean_value);
+    v = _mm256_mul_ps(v, vscale);
+    if (mirror) {
+      _mm256_storeu_ps(dst + width - w - 8, _mm256_permutevar8x32_ps(v,
+          reverse));
+    } else {
+      _mm256_storeu_ps(dst + w, v);
+    }
+  }
+  if (w < width) {
+    transform_row_scalar(src + w, mean ? mean + w : NULL, mean_value, scale,
+        width - w, mirror, mirror ? dst : dst + w);
+  }
+}
+
+__attribute__((target("avx512f")))
+void transform_row_avx512(const uint8_t* src, const float* mean,
+    float mean_value, float scale, int width, bool mirror, float* dst) {
+  const __m512 vscale = _mm512_set1_ps(scale);
+  const __m512 vmean_value = _mm512_set1_ps(mean_value);
+  const __m512i reverse = _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8,
+      7, 6, 5, 4, 3, 2, 1, 0);
+  int w = 0;
+  for (; w + 16 <= width; w += 16) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + w));
+    __m512 v = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes));
+    v = _mm512_sub_ps(v, mean ? _mm512_loadu_ps(mean + w) : vmean_value);
+    v = _mm512_mul_ps(v, vscale);
+    if (mirror) {
+      _mm512_storeu_ps(dst + width - w - 16,
+          _mm512_permutexvar_ps(reverse, v));
+    } else {
+      _mm512_storeu_ps(dst + w, v);
+    }
+  }
+  if (w < width) {
+    transform_row_avx2(src + w, mean ? mean + w : NULL, mean_value, scale,
+        width - w, mirror, mirror ? dst : dst + w);
+  }
+}
+#endif  // CAFFE_TRANSFORM_ROW_X86
+
+static TransformRowFunc select_transform_row() {
+  const cpu::Isa isa = cpu::getSupportedIsa();
+  LOG(INFO) << "Data transformation uses " << cpu::getIsaName(isa)
+            << " kernels";
+#ifdef CAFFE_TRANSFORM_ROW_X86
+  switch (isa) {
+    case cpu::isaAvx512: return transform_row_avx512;
+    case cpu::isaAvx2: return transform_row_avx2;
+    default: break;
+  }
+#endif
+  return transform_row_scalar;
+}
+
+TransformRowFunc transform_row() {
+  static const TransformRowFunc func = select_transform_row();
+  return func;
+}
+
+}  // namespace caffe
@@ -0,0 +1,316 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/winograd.hpp"
+
+namespace caffe {
+
+// The 1D transforms of F(m, 3): input (B^T), filter (G) and output (A^T),
+// reading elements s apart and writing them t apart. The 2D transforms
+// apply them to the columns and then to the rows of a tile.
+template <int M> struct WinogradTransforms;
+
+template <> struct WinogradTransforms<2> {
+  static const int T = 4;
+
+  template <typename Dtype>
+  static inline void input(const Dtype* d, const int s, Dtype* v,
+      const int t) {
+    const Dtype d0 = d[0], d1 = d[s], d2 = d[2 * s], d3 = d[3 * s];
+    v[0] = d0 - d2;
+    v[t] = d1 + d2;
+    v[2 * t] = d2 - d1;
+    v[3 * t] = d1 - d3;
+  }
+
+  template <typename Dtype>
+  static inline void filter(const Dtype* g, const int s, Dtype* u,
+      const int t) {
+    const Dtype g0 = g[0], g1 = g[s], g2 = g[2 * s];
+    u[0] = g0;
+    u[t] = Dtype(0.5) * (g0 + g1 + g2);
+    u[2 * t] = Dtype(0.5) * (g0 - g1 + g2);
+    u[3 * t] = g2;
+  }
+
+  template <typename Dtype>
+  static inline void output(const Dtype* m, const int s, Dtype* y,
+      const int t) {
+    const Dtype m1 = m[s], m2 = m[2 * s];
+    y[0] = m[0] + m1 + m2;
+    y[t] = m1 - m2 - m[3 * s];
+  }
+};
+
+template <> struct WinogradTransforms<4> {
+  static const int T = 6;
+
+  template <typename Dtype>
+  static inline void input(const Dtype* d, const int s, Dtype* v,
+      const int t) {
+    const Dtype d0 = d[0], d1 = d[s], d2 = d[2 * s], d3 = d[3 * s],
+        d4 = d[4 * s], d5 = d[5 * s];
+    const Dtype a = d4 - Dtype(4) * d2, b = d3 - Dtype(4) * d1;
+    const Dtype c = d4 - d2, e = Dtype(2) * (d3 - d1);
+    v[0] = Dtype(4) * d0 - Dtype(5) * d2 + d4;
+    v[t] = a + b;
+    v[2 * t] = a - b;
+    v[3 * t] = c + e;
+    v[4 * t] = c - e;
+    v[5 * t] = Dtype(4) * d1 - Dtype(5) * d3 + d5;
+  }
+
+  template <typename Dtype>
+  static inline void filter(const Dtype* g, const int s, Dtype* u,
+      const int t) {
+    const Dtype g0 = g[0], g1 = g[s], g2 = g[2 * s];
+    u[0] = g0 / Dtype(4);
+    u[t] = -(g0 + g1 + g2) / Dtype(6);
+    u[2 * t] = -(g0 - g1 + g2) / Dtype(6);
+    u[3 * t] = g0 / Dtype(24) + g1 / Dtype(12) + g2 / Dtype(6);
+    u[4 * t] = g0 / Dtype(24) - g1 / Dtype(12) + g2 / Dtype(6);
+    u[5 * t] = g2;
+  }
+
+  template <typename Dtype>
+  static inline void output(const Dtype* m, const int s, Dtype* y,
+      const int t) {
+    const Dtype m1 = m[s], m2 = m[2 * s], m3 = m[3 * s], m4 = m[4 * s];
+    const Dtype a = m1 + m2, b = m1 - m2, c = m3 + m4, e = m3 - m4;
+    y[0] = m[0] + a + c;
+    y[t] = b + Dtype(2) * e;
+    y[2 * t] = a + Dtype(4) * c;
+    y[3 * t] = b + Dtype(8) * e + m[5 * s];
+  }
+};
+
+template <int M, typename Dtype>
+static void winograd_transform_filters(const Dtype* weights,
+    const int num_output, const int channels, const int group,
+    const bool backward, Dtype* transformed) {
+  typedef WinogradTransforms<M> W;
+  const int T = W::T;
+  const int group_out = num_output / group;
+  const int group_in = channels / group;
+  for (int g = 0; g < group; ++g) {
+    for (int k = 0; k < group_out; ++k) {
+      for (int c = 0; c < group_in; ++c) {
+        const Dtype* filter =
+            weights + ((g * group_out + k) * group_in + c) * 9;
+        Dtype flipped[9];
+        if (backward) {
+          for (int i = 0; i < 9; ++i) {
+            flipped[i] = filter[8 - i];
+          }
+          filter = flipped;
+        }
+        // Element e of the transformed filter goes to the matrix of e,
+        // rows k, columns c (backward: rows c, columns k).
+        Dtype* u = transformed + g * T * T * group_out * group_in +
+            (backward ? c * group_out + k : k * group_in + c);
+        const int stride = group_out * group_in;
+        Dtype tmp[T * 3];
+        for (int j = 0; j < 3; ++j) {
+          W::filter(filter + j, 3, tmp + j, 3);
+        }
+        for (int i = 0; i < T; ++i) {
+          W::filter(tmp + i * 3, 1, u + i * T * stride, stride);
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void winograd_transform_filters_cpu(const int m, const Dtype* weights,
+    const int num_output, const int channels, const int group,
+    const bool backward, Dtype* transformed) {
+  switch (m) {
+  case 2:
+    winograd_transform_filters<2>(weights, num_output, channels, group,
+        backward, transformed);
+    break;
+  case 4:
+    winograd_transform_filters<4>(weights, num_output, channels, group,
+        backward, transformed);
+    break;
+  default:
+    LOG(FATAL) << "Unsupported Winograd output tile " << m;
+  }
+}
+
+size_t winograd_workspace_count(const int m, const int channels,
+    const int num_output, const int group, const int out_height,
+    const int out_width) {
+  const size_t tiles = static_cast<size_t>((out_height + m - 1) / m) *
+      ((out_width + m - 1) / m);
+  return static_cast<size_t>(m + 2) * (m + 2) *
+      (channels / group + num_output / group) * tiles;
+}
+
+template <int M, typename Dtype>
+static void winograd_conv(const Dtype* data_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const Dtype* transformed, const int num_output, const int group,
+    Dtype* data_out, Dtype* workspace) {
+  typedef WinogradTransforms<M> W;
+  const int T = W::T;
+  const int out_height = height + 2 * pad_h - 2;
+  const int out_width = width + 2 * pad_w - 2;
+  const int tiles_h = (out_height + M - 1) / M;
+  const int tiles_w = (out_width + M - 1) / M;
+  const int tiles = tiles_h * tiles_w;
+  const int group_in = channels / group;
+  const int group_out = num_output / group;
+  // T * T matrices of group_in x tiles transformed inputs, and of
+  // group_out x tiles products.
+  Dtype* inputs = workspace;
+  Dtype* products = workspace + T * T * group_in * tiles;
+  for (int g = 0; g < group; ++g) {
+    for (int c = 0; c < group_in; ++c) {
+      const Dtype* im = data_im + (g * group_in + c) * height * width;
+      for (int th = 0; th < tiles_h; ++th) {
+        const int y0 = th * M - pad_h;
+        for (int tw = 0; tw < tiles_w; ++tw) {
+          const int x0 = tw * M - pad_w;
+          Dtype tile[T * T];
+          const Dtype* d = tile;
+          int d_stride = T;
+          if (y0 >= 0 && y0 + T <= height && x0 >= 0 && x0 + T <= width) {
+            d = im + y0 * width + x0;
+            d_stride = width;
+          } else {
+            for (int i = 0; i < T; ++i) {
+              for (int j = 0; j < T; ++j) {
+                const int y = y0 + i, x = x0 + j;
+                tile[i * T + j] = (y >= 0 && y < height && x >= 0 &&
+                    x < width) ? im[y * width + x] : Dtype(0);
+              }
+            }
+          }
+          Dtype tmp[T * T];
+          for (int j = 0; j < T; ++j) {
+            W::input(d + j, d_stride, tmp + j, T);
+          }
+          const int stride = group_in * tiles;
+          Dtype* v = inputs + c * tiles + th * tiles_w + tw;
+          for (int i = 0; i < T; ++i) {
+            W::input(tmp + i * T, 1, v + i * T * stride, stride);
+          }
+        }
+      }
+    }
+    for (int e = 0; e < T * T; ++e) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, group_out, tiles,
+          group_in, (Dtype)1.,
+          transformed + (g * T * T + e) * group_out * group_in,
+          inputs + e * group_in * tiles, (Dtype)0.,
+          products + e * group_out * tiles);
+    }
+    for (int k = 0; k < group_out; ++k) {
+      Dtype* out = data_out + (g * group_out + k) * out_height * out_width;
+      for (int th = 0; th < tiles_h; ++th) {
+        const int rows = std::min(M, out_height - th * M);
+        for (int tw = 0; tw < tiles_w; ++tw) {
+          const int cols = std::min(M, out_width - tw * M);
+          const int stride = group_out * tiles;
+          const Dtype* p = products + k * tiles + th * tiles_w + tw;
+          Dtype tmp[M * T];
+          for (int j = 0; j < T; ++j) {
+            W::output(p + j * stride, T * stride, tmp + j, T);
+          }
+          Dtype* y = out + th * M * out_width + tw * M;
+          if (rows == M && cols == M) {
+            for (int i = 0; i < M; ++i) {
+              W::output(tmp + i * T, 1, y + i * out_width, 1);
+            }
+          } else {
+            Dtype tile[M * M];
+            for (int i = 0; i < M; ++i) {
+              W::output(tmp + i * T, 1, tile + i * M, 1);
+            }
+            for (int i = 0; i < rows; ++i) {
+              for (int j = 0; j < cols; ++j) {
+                y[i * out_width + j] = tile[i * M + j];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void winograd_conv_cpu(const int m, const Dtype* data_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const Dtype* transformed, const int num_output, const int group,
+    Dtype* data_out, Dtype* workspace) {
+  switch (m) {
+  case 2:
+    winograd_conv<2>(data_im, channels, height, width, pad_h, pad_w,
+        transformed, num_output, group, data_out, workspace);
+    break;
+  case 4:
+    winograd_conv<4>(data_im, channels, height, width, pad_h, pad_w,
+        transformed, num_output, group, data_out, workspace);
+    break;
+  default:
+    LOG(FATAL) << "Unsupported Winograd output tile " << m;
+  }
+}
+
+// Explicit instantiation
+template void winograd_transform_filters_cpu<float>(const int m,
+    const float* weights, const int num_output, const int channels,
+    const int group, const bool backward, float* transformed);
+template void winograd_transform_filters_cpu<double>(const int m,
+    const double* weights, const int num_output, const int channels,
+    const int group, const bool backward, double* transformed);
+template void winograd_conv_cpu<float>(const int m, const float* data_im,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, const float* transformed, const int num_output,
+    const int group, float* data_out, float* workspace);
+template void winograd_conv_cpu<double>(const int m, const double* data_im,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, const double* transformed, const int num_output,
+    const int group, double* data_out, double* workspace);
+
+}  // namespace caffe
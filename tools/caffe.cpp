@@ -45,6 +45,7 @@ namespace bp = boost::python;
 
 #include <cstring>
 #include <map>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -68,6 +69,7 @@ namespace bp = boost::python;
 
 using caffe::Blob;
 using caffe::Caffe;
+using caffe::ConversionLedger;
 using caffe::Net;
 using caffe::Layer;
 using caffe::Solver;
@@ -109,6 +111,9 @@ DEFINE_bool(forward_only, false,
     "Optional; Execute only forward pass");
 DEFINE_string(engine, "",
     "Optional; Engine sequence in format: engine:subengine_1,subengine_2,...");
+DEFINE_string(conversion_plan, "",
+    "Optional; the time command records the layout conversions between "
+    "engines and writes the model with layers moved to avoid them here.");
 DEFINE_string(collect_dir, "collect_out",
     "Optional; Directory with reference binary files");
 DEFINE_string(compare_output_dir, "compare_out",
@@ -117,6 +122,22 @@ DEFINE_double(epsilon, 1e-3, "Optional; Layer output comparison error");
 DEFINE_bool(detection, false,
     "Optional; Enables detection for testing. "
     "By default it is false and classification is on.");
+DEFINE_int32(calibration_iterations, 0,
+    "Optional; the test command calibrates int8 inference of the "
+    "Convolution and InnerProduct layers over this many batches, then scores "
+    "the quantized net against the float one.");
+DEFINE_string(quantized_model, "",
+    "Optional; where the calibrating test command writes the model with the "
+    "quantization parameters.");
+DEFINE_string(quantized_weights, "",
+    "Optional; where the calibrating test command writes the weights, the "
+    "quantized ones in int8.");
+DEFINE_string(folded_model, "",
+    "The model definition the fold command writes, with the BatchNorm, Scale "
+    "and ReLU layers folded into the layers before them.");
+DEFINE_string(folded_weights, "",
+    "The weights the fold command writes for the folded model, in HDF5 if "
+    "the name ends in .h5.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -442,6 +463,125 @@ int test_detection(Net<float>& caffe_net) {
   return 0;
 }
 
+// Adds the elements of the outputs of a net to scores.
+static void accumulate_scores(const vector<Blob<float>*>& result,
+    vector<float>* scores) {
+  int idx = 0;
+  for (int j = 0; j < result.size(); ++j) {
+    const float* result_vec = result[j]->cpu_data();
+    for (int k = 0; k < result[j]->count(); ++k, ++idx) {
+      if (idx == scores->size()) {
+        scores->push_back(0);
+      }
+      (*scores)[idx] += result_vec[k];
+    }
+  }
+}
+
+// Calibrates int8 inference on the fp32 net, then runs the float and the
+// quantized net on the same batches and reports how the scores differ.
+int test_quantized(Net<float>& caffe_net) {
+  CHECK(Caffe::mode() == Caffe::CPU) << "Int8 inference only runs on the CPU";
+  caffe::NetParameter quantized;
+  caffe_net.ToProto(&quantized);
+  LOG(INFO) << "Calibrating for " << FLAGS_calibration_iterations
+            << " iterations.";
+  const int calibrated = caffe_net.CalibrateQuantization(
+      FLAGS_calibration_iterations, &quantized);
+  LOG(INFO) << "Calibrated " << calibrated << " layers.";
+  if (calibrated == 0) {
+    LOG(WARNING) << "Only Convolution and InnerProduct layers of the CAFFE "
+                 << "engine run in int8, see -engine";
+  }
+  caffe::NetParameter model;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &model);
+  std::map<string, caffe::QuantizationParameter> quantization_params;
+  for (int i = 0; i < quantized.layer_size(); ++i) {
+    caffe::LayerParameter* layer = quantized.mutable_layer(i);
+    // Layers were already filtered for the net state.
+    layer->clear_include();
+    layer->clear_exclude();
+    if (layer->has_quantization_param()) {
+      quantization_params[layer->name()] = layer->quantization_param();
+      caffe::PackBlobProto(caffe::INT8, layer->mutable_blobs(0));
+    }
+  }
+  for (int i = 0; i < model.layer_size(); ++i) {
+    if (quantization_params.count(model.layer(i).name())) {
+      model.mutable_layer(i)->mutable_quantization_param()->CopyFrom(
+          quantization_params[model.layer(i).name()]);
+    }
+  }
+  if (FLAGS_quantized_model.size()) {
+    caffe::WriteProtoToTextFile(model, FLAGS_quantized_model);
+    LOG(INFO) << "Wrote " << FLAGS_quantized_model;
+  }
+  if (FLAGS_quantized_weights.size()) {
+    caffe::WriteProtoToBinaryFile(quantized, FLAGS_quantized_weights);
+    LOG(INFO) << "Wrote " << FLAGS_quantized_weights;
+  }
+
+  // The quantized net is fed by the float one: its leading layers without
+  // bottoms, the data layers, become Input layers of the same shapes.
+  vector<string> input_names;
+  int num_inputs = 0;
+  for (; num_inputs < quantized.layer_size() &&
+       quantized.layer(num_inputs).bottom_size() == 0; ++num_inputs) {
+    caffe::LayerParameter input;
+    input.set_name(quantized.layer(num_inputs).name());
+    input.set_type("Input");
+    for (int j = 0; j < quantized.layer(num_inputs).top_size(); ++j) {
+      const string& top = quantized.layer(num_inputs).top(j);
+      input.add_top(top);
+      caffe::BlobShape* shape = input.mutable_input_param()->add_shape();
+      const vector<int>& dims = caffe_net.blob_by_name(top)->shape();
+      for (int k = 0; k < dims.size(); ++k) {
+        shape->add_dim(dims[k]);
+      }
+      input_names.push_back(top);
+    }
+    quantized.mutable_layer(num_inputs)->CopyFrom(input);
+  }
+  CHECK_GT(num_inputs, 0) << "The model has no data layers";
+  if (FLAGS_engine.size()) {
+    quantized.set_engine(FLAGS_engine);
+  }
+  Net<float> quantized_net(quantized);
+
+  vector<float> test_score, quantized_score;
+  float loss = 0, quantized_loss = 0;
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    loss += caffe_net.ForwardTo(num_inputs - 1);
+    for (int j = 0; j < input_names.size(); ++j) {
+      quantized_net.blob_by_name(input_names[j])->CopyFrom(
+          *caffe_net.blob_by_name(input_names[j]), false, true);
+    }
+    loss += caffe_net.ForwardFrom(num_inputs);
+    float iter_loss;
+    quantized_net.Forward(&iter_loss);
+    quantized_loss += iter_loss;
+    accumulate_scores(caffe_net.output_blobs(), &test_score);
+    accumulate_scores(quantized_net.output_blobs(), &quantized_score);
+  }
+  loss /= FLAGS_iterations;
+  quantized_loss /= FLAGS_iterations;
+  LOG(INFO) << "Loss: " << loss << " (int8 " << quantized_loss << ", delta "
+            << quantized_loss - loss << ")";
+  int idx = 0;
+  for (int j = 0; j < caffe_net.output_blobs().size(); ++j) {
+    const std::string& output_name = caffe_net.blob_names()[
+        caffe_net.output_blob_indices()[j]];
+    for (int k = 0; k < caffe_net.output_blobs()[j]->count(); ++k, ++idx) {
+      const float mean_score = test_score[idx] / FLAGS_iterations;
+      const float quantized_mean = quantized_score[idx] / FLAGS_iterations;
+      LOG(INFO) << output_name << " = " << mean_score << " (int8 "
+                << quantized_mean << ", delta " << quantized_mean - mean_score
+                << ")";
+    }
+  }
+  return 0;
+}
+
 // Test: score a model.
 int test() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to score.";
@@ -474,6 +614,9 @@ int test() {
     test_detection(caffe_net);
     return 0;
   }
+  if (FLAGS_calibration_iterations > 0) {
+    return test_quantized(caffe_net);
+  }
 
   vector<int> test_score_output_id;
   vector<float> test_score;
@@ -520,6 +663,92 @@ int test() {
 }
 RegisterBrewFunction(test);
 
+// Fold: fold the BatchNorm, Scale and ReLU or PReLU layers of a model for
+// inference into the Convolution and InnerProduct layers before them, see
+// NetParameter.fold_inference, and write the folded model and weights.
+int fold() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to fold.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to fold.";
+  CHECK_GT(FLAGS_folded_model.size(), 0) << "Need a folded model to write.";
+  CHECK_GT(FLAGS_folded_weights.size(), 0)
+      << "Need folded weights to write.";
+  vector<string> stages = get_stages_from_flags(FLAGS_stage);
+  Caffe::set_mode(Caffe::CPU);
+
+  caffe::NetParameter model;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &model);
+  caffe::NetParameter param(model);
+  param.set_fold_inference(true);
+  param.mutable_state()->set_phase(caffe::TEST);
+  param.mutable_state()->set_level(FLAGS_level);
+  for (int i = 0; i < stages.size(); ++i) {
+    param.mutable_state()->add_stage(stages[i]);
+  }
+  if (FLAGS_engine.size()) {
+    param.set_engine(FLAGS_engine);
+  }
+  Net<float> caffe_net(param);
+  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+
+  // Apply the folding to the model as written, keeping its other layers
+  // (and their include rules) and the layers that were not folded.
+  std::map<string, const caffe::LayerParameter*> folding;
+  std::set<string> folded;
+  for (int i = 0; i < caffe_net.layers().size(); ++i) {
+    const caffe::LayerParameter& layer = caffe_net.layers()[i]->layer_param();
+    if (layer.folded_layer_size()) {
+      folding[layer.name()] = &layer;
+      for (int j = 0; j < layer.folded_layer_size(); ++j) {
+        folded.insert(layer.folded_layer(j).name());
+      }
+    }
+  }
+  caffe::NetParameter folded_model(model);
+  folded_model.clear_layer();
+  for (int i = 0; i < model.layer_size(); ++i) {
+    const caffe::LayerParameter& layer = model.layer(i);
+    if (folded.count(layer.name())) {
+      continue;
+    }
+    caffe::LayerParameter* folded_layer = folded_model.add_layer();
+    folded_layer->CopyFrom(layer);
+    std::map<string, const caffe::LayerParameter*>::const_iterator it =
+        folding.find(layer.name());
+    if (it != folding.end()) {
+      const caffe::LayerParameter& net_layer = *it->second;
+      folded_layer->set_top(0, net_layer.folded_layer(
+          net_layer.folded_layer_size() - 1).top(0));
+      if (net_layer.has_convolution_param()) {
+        folded_layer->mutable_convolution_param()->CopyFrom(
+            net_layer.convolution_param());
+      }
+      if (net_layer.has_inner_product_param()) {
+        folded_layer->mutable_inner_product_param()->CopyFrom(
+            net_layer.inner_product_param());
+      }
+    }
+  }
+  caffe::WriteProtoToTextFile(folded_model, FLAGS_folded_model);
+  LOG(INFO) << "Folded " << folded.size() << " layers into "
+            << folding.size() << ", wrote " << FLAGS_folded_model;
+
+  const string& weights = FLAGS_folded_weights;
+  if (weights.size() >= 3 &&
+      weights.compare(weights.size() - 3, 3, ".h5") == 0) {
+    caffe_net.ToHDF5(weights);
+  } else {
+    caffe::NetParameter folded_weights;
+    caffe_net.ToProto(&folded_weights);
+    for (int i = 0; i < folded_weights.layer_size(); ++i) {
+      folded_weights.mutable_layer(i)->clear_folded_layer();
+    }
+    caffe::WriteProtoToBinaryFile(folded_weights, weights);
+  }
+  LOG(INFO) << "Wrote " << weights;
+  return 0;
+}
+RegisterBrewFunction(fold);
+
 
 // Time: benchmark the execution time of a model.
 int time() {
@@ -538,6 +767,9 @@ int time() {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
   }
+  if (FLAGS_conversion_plan.size()) {
+    ConversionLedger::set_enabled(true);
+  }
   // Instantiate the caffe net.
   Net<float> caffe_net(FLAGS_model, phase, FLAGS_level, &stages, NULL,
                        FLAGS_engine);
@@ -560,6 +792,7 @@ int time() {
   const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
   const vector<vector<bool> >& bottom_need_backward =
       caffe_net.bottom_need_backward();
+  ConversionLedger::Get()->Clear();
   LOG(INFO) << "*** Benchmark begins ***";
   LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
   Timer total_timer;
@@ -577,6 +810,7 @@ int time() {
     forward_timer.Start();
     for (int i = 0; i < layers.size(); ++i) {
       timer.Start();
+      ConversionLedger::set_layer(&layers[i]->layer_param().name(), false);
       layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
       forward_time_per_layer[i] += timer.MicroSeconds();
     }
@@ -585,6 +819,7 @@ int time() {
       backward_timer.Start();
       for (int i = layers.size() - 1; i >= 0; --i) {
         timer.Start();
+        ConversionLedger::set_layer(&layers[i]->layer_param().name(), true);
         layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
                             bottom_vecs[i]);
         backward_time_per_layer[i] += timer.MicroSeconds();
@@ -596,7 +831,9 @@ int time() {
       LOG(INFO) << "Iteration: " << j + 1 << " forward time: "
         << iter_timer.MilliSeconds() << " ms.";
     }
+    ConversionLedger::Get()->EndIteration();
   }
+  ConversionLedger::set_layer(NULL, false);
   LOG(INFO) << "Average time per layer: ";
   for (int i = 0; i < layers.size(); ++i) {
     const caffe::string& layername = layers[i]->layer_param().name();
@@ -620,6 +857,31 @@ int time() {
   }
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
   LOG(INFO) << "*** Benchmark ends ***";
+  if (FLAGS_conversion_plan.size()) {
+    ConversionLedger::Get()->Log();
+    caffe::NetParameter model, planned;
+    caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &model);
+    const bool has_state = model.has_state();
+    const caffe::NetState state = model.state();
+    model.mutable_state()->set_phase(phase);
+    for (int i = 0; i < stages.size(); ++i) {
+      model.mutable_state()->add_stage(stages[i]);
+    }
+    model.mutable_state()->set_level(FLAGS_level);
+    if (FLAGS_engine.size()) {
+      model.set_engine(FLAGS_engine);
+    }
+    const int moved = Net<float>::PlanEngines(model,
+        ConversionLedger::Get()->entries(), &planned);
+    if (has_state) {
+      planned.mutable_state()->CopyFrom(state);
+    } else {
+      planned.clear_state();
+    }
+    caffe::WriteProtoToTextFile(planned, FLAGS_conversion_plan);
+    LOG(INFO) << "Moved " << moved << " layers, wrote "
+              << FLAGS_conversion_plan;
+  }
   return 0;
 }
 RegisterBrewFunction(time);
@@ -888,6 +1150,7 @@ int main(int argc, char** argv) {
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
       "  time            benchmark model execution time\n"
+      "  fold            fold BatchNorm, Scale and ReLU layers for inference\n"
       "  collect         collects layer data on specified device\n"
       "  compare         collects layer data using inputs from other device");
   // Run tool or show usage.
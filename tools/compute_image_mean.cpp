@@ -35,8 +35,12 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <stdint.h>
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
@@ -56,7 +60,54 @@ using std::pair;
 using boost::scoped_ptr;
 
 DEFINE_string(backend, "lmdb",
-        "The backend {leveldb, lmdb} containing the images");
+        "The backend {leveldb, lmdb, packed} containing the images");
+DEFINE_int32(threads, 0,
+        "Number of threads reading the DB, 0 for the OpenMP default");
+DEFINE_int32(sample, 0,
+        "Only use that many records, evenly spread over the DB, 0 for all");
+
+// Records used per block. Threads take blocks, each through its own cursor.
+const int kBlockSize = 1024;
+
+// The k-th of num_used records spread evenly over num_records.
+inline size_t SampledIndex(size_t k, size_t num_records, size_t num_used) {
+  return static_cast<uint64_t>(k) * num_records / num_used;
+}
+
+// Sums of one thread, in double precision so that they stay exact.
+struct Sums {
+  Sums(int data_size, int channels)
+      : data(data_size, 0.), channel_squares(channels, 0.), count(0) {}
+  vector<double> data;
+  vector<double> channel_squares;
+  int count;
+};
+
+// Adds the values given by value to sums, with dim values per channel.
+template <typename Getter>
+void Accumulate(const Getter& value, int dim, Sums* sums) {
+  for (int c = 0; c < sums->channel_squares.size(); ++c) {
+    double squares = 0.;
+    for (int i = dim * c; i < dim * (c + 1); ++i) {
+      const double x = value(i);
+      sums->data[i] += x;
+      squares += x * x;
+    }
+    sums->channel_squares[c] += squares;
+  }
+}
+
+struct PixelValue {
+  explicit PixelValue(const string& data) : data(data) {}
+  double operator()(int i) const { return (uint8_t)data[i]; }
+  const string& data;
+};
+
+struct FloatValue {
+  explicit FloatValue(const Datum& datum) : datum(datum) {}
+  double operator()(int i) const { return datum.float_data(i); }
+  const Datum& datum;
+};
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
@@ -83,7 +134,6 @@ int main(int argc, char** argv) {
   scoped_ptr<db::Cursor> cursor(db->NewCursor());
 
   BlobProto sum_blob;
-  int count = 0;
   // load first datum
   Datum datum;
   datum.ParseFromString(cursor->value());
@@ -97,66 +147,136 @@ int main(int argc, char** argv) {
   sum_blob.set_height(datum.height());
   sum_blob.set_width(datum.width());
   const int data_size = datum.channels() * datum.height() * datum.width();
-  int size_in_datum = std::max<int>(datum.data().size(),
-                                    datum.float_data_size());
-  for (int i = 0; i < size_in_datum; ++i) {
-    sum_blob.add_data(0.);
+  const int channels = sum_blob.channels();
+  const int dim = sum_blob.height() * sum_blob.width();
+
+  size_t num_records = 0;
+  if (!db->Count(&num_records)) {
+    for (; cursor->valid(); cursor->Next()) {
+      ++num_records;
+    }
+  }
+  const size_t num_used = FLAGS_sample > 0 ?
+      std::min<size_t>(FLAGS_sample, num_records) : num_records;
+  LOG(INFO) << "Using " << num_used << " of " << num_records << " records";
+  const int num_blocks = (num_used + kBlockSize - 1) / kBlockSize;
+  // Backends that cannot seek to a record by its index are walked for the
+  // key of the first record of every block. Walking the keys is cheap next
+  // to parsing and decoding the values, which are only read when used.
+  const bool seek_to_index = cursor->SeekToIndex(0);
+  vector<string> block_keys;
+  if (!seek_to_index) {
+    cursor->SeekToFirst();
+    for (size_t index = 0; block_keys.size() < static_cast<size_t>(num_blocks);
+         ++index, cursor->Next()) {
+      CHECK(cursor->valid());
+      if (index == SampledIndex(block_keys.size() * kBlockSize, num_records,
+                                num_used)) {
+        block_keys.push_back(cursor->key());
+      }
+    }
+  }
+
+#ifdef _OPENMP
+  if (FLAGS_threads > 0) {
+    omp_set_num_threads(FLAGS_threads);
   }
+#endif
+  Sums total(data_size, channels);
   LOG(INFO) << "Starting Iteration";
-  while (cursor->valid()) {
-    Datum datum;
-    datum.ParseFromString(cursor->value());
-    DecodeDatumNative(&datum);
-
-    const std::string& data = datum.data();
-    size_in_datum = std::max<int>(datum.data().size(),
-        datum.float_data_size());
-    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
-        size_in_datum;
-    if (data.size() != 0) {
-      CHECK_EQ(data.size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) + (uint8_t)data[i]);
+#ifdef _OPENMP
+  #pragma omp parallel
+#endif
+  {
+    Sums sums(data_size, channels);
+    scoped_ptr<db::Cursor> block_cursor;
+    // Opening a cursor is not thread-safe for every backend.
+#ifdef _OPENMP
+    #pragma omp critical
+#endif
+    block_cursor.reset(db->NewCursor());
+#ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+#endif
+    for (int block = 0; block < num_blocks; ++block) {
+      const size_t begin = static_cast<size_t>(block) * kBlockSize;
+      const size_t end = std::min<size_t>(begin + kBlockSize, num_used);
+      size_t index = SampledIndex(begin, num_records, num_used);
+      if (!seek_to_index) {
+        block_cursor->Seek(block_keys[block]);
       }
-    } else {
-      CHECK_EQ(datum.float_data_size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) +
-            static_cast<float>(datum.float_data(i)));
+      for (size_t k = begin; k < end; ++k) {
+        const size_t used_index = SampledIndex(k, num_records, num_used);
+        if (seek_to_index) {
+          block_cursor->SeekToIndex(used_index);
+        } else {
+          for (; index < used_index; ++index) {
+            block_cursor->Next();
+          }
+        }
+        CHECK(block_cursor->valid());
+        Datum datum;
+        datum.ParseFromString(block_cursor->value());
+        DecodeDatumNative(&datum);
+
+        const std::string& data = datum.data();
+        const int size_in_datum = std::max<int>(datum.data().size(),
+            datum.float_data_size());
+        CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
+            size_in_datum;
+        if (data.size() != 0) {
+          CHECK_EQ(data.size(), size_in_datum);
+          Accumulate(PixelValue(data), dim, &sums);
+        } else {
+          CHECK_EQ(datum.float_data_size(), size_in_datum);
+          Accumulate(FloatValue(datum), dim, &sums);
+        }
+        ++sums.count;
       }
     }
-    ++count;
-    if (count % 10000 == 0) {
-      LOG(INFO) << "Processed " << count << " files.";
+#ifdef _OPENMP
+    #pragma omp critical
+#endif
+    {
+      for (int i = 0; i < data_size; ++i) {
+        total.data[i] += sums.data[i];
+      }
+      for (int c = 0; c < channels; ++c) {
+        total.channel_squares[c] += sums.channel_squares[c];
+      }
+      total.count += sums.count;
+      LOG(INFO) << "Processed " << total.count << " files.";
     }
-    cursor->Next();
-  }
-
-  if (count % 10000 != 0) {
-    LOG(INFO) << "Processed " << count << " files.";
   }
+  const int count = total.count;
 
   if (count == 0) {
     LOG(FATAL) << "Division by zero 'count' value possible.";
   }
 
-  for (int i = 0; i < sum_blob.data_size(); ++i) {
-    sum_blob.set_data(i, sum_blob.data(i) / count);
+  for (int i = 0; i < data_size; ++i) {
+    sum_blob.add_data(total.data[i] / count);
   }
   // Write to disk
   if (argc == 3) {
     LOG(INFO) << "Write to " << argv[2];
     WriteProtoToBinaryFile(sum_blob, argv[2]);
   }
-  const int channels = sum_blob.channels();
-  const int dim = sum_blob.height() * sum_blob.width();
-  std::vector<float> mean_values(channels, 0.0);
+  std::vector<double> mean_values(channels, 0.0);
   LOG(INFO) << "Number of channels: " << channels;
   for (int c = 0; c < channels; ++c) {
     for (int i = 0; i < dim; ++i) {
-      mean_values[c] += sum_blob.data(dim * c + i);
+      mean_values[c] += total.data[dim * c + i];
     }
-    LOG(INFO) << "mean_value channel [" << c << "]:" << mean_values[c] / dim;
+    mean_values[c] /= static_cast<double>(count) * dim;
+    LOG(INFO) << "mean_value channel [" << c << "]:" << mean_values[c];
+  }
+  for (int c = 0; c < channels; ++c) {
+    const double mean_square =
+        total.channel_squares[c] / (static_cast<double>(count) * dim);
+    const double variance =
+        std::max(mean_square - mean_values[c] * mean_values[c], 0.);
+    LOG(INFO) << "std_value channel [" << c << "]:" << std::sqrt(variance);
   }
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
@@ -49,6 +49,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // For detection task, the file should be in the format as
 //   imgfolder1/img1.JPEG annofolder1/anno1.xml
 //   ....
+//
+// Images and annotations are read by a pool of threads, one chunk of the list
+// at a time, while a single writer thread stores the previous chunk in list
+// order. The result is the same as when converting one image at a time.
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
@@ -58,11 +66,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 
 #include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 #include "boost/variant.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/convert_writer.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
@@ -77,7 +87,7 @@ DEFINE_bool(gray, false,
 DEFINE_bool(shuffle, false,
     "Randomly shuffle the order of images and their labels");
 DEFINE_string(backend, "lmdb",
-    "The backend {lmdb, leveldb} for storing the result");
+    "The backend {lmdb, leveldb, packed} for storing the result");
 DEFINE_string(anno_type, "classification",
     "The type of annotation {classification, detection}.");
 DEFINE_string(label_type, "xml",
@@ -98,6 +108,11 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_int32(threads, 0,
+    "Number of threads reading images, 0 for the OpenMP default");
+
+// Images read per chunk, and stored per DB transaction.
+const int kChunkSize = 1000;
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -170,74 +185,78 @@ int main(int argc, char** argv) {
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   CHECK_NOTNULL(db.get());
   db->Open(argv[3], db::NEW);
-  scoped_ptr<db::Transaction> txn(db->NewTransaction());
 
   // Storing to db
   std::string root_folder(argv[1]);
-  AnnotatedDatum anno_datum;
-  Datum* datum = anno_datum.mutable_datum();
-  int count = 0;
-  int data_size = 0;
-  bool data_size_initialized = false;
-
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status = true;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
-    }
-    filename = root_folder + lines[line_id].first;
-    if (anno_type == "classification") {
-      label = boost::get<int>(lines[line_id].second);
-      status = ReadImageToDatum(filename, label, resize_height, resize_width,
-          is_color, enc, datum);
-    } else if (anno_type == "detection") {
-      labelname = root_folder + boost::get<std::string>(lines[line_id].second);
-      status = ReadRichImageToAnnotatedDatum(filename, labelname, resize_height,
-          resize_width, min_dim, max_dim, is_color, enc, type, label_type,
-          name_to_label, &anno_datum);
-      anno_datum.set_type(AnnotatedDatum_AnnotationType_BBOX);
-    }
-    if (status == false) {
-      LOG(WARNING) << "Failed to read " << lines[line_id].first;
-      continue;
-    }
-    if (check_size) {
-      if (!data_size_initialized) {
-        data_size = datum->channels() * datum->height() * datum->width();
-        data_size_initialized = true;
-      } else {
-        const std::string& data = datum->data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-            << data.size();
+#ifdef _OPENMP
+  if (FLAGS_threads > 0) {
+    omp_set_num_threads(FLAGS_threads);
+  }
+#endif
+  ConvertWriter writer(db.get(), true, check_size, kChunkSize);
+  // Chunks are read into one buffer while the other one is written.
+  vector<ConvertEntry> chunks[2];
+  boost::thread writer_thread;
+
+  for (int chunk_begin = 0; chunk_begin < lines.size();
+       chunk_begin += kChunkSize) {
+    const int chunk_end = std::min<int>(chunk_begin + kChunkSize, lines.size());
+    vector<ConvertEntry>& chunk = chunks[(chunk_begin / kChunkSize) % 2];
+    chunk.resize(chunk_end - chunk_begin);
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (int line_id = chunk_begin; line_id < chunk_end; ++line_id) {
+      ConvertEntry& entry = chunk[line_id - chunk_begin];
+      AnnotatedDatum anno_datum;
+      Datum* datum = anno_datum.mutable_datum();
+      entry.status = true;
+      std::string enc = encode_type;
+      if (encoded && !enc.size()) {
+        // Guess the encoding type from the file name
+        string fn = lines[line_id].first;
+        size_t p = fn.rfind('.');
+        if ( p == fn.npos )
+          LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+        enc = fn.substr(p);
+        std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+      }
+      const string filename = root_folder + lines[line_id].first;
+      if (anno_type == "classification") {
+        const int label = boost::get<int>(lines[line_id].second);
+        entry.status = ReadImageToDatum(filename, label, resize_height,
+            resize_width, is_color, enc, datum);
+      } else if (anno_type == "detection") {
+        const string labelname =
+            root_folder + boost::get<std::string>(lines[line_id].second);
+        entry.status = ReadRichImageToAnnotatedDatum(filename, labelname,
+            resize_height, resize_width, min_dim, max_dim, is_color, enc, type,
+            label_type, name_to_label, &anno_datum);
+        anno_datum.set_type(AnnotatedDatum_AnnotationType_BBOX);
+      }
+      entry.has_shape = datum->has_channels();
+      entry.channels = datum->channels();
+      entry.height = datum->height();
+      entry.width = datum->width();
+      if (entry.status == false) {
+        // Reported by the writer, in list order.
+        entry.key = lines[line_id].first;
+        continue;
       }
+      entry.data_size = datum->data().size();
+      // sequential
+      entry.key = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
+      CHECK(anno_datum.SerializeToString(&entry.value));
     }
-    // sequential
-    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
-
-    // Put in db
-    string out;
-    CHECK(anno_datum.SerializeToString(&out));
-    txn->Put(key_str, out);
-
-    if (++count % 1000 == 0) {
-      // Commit db
-      txn->Commit();
-      txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
+    if (writer_thread.joinable()) {
+      writer_thread.join();
     }
+    writer_thread = boost::thread(&ConvertWriter::Write, &writer, &chunk);
   }
-  // write the last batch
-  if (count % 1000 != 0) {
-    txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
+  if (writer_thread.joinable()) {
+    writer_thread.join();
   }
+  writer.Finish();
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
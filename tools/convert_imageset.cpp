@@ -44,6 +44,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // should be a list of files as well as their labels, in the format as
 //   subfolder1/file1.JPEG 7
 //   ....
+//
+// Images are read, decoded and resized by a pool of threads, one chunk of the
+// list at a time, while a single writer thread stores the previous chunk in
+// list order. The result is the same as when converting one image at a time.
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
@@ -52,10 +60,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 
 #include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/convert_writer.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
@@ -70,7 +80,7 @@ DEFINE_bool(gray, false,
 DEFINE_bool(shuffle, false,
     "Randomly shuffle the order of images and their labels");
 DEFINE_string(backend, "lmdb",
-        "The backend {lmdb, leveldb} for storing the result");
+        "The backend {lmdb, leveldb, packed} for storing the result");
 DEFINE_int32(resize_width, 0, "Width images are resized to");
 DEFINE_int32(resize_height, 0, "Height images are resized to");
 DEFINE_bool(check_size, false,
@@ -79,6 +89,11 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_int32(threads, 0,
+    "Number of threads reading images, 0 for the OpenMP default");
+
+// Images read per chunk, and stored per DB transaction.
+const int kChunkSize = 1000;
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -131,64 +146,75 @@ int main(int argc, char** argv) {
   int resize_height = std::max<int>(0, FLAGS_resize_height);
   int resize_width = std::max<int>(0, FLAGS_resize_width);
 
+  if (FLAGS_backend == "packed" && !encoded &&
+      (resize_height == 0 || resize_width == 0)) {
+    LOG(INFO) << "Images are not resized, the packed DB will only be "
+              << "fixed-stride if they all have the same size.";
+  }
+
   // Create new DB
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[3], db::NEW);
-  scoped_ptr<db::Transaction> txn(db->NewTransaction());
 
   // Storing to db
   std::string root_folder(argv[1]);
-  Datum datum;
-  int count = 0;
-  int data_size = 0;
-  bool data_size_initialized = false;
-
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
-    }
-    status = ReadImageToDatum(root_folder + lines[line_id].first,
-        lines[line_id].second, resize_height, resize_width, is_color,
-        enc, &datum);
-    if (status == false) continue;
-    if (check_size) {
-      if (!data_size_initialized) {
-        data_size = datum.channels() * datum.height() * datum.width();
-        data_size_initialized = true;
-      } else {
-        const std::string& data = datum.data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-            << data.size();
+#ifdef _OPENMP
+  if (FLAGS_threads > 0) {
+    omp_set_num_threads(FLAGS_threads);
+  }
+#endif
+  ConvertWriter writer(db.get(), false, check_size, kChunkSize);
+  // Chunks are read into one buffer while the other one is written.
+  vector<ConvertEntry> chunks[2];
+  boost::thread writer_thread;
+
+  for (int chunk_begin = 0; chunk_begin < lines.size();
+       chunk_begin += kChunkSize) {
+    const int chunk_end = std::min<int>(chunk_begin + kChunkSize, lines.size());
+    vector<ConvertEntry>& chunk = chunks[(chunk_begin / kChunkSize) % 2];
+    chunk.resize(chunk_end - chunk_begin);
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (int line_id = chunk_begin; line_id < chunk_end; ++line_id) {
+      ConvertEntry& entry = chunk[line_id - chunk_begin];
+      Datum datum;
+      std::string enc = encode_type;
+      if (encoded && !enc.size()) {
+        // Guess the encoding type from the file name
+        string fn = lines[line_id].first;
+        size_t p = fn.rfind('.');
+        if ( p == fn.npos )
+          LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+        enc = fn.substr(p);
+        std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+      }
+      entry.status = ReadImageToDatum(root_folder + lines[line_id].first,
+          lines[line_id].second, resize_height, resize_width, is_color,
+          enc, &datum);
+      entry.has_shape = datum.has_channels();
+      entry.channels = datum.channels();
+      entry.height = datum.height();
+      entry.width = datum.width();
+      if (entry.status == false) {
+        // Reported by the writer, in list order.
+        entry.key = lines[line_id].first;
+        continue;
       }
+      entry.data_size = datum.data().size();
+      // sequential
+      entry.key = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
+      CHECK(datum.SerializeToString(&entry.value));
     }
-    // sequential
-    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
-
-    // Put in db
-    string out;
-    CHECK(datum.SerializeToString(&out));
-    txn->Put(key_str, out);
-
-    if (++count % 1000 == 0) {
-      // Commit db
-      txn->Commit();
-      txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
+    if (writer_thread.joinable()) {
+      writer_thread.join();
     }
+    writer_thread = boost::thread(&ConvertWriter::Write, &writer, &chunk);
   }
-  // write the last batch
-  if (count % 1000 != 0) {
-    txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
+  if (writer_thread.joinable()) {
+    writer_thread.join();
   }
+  writer.Finish();
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV